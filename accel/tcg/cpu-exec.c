@@ -34,6 +34,7 @@
 #include "tcg/tcg.h"
 #include "qemu/atomic.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "exec/log.h"
 #include "qemu/main-loop.h"
 #include "exec/icount.h"
@@ -210,6 +211,33 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, TCGTBCPUState s)
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+static inline TranslationBlock *tb_jmp_l2_lookup(CPUJumpCache *jc,
+                                                 TCGTBCPUState s)
+{
+    uint32_t h = tb_jmp_l2_hash_func(s.pc, s.flags, s.cflags);
+    TranslationBlock *tb = qatomic_read(&jc->l2[h].tb);
+
+    if (tb &&
+        jc->l2[h].gen == qatomic_read(&jc->l2_gen) &&
+        jc->l2[h].pc == s.pc &&
+        tb->cs_base == s.cs_base &&
+        tb->flags == s.flags &&
+        tb_cflags(tb) == s.cflags) {
+        return tb;
+    }
+    return NULL;
+}
+
+static inline void tb_jmp_l2_insert(CPUJumpCache *jc, TCGTBCPUState s,
+                                    TranslationBlock *tb)
+{
+    uint32_t h = tb_jmp_l2_hash_func(s.pc, s.flags, s.cflags);
+
+    jc->l2[h].pc = s.pc;
+    jc->l2[h].gen = qatomic_read(&jc->l2_gen);
+    qatomic_set(&jc->l2[h].tb, tb);
+}
+
 /**
  * tb_lookup:
  * @cpu: CPU that will execute the returned translation block
@@ -219,7 +247,8 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, TCGTBCPUState s)
  * @cflags: CF_* flags
  *
  * Look up a translation block inside the QHT using @pc, @cs_base, @flags and
- * @cflags. Uses @cpu's tb_jmp_cache. Might cause an exception, so have a
+ * @cflags. Uses @cpu's tb_jmp_cache, and its second level on a miss,
+ * before falling back to the QHT. Might cause an exception, so have a
  * longjmp destination ready.
  *
  * Returns: an existing translation block or NULL.
@@ -245,9 +274,16 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, TCGTBCPUState s)
         goto hit;
     }
 
-    tb = tb_htable_lookup(cpu, s);
-    if (tb == NULL) {
-        return NULL;
+    tb = tb_jmp_l2_lookup(jc, s);
+    if (tb) {
+        qatomic_set(&jc->l2_hits, jc->l2_hits + 1);
+    } else {
+        qatomic_set(&jc->l2_misses, jc->l2_misses + 1);
+        tb = tb_htable_lookup(cpu, s);
+        if (tb == NULL) {
+            return NULL;
+        }
+        tb_jmp_l2_insert(jc, s, tb);
     }
 
     jc->array[hash].pc = s.pc;
@@ -363,15 +399,7 @@ static inline bool check_for_breakpoints(CPUState *cpu, vaddr pc,
         check_for_breakpoints_slow(cpu, pc, cflags);
 }
 
-/**
- * helper_lookup_tb_ptr: quick check for next tb
- * @env: current cpu state
- *
- * Look for an existing TB matching the current cpu state.
- * If found, return the code pointer.  If not found, return
- * the tcg epilogue so that we return into cpu_tb_exec.
- */
-const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+static TranslationBlock *lookup_tb_for_goto_ptr(CPUArchState *env)
 {
     CPUState *cpu = env_cpu(env);
     TranslationBlock *tb;
@@ -394,13 +422,83 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
 
     tb = tb_lookup(cpu, s);
     if (tb == NULL) {
-        return tcg_code_gen_epilogue;
+        return NULL;
     }
 
     if (qemu_loglevel_mask(CPU_LOG_TB_CPU | CPU_LOG_EXEC)) {
         log_cpu_exec(s.pc, cpu, tb);
     }
 
+    return tb;
+}
+
+/**
+ * helper_lookup_tb_ptr: quick check for next tb
+ * @env: current cpu state
+ *
+ * Look for an existing TB matching the current cpu state.
+ * If found, return the code pointer.  If not found, return
+ * the tcg epilogue so that we return into cpu_tb_exec.
+ */
+const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+{
+    TranslationBlock *tb = lookup_tb_for_goto_ptr(env);
+
+    return tb ? tb->tc.ptr : tcg_code_gen_epilogue;
+}
+
+/* May @tb be recorded as a predicted successor of @owner? */
+static bool tb_ic_allowed(const TranslationBlock *owner,
+                          const TranslationBlock *tb)
+{
+    /* The predicted path neither logs nor checks for breakpoints. */
+    if ((tb_cflags(tb) & (CF_PCREL | CF_BP_PAGE)) ||
+        qemu_loglevel_mask(CPU_LOG_TB_CPU | CPU_LOG_EXEC)) {
+        return false;
+    }
+    /*
+     * As for direct jumps, only predict targets on the page of the
+     * owner TB.  In system mode, its mapping is known to be current
+     * whenever the slot is used, which is not true of any other page.
+     * In both modes, execution then only enters a page through
+     * lookup_tb_for_goto_ptr() or cpu_exec(), whose check_for_breakpoints()
+     * switches to CF_BP_PAGE TBs, which do not predict, as soon as a
+     * breakpoint is set on the page.  Predicted returns may come from
+     * another page, but the return address stack is cleared when a
+     * breakpoint is inserted.
+     */
+    return tb_page_addr1(tb) == -1 &&
+           ((tb->pc ^ owner->pc) & TARGET_PAGE_MASK) == 0;
+}
+
+/**
+ * helper_lookup_tb_ptr_ic: lookup_tb_ptr, filling a prediction slot
+ * @env: current cpu state
+ * @owner: TB holding the slot, or NULL
+ * @idx: TB_IC_* index of the slot
+ *
+ * As helper_lookup_tb_ptr, but also record the TB found in
+ * @owner->ic_dest[@idx], for the inline check emitted by
+ * tcg_gen_lookup_and_goto_ptr_cached and tcg_gen_lookup_and_goto_ptr_ret.
+ */
+const void *HELPER(lookup_tb_ptr_ic)(CPUArchState *env, void *owner,
+                                     uint32_t idx)
+{
+    TranslationBlock *tb = lookup_tb_for_goto_ptr(env);
+    TranslationBlock *otb = owner;
+
+    if (tb == NULL) {
+        return tcg_code_gen_epilogue;
+    }
+    if (otb && tb_ic_allowed(otb, tb)) {
+        /*
+         * The slot is in the code_gen buffer, and we were called from
+         * the generated code, so it is not writable on MAP_JIT hosts.
+         */
+        qemu_thread_jit_write();
+        qatomic_set(&otb->ic_dest[idx], tb);
+        qemu_thread_jit_execute();
+    }
     return tb->tc.ptr;
 }
 
@@ -436,7 +534,15 @@ cpu_tb_exec(CPUState *cpu, TranslationBlock *itb, int *tb_exit)
     }
 
     qemu_thread_jit_execute();
-    ret = tcg_qemu_tb_exec(cpu_env(cpu), tb_ptr);
+    if (unlikely(itb->profile)) {
+        int64_t ticks = cpu_get_host_ticks();
+
+        ret = tcg_qemu_tb_exec(cpu_env(cpu), tb_ptr);
+        /* Charge the whole chain to the block we entered it through. */
+        qatomic_add(&itb->profile->ticks, cpu_get_host_ticks() - ticks);
+    } else {
+        ret = tcg_qemu_tb_exec(cpu_env(cpu), tb_ptr);
+    }
     cpu->neg.can_do_io = true;
     qemu_plugin_disable_mem_helpers(cpu);
     /*
@@ -978,6 +1084,7 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                 jc = cpu->tb_jmp_cache;
                 jc->array[h].pc = s.pc;
                 qatomic_set(&jc->array[h].tb, tb);
+                tb_jmp_l2_insert(jc, s, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
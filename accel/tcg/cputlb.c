@@ -159,6 +159,13 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
         qatomic_set(&jc->array[i0 + i].tb, NULL);
     }
+
+    i0 = tb_jmp_l2_hash_page(page_addr);
+    for (i = 0; i < TB_JMP_L2_PAGE_SIZE; i++) {
+        qatomic_set(&jc->l2[i0 + i].tb, NULL);
+    }
+
+    tcg_flush_ras(cpu);
 }
 
 /**
@@ -327,6 +334,9 @@ void tlb_init(CPUState *cpu)
 
     /* All tlbs are initialized flushed. */
     cpu->neg.tlb.c.dirty = 0;
+    cpu->neg.tlb.c.n_pending = 0;
+    cpu->neg.tlb.c.pending_full = 0;
+    cpu->neg.tlb.c.pending_queued = false;
 
     for (i = 0; i < NB_MMU_MODES; i++) {
         tlb_mmu_init(&cpu->neg.tlb.d[i], cpu_tlb_fast(cpu, i), now);
@@ -347,25 +357,6 @@ void tlb_destroy(CPUState *cpu)
     }
 }
 
-/* flush_all_helper: run fn across all cpus
- *
- * If the wait flag is set then the src cpu's helper will be queued as
- * "safe" work and the loop exited creating a synchronisation point
- * where all queued work will be finished before execution starts
- * again.
- */
-static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
-                             run_on_cpu_data d)
-{
-    CPUState *cpu;
-
-    CPU_FOREACH(cpu) {
-        if (cpu != src) {
-            async_run_on_cpu(cpu, fn, d);
-        }
-    }
-}
-
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     MMUIdxMap asked = data.host_int;
@@ -420,14 +411,17 @@ void tlb_flush(CPUState *cpu)
     tlb_flush_by_mmuidx(cpu, ALL_MMUIDX_BITS);
 }
 
+typedef CPUTLBPendingFlush TLBFlushRangeData;
+
+static void tlb_flush_pending_all_cpus_synced(CPUState *src_cpu,
+                                              const TLBFlushRangeData *d,
+                                              MMUIdxMap full);
+
 void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu, MMUIdxMap idxmap)
 {
-    const run_on_cpu_func fn = tlb_flush_by_mmuidx_async_work;
-
     tlb_debug("mmu_idx: 0x%"PRIx16"\n", idxmap);
 
-    flush_all_helper(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
-    async_safe_run_on_cpu(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
+    tlb_flush_pending_all_cpus_synced(src_cpu, NULL, idxmap);
 }
 
 void tlb_flush_all_cpus_synced(CPUState *src_cpu)
@@ -553,50 +547,6 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
     tb_jmp_cache_clear_page(cpu, addr);
 }
 
-/**
- * tlb_flush_page_by_mmuidx_async_1:
- * @cpu: cpu on which to flush
- * @data: encoded addr + idxmap
- *
- * Helper for tlb_flush_page_by_mmuidx and friends, called through
- * async_run_on_cpu.  The idxmap parameter is encoded in the page
- * offset of the target_ptr field.  This limits the set of mmu_idx
- * that can be passed via this method.
- */
-static void tlb_flush_page_by_mmuidx_async_1(CPUState *cpu,
-                                             run_on_cpu_data data)
-{
-    vaddr addr_and_idxmap = data.target_ptr;
-    vaddr addr = addr_and_idxmap & TARGET_PAGE_MASK;
-    MMUIdxMap idxmap = addr_and_idxmap & ~TARGET_PAGE_MASK;
-
-    tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-}
-
-typedef struct {
-    vaddr addr;
-    MMUIdxMap idxmap;
-} TLBFlushPageByMMUIdxData;
-
-/**
- * tlb_flush_page_by_mmuidx_async_2:
- * @cpu: cpu on which to flush
- * @data: allocated addr + idxmap
- *
- * Helper for tlb_flush_page_by_mmuidx and friends, called through
- * async_run_on_cpu.  The addr+idxmap parameters are stored in a
- * TLBFlushPageByMMUIdxData structure that has been allocated
- * specifically for this helper.  Free the structure when done.
- */
-static void tlb_flush_page_by_mmuidx_async_2(CPUState *cpu,
-                                             run_on_cpu_data data)
-{
-    TLBFlushPageByMMUIdxData *d = data.host_ptr;
-
-    tlb_flush_page_by_mmuidx_async_0(cpu, d->addr, d->idxmap);
-    g_free(d);
-}
-
 void tlb_flush_page_by_mmuidx(CPUState *cpu, vaddr addr, MMUIdxMap idxmap)
 {
     tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%" PRIx16 "\n", addr, idxmap);
@@ -618,41 +568,21 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                               vaddr addr,
                                               MMUIdxMap idxmap)
 {
-    tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%"PRIx16"\n", addr, idxmap);
+    TLBFlushRangeData d;
 
-    /* This should already be page aligned */
-    addr &= TARGET_PAGE_MASK;
+    tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
+     * A single page with all address bits significant is the same as
+     * tlb_flush_page_by_mmuidx.  Queue it as a range so that it can be
+     * coalesced with its neighbours.
      */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                              RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
+    d.addr = addr & TARGET_PAGE_MASK;
+    d.len = TARGET_PAGE_SIZE;
+    d.idxmap = idxmap;
+    d.bits = target_long_bits();
 
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
-                              RUN_ON_CPU_HOST_PTR(d));
-    }
+    tlb_flush_pending_all_cpus_synced(src_cpu, &d, 0);
 }
 
 void tlb_flush_page_all_cpus_synced(CPUState *src, vaddr addr)
@@ -688,10 +618,12 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
 
     /*
      * Check if we need to flush due to large pages.
-     * Because large_page_mask contains all 1's from the msb,
-     * we only need to test the end of the range.
+     * The range may have been merged from several flushes, so it can
+     * begin inside the large page and end beyond it, or the other way
+     * round: test for any overlap, not just one end of the range.
      */
-    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
+    if (addr <= (d->large_page_addr | ~d->large_page_mask) &&
+        addr + len - 1 >= d->large_page_addr) {
         tlb_debug("forcing full flush midx %d ("
                   "%016" VADDR_PRIx "/%016" VADDR_PRIx ")\n",
                   midx, d->large_page_addr, d->large_page_mask);
@@ -710,13 +642,6 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
     }
 }
 
-typedef struct {
-    vaddr addr;
-    vaddr len;
-    MMUIdxMap idxmap;
-    unsigned bits;
-} TLBFlushRangeData;
-
 static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
                                               TLBFlushRangeData d)
 {
@@ -755,12 +680,142 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
     }
 }
 
-static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
-                                              run_on_cpu_data data)
+/* Return true if @a and @b overlap or abut, so may be flushed as one. */
+static bool tlb_flush_range_mergeable(const TLBFlushRangeData *a,
+                                      const TLBFlushRangeData *b)
+{
+    vaddr a_last = a->addr + a->len - 1;
+    vaddr b_last = b->addr + b->len - 1;
+
+    if (a->idxmap != b->idxmap || a->bits != b->bits) {
+        return false;
+    }
+    if (a->addr <= b_last && b->addr <= a_last) {
+        return true;
+    }
+    /* Do not merge across the top of the address space. */
+    return (a_last + 1 == b->addr && b->addr != 0) ||
+           (b_last + 1 == a->addr && a->addr != 0);
+}
+
+/*
+ * tlb_flush_pending_push:
+ * @cpu: cpu whose pending buffer receives the flush
+ * @d: range to flush, or NULL
+ * @full: if @d is NULL, set of mmu_idx to flush entirely
+ *
+ * Record a flush for @cpu to apply the next time it drains its pending
+ * buffer, merging it into an already queued range where possible.
+ * Returns true if the caller must queue tlb_flush_pending_async_work;
+ * false if a queued work item has yet to drain the buffer.
+ */
+static bool tlb_flush_pending_push(CPUState *cpu, const TLBFlushRangeData *d,
+                                   MMUIdxMap full)
 {
-    TLBFlushRangeData *d = data.host_ptr;
-    tlb_flush_range_by_mmuidx_async_0(cpu, *d);
-    g_free(d);
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    bool need_queue;
+    unsigned i;
+
+    qemu_spin_lock(&c->lock);
+
+    if (d) {
+        for (i = 0; i < c->n_pending; i++) {
+            TLBFlushRangeData *p = &c->pending[i];
+
+            if (tlb_flush_range_mergeable(p, d)) {
+                vaddr last = MAX(p->addr + p->len - 1, d->addr + d->len - 1);
+
+                p->addr = MIN(p->addr, d->addr);
+                p->len = last - p->addr + 1;
+                qatomic_set(&c->coalesce_flush_count,
+                            c->coalesce_flush_count + 1);
+                break;
+            }
+        }
+        if (i == c->n_pending) {
+            if (c->n_pending < CPU_TLB_PENDING_SIZE) {
+                c->pending[c->n_pending++] = *d;
+            } else {
+                c->pending_full |= d->idxmap;
+            }
+        }
+    } else {
+        c->pending_full |= full;
+    }
+
+    need_queue = !c->pending_queued;
+    c->pending_queued = true;
+    if (!need_queue) {
+        qatomic_set(&c->batch_flush_count, c->batch_flush_count + 1);
+    }
+
+    qemu_spin_unlock(&c->lock);
+    return need_queue;
+}
+
+/*
+ * tlb_flush_pending_async_work:
+ * Apply every flush recorded by tlb_flush_pending_push for @cpu.
+ * Anything pushed after the buffer is emptied here queues a new
+ * work item, so nothing is lost if we race with another cpu.
+ */
+static void tlb_flush_pending_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    TLBFlushRangeData pending[CPU_TLB_PENDING_SIZE];
+    MMUIdxMap full;
+    unsigned i, n;
+
+    assert_cpu_is_self(cpu);
+
+    qemu_spin_lock(&c->lock);
+    n = c->n_pending;
+    memcpy(pending, c->pending, n * sizeof(pending[0]));
+    full = c->pending_full;
+    c->n_pending = 0;
+    c->pending_full = 0;
+    c->pending_queued = false;
+    qemu_spin_unlock(&c->lock);
+
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+    for (i = 0; i < n; i++) {
+        pending[i].idxmap &= ~full;
+        if (pending[i].idxmap) {
+            tlb_flush_range_by_mmuidx_async_0(cpu, pending[i]);
+        }
+    }
+}
+
+/*
+ * tlb_flush_pending_all_cpus_synced:
+ * Queue a flush of @d (or of @full if @d is NULL) on every cpu.
+ * As before, the source cpu drains its buffer as "safe" work, which
+ * exits the cpu loop and creates a synchronisation point where all
+ * queued work is finished before execution starts again.  However,
+ * a burst of requests only queues one work item per destination cpu.
+ *
+ * The safe work item is queued on the source cpu even if its buffer
+ * already has a work item pending: that one may be a plain item queued
+ * by another cpu, which would not provide the synchronisation point.
+ */
+static void tlb_flush_pending_all_cpus_synced(CPUState *src_cpu,
+                                              const TLBFlushRangeData *d,
+                                              MMUIdxMap full)
+{
+    CPUState *dst_cpu;
+
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu && tlb_flush_pending_push(dst_cpu, d, full)) {
+            async_run_on_cpu(dst_cpu, tlb_flush_pending_async_work,
+                             RUN_ON_CPU_NULL);
+        }
+    }
+
+    tlb_flush_pending_push(src_cpu, d, full);
+    async_safe_run_on_cpu(src_cpu, tlb_flush_pending_async_work,
+                          RUN_ON_CPU_NULL);
 }
 
 void tlb_flush_range_by_mmuidx(CPUState *cpu, vaddr addr,
@@ -806,8 +861,7 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                                MMUIdxMap idxmap,
                                                unsigned bits)
 {
-    TLBFlushRangeData d, *p;
-    CPUState *dst_cpu;
+    TLBFlushRangeData d;
 
     /* If no page bits are significant, this devolves to tlb_flush. */
     if (bits < TARGET_PAGE_BITS) {
@@ -829,18 +883,7 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
     d.idxmap = idxmap;
     d.bits = bits;
 
-    /* Allocate a separate data block for each destination cpu.  */
-    CPU_FOREACH(dst_cpu) {
-        if (dst_cpu != src_cpu) {
-            p = g_memdup(&d, sizeof(d));
-            async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
-                             RUN_ON_CPU_HOST_PTR(p));
-        }
-    }
-
-    p = g_memdup(&d, sizeof(d));
-    async_safe_run_on_cpu(src_cpu, tlb_flush_range_by_mmuidx_async_1,
-                          RUN_ON_CPU_HOST_PTR(p));
+    tlb_flush_pending_all_cpus_synced(src_cpu, &d, 0);
 }
 
 void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
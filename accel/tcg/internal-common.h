@@ -18,6 +18,22 @@ extern int64_t max_delay;
 extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
+extern bool tb_exec_profile;
+
+/*
+ * Execution profile of a TB.  @count is incremented on every entry to
+ * the block, including entries via chained jumps; @ticks accumulates
+ * the host cycles spent in cpu_tb_exec for chains entered at this
+ * block.  Both are updated atomically.  The profiles are freed by
+ * tb_flush, together with the TBs that point to them.
+ */
+typedef struct TBProfile {
+    uint64_t count;
+    uint64_t ticks;
+} TBProfile;
+
+TBProfile *tb_profile_new(void);
+void tb_profile_reset(void);
 
 extern bool icount_align_option;
 
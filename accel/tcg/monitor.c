@@ -29,9 +29,38 @@ HumanReadableText *qmp_x_query_jit(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+HumanReadableText *qmp_x_query_tcg_profile(bool has_max, uint32_t max,
+                                           const char *pprof, Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TB profile is only available with accel=tcg");
+        return NULL;
+    }
+    if (!qatomic_read(&tb_exec_profile)) {
+        error_setg(errp, "TB profiling is not enabled");
+        error_append_hint(errp, "Use -accel tcg,profile=on\n");
+        return NULL;
+    }
+
+    if (pprof && !tcg_write_profile_pprof(pprof, errp)) {
+        return NULL;
+    }
+    tcg_dump_profile(buf, has_max ? max : 50);
+
+    return human_readable_text_from_str(buf);
+}
+
+static HumanReadableText *hmp_tcg_profile(Error **errp)
+{
+    return qmp_x_query_tcg_profile(false, 0, NULL, errp);
+}
+
 static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
+    monitor_register_hmp_info_hrt("tcg-profile", hmp_tcg_profile);
 }
 
 type_init(hmp_tcg_register);
@@ -51,6 +51,29 @@ static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
            | (tmp & TB_JMP_ADDR_MASK));
 }
 
+/*
+ * The second-level cache uses the same scheme: the top bits depend only
+ * on the page, so that a page flush need only clear one set.
+ */
+#define TB_JMP_L2_PAGE_BITS (TB_JMP_L2_BITS - TB_JMP_PAGE_BITS)
+#define TB_JMP_L2_PAGE_SIZE (1 << TB_JMP_L2_PAGE_BITS)
+#define TB_JMP_L2_ADDR_MASK (TB_JMP_L2_PAGE_SIZE - 1)
+#define TB_JMP_L2_PAGE_MASK (TB_JMP_L2_SIZE - TB_JMP_L2_PAGE_SIZE)
+
+static inline unsigned int tb_jmp_l2_hash_page(vaddr pc)
+{
+    vaddr tmp = pc >> TARGET_PAGE_BITS;
+    tmp ^= tmp >> TB_JMP_PAGE_BITS;
+    return (tmp << TB_JMP_L2_PAGE_BITS) & TB_JMP_L2_PAGE_MASK;
+}
+
+static inline unsigned int tb_jmp_l2_hash_func(vaddr pc, uint32_t flags,
+                                               uint32_t cflags)
+{
+    return tb_jmp_l2_hash_page(pc)
+           | (qemu_xxhash5(pc, cflags, flags) & TB_JMP_L2_ADDR_MASK);
+}
+
 #else
 
 /* In user-mode we can get better hashing because we do not have a TLB */
@@ -59,6 +82,12 @@ static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
     return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
 }
 
+static inline unsigned int tb_jmp_l2_hash_func(vaddr pc, uint32_t flags,
+                                               uint32_t cflags)
+{
+    return qemu_xxhash5(pc, cflags, flags) & (TB_JMP_L2_SIZE - 1);
+}
+
 #endif /* CONFIG_SOFTMMU */
 
 static inline
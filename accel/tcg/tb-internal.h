@@ -10,6 +10,7 @@
 #define ACCEL_TCG_TB_INTERNAL_TARGET_H
 
 #include "exec/translation-block.h"
+#include "hw/core/cpu.h"
 
 /*
  * The true return address will often point to a host insn that is part of
@@ -24,6 +25,18 @@
 
 void tb_lock_page0(tb_page_addr_t);
 
+/*
+ * Forget the return address stack.  The TBs referenced by it may be
+ * about to be freed, or (for system mode) their virtual addresses may
+ * no longer map to the same code.
+ */
+static inline void tcg_flush_ras(CPUState *cpu)
+{
+    for (int i = 0; i < CPU_RAS_SIZE; i++) {
+        qatomic_set(&cpu->neg.ras.tb[i], NULL);
+    }
+}
+
 #ifdef CONFIG_USER_ONLY
 /*
  * For user-only, page_protect sets the page read-only.
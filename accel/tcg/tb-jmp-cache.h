@@ -15,6 +15,9 @@
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
+#define TB_JMP_L2_BITS 13
+#define TB_JMP_L2_SIZE (1 << TB_JMP_L2_BITS)
+
 /*
  * Invalidated in parallel; all accesses to 'tb' must be atomic.
  * A valid entry is read/written by a single CPU, therefore there is
@@ -28,6 +31,25 @@ typedef struct CPUJumpCache {
         TranslationBlock *tb;
         vaddr pc;
     } array[TB_JMP_CACHE_SIZE];
+
+    /*
+     * Second-level cache, consulted on a miss in 'array' before falling
+     * back to the global qht.  It is hashed by (pc, flags, cflags), so
+     * that the many targets of one indirect branch do not all compete
+     * for a single slot.  The same rules as for 'array' apply, and in
+     * addition an entry is only valid if its 'gen' matches 'l2_gen':
+     * incrementing 'l2_gen' flushes the whole level at once.
+     */
+    uint64_t l2_gen;
+    struct {
+        TranslationBlock *tb;
+        vaddr pc;
+        uint64_t gen;
+    } l2[TB_JMP_L2_SIZE];
+
+    /* Statistics; written only by the owning CPU. */
+    uint64_t l2_hits;
+    uint64_t l2_misses;
 } CPUJumpCache;
 
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
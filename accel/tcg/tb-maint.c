@@ -785,6 +785,7 @@ void tb_flush__exclusive_or_serial(void)
     tb_remove_all();
 
     tcg_region_reset_all();
+    tb_profile_reset();
     /* XXX: flush processor icache at this point if cache flush is expensive */
     qatomic_inc(&tb_ctx.tb_flush_count);
     qemu_plugin_flush_cb();
@@ -902,6 +903,9 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
         }
     } else {
         uint32_t h = tb_jmp_cache_hash_func(tb->pc);
+        /* The lookup key never includes CF_INVALID. */
+        uint32_t h2 = tb_jmp_l2_hash_func(tb->pc, tb->flags,
+                                          tb_cflags(tb) & ~CF_INVALID);
 
         CPU_FOREACH(cpu) {
             CPUJumpCache *jc = cpu->tb_jmp_cache;
@@ -909,6 +913,9 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
             if (qatomic_read(&jc->array[h].tb) == tb) {
                 qatomic_set(&jc->array[h].tb, NULL);
             }
+            if (qatomic_read(&jc->l2[h2].tb) == tb) {
+                qatomic_set(&jc->l2[h2].tb, NULL);
+            }
         }
     }
 }
@@ -16,6 +16,7 @@
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 #include <math.h>
 
 static void dump_drift_info(GString *buf)
@@ -132,34 +133,61 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                             size_t *pbatch, size_t *pcoalesce)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
+    size_t full = 0, part = 0, elide = 0, batch = 0, coalesce = 0;
 
     CPU_FOREACH(cpu) {
         full += qatomic_read(&cpu->neg.tlb.c.full_flush_count);
         part += qatomic_read(&cpu->neg.tlb.c.part_flush_count);
         elide += qatomic_read(&cpu->neg.tlb.c.elide_flush_count);
+        batch += qatomic_read(&cpu->neg.tlb.c.batch_flush_count);
+        coalesce += qatomic_read(&cpu->neg.tlb.c.coalesce_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *pbatch = batch;
+    *pcoalesce = coalesce;
+}
+
+static void tcg_dump_jmp_cache_info(GString *buf)
+{
+    CPUState *cpu;
+    uint64_t hits = 0, misses = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+        if (jc) {
+            hits += qatomic_read(&jc->l2_hits);
+            misses += qatomic_read(&jc->l2_misses);
+        }
+    }
+    g_string_append_printf(buf, "TB L2 cache hits    %" PRIu64 " (%0.1f%%)\n",
+                           hits, hits + misses ?
+                           (double)hits * 100 / (hits + misses) : 0);
+    g_string_append_printf(buf, "TB qht lookups      %" PRIu64 "\n", misses);
 }
 
 static void tcg_dump_flush_info(GString *buf)
 {
-    size_t flush_full, flush_part, flush_elide;
+    size_t flush_full, flush_part, flush_elide, flush_batch, flush_coalesce;
 
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
 
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide,
+                     &flush_batch, &flush_coalesce);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    g_string_append_printf(buf, "TLB batched flushes %zu\n", flush_batch);
+    g_string_append_printf(buf, "TLB merged flushes  %zu\n", flush_coalesce);
 }
 
 static void dump_exec_info(GString *buf)
@@ -203,6 +231,7 @@ static void dump_exec_info(GString *buf)
     qht_statistics_destroy(&hst);
 
     g_string_append_printf(buf, "\nStatistics:\n");
+    tcg_dump_jmp_cache_info(buf);
     tcg_dump_flush_info(buf);
 }
 
@@ -217,3 +246,188 @@ void tcg_dump_stats(GString *buf)
 {
     tcg_get_stats(current_accel(), buf);
 }
+
+/*
+ * Every TBProfile handed out since the last tb_flush.  TBs are only
+ * freed all at once, by tb_flush, so the profiles follow them then.
+ */
+static QemuSpin tb_profiles_lock;
+static GPtrArray *tb_profiles;
+
+TBProfile *tb_profile_new(void)
+{
+    TBProfile *prof = g_new0(TBProfile, 1);
+
+    qemu_spin_lock(&tb_profiles_lock);
+    if (!tb_profiles) {
+        tb_profiles = g_ptr_array_new_with_free_func(g_free);
+    }
+    g_ptr_array_add(tb_profiles, prof);
+    qemu_spin_unlock(&tb_profiles_lock);
+    return prof;
+}
+
+/*
+ * Called from tb_flush, after tcg_region_reset_all: no TB refers to
+ * the profiles any more, and tcg_tb_foreach cannot find the old TBs.
+ */
+void tb_profile_reset(void)
+{
+    g_autoptr(GPtrArray) old = NULL;
+
+    qemu_spin_lock(&tb_profiles_lock);
+    old = tb_profiles;
+    tb_profiles = NULL;
+    qemu_spin_unlock(&tb_profiles_lock);
+}
+
+/*
+ * Block profile.  The TranslationBlocks may be freed by a tb_flush as
+ * soon as tcg_tb_foreach returns, so take a snapshot of everything we
+ * want to report while walking the tree.
+ */
+typedef struct TBProfileEntry {
+    vaddr pc;           /* guest pc, or physical address if @pcrel */
+    bool pcrel;
+    uint16_t size;
+    uint16_t icount;
+    uint64_t count;
+    uint64_t ticks;
+} TBProfileEntry;
+
+struct tb_profile {
+    GArray *entries;
+    uint64_t total_count;
+    uint64_t total_ticks;
+};
+
+static gboolean tb_profile_iter(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    struct tb_profile *prof = data;
+    bool pcrel = tb_cflags(tb) & CF_PCREL;
+    TBProfileEntry e = {
+        /* With CF_PCREL only the physical address of the block is known. */
+        .pc = pcrel ? tb_page_addr0(tb) : tb->pc,
+        .pcrel = pcrel,
+        .size = tb->size,
+        .icount = tb->icount,
+    };
+
+    if (!tb->profile) {
+        return false;
+    }
+    e.count = qatomic_read(&tb->profile->count);
+    e.ticks = qatomic_read(&tb->profile->ticks);
+    if (e.count) {
+        g_array_append_val(prof->entries, e);
+        prof->total_count += e.count;
+        prof->total_ticks += e.ticks;
+    }
+    return false;
+}
+
+static gint tb_profile_cmp(gconstpointer ap, gconstpointer bp)
+{
+    const TBProfileEntry *a = ap;
+    const TBProfileEntry *b = bp;
+
+    /* Descending by execution count, then by host ticks */
+    if (a->count != b->count) {
+        return a->count < b->count ? 1 : -1;
+    }
+    if (a->ticks != b->ticks) {
+        return a->ticks < b->ticks ? 1 : -1;
+    }
+    return 0;
+}
+
+static void tb_profile_collect(struct tb_profile *prof)
+{
+    prof->entries = g_array_new(false, false, sizeof(TBProfileEntry));
+    prof->total_count = 0;
+    prof->total_ticks = 0;
+    tcg_tb_foreach(tb_profile_iter, prof);
+    g_array_sort(prof->entries, tb_profile_cmp);
+}
+
+void tcg_dump_profile(GString *buf, size_t max)
+{
+    struct tb_profile prof;
+    size_t i, n;
+
+    tb_profile_collect(&prof);
+    n = MIN(max, prof.entries->len);
+
+    g_string_append_printf(buf, "TB profile: %u blocks executed, "
+                           "%"PRIu64" executions, %"PRIu64" host ticks\n",
+                           prof.entries->len, prof.total_count,
+                           prof.total_ticks);
+    g_string_append_printf(buf, "%-19s %5s %5s %20s %6s %20s %6s\n",
+                           "pc", "size", "insns", "count", "%",
+                           "ticks", "%");
+    for (i = 0; i < n; i++) {
+        const TBProfileEntry *e = &g_array_index(prof.entries,
+                                                 TBProfileEntry, i);
+
+        g_string_append_printf(buf, "%s0x%016" VADDR_PRIx " %5u %5u "
+                               "%20" PRIu64 " %5.1f%% %20" PRIu64 " %5.1f%%\n",
+                               e->pcrel ? "P" : " ", e->pc,
+                               e->size, e->icount,
+                               e->count, 100.0 * e->count / prof.total_count,
+                               e->ticks, prof.total_ticks ?
+                               100.0 * e->ticks / prof.total_ticks : 0);
+    }
+    if (n < prof.entries->len) {
+        g_string_append_printf(buf, "(%u more blocks not shown)\n",
+                               prof.entries->len - (unsigned)n);
+    }
+    g_array_free(prof.entries, true);
+}
+
+/*
+ * Write the block profile in the legacy gperftools CPU profile format,
+ * which pprof understands: a header of five words (0, 3, 0, period, 0),
+ * then one record per sample site (count, depth, pc...), then a trailer
+ * of (0, 1, 0).  All words are host uintptr_t in host byte order.
+ * Each block becomes a single-frame sample weighted by its execution
+ * count, with a nominal 1us period.
+ */
+bool tcg_write_profile_pprof(const char *filename, Error **errp)
+{
+    struct tb_profile prof;
+    g_autoptr(GArray) words = g_array_new(false, false, sizeof(uintptr_t));
+    g_autoptr(GError) gerr = NULL;
+    uintptr_t w;
+    size_t i;
+
+#define PUSH(X)  (w = (X), g_array_append_val(words, w))
+    PUSH(0);
+    PUSH(3);
+    PUSH(0);
+    PUSH(1);
+    PUSH(0);
+
+    tb_profile_collect(&prof);
+    for (i = 0; i < prof.entries->len; i++) {
+        const TBProfileEntry *e = &g_array_index(prof.entries,
+                                                 TBProfileEntry, i);
+        PUSH(e->count);
+        PUSH(1);
+        PUSH(e->pc);
+    }
+    g_array_free(prof.entries, true);
+
+    PUSH(0);
+    PUSH(1);
+    PUSH(0);
+#undef PUSH
+
+    if (!g_file_set_contents(filename, words->data,
+                             words->len * sizeof(uintptr_t), &gerr)) {
+        error_setg(errp, "failed to write TB profile to '%s': %s",
+                   filename, gerr->message);
+        return false;
+    }
+    return true;
+}
@@ -309,6 +309,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
     tb->cs_base = s.cs_base;
     tb->flags = s.flags;
     tb->cflags = s.cflags;
+    tb->profile = qatomic_read(&tb_exec_profile) ? tb_profile_new() : NULL;
+    tb->ic_dest[TB_IC_JUMP] = NULL;
+    tb->ic_dest[TB_IC_RETURN] = NULL;
     tb_set_page_addr0(tb, phys_pc);
     tb_set_page_addr1(tb, -1);
     if (phys_pc != -1) {
@@ -637,4 +640,6 @@ void tcg_flush_jmp_cache(CPUState *cpu)
     for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
+    qatomic_inc(&jc->l2_gen);
+    tcg_flush_ras(cpu);
 }
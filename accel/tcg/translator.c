@@ -85,6 +85,16 @@ static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
     return icount_start_insn;
 }
 
+/*
+ * Bump the execution count of @tb on entry to the block, so that
+ * chained entries are counted too.  Several vCPUs may run the block
+ * at once, so leave the increment to an atomic helper.
+ */
+static void gen_tb_profile(const TranslationBlock *tb)
+{
+    gen_helper_tb_profile_count(tcg_constant_ptr(&tb->profile->count));
+}
+
 static void gen_tb_end(const TranslationBlock *tb, uint32_t cflags,
                        TCGOp *icount_start_insn, int num_insns)
 {
@@ -148,6 +158,9 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
 
     /* Start translating.  */
     icount_start_insn = gen_tb_start(db, cflags);
+    if (tb->profile) {
+        gen_tb_profile(tb);
+    }
     ops->tb_start(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
@@ -5651,7 +5651,9 @@ fail:
  * check are stored in res.
  */
 int coroutine_fn bdrv_co_check(BlockDriverState *bs,
-                               BdrvCheckResult *res, BdrvCheckMode fix)
+                               BdrvCheckResult *res, BdrvCheckMode fix,
+                               BlockDriverCheckStatusCB *status_cb,
+                               void *cb_opaque)
 {
     IO_CODE();
     assert_bdrv_graph_readable();
@@ -5663,7 +5665,7 @@ int coroutine_fn bdrv_co_check(BlockDriverState *bs,
     }
 
     memset(res, 0, sizeof(*res));
-    return bs->drv->bdrv_co_check(bs, res, fix);
+    return bs->drv->bdrv_co_check(bs, res, fix, status_cb, cb_opaque);
 }
 
 /*
@@ -2834,6 +2834,50 @@ int coroutine_fn blk_co_copy_range(BlockBackend *blk_in, int64_t off_in,
                               bytes, read_flags, write_flags);
 }
 
+/*
+ * Like blk_co_copy_range(), but for callers that read from a BdrvChild of
+ * their own, like the source side of block jobs.
+ */
+int coroutine_fn blk_co_copy_range_from(BdrvChild *src, int64_t off_in,
+                                        BlockBackend *blk_out, int64_t off_out,
+                                        int64_t bytes,
+                                        BdrvRequestFlags read_flags,
+                                        BdrvRequestFlags write_flags)
+{
+    int r;
+    IO_CODE();
+    assert_bdrv_graph_readable();
+
+    r = blk_check_byte_request(blk_out, off_out, bytes);
+    if (r) {
+        return r;
+    }
+
+    return bdrv_co_copy_range(src, off_in, blk_out->root, off_out,
+                              bytes, read_flags, write_flags);
+}
+
+/* See bdrv_co_get_data_fd() */
+int coroutine_fn blk_co_get_data_fd(BlockBackend *blk, int64_t *offset,
+                                    int64_t bytes)
+{
+    int r;
+    IO_CODE();
+    GRAPH_RDLOCK_GUARD();
+
+    r = blk_check_byte_request(blk, *offset, bytes);
+    if (r) {
+        return r;
+    }
+
+    /* I/O limits must see every request */
+    if (blk->public.throttle_group_member.throttle_state) {
+        return -ENOTSUP;
+    }
+
+    return bdrv_co_get_data_fd(blk->root, offset, bytes);
+}
+
 const BdrvChild *blk_root(BlockBackend *blk)
 {
     GLOBAL_STATE_CODE();
@@ -36,6 +36,11 @@
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
 
+/* Adaptive tuning, see block_copy_tune_sample() */
+#define BLOCK_COPY_TUNE_INITIAL_WORKERS 8
+#define BLOCK_COPY_TUNE_WINDOW_NS 100000000LL
+#define BLOCK_COPY_TUNE_SETTLE_WINDOWS 50
+
 typedef enum {
     COPY_READ_WRITE_CLUSTER,
     COPY_READ_WRITE,
@@ -53,6 +58,7 @@ typedef struct BlockCopyCallState {
     int64_t bytes;
     int max_workers;
     int64_t max_chunk;
+    bool adaptive;
     bool ignore_ratelimit;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
@@ -112,6 +118,49 @@ static int64_t task_end(BlockCopyTask *task)
     return task->req.offset + task->req.bytes;
 }
 
+/*
+ * Probes of the adaptive tuning, tried in this order.  Each one changes one
+ * parameter of the best configuration found so far.
+ */
+typedef enum {
+    BLOCK_COPY_TUNE_WORKERS_UP,
+    BLOCK_COPY_TUNE_CHUNK_DOWN,
+    BLOCK_COPY_TUNE_WORKERS_DOWN,
+    BLOCK_COPY_TUNE_CHUNK_UP,
+    BLOCK_COPY_TUNE__MAX,
+} BlockCopyTuneStep;
+
+typedef struct BlockCopyTuning {
+    /* Limits currently in use, also read atomically by block_copy_get_tuning */
+    int workers;
+    int chunk;
+
+    /* Bounds, set when the first adaptive call starts */
+    int max_workers;
+    int min_chunk;
+    int max_chunk;
+
+    /* Best configuration found so far, and the throughput it achieved */
+    int best_workers;
+    int best_chunk;
+    uint64_t best_bps;
+
+    /*
+     * Whether the current configuration is a probe (otherwise it is the best
+     * one), which probe to try next, and how many probes in a row failed
+     */
+    bool probing;
+    BlockCopyTuneStep step;
+    int failed_probes;
+    int settled_windows;
+
+    /* Current measurement window */
+    int64_t window_start_ns;
+    uint64_t window_bytes;
+    uint64_t window_requests;
+    uint64_t window_latency_ns;
+} BlockCopyTuning;
+
 typedef struct BlockCopyState {
     /*
      * BdrvChild objects are not owned or managed by block-copy. They are
@@ -160,6 +209,13 @@ typedef struct BlockCopyState {
     ProgressMeter *progress;
     SharedResource *mem;
     RateLimit rate_limit;
+
+    /*
+     * Adaptive chunk size and worker count for calls with @adaptive set.
+     * Protected by lock (except where noted).
+     */
+    bool tuning_started;
+    BlockCopyTuning tuning;
 } BlockCopyState;
 
 /* Called with lock held */
@@ -194,6 +250,9 @@ block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
 
     QEMU_LOCK_GUARD(&s->lock);
     max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), call_state->max_chunk);
+    if (call_state->adaptive) {
+        max_chunk = MIN(max_chunk, s->tuning.chunk);
+    }
     if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
                                            offset, offset + bytes,
                                            max_chunk, &offset, &bytes))
@@ -578,12 +637,191 @@ block_copy_do_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
     return ret;
 }
 
+/*
+ * Switch to the configuration that @step leads to from the best one.
+ * Returns false if that is not possible because a bound has been reached.
+ * Called with lock held.
+ */
+static bool block_copy_tune_apply(BlockCopyTuning *t, BlockCopyTuneStep step)
+{
+    int workers = t->best_workers;
+    int chunk = t->best_chunk;
+
+    switch (step) {
+    case BLOCK_COPY_TUNE_WORKERS_UP:
+        workers = MIN((int64_t)workers * 2, t->max_workers);
+        break;
+    case BLOCK_COPY_TUNE_WORKERS_DOWN:
+        workers = MAX(workers / 2, 1);
+        break;
+    case BLOCK_COPY_TUNE_CHUNK_UP:
+        chunk = MIN((int64_t)chunk * 2, t->max_chunk);
+        break;
+    case BLOCK_COPY_TUNE_CHUNK_DOWN:
+        chunk = MAX(chunk / 2, t->min_chunk);
+        break;
+    default:
+        abort();
+    }
+
+    if (workers == t->best_workers && chunk == t->best_chunk) {
+        return false;
+    }
+
+    qatomic_set(&t->workers, workers);
+    qatomic_set(&t->chunk, chunk);
+    return true;
+}
+
+/*
+ * Start the next probe.  Once every probe in a row has failed to improve
+ * anything, settle on the best configuration for a while.
+ * Called with lock held.
+ */
+static void block_copy_tune_next_probe(BlockCopyTuning *t)
+{
+    while (t->failed_probes < BLOCK_COPY_TUNE__MAX) {
+        if (block_copy_tune_apply(t, t->step)) {
+            t->probing = true;
+            return;
+        }
+        /* At a bound, so this direction cannot help */
+        t->failed_probes++;
+        t->step = (t->step + 1) % BLOCK_COPY_TUNE__MAX;
+    }
+
+    t->probing = false;
+    t->settled_windows = 0;
+    qatomic_set(&t->workers, t->best_workers);
+    qatomic_set(&t->chunk, t->best_chunk);
+}
+
+/*
+ * Evaluate a finished measurement window.
+ *
+ * This is a simple hill climber: every window measures either the best
+ * configuration or a probe that changes one parameter of it by a factor of
+ * two.  A probe is kept if it increases throughput noticeably, in which case
+ * the next probe goes further in the same direction.  Probes that reduce
+ * chunk size or worker count are also kept as long as throughput does not
+ * drop noticeably, because they lower the latency that the background copy
+ * adds to concurrent (e.g. guest and copy-before-write) requests.
+ *
+ * Called with lock held.
+ */
+static void block_copy_tune_window_done(BlockCopyTuning *t, uint64_t bps)
+{
+    uint64_t margin = t->best_bps / 16;
+    bool shrink;
+
+    if (!t->probing) {
+        /* Track changing bandwidth while using the best configuration */
+        t->best_bps = bps;
+        if (t->failed_probes >= BLOCK_COPY_TUNE__MAX) {
+            if (++t->settled_windows < BLOCK_COPY_TUNE_SETTLE_WINDOWS) {
+                return;
+            }
+            t->failed_probes = 0;
+        }
+        block_copy_tune_next_probe(t);
+        return;
+    }
+
+    shrink = t->step == BLOCK_COPY_TUNE_WORKERS_DOWN ||
+             t->step == BLOCK_COPY_TUNE_CHUNK_DOWN;
+
+    if (bps > t->best_bps + margin || (shrink && bps + margin >= t->best_bps)) {
+        t->best_workers = t->workers;
+        t->best_chunk = t->chunk;
+        t->best_bps = MAX(t->best_bps, bps);
+        t->failed_probes = 0;
+    } else {
+        t->failed_probes++;
+        t->step = (t->step + 1) % BLOCK_COPY_TUNE__MAX;
+    }
+
+    block_copy_tune_next_probe(t);
+}
+
+/*
+ * Account a successfully copied chunk of an adaptive call, which took
+ * @latency_ns.  Called with lock held.
+ */
+static void block_copy_tune_sample(BlockCopyState *s, int64_t bytes,
+                                   int64_t latency_ns)
+{
+    BlockCopyTuning *t = &s->tuning;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t elapsed = now - t->window_start_ns;
+    uint64_t bps;
+
+    t->window_bytes += bytes;
+    t->window_requests++;
+    t->window_latency_ns += latency_ns;
+
+    /* Let every worker complete at least one request per window */
+    if (elapsed < BLOCK_COPY_TUNE_WINDOW_NS ||
+        t->window_requests < t->workers) {
+        return;
+    }
+
+    bps = muldiv64(t->window_bytes, NANOSECONDS_PER_SECOND, elapsed);
+    trace_block_copy_tune(s, t->workers, t->chunk, bps,
+                          t->window_latency_ns / t->window_requests);
+
+    block_copy_tune_window_done(t, bps);
+
+    t->window_start_ns = now;
+    t->window_bytes = 0;
+    t->window_requests = 0;
+    t->window_latency_ns = 0;
+}
+
+/*
+ * Prepare the tuning for a new adaptive call.  The configuration found by
+ * earlier calls is kept, but measurement starts over.
+ * Called with lock held.
+ */
+static void block_copy_tune_start(BlockCopyState *s,
+                                  BlockCopyCallState *call_state)
+{
+    BlockCopyTuning *t = &s->tuning;
+
+    if (!s->tuning_started) {
+        int64_t max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s),
+                                         call_state->max_chunk);
+
+        *t = (BlockCopyTuning) {
+            .max_workers = call_state->max_workers,
+            .min_chunk = s->cluster_size,
+            .max_chunk = MIN(max_chunk, INT_MAX),
+        };
+        t->best_workers = MIN(BLOCK_COPY_TUNE_INITIAL_WORKERS,
+                              t->max_workers);
+        t->best_chunk = t->max_chunk;
+        qatomic_set(&t->workers, t->best_workers);
+        qatomic_set(&t->chunk, t->best_chunk);
+        qatomic_store_release(&s->tuning_started, true);
+    }
+
+    /* Measure the best configuration first */
+    t->probing = false;
+    qatomic_set(&t->workers, t->best_workers);
+    qatomic_set(&t->chunk, t->best_chunk);
+
+    t->window_start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    t->window_bytes = 0;
+    t->window_requests = 0;
+    t->window_latency_ns = 0;
+}
+
 static coroutine_fn int block_copy_task_entry(AioTask *task)
 {
     BlockCopyTask *t = container_of(task, BlockCopyTask, task);
     BlockCopyState *s = t->s;
     bool error_is_read = false;
     BlockCopyMethod method = t->method;
+    int64_t start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     int ret = -1;
 
     WITH_GRAPH_RDLOCK_GUARD() {
@@ -596,6 +834,14 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
             s->method = method;
         }
 
+        /* Zero writes say little about the bandwidth to the target */
+        if (t->call_state->adaptive && ret >= 0 &&
+            t->method != COPY_WRITE_ZEROES) {
+            block_copy_tune_sample(s, t->req.bytes,
+                                   qemu_clock_get_ns(QEMU_CLOCK_REALTIME) -
+                                   start_ns);
+        }
+
         if (ret < 0) {
             if (!t->call_state->ret) {
                 t->call_state->ret = ret;
@@ -824,6 +1070,10 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
         if (!aio && bytes) {
             aio = aio_task_pool_new(call_state->max_workers);
         }
+        if (aio && call_state->adaptive) {
+            aio_task_pool_set_max_busy_tasks(aio,
+                                             qatomic_read(&s->tuning.workers));
+        }
 
         ret = block_copy_task_run(aio, task);
         if (ret < 0) {
@@ -932,8 +1182,16 @@ block_copy_common(BlockCopyCallState *call_state)
 
 static void coroutine_fn block_copy_async_co_entry(void *opaque)
 {
+    BlockCopyCallState *call_state = opaque;
+
+    if (call_state->adaptive) {
+        WITH_QEMU_LOCK_GUARD(&call_state->s->lock) {
+            block_copy_tune_start(call_state->s, call_state);
+        }
+    }
+
     GRAPH_RDLOCK_GUARD();
-    block_copy_common(opaque);
+    block_copy_common(call_state);
 }
 
 int coroutine_fn block_copy(BlockCopyState *s, int64_t start, int64_t bytes,
@@ -972,6 +1230,7 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t start, int64_t bytes,
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
                                      int max_workers, int64_t max_chunk,
+                                     bool adaptive,
                                      BlockCopyAsyncCallbackFunc cb,
                                      void *cb_opaque)
 {
@@ -983,6 +1242,7 @@ BlockCopyCallState *block_copy_async(BlockCopyState *s,
         .bytes = bytes,
         .max_workers = max_workers,
         .max_chunk = max_chunk,
+        .adaptive = adaptive,
         .cb = cb,
         .cb_opaque = cb_opaque,
 
@@ -1057,6 +1317,18 @@ int64_t block_copy_cluster_size(BlockCopyState *s)
     return s->cluster_size;
 }
 
+bool block_copy_get_tuning(BlockCopyState *s, int *workers, int64_t *chunk)
+{
+    /* Pairs with qatomic_store_release() in block_copy_tune_start() */
+    if (!qatomic_load_acquire(&s->tuning_started)) {
+        return false;
+    }
+
+    *workers = qatomic_read(&s->tuning.workers);
+    *chunk = qatomic_read(&s->tuning.chunk);
+    return true;
+}
+
 void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip)
 {
     qatomic_set(&s->skip_unallocated, skip);
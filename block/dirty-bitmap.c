@@ -29,6 +29,13 @@
 #include "block/blockjob.h"
 #include "block/dirty-bitmap.h"
 #include "qemu/main-loop.h"
+#include "qemu/units.h"
+
+/*
+ * Bitmaps whose dense bottom level would take more memory than this use a
+ * sparse HBitmap, which only allocates memory for the dirty parts.
+ */
+#define DIRTY_BITMAP_SPARSE_THRESHOLD (1 * MiB)
 
 struct BdrvDirtyBitmap {
     BlockDriverState *bs;
@@ -71,6 +78,17 @@ static inline void bdrv_dirty_bitmaps_unlock(BlockDriverState *bs)
     qemu_mutex_unlock(&bs->dirty_bitmap_mutex);
 }
 
+static HBitmap *bdrv_dirty_bitmap_alloc_hbitmap(uint64_t size,
+                                                int granularity)
+{
+    uint64_t bits = DIV_ROUND_UP(size, UINT64_C(1) << granularity);
+
+    if (bits / CHAR_BIT > DIRTY_BITMAP_SPARSE_THRESHOLD) {
+        return hbitmap_alloc_sparse(size, granularity);
+    }
+    return hbitmap_alloc(size, granularity);
+}
+
 void bdrv_dirty_bitmap_lock(BdrvDirtyBitmap *bitmap)
 {
     bdrv_dirty_bitmaps_lock(bitmap->bs);
@@ -124,7 +142,8 @@ BdrvDirtyBitmap *bdrv_create_dirty_bitmap(BlockDriverState *bs,
     }
     bitmap = g_new0(BdrvDirtyBitmap, 1);
     bitmap->bs = bs;
-    bitmap->bitmap = hbitmap_alloc(bitmap_size, ctz32(granularity));
+    bitmap->bitmap = bdrv_dirty_bitmap_alloc_hbitmap(bitmap_size,
+                                                     ctz32(granularity));
     bitmap->size = bitmap_size;
     bitmap->name = g_strdup(name);
     bitmap->disabled = false;
@@ -580,8 +599,9 @@ void bdrv_clear_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap **out)
         hbitmap_reset_all(bitmap->bitmap);
     } else {
         HBitmap *backup = bitmap->bitmap;
-        bitmap->bitmap = hbitmap_alloc(bitmap->size,
-                                       hbitmap_granularity(backup));
+        bitmap->bitmap =
+            bdrv_dirty_bitmap_alloc_hbitmap(bitmap->size,
+                                            hbitmap_granularity(backup));
         *out = backup;
     }
     bdrv_dirty_bitmaps_unlock(bitmap->bs);
@@ -875,7 +895,8 @@ void bdrv_dirty_bitmap_merge_internal(BdrvDirtyBitmap *dest,
 
     if (backup) {
         *backup = dest->bitmap;
-        dest->bitmap = hbitmap_alloc(dest->size, hbitmap_granularity(*backup));
+        dest->bitmap = bdrv_dirty_bitmap_alloc_hbitmap(
+            dest->size, hbitmap_granularity(*backup));
         hbitmap_merge(*backup, src->bitmap, dest->bitmap);
     } else {
         hbitmap_merge(dest->bitmap, src->bitmap, dest->bitmap);
@@ -29,6 +29,9 @@
 #ifdef CONFIG_VDUSE_BLK_EXPORT
 #include "vduse-blk.h"
 #endif
+#ifdef CONFIG_UBLK_BLK_EXPORT
+#include "ublk.h"
+#endif
 
 static const BlockExportDriver *blk_exp_drivers[] = {
     &blk_exp_nbd,
@@ -41,6 +44,9 @@ static const BlockExportDriver *blk_exp_drivers[] = {
 #ifdef CONFIG_VDUSE_BLK_EXPORT
     &blk_exp_vduse_blk,
 #endif
+#ifdef CONFIG_UBLK_BLK_EXPORT
+    &blk_exp_ublk,
+#endif
 };
 
 /* Only accessed from the main thread */
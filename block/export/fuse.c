@@ -28,6 +28,7 @@
 #include "qapi/error.h"
 #include "qapi/qapi-commands-block.h"
 #include "qemu/coroutine.h"
+#include "qemu/cutils.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "system/block-backend.h"
@@ -51,6 +52,9 @@
 #define FUSE_MAX_READ_BYTES (MIN(BDRV_REQUEST_MAX_BYTES, 1 * 1024 * 1024))
 #define FUSE_MAX_WRITE_BYTES (64 * 1024)
 
+/* Number of FUSE-over-io_uring entries per kernel queue (i.e. per host CPU) */
+#define FUSE_RING_QUEUE_DEPTH 8
+
 /*
  * fuse_init_in structure before 7.36.  We don't need the flags2 field added
  * there, so we can work with the smaller older structure to stay compatible
@@ -68,6 +72,8 @@ typedef struct FuseRequestInHeader {
     /* All supported requests */
     union {
         struct fuse_init_in_compat init;
+        /* Only valid if init.flags has FUSE_INIT_EXT */
+        struct fuse_init_in init_ext;
         struct fuse_open_in open;
         struct fuse_setattr_in setattr;
         struct fuse_read_in read;
@@ -121,12 +127,43 @@ QEMU_BUILD_BUG_ON(sizeof(((FuseRequestInHeaderBuf *)0)->head) +
                   sizeof(FuseRequestInHeader));
 
 typedef struct FuseExport FuseExport;
+typedef struct FuseQueue FuseQueue;
+typedef struct FuseRingEnt FuseRingEnt;
+
+#ifdef CONFIG_LINUX_IO_URING
+QEMU_BUILD_BUG_ON(sizeof(FuseRequestInHeader) -
+                  offsetof(FuseRequestInHeader, init) >
+                  FUSE_URING_OP_IN_OUT_SZ);
+QEMU_BUILD_BUG_ON(sizeof(struct fuse_in_header) > FUSE_URING_IN_OUT_HEADER_SZ);
+
+/*
+ * One FUSE-over-io_uring entry: a buffer registered with the kernel, into
+ * which it places one request at a time.  The response is committed from
+ * the same buffer, which at the same time fetches the next request.
+ */
+struct FuseRingEnt {
+    FuseQueue *q;
+    uint16_t qid; /* Kernel queue, i.e. host CPU */
+
+    struct fuse_uring_req_header req_header;
+    void *op_payload;
+    size_t op_payload_sz;
+    struct iovec iov[2];
+
+    /* Next command to submit, and the request it commits */
+    uint32_t cmd_op;
+    uint64_t commit_id;
+
+    CqeHandler cqe_handler;
+    QSIMPLEQ_ENTRY(FuseRingEnt) next;
+};
+#endif
 
 /*
  * One FUSE "queue", representing one FUSE FD from which requests are fetched
  * and processed.  Each queue is tied to an AioContext.
  */
-typedef struct FuseQueue {
+struct FuseQueue {
     FuseExport *exp;
 
     AioContext *ctx;
@@ -147,7 +184,18 @@ typedef struct FuseQueue {
      * via blk_blockalign() and thus need to be freed via qemu_vfree().
      */
     void *req_write_data_cached;
-} FuseQueue;
+
+#ifdef CONFIG_LINUX_IO_URING
+    /*
+     * FUSE-over-io_uring entries served by this queue, submitted from ctx.
+     * Entries that receive a request during a drained section are parked
+     * until it ends; only accessed from ctx.
+     */
+    FuseRingEnt *ring_ents;
+    size_t nr_ring_ents;
+    QSIMPLEQ_HEAD(, FuseRingEnt) ring_parked;
+#endif
+};
 
 struct FuseExport {
     BlockExport common;
@@ -179,6 +227,16 @@ struct FuseExport {
     /* Whether allow_other was used as a mount option or not */
     bool allow_other;
 
+#ifdef CONFIG_LINUX_IO_URING
+    /* FUSE-over-io_uring was requested, and was agreed on in FUSE_INIT */
+    bool io_uring;
+    bool io_uring_negotiated;
+    /* The kernel refused to register a ring entry, only reported once */
+    bool io_uring_failed;
+    /* Set during drained sections, access atomically */
+    bool quiesced;
+#endif
+
     /* All atomic */
     mode_t st_mode;
     uid_t st_uid;
@@ -209,9 +267,17 @@ static bool is_regular_file(const char *path, Error **errp);
 static void read_from_fuse_fd(void *opaque);
 static void coroutine_fn
 fuse_co_process_request(FuseQueue *q, const FuseRequestInHeader *in_hdr,
-                        const void *data_buffer);
+                        const void *data_buffer, FuseRingEnt *ent);
 static int fuse_write_err(int fd, const struct fuse_in_header *in_hdr, int err);
 
+#ifdef CONFIG_LINUX_IO_URING
+static void fuse_uring_start(FuseExport *exp);
+static void fuse_uring_commit(FuseRingEnt *ent,
+                              const struct fuse_out_header *out_hdr,
+                              const void *buf);
+static void fuse_uring_resume_bh(void *opaque);
+#endif
+
 static void fuse_inc_in_flight(FuseExport *exp)
 {
     if (qatomic_fetch_inc(&exp->in_flight) == 0) {
@@ -262,7 +328,13 @@ static void fuse_detach_handlers(FuseExport *exp)
 
 static void fuse_export_drained_begin(void *opaque)
 {
-    fuse_detach_handlers(opaque);
+    FuseExport *exp = opaque;
+
+    fuse_detach_handlers(exp);
+#ifdef CONFIG_LINUX_IO_URING
+    /* Pairs with smp_mb__after_rmw() in fuse_uring_cqe_handler() */
+    qatomic_set_mb(&exp->quiesced, true);
+#endif
 }
 
 static void fuse_export_drained_end(void *opaque)
@@ -277,6 +349,16 @@ static void fuse_export_drained_end(void *opaque)
     }
 
     fuse_attach_handlers(exp);
+
+#ifdef CONFIG_LINUX_IO_URING
+    qatomic_set(&exp->quiesced, false);
+    for (int i = 0; i < exp->num_queues; i++) {
+        if (exp->queues[i].ring_ents) {
+            aio_bh_schedule_oneshot(exp->queues[i].ctx, fuse_uring_resume_bh,
+                                    &exp->queues[i]);
+        }
+    }
+#endif
 }
 
 static bool fuse_export_drained_poll(void *opaque)
@@ -335,6 +417,33 @@ static int fuse_export_create(BlockExport *blk_exp,
         };
     }
 
+#ifdef CONFIG_LINUX_IO_URING
+    for (int i = 0; i < exp->num_queues; i++) {
+        QSIMPLEQ_INIT(&exp->queues[i].ring_parked);
+    }
+
+    if (args->has_io_uring && args->io_uring) {
+        /*
+         * FUSE_IO_URING_CMD_* carry an 80-byte command, which only fits into
+         * 128-byte SQEs.
+         */
+        if (!aio_has_io_uring_sqe128()) {
+            error_setg(errp, "FUSE-over-io_uring requires io_uring with "
+                       "128-byte SQEs, which is not available");
+            ret = -ENOTSUP;
+            goto fail;
+        }
+
+        exp->io_uring = true;
+        /*
+         * Ring entries are submitted in and bound to their queue's
+         * AioContext, so the queue must not move along with the
+         * BlockBackend.
+         */
+        exp->follow_aio_context = false;
+    }
+#endif
+
     /* For growable and writable exports, take the RESIZE permission */
     if (args->growable || blk_exp_args->writable) {
         uint64_t blk_perm, blk_shared_perm;
@@ -717,7 +826,7 @@ static void coroutine_fn co_read_from_fuse_fd(void *opaque)
         release_write_data_buffer(q, &data_buffer);
     }
 
-    fuse_co_process_request(q, in_hdr, data_buffer);
+    fuse_co_process_request(q, in_hdr, data_buffer, NULL);
 
 no_request:
     release_write_data_buffer(q, &data_buffer);
@@ -748,6 +857,18 @@ static void fuse_export_shutdown(BlockExport *blk_exp)
         fuse_detach_handlers(exp);
     }
 
+#ifdef CONFIG_LINUX_IO_URING
+    /*
+     * Ring entries hold export references until the kernel returns them,
+     * which it only does once the connection is gone.  Unmount now instead
+     * of in fuse_export_delete(), which would never be reached otherwise.
+     */
+    if (exp->io_uring_negotiated && exp->mounted) {
+        fuse_session_unmount(exp->fuse_session);
+        exp->mounted = false;
+    }
+#endif
+
     if (exp->mountpoint) {
         /*
          * Safe to drop now, because we will not handle any requests for this
@@ -769,6 +890,13 @@ static void fuse_export_delete(BlockExport *blk_exp)
             close(q->fuse_fd);
         }
         qemu_vfree(q->req_write_data_cached);
+
+#ifdef CONFIG_LINUX_IO_URING
+        for (size_t j = 0; j < q->nr_ring_ents; j++) {
+            qemu_vfree(q->ring_ents[j].op_payload);
+        }
+        g_free(q->ring_ents);
+#endif
     }
     g_free(exp->queues);
 
@@ -826,9 +954,11 @@ static bool is_regular_file(const char *path, Error **errp)
  */
 static ssize_t coroutine_fn GRAPH_RDLOCK
 fuse_co_init(FuseExport *exp, struct fuse_init_out *out,
-             const struct fuse_init_in_compat *in)
+             const struct fuse_init_in_compat *in, uint32_t in_flags2)
 {
     const uint32_t supported_flags = FUSE_ASYNC_READ | FUSE_ASYNC_DIO;
+    uint32_t flags2 = 0;
+    uint32_t extra_flags = 0;
 
     if (in->major != 7) {
         error_report("FUSE major version mismatch: We have 7, but kernel has %"
@@ -843,13 +973,32 @@ fuse_co_init(FuseExport *exp, struct fuse_init_out *out,
         return -EINVAL;
     }
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (exp->io_uring) {
+        if ((in->flags & FUSE_INIT_EXT) &&
+            (in_flags2 & (FUSE_OVER_IO_URING >> 32)))
+        {
+            /*
+             * The kernel sizes ring payloads by max_pages, which it only
+             * takes from us with FUSE_MAX_PAGES
+             */
+            extra_flags = FUSE_INIT_EXT | FUSE_MAX_PAGES;
+            flags2 = FUSE_OVER_IO_URING >> 32;
+            exp->io_uring_negotiated = true;
+        } else {
+            warn_report("FUSE-over-io_uring not supported by the kernel "
+                        "(is fuse.enable_uring set?), using /dev/fuse");
+        }
+    }
+#endif
+
     *out = (struct fuse_init_out) {
         .major = 7,
         .minor = MIN(FUSE_KERNEL_MINOR_VERSION, in->minor),
         .max_readahead = in->max_readahead,
         .max_write = FUSE_MAX_WRITE_BYTES,
-        .flags = in->flags & supported_flags,
-        .flags2 = 0,
+        .flags = (in->flags & supported_flags) | extra_flags,
+        .flags2 = flags2,
 
         /* libfuse maximum: 2^16 - 1 */
         .max_background = UINT16_MAX,
@@ -1453,11 +1602,13 @@ static int fuse_write_buf_response(int fd,
 }
 
 /**
- * Process a FUSE request, incl. writing the response.
+ * Process a FUSE request, incl. writing the response.  If @ent is not NULL,
+ * the request was received through that FUSE-over-io_uring entry, and the
+ * response is committed through it; otherwise, it is written to q->fuse_fd.
  */
 static void coroutine_fn
 fuse_co_process_request(FuseQueue *q, const FuseRequestInHeader *in_hdr,
-                        const void *data_buffer)
+                        const void *data_buffer, FuseRingEnt *ent)
 {
     FuseRequestOutHeader out_hdr;
     FuseExport *exp = q->exp;
@@ -1469,7 +1620,9 @@ fuse_co_process_request(FuseQueue *q, const FuseRequestInHeader *in_hdr,
 
     switch (in_hdr->common.opcode) {
     case FUSE_INIT:
-        ret = fuse_co_init(exp, &out_hdr.init, &in_hdr->init);
+        ret = fuse_co_init(exp, &out_hdr.init, &in_hdr->init,
+                           in_hdr->init.flags & FUSE_INIT_EXT ?
+                           in_hdr->init_ext.flags2 : 0);
         break;
 
     case FUSE_DESTROY:
@@ -1495,7 +1648,15 @@ fuse_co_process_request(FuseQueue *q, const FuseRequestInHeader *in_hdr,
     case FUSE_FORGET:
     case FUSE_BATCH_FORGET:
         /* These have no response, and there is nothing we need to do */
-        return;
+        if (!ent) {
+            return;
+        }
+        /*
+         * The kernel sends these through /dev/fuse, but a ring entry always
+         * needs to be committed to get it back.
+         */
+        ret = -ENOSYS;
+        break;
 
     case FUSE_GETATTR:
         ret = fuse_co_getattr(exp, &out_hdr.attr);
@@ -1583,13 +1744,302 @@ fuse_co_process_request(FuseQueue *q, const FuseRequestInHeader *in_hdr,
         };
     }
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (ent) {
+        fuse_uring_commit(ent, &out_hdr.common,
+                          out_data_buffer ?:
+                          (char *)&out_hdr + sizeof(out_hdr.common));
+        qemu_vfree(out_data_buffer);
+        return;
+    }
+#else
+    assert(!ent);
+#endif
+
     if (out_data_buffer) {
         fuse_write_buf_response(q->fuse_fd, &out_hdr.common, out_data_buffer);
         qemu_vfree(out_data_buffer);
     } else {
         fuse_write_response(q->fuse_fd, &out_hdr);
     }
+
+#ifdef CONFIG_LINUX_IO_URING
+    /* The kernel will only use the ring after the INIT response */
+    if (in_hdr->common.opcode == FUSE_INIT && exp->io_uring_negotiated) {
+        fuse_uring_start(exp);
+    }
+#endif
+}
+
+#ifdef CONFIG_LINUX_IO_URING
+static void fuse_uring_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
+{
+    FuseRingEnt *ent = opaque;
+    struct fuse_uring_cmd_req req = {
+        .commit_id = ent->commit_id,
+        .qid = ent->qid,
+    };
+
+    io_uring_prep_rw(IORING_OP_URING_CMD, sqe, ent->q->fuse_fd, ent->iov,
+                     ARRAY_SIZE(ent->iov), 0);
+    sqe->cmd_op = ent->cmd_op;
+    memcpy(sqe->cmd, &req, sizeof(req));
+}
+
+/**
+ * Process the request the kernel has placed into the ring entry in `opaque`,
+ * and commit the response, which fetches the next request.
+ *
+ * Assumes the export's in-flight counter has already been incremented.
+ */
+static void coroutine_fn co_process_ring_ent(void *opaque)
+{
+    FuseRingEnt *ent = opaque;
+    FuseExport *exp = ent->q->exp;
+    FuseRequestInHeader in_hdr;
+    ssize_t op_hdr_len;
+    int err = 0;
+
+    memcpy(&in_hdr.common, ent->req_header.in_out, sizeof(in_hdr.common));
+    memcpy(&in_hdr.init, ent->req_header.op_in,
+           sizeof(in_hdr) - offsetof(FuseRequestInHeader, init));
+    ent->commit_id = ent->req_header.ring_ent_in_out.commit_id;
+
+    op_hdr_len = req_op_hdr_len(&in_hdr);
+    if (op_hdr_len < 0) {
+        err = op_hdr_len;
+    } else if (in_hdr.common.opcode == FUSE_WRITE &&
+               in_hdr.write.size >
+               ent->req_header.ring_ent_in_out.payload_sz) {
+        error_report("FUSE WRITE payload truncated, expected %" PRIu32
+                     " bytes, got %" PRIu32 " bytes",
+                     in_hdr.write.size,
+                     ent->req_header.ring_ent_in_out.payload_sz);
+        err = -EINVAL;
+    }
+
+    if (err) {
+        struct fuse_out_header out_hdr = {
+            .len = sizeof(out_hdr),
+            .error = err,
+            .unique = in_hdr.common.unique,
+        };
+        fuse_uring_commit(ent, &out_hdr, NULL);
+    } else {
+        fuse_co_process_request(ent->q, &in_hdr, ent->op_payload, ent);
+    }
+
+    fuse_dec_in_flight(exp);
+}
+
+static void fuse_uring_cqe_handler(CqeHandler *cqe_handler)
+{
+    FuseRingEnt *ent = container_of(cqe_handler, FuseRingEnt, cqe_handler);
+    FuseExport *exp = ent->q->exp;
+    int ret = cqe_handler->cqe.res;
+    Coroutine *co;
+
+    if (unlikely(ret < 0)) {
+        /*
+         * The kernel returns all entries with an error once the connection
+         * is gone, which is expected on unmount.  Either way, the entry will
+         * not be used again.
+         */
+        if (ret == -ENOTCONN || ret == -ECONNABORTED || ret == -ECANCELED) {
+            /* Unmounted */
+        } else if (ent->cmd_op == FUSE_IO_URING_CMD_REGISTER) {
+            /* The kernel does not start the ring, /dev/fuse keeps working */
+            warn_report_once_cond(&exp->io_uring_failed,
+                                  "Cannot register FUSE-over-io_uring queue "
+                                  "%d: %s, using /dev/fuse",
+                                  ent->qid, strerror(-ret));
+        } else {
+            error_report("FUSE-over-io_uring command failed: %s",
+                         strerror(-ret));
+        }
+        blk_exp_unref(&exp->common);
+        return;
+    }
+
+    /* Decremented by co_process_ring_ent() */
+    fuse_inc_in_flight(exp);
+
+    /* Pairs with qatomic_set_mb() in fuse_export_drained_begin() */
+    smp_mb__after_rmw();
+
+    if (unlikely(qatomic_read(&exp->quiesced))) {
+        /* Resumed by fuse_uring_resume_bh() */
+        QSIMPLEQ_INSERT_TAIL(&ent->q->ring_parked, ent, next);
+        fuse_dec_in_flight(exp);
+        return;
+    }
+
+    co = qemu_coroutine_create(co_process_ring_ent, ent);
+    qemu_coroutine_enter(co);
+}
+
+/**
+ * Process the requests that were received during a drained section.
+ * Takes a FuseQueue pointer in `opaque`, must run in its AioContext.
+ */
+static void fuse_uring_resume_bh(void *opaque)
+{
+    FuseQueue *q = opaque;
+    FuseRingEnt *ent;
+
+    while (!qatomic_read(&q->exp->quiesced) &&
+           (ent = QSIMPLEQ_FIRST(&q->ring_parked))) {
+        Coroutine *co;
+
+        QSIMPLEQ_REMOVE_HEAD(&q->ring_parked, next);
+
+        co = qemu_coroutine_create(co_process_ring_ent, ent);
+        /* Decremented by co_process_ring_ent() */
+        fuse_inc_in_flight(q->exp);
+        qemu_coroutine_enter(co);
+    }
+}
+
+/**
+ * Commit a response through @ent: @out_hdr is followed by
+ * `out_hdr->len - sizeof(*out_hdr)` bytes of payload in @buf.
+ */
+static void fuse_uring_commit(FuseRingEnt *ent,
+                              const struct fuse_out_header *out_hdr,
+                              const void *buf)
+{
+    size_t payload_len = out_hdr->len - sizeof(*out_hdr);
+
+    QEMU_BUILD_BUG_ON(sizeof(*out_hdr) > FUSE_URING_IN_OUT_HEADER_SZ);
+
+    if (unlikely(payload_len > ent->op_payload_sz)) {
+        struct fuse_out_header err_hdr = {
+            .len = sizeof(err_hdr),
+            .error = -EIO,
+            .unique = out_hdr->unique,
+        };
+
+        error_report("FUSE response of %zu bytes exceeds the ring entry's "
+                     "payload buffer of %zu bytes",
+                     payload_len, ent->op_payload_sz);
+        memcpy(ent->req_header.in_out, &err_hdr, sizeof(err_hdr));
+        payload_len = 0;
+    } else {
+        memcpy(ent->req_header.in_out, out_hdr, sizeof(*out_hdr));
+        if (payload_len) {
+            memcpy(ent->op_payload, buf, payload_len);
+        }
+    }
+
+    ent->req_header.ring_ent_in_out.payload_sz = payload_len;
+    ent->cmd_op = FUSE_IO_URING_CMD_COMMIT_AND_FETCH;
+    aio_add_sqe(fuse_uring_prep_sqe, ent, &ent->cqe_handler);
+}
+
+/**
+ * Register all ring entries of a queue with the kernel.
+ * Takes a FuseQueue pointer in `opaque`, must run in its AioContext.
+ */
+static void fuse_uring_register_bh(void *opaque)
+{
+    FuseQueue *q = opaque;
+
+    for (size_t i = 0; i < q->nr_ring_ents; i++) {
+        aio_add_sqe(fuse_uring_prep_sqe, &q->ring_ents[i],
+                    &q->ring_ents[i].cqe_handler);
+    }
+}
+
+/**
+ * Return the number of kernel ring queues, i.e. the kernel's nr_cpu_ids:
+ * one more than the highest possible CPU.  This can be more than
+ * sysconf(_SC_NPROCESSORS_CONF), which only counts present CPUs.
+ */
+static long fuse_uring_nr_qids(Error **errp)
+{
+    const char *path = "/sys/devices/system/cpu/possible";
+    g_autofree char *contents = NULL;
+    g_autoptr(GError) err = NULL;
+    const char *p, *dash;
+    unsigned long last_cpu;
+
+    if (!g_file_get_contents(path, &contents, NULL, &err)) {
+        error_setg(errp, "%s", err->message);
+        return -1;
+    }
+
+    /* A list of ranges such as "0-3,8-11", the last one ends highest */
+    g_strchomp(contents);
+    p = strrchr(contents, ',');
+    p = p ? p + 1 : contents;
+    dash = strchr(p, '-');
+    if (dash) {
+        p = dash + 1;
+    }
+    if (qemu_strtoul(p, NULL, 10, &last_cpu) < 0 || last_cpu >= INT_MAX) {
+        error_setg(errp, "Cannot parse '%s' from %s", contents, path);
+        return -1;
+    }
+    return last_cpu + 1;
+}
+
+/**
+ * Set up FUSE-over-io_uring after FUSE_INIT has negotiated it.
+ *
+ * The kernel has one ring queue per possible host CPU, and only starts
+ * using the ring once every queue has an entry registered; until then,
+ * requests keep coming through /dev/fuse.  Kernel queue qid is served by
+ * exp->queues[qid % exp->num_queues].
+ */
+static void fuse_uring_start(FuseExport *exp)
+{
+    Error *local_err = NULL;
+    long nr_qids = fuse_uring_nr_qids(&local_err);
+    size_t payload_sz = ROUND_UP(FUSE_MAX_WRITE_BYTES,
+                                 qemu_real_host_page_size());
+
+    if (nr_qids < 0) {
+        warn_reportf_err(local_err, "Cannot determine number of possible "
+                         "host CPUs, using /dev/fuse instead of "
+                         "FUSE-over-io_uring: ");
+        return;
+    }
+
+    for (int i = 0; i < exp->num_queues && i < nr_qids; i++) {
+        FuseQueue *q = &exp->queues[i];
+        size_t n = 0;
+
+        q->nr_ring_ents = DIV_ROUND_UP(nr_qids - i, exp->num_queues) *
+                          FUSE_RING_QUEUE_DEPTH;
+        q->ring_ents = g_new0(FuseRingEnt, q->nr_ring_ents);
+
+        for (long qid = i; qid < nr_qids; qid += exp->num_queues) {
+            for (int j = 0; j < FUSE_RING_QUEUE_DEPTH; j++) {
+                FuseRingEnt *ent = &q->ring_ents[n++];
+
+                ent->q = q;
+                ent->qid = qid;
+                ent->op_payload = blk_blockalign(exp->common.blk, payload_sz);
+                ent->op_payload_sz = payload_sz;
+                ent->iov[0] = (struct iovec) {
+                    &ent->req_header, sizeof(ent->req_header)
+                };
+                ent->iov[1] = (struct iovec) {
+                    ent->op_payload, ent->op_payload_sz
+                };
+                ent->cmd_op = FUSE_IO_URING_CMD_REGISTER;
+                ent->cqe_handler.cb = fuse_uring_cqe_handler;
+
+                /* Dropped by fuse_uring_cqe_handler() on error */
+                blk_exp_ref(&exp->common);
+            }
+        }
+        assert(n == q->nr_ring_ents);
+
+        aio_bh_schedule_oneshot(q->ctx, fuse_uring_register_bh, q);
+    }
 }
+#endif /* CONFIG_LINUX_IO_URING */
 
 const BlockExportDriver blk_exp_fuse = {
     .type               = BLOCK_EXPORT_TYPE_FUSE,
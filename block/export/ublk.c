@@ -0,0 +1,785 @@
+/*
+ * Export QEMU block device via Linux ublk
+ *
+ * The ublk driver (ublk_drv.ko) creates a host block device /dev/ublkbN whose
+ * requests are served by userspace through io_uring commands on the
+ * character device /dev/ublkcN.  Every hardware queue has a fixed number of
+ * tags; for each tag we keep one UBLK_IO_FETCH_REQ/COMMIT_AND_FETCH_REQ
+ * command in flight, which completes when the kernel has a request for us.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <linux/ublk_cmd.h>
+
+#include "qapi/error.h"
+#include "block/export.h"
+#include "qemu/aio-wait.h"
+#include "qemu/error-report.h"
+#include "qemu/host-utils.h"
+#include "qemu/memalign.h"
+#include "system/block-backend.h"
+#include "util/block-helpers.h"
+#include "ublk.h"
+
+#define UBLK_CONTROL_PATH "/dev/ublk-control"
+#define UBLK_CHAR_DEV_FMT "/dev/ublkc%" PRIu32
+
+#define UBLK_DEFAULT_QUEUE_DEPTH 128
+#define UBLK_MAX_IO_BYTES (512 * KiB)
+
+/* dev_id value letting the kernel pick the device ID */
+#define UBLK_DEV_ID_AUTO UINT32_MAX
+/* queue_id value for control commands that are not for a specific queue */
+#define UBLK_QUEUE_ID_NONE UINT16_MAX
+
+/* The character device appears asynchronously through udev */
+#define UBLK_CHAR_DEV_OPEN_RETRIES 100
+#define UBLK_CHAR_DEV_OPEN_DELAY_US (10 * 1000)
+
+/*
+ * Newer kernels may be built without the legacy command opcodes, so prefer
+ * the ioctl-encoded ones where the headers have them.
+ */
+#ifdef UBLK_U_CMD_ADD_DEV
+#define UBLK_CTRL_OP(op) UBLK_U_CMD_##op
+#define UBLK_IO_OP(op) UBLK_U_IO_##op
+#define UBLK_CTRL_FLAGS UBLK_F_CMD_IOCTL_ENCODE
+#else
+#define UBLK_CTRL_OP(op) UBLK_CMD_##op
+#define UBLK_IO_OP(op) UBLK_IO_##op
+#define UBLK_CTRL_FLAGS 0
+#endif
+
+typedef struct UblkExport UblkExport;
+typedef struct UblkQueue UblkQueue;
+
+/* One tag of a ublk queue, i.e. one request slot */
+typedef struct UblkIo {
+    UblkQueue *q;
+    uint16_t tag;
+
+    /*
+     * Data buffer registered with the kernel, which copies write data into
+     * it before and read data out of it after we process the request
+     */
+    void *buf;
+
+    /* Next command to submit, and the result it commits */
+    uint32_t cmd_op;
+    int32_t result;
+
+    CqeHandler cqe_handler;
+
+    /*
+     * The tag was fetched during a drained section and holds a request that
+     * is processed when the section ends; only accessed from q->ctx
+     */
+    bool parked;
+} UblkIo;
+
+/*
+ * One ublk hardware queue.  The kernel requires all commands for a queue to
+ * be submitted from the same thread, so each queue stays in its AioContext.
+ */
+struct UblkQueue {
+    UblkExport *exp;
+    AioContext *ctx;
+    uint16_t qid;
+
+    /* Request descriptors, indexed by tag; written by the kernel */
+    const struct ublksrv_io_desc *io_descs;
+    size_t io_descs_size;
+
+    UblkIo *ios;
+};
+
+struct UblkExport {
+    BlockExport common;
+
+    int ctrl_fd;
+    int cdev_fd;
+    struct ublksrv_ctrl_dev_info dev_info;
+    bool dev_added;
+
+    UblkQueue *queues;
+    uint16_t num_queues;
+    uint64_t logical_block_size;
+
+    unsigned int in_flight; /* atomic */
+    bool quiesced; /* atomic */
+};
+
+/* A command on /dev/ublk-control, submitted from the main loop */
+typedef struct UblkCtrlCmd {
+    int ctrl_fd;
+    uint32_t cmd_op;
+    const char *name;
+    struct ublksrv_ctrl_cmd cmd;
+
+    /* Asynchronous commands are freed on completion, errors are reported */
+    bool async;
+    bool done;
+    int ret;
+
+    CqeHandler cqe_handler;
+} UblkCtrlCmd;
+
+static void ublk_inc_in_flight(UblkExport *exp)
+{
+    if (qatomic_fetch_inc(&exp->in_flight) == 0) {
+        /* Prevent export from being deleted */
+        blk_exp_ref(&exp->common);
+    }
+}
+
+static void ublk_dec_in_flight(UblkExport *exp)
+{
+    if (qatomic_fetch_dec(&exp->in_flight) == 1) {
+        /* Wake AIO_WAIT_WHILE() */
+        aio_wait_kick();
+
+        /* Now the export can be deleted */
+        blk_exp_unref(&exp->common);
+    }
+}
+
+static void ublk_ctrl_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
+{
+    UblkCtrlCmd *ctrl = opaque;
+
+    io_uring_prep_rw(IORING_OP_URING_CMD, sqe, ctrl->ctrl_fd, NULL, 0, 0);
+    sqe->cmd_op = ctrl->cmd_op;
+    memcpy(sqe->cmd, &ctrl->cmd, sizeof(ctrl->cmd));
+}
+
+static void ublk_ctrl_cqe_handler(CqeHandler *cqe_handler)
+{
+    UblkCtrlCmd *ctrl = container_of(cqe_handler, UblkCtrlCmd, cqe_handler);
+
+    ctrl->ret = cqe_handler->cqe.res;
+    ctrl->done = true;
+
+    if (ctrl->async) {
+        if (ctrl->ret < 0) {
+            error_report("ublk %s failed: %s", ctrl->name,
+                         strerror(-ctrl->ret));
+        }
+        g_free(ctrl);
+    }
+}
+
+/*
+ * Submit a control command and wait for its completion.  Return the
+ * command's result, i.e. 0 on success and -errno on error.
+ */
+static int ublk_ctrl_cmd(UblkExport *exp, uint32_t cmd_op, const char *name,
+                         const struct ublksrv_ctrl_cmd *cmd)
+{
+    UblkCtrlCmd ctrl = {
+        .ctrl_fd = exp->ctrl_fd,
+        .cmd_op = cmd_op,
+        .name = name,
+        .cmd = *cmd,
+        .cqe_handler.cb = ublk_ctrl_cqe_handler,
+    };
+
+    GLOBAL_STATE_CODE();
+
+    aio_add_sqe(ublk_ctrl_prep_sqe, &ctrl, &ctrl.cqe_handler);
+    AIO_WAIT_WHILE_UNLOCKED(NULL, !ctrl.done);
+    return ctrl.ret;
+}
+
+/*
+ * Submit a control command without waiting for it.  Failure is only
+ * reported.  exp->ctrl_fd must stay open until the next main loop
+ * iteration has submitted the command.
+ */
+static void ublk_ctrl_cmd_async(UblkExport *exp, uint32_t cmd_op,
+                                const char *name,
+                                const struct ublksrv_ctrl_cmd *cmd)
+{
+    UblkCtrlCmd *ctrl = g_new(UblkCtrlCmd, 1);
+
+    GLOBAL_STATE_CODE();
+
+    *ctrl = (UblkCtrlCmd) {
+        .ctrl_fd = exp->ctrl_fd,
+        .cmd_op = cmd_op,
+        .name = name,
+        .cmd = *cmd,
+        .async = true,
+        .cqe_handler.cb = ublk_ctrl_cqe_handler,
+    };
+    aio_add_sqe(ublk_ctrl_prep_sqe, ctrl, &ctrl->cqe_handler);
+}
+
+static void ublk_io_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
+{
+    UblkIo *io = opaque;
+    UblkExport *exp = io->q->exp;
+    struct ublksrv_io_cmd cmd = {
+        .q_id = io->q->qid,
+        .tag = io->tag,
+        .result = io->result,
+        .addr = (uintptr_t)io->buf,
+    };
+
+    io_uring_prep_rw(IORING_OP_URING_CMD, sqe, exp->cdev_fd, NULL, 0, 0);
+    sqe->cmd_op = io->cmd_op;
+    memcpy(sqe->cmd, &cmd, sizeof(cmd));
+}
+
+/**
+ * Process the request the kernel has placed into the tag in `opaque`, and
+ * commit the result, which fetches the next request for this tag.
+ *
+ * Assumes the export's in-flight counter has already been incremented.
+ */
+static void coroutine_fn ublk_co_process_io(void *opaque)
+{
+    UblkIo *io = opaque;
+    UblkExport *exp = io->q->exp;
+    BlockBackend *blk = exp->common.blk;
+    /* The kernel will not touch the descriptor until we commit */
+    struct ublksrv_io_desc iod = io->q->io_descs[io->tag];
+    uint32_t flags = ublksrv_get_flags(&iod);
+    int64_t offset = iod.start_sector << BDRV_SECTOR_BITS;
+    int64_t bytes = (int64_t)iod.nr_sectors << BDRV_SECTOR_BITS;
+    int ret;
+
+    switch (ublksrv_get_op(&iod)) {
+    case UBLK_IO_OP_READ:
+        if (bytes > UBLK_MAX_IO_BYTES) {
+            ret = -EINVAL;
+            break;
+        }
+        ret = blk_co_pread(blk, offset, bytes, io->buf, 0);
+        if (ret == 0) {
+            ret = bytes;
+        }
+        break;
+
+    case UBLK_IO_OP_WRITE:
+        if (bytes > UBLK_MAX_IO_BYTES) {
+            ret = -EINVAL;
+            break;
+        }
+        ret = blk_co_pwrite(blk, offset, bytes, io->buf,
+                            flags & UBLK_IO_F_FUA ? BDRV_REQ_FUA : 0);
+        if (ret == 0) {
+            ret = bytes;
+        }
+        break;
+
+    case UBLK_IO_OP_FLUSH:
+        ret = blk_co_flush(blk);
+        break;
+
+    case UBLK_IO_OP_DISCARD:
+        ret = blk_co_pdiscard(blk, offset, bytes);
+        break;
+
+    case UBLK_IO_OP_WRITE_ZEROES:
+        ret = blk_co_pwrite_zeroes(blk, offset, bytes,
+                                   flags & UBLK_IO_F_NOUNMAP ?
+                                   0 : BDRV_REQ_MAY_UNMAP);
+        break;
+
+    default:
+        ret = -EOPNOTSUPP;
+    }
+
+    io->result = ret;
+    io->cmd_op = UBLK_IO_OP(COMMIT_AND_FETCH_REQ);
+    aio_add_sqe(ublk_io_prep_sqe, io, &io->cqe_handler);
+
+    ublk_dec_in_flight(exp);
+}
+
+/*
+ * Start processing the request that the kernel put into the descriptor of
+ * @io.  A fetched tag cannot be handed back to the kernel, so while the
+ * export is drained, @io is only marked as parked and false is returned;
+ * ublk_queue_resume_bh() tries again.  Must run in io->q->ctx.
+ */
+static bool ublk_try_process_io(UblkIo *io)
+{
+    UblkExport *exp = io->q->exp;
+
+    /* Decremented by ublk_co_process_io() */
+    ublk_inc_in_flight(exp);
+
+    /*
+     * Either ublk_exp_drained_poll() sees the request in flight, or we see
+     * the drained section that it is part of
+     */
+    smp_mb__after_rmw();
+
+    if (unlikely(qatomic_read(&exp->quiesced))) {
+        io->parked = true;
+        ublk_dec_in_flight(exp);
+        return false;
+    }
+
+    io->parked = false;
+    qemu_coroutine_enter(qemu_coroutine_create(ublk_co_process_io, io));
+    return true;
+}
+
+static void ublk_io_cqe_handler(CqeHandler *cqe_handler)
+{
+    UblkIo *io = container_of(cqe_handler, UblkIo, cqe_handler);
+    UblkExport *exp = io->q->exp;
+    int ret = cqe_handler->cqe.res;
+
+    if (unlikely(ret < 0)) {
+        /*
+         * The kernel aborts all tags when the device is stopped.  Either
+         * way, this tag will not be used again.
+         */
+        if (ret != UBLK_IO_RES_ABORT) {
+            error_report("ublk I/O command failed: %s", strerror(-ret));
+        }
+        blk_exp_unref(&exp->common);
+        /* Wake ublk_exp_create() waiting for a failed start to be undone */
+        aio_wait_kick();
+        return;
+    }
+
+    ublk_try_process_io(io);
+}
+
+/**
+ * Submit UBLK_IO_FETCH_REQ for all tags of a queue.
+ * Takes a UblkQueue pointer in `opaque`, must run in its AioContext.
+ */
+static void ublk_queue_start_bh(void *opaque)
+{
+    UblkQueue *q = opaque;
+
+    for (uint16_t tag = 0; tag < q->exp->dev_info.queue_depth; tag++) {
+        UblkIo *io = &q->ios[tag];
+
+        aio_add_sqe(ublk_io_prep_sqe, io, &io->cqe_handler);
+    }
+}
+
+/**
+ * Process the tags of a queue that were parked during a drained section.
+ * Takes a UblkQueue pointer in `opaque`, must run in its AioContext.
+ */
+static void ublk_queue_resume_bh(void *opaque)
+{
+    UblkQueue *q = opaque;
+
+    for (uint16_t tag = 0; tag < q->exp->dev_info.queue_depth; tag++) {
+        UblkIo *io = &q->ios[tag];
+
+        /* Stop if the next drained section has already begun */
+        if (io->parked && !ublk_try_process_io(io)) {
+            break;
+        }
+    }
+}
+
+static void ublk_exp_drained_begin(void *opaque)
+{
+    UblkExport *exp = opaque;
+
+    /* Pairs with smp_mb__after_rmw() in ublk_try_process_io() */
+    qatomic_set_mb(&exp->quiesced, true);
+}
+
+static void ublk_exp_drained_end(void *opaque)
+{
+    UblkExport *exp = opaque;
+
+    qatomic_set(&exp->quiesced, false);
+    for (uint16_t i = 0; i < exp->num_queues; i++) {
+        aio_bh_schedule_oneshot(exp->queues[i].ctx, ublk_queue_resume_bh,
+                                &exp->queues[i]);
+    }
+}
+
+static bool ublk_exp_drained_poll(void *opaque)
+{
+    UblkExport *exp = opaque;
+
+    return qatomic_read(&exp->in_flight) > 0;
+}
+
+static const BlockDevOps ublk_blk_dev_ops = {
+    .drained_begin = ublk_exp_drained_begin,
+    .drained_end   = ublk_exp_drained_end,
+    .drained_poll  = ublk_exp_drained_poll,
+};
+
+static int ublk_set_params(UblkExport *exp, bool writable, int64_t length,
+                           Error **errp)
+{
+    uint8_t bs_shift = ctz64(exp->logical_block_size);
+    struct ublk_params params = {
+        .len = sizeof(params),
+        .types = UBLK_PARAM_TYPE_BASIC,
+        .basic = {
+            .logical_bs_shift = bs_shift,
+            .physical_bs_shift = bs_shift,
+            .io_opt_shift = bs_shift,
+            .io_min_shift = bs_shift,
+            .max_sectors = UBLK_MAX_IO_BYTES >> BDRV_SECTOR_BITS,
+            .dev_sectors = length >> BDRV_SECTOR_BITS,
+        },
+    };
+    struct ublksrv_ctrl_cmd cmd = {
+        .dev_id = exp->dev_info.dev_id,
+        .queue_id = UBLK_QUEUE_ID_NONE,
+        .addr = (uintptr_t)&params,
+        .len = sizeof(params),
+    };
+    int ret;
+
+    if (!writable) {
+        params.basic.attrs |= UBLK_ATTR_READ_ONLY;
+    } else {
+        params.types |= UBLK_PARAM_TYPE_DISCARD;
+        params.discard = (struct ublk_param_discard) {
+            .discard_granularity = exp->logical_block_size,
+            .max_discard_sectors = BDRV_REQUEST_MAX_SECTORS,
+            .max_write_zeroes_sectors = BDRV_REQUEST_MAX_SECTORS,
+            .max_discard_segments = 1,
+        };
+    }
+    if (blk_enable_write_cache(exp->common.blk)) {
+        params.basic.attrs |= UBLK_ATTR_VOLATILE_CACHE | UBLK_ATTR_FUA;
+    }
+
+    ret = ublk_ctrl_cmd(exp, UBLK_CTRL_OP(SET_PARAMS), "SET_PARAMS", &cmd);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to set ublk device parameters");
+        return ret;
+    }
+    return 0;
+}
+
+/* State of the timer that retries opening the character device */
+typedef struct UblkCharDevOpen {
+    UblkExport *exp;
+    const char *path;
+    QEMUTimer timer;
+    int retries;
+    int err;
+    bool done;
+} UblkCharDevOpen;
+
+static void ublk_open_char_dev_cb(void *opaque)
+{
+    UblkCharDevOpen *o = opaque;
+
+    o->exp->cdev_fd = qemu_open_old(o->path, O_RDWR);
+    o->err = errno;
+    if (o->exp->cdev_fd < 0 && o->err == ENOENT && o->retries-- > 0) {
+        timer_mod(&o->timer, qemu_clock_get_us(QEMU_CLOCK_REALTIME) +
+                             UBLK_CHAR_DEV_OPEN_DELAY_US);
+        return;
+    }
+    o->done = true;
+}
+
+static int ublk_open_char_dev(UblkExport *exp, Error **errp)
+{
+    g_autofree char *path = g_strdup_printf(UBLK_CHAR_DEV_FMT,
+                                            exp->dev_info.dev_id);
+    UblkCharDevOpen o = {
+        .exp = exp,
+        .path = path,
+        .retries = UBLK_CHAR_DEV_OPEN_RETRIES - 1,
+    };
+
+    /* Keep the main AioContext running while we wait for the device */
+    aio_timer_init(qemu_get_aio_context(), &o.timer, QEMU_CLOCK_REALTIME,
+                   SCALE_US, ublk_open_char_dev_cb, &o);
+    ublk_open_char_dev_cb(&o);
+    AIO_WAIT_WHILE_UNLOCKED(NULL, !o.done);
+    timer_del(&o.timer);
+
+    if (exp->cdev_fd < 0) {
+        error_setg_errno(errp, o.err, "Failed to open %s", path);
+        return -o.err;
+    }
+    return 0;
+}
+
+static int ublk_queue_init(UblkQueue *q, Error **errp)
+{
+    UblkExport *exp = q->exp;
+    uint16_t depth = exp->dev_info.queue_depth;
+    size_t max_descs_size = ROUND_UP(UBLK_MAX_QUEUE_DEPTH *
+                                     sizeof(struct ublksrv_io_desc),
+                                     qemu_real_host_page_size());
+    void *descs;
+
+    q->io_descs_size = ROUND_UP(depth * sizeof(struct ublksrv_io_desc),
+                                qemu_real_host_page_size());
+    descs = mmap(NULL, q->io_descs_size, PROT_READ, MAP_SHARED | MAP_POPULATE,
+                 exp->cdev_fd,
+                 UBLKSRV_CMD_BUF_OFFSET + q->qid * max_descs_size);
+    if (descs == MAP_FAILED) {
+        int ret = -errno;
+        error_setg_errno(errp, -ret,
+                         "Failed to map ublk request descriptors of queue %"
+                         PRIu16, q->qid);
+        return ret;
+    }
+    q->io_descs = descs;
+
+    q->ios = g_new0(UblkIo, depth);
+    for (uint16_t tag = 0; tag < depth; tag++) {
+        q->ios[tag] = (UblkIo) {
+            .q = q,
+            .tag = tag,
+            .buf = blk_blockalign(exp->common.blk, UBLK_MAX_IO_BYTES),
+            .cmd_op = UBLK_IO_OP(FETCH_REQ),
+            .cqe_handler.cb = ublk_io_cqe_handler,
+        };
+    }
+    return 0;
+}
+
+/*
+ * Stop the device.  The kernel then aborts all outstanding tags, which drops
+ * their export references.
+ */
+static void ublk_stop_dev(UblkExport *exp, bool wait)
+{
+    struct ublksrv_ctrl_cmd cmd = {
+        .dev_id = exp->dev_info.dev_id,
+        .queue_id = UBLK_QUEUE_ID_NONE,
+    };
+    int ret;
+
+    if (!wait) {
+        ublk_ctrl_cmd_async(exp, UBLK_CTRL_OP(STOP_DEV), "STOP_DEV", &cmd);
+        return;
+    }
+
+    ret = ublk_ctrl_cmd(exp, UBLK_CTRL_OP(STOP_DEV), "STOP_DEV", &cmd);
+    if (ret < 0) {
+        error_report("Failed to stop ublk device %" PRIu32 ": %s",
+                     exp->dev_info.dev_id, strerror(-ret));
+    }
+}
+
+static void ublk_exp_delete(BlockExport *blk_exp)
+{
+    UblkExport *exp = container_of(blk_exp, UblkExport, common);
+
+    assert(qatomic_read(&exp->in_flight) == 0);
+
+    for (uint16_t i = 0; exp->queues && i < exp->num_queues; i++) {
+        UblkQueue *q = &exp->queues[i];
+
+        if (q->io_descs) {
+            munmap((void *)q->io_descs, q->io_descs_size);
+        }
+        for (uint16_t tag = 0; q->ios && tag < exp->dev_info.queue_depth;
+             tag++) {
+            qemu_vfree(q->ios[tag].buf);
+        }
+        g_free(q->ios);
+    }
+    g_free(exp->queues);
+
+    /* The kernel only completes DEL_DEV once the character device is gone */
+    if (exp->cdev_fd >= 0) {
+        close(exp->cdev_fd);
+    }
+
+    if (exp->dev_added) {
+        struct ublksrv_ctrl_cmd cmd = {
+            .dev_id = exp->dev_info.dev_id,
+            .queue_id = UBLK_QUEUE_ID_NONE,
+        };
+        int ret;
+
+        ret = ublk_ctrl_cmd(exp, UBLK_CTRL_OP(DEL_DEV), "DEL_DEV", &cmd);
+        if (ret < 0) {
+            error_report("Failed to delete ublk device %" PRIu32 ": %s",
+                         exp->dev_info.dev_id, strerror(-ret));
+        }
+    }
+
+    if (exp->ctrl_fd >= 0) {
+        close(exp->ctrl_fd);
+    }
+}
+
+static int ublk_exp_create(BlockExport *blk_exp, BlockExportOptions *opts,
+                           AioContext *const *multithread, size_t mt_count,
+                           Error **errp)
+{
+    UblkExport *exp = container_of(blk_exp, UblkExport, common);
+    BlockExportOptionsUblk *ublk_opts = &opts->u.ublk;
+    uint16_t queue_depth = UBLK_DEFAULT_QUEUE_DEPTH;
+    struct ublksrv_ctrl_cmd cmd;
+    int64_t length;
+    int ret;
+
+    exp->ctrl_fd = -1;
+    exp->cdev_fd = -1;
+    exp->logical_block_size = BDRV_SECTOR_SIZE;
+
+    if (ublk_opts->has_queue_depth) {
+        queue_depth = ublk_opts->queue_depth;
+        if (queue_depth == 0 || queue_depth > UBLK_MAX_QUEUE_DEPTH) {
+            error_setg(errp, "queue-depth must be between 1 and %d",
+                       UBLK_MAX_QUEUE_DEPTH);
+            return -EINVAL;
+        }
+    }
+
+    if (ublk_opts->has_logical_block_size) {
+        exp->logical_block_size = ublk_opts->logical_block_size;
+        if (!check_block_size("logical-block-size", exp->logical_block_size,
+                              errp)) {
+            return -EINVAL;
+        }
+    }
+
+    /* Control commands carry a 32-byte payload and need 128-byte SQEs */
+    if (!aio_has_io_uring_sqe128()) {
+        error_setg(errp, "ublk export requires io_uring with 128-byte SQEs");
+        return -ENOTSUP;
+    }
+
+    length = blk_getlength(blk_exp->blk);
+    if (length < 0) {
+        error_setg_errno(errp, -length, "Failed to get the export length");
+        return length;
+    }
+
+    if (multithread) {
+        /* Guaranteed by common export code */
+        assert(mt_count >= 1);
+
+        if (mt_count > UINT16_MAX) {
+            error_setg(errp, "Too many I/O threads for a ublk export");
+            return -EINVAL;
+        }
+        exp->num_queues = mt_count;
+    } else {
+        exp->num_queues = 1;
+    }
+
+    exp->queues = g_new0(UblkQueue, exp->num_queues);
+    for (uint16_t i = 0; i < exp->num_queues; i++) {
+        exp->queues[i] = (UblkQueue) {
+            .exp = exp,
+            .ctx = multithread ? multithread[i] : blk_exp->ctx,
+            .qid = i,
+        };
+    }
+
+    exp->ctrl_fd = qemu_open(UBLK_CONTROL_PATH, O_RDWR, errp);
+    if (exp->ctrl_fd < 0) {
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    exp->dev_info = (struct ublksrv_ctrl_dev_info) {
+        .nr_hw_queues = exp->num_queues,
+        .queue_depth = queue_depth,
+        .max_io_buf_bytes = UBLK_MAX_IO_BYTES,
+        .dev_id = ublk_opts->has_dev_id ? ublk_opts->dev_id : UBLK_DEV_ID_AUTO,
+        .ublksrv_pid = getpid(),
+        .flags = UBLK_CTRL_FLAGS,
+    };
+    cmd = (struct ublksrv_ctrl_cmd) {
+        .dev_id = exp->dev_info.dev_id,
+        .queue_id = UBLK_QUEUE_ID_NONE,
+        .addr = (uintptr_t)&exp->dev_info,
+        .len = sizeof(exp->dev_info),
+    };
+    ret = ublk_ctrl_cmd(exp, UBLK_CTRL_OP(ADD_DEV), "ADD_DEV", &cmd);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to add ublk device");
+        goto fail;
+    }
+    exp->dev_added = true;
+
+    ret = ublk_set_params(exp, opts->writable, length, errp);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    ret = ublk_open_char_dev(exp, errp);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    for (uint16_t i = 0; i < exp->num_queues; i++) {
+        ret = ublk_queue_init(&exp->queues[i], errp);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    blk_set_dev_ops(blk_exp->blk, &ublk_blk_dev_ops, exp);
+
+    /*
+     * We handle draining ourselves using an in-flight counter and by parking
+     * requests. Do not queue BlockBackend requests, they need to complete so
+     * the in-flight counter reaches zero.
+     */
+    blk_set_disable_request_queuing(blk_exp->blk, true);
+
+    for (uint16_t i = 0; i < exp->num_queues; i++) {
+        /* Dropped by ublk_io_cqe_handler() when the tag is aborted */
+        for (uint16_t tag = 0; tag < exp->dev_info.queue_depth; tag++) {
+            blk_exp_ref(blk_exp);
+        }
+        aio_bh_schedule_oneshot(exp->queues[i].ctx, ublk_queue_start_bh,
+                                &exp->queues[i]);
+    }
+
+    /* The kernel completes START_DEV once every tag has been fetched */
+    cmd = (struct ublksrv_ctrl_cmd) {
+        .dev_id = exp->dev_info.dev_id,
+        .queue_id = UBLK_QUEUE_ID_NONE,
+        .data[0] = getpid(),
+    };
+    ret = ublk_ctrl_cmd(exp, UBLK_CTRL_OP(START_DEV), "START_DEV", &cmd);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to start ublk device");
+
+        /* The caller frees the export, so all tags must be back */
+        ublk_stop_dev(exp, true);
+        AIO_WAIT_WHILE_UNLOCKED(NULL, qatomic_read(&blk_exp->refcount) > 1);
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    ublk_exp_delete(blk_exp);
+    return ret;
+}
+
+/* Called with exp->ctx acquired */
+static void ublk_exp_request_shutdown(BlockExport *blk_exp)
+{
+    UblkExport *exp = container_of(blk_exp, UblkExport, common);
+
+    ublk_stop_dev(exp, false);
+}
+
+const BlockExportDriver blk_exp_ublk = {
+    .type               = BLOCK_EXPORT_TYPE_UBLK,
+    .instance_size      = sizeof(UblkExport),
+    .create             = ublk_exp_create,
+    .delete             = ublk_exp_delete,
+    .request_shutdown   = ublk_exp_request_shutdown,
+};
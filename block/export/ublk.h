@@ -0,0 +1,15 @@
+/*
+ * Export QEMU block device via Linux ublk
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#ifndef UBLK_H
+#define UBLK_H
+
+#include "block/export.h"
+
+extern const BlockExportDriver blk_exp_ublk;
+
+#endif /* UBLK_H */
@@ -3918,6 +3918,19 @@ static void raw_abort_perm_update(BlockDriverState *bs)
     raw_handle_perm_lock(bs, RAW_PL_ABORT, 0, 0, NULL);
 }
 
+static int coroutine_fn raw_co_get_data_fd(BlockDriverState *bs,
+                                           int64_t *offset, int64_t bytes)
+{
+    BDRVRawState *s = bs->opaque;
+
+    /* Readers like sendfile(2) go through the page cache */
+    if (bs->open_flags & BDRV_O_NOCACHE) {
+        return -ENOTSUP;
+    }
+
+    return s->fd;
+}
+
 static int coroutine_fn GRAPH_RDLOCK raw_co_copy_range_from(
         BlockDriverState *bs, BdrvChild *src, int64_t src_offset,
         BdrvChild *dst, int64_t dst_offset, int64_t bytes,
@@ -3989,6 +4002,7 @@ BlockDriver bdrv_file = {
     .bdrv_co_pdiscard       = raw_co_pdiscard,
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
+    .bdrv_co_get_data_fd    = raw_co_get_data_fd,
     .bdrv_refresh_limits = raw_refresh_limits,
 
     .bdrv_co_truncate                   = raw_co_truncate,
@@ -3578,6 +3578,32 @@ int coroutine_fn bdrv_co_copy_range(BdrvChild *src, int64_t src_offset,
                                    bytes, read_flags, write_flags);
 }
 
+int coroutine_fn bdrv_co_get_data_fd(BdrvChild *child, int64_t *offset,
+                                     int64_t bytes)
+{
+    BlockDriverState *bs = child ? child->bs : NULL;
+    int ret;
+
+    IO_CODE();
+    assert_bdrv_graph_readable();
+
+    if (!bs || !bs->drv) {
+        return -ENOMEDIUM;
+    }
+
+    ret = bdrv_check_request(*offset, bytes, NULL);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* Copy-on-read needs the data to pass through the block layer */
+    if (!bs->drv->bdrv_co_get_data_fd || qatomic_read(&bs->copy_on_read)) {
+        return -ENOTSUP;
+    }
+
+    return bs->drv->bdrv_co_get_data_fd(bs, offset, bytes);
+}
+
 void coroutine_fn bdrv_co_parent_cb_resize(BlockDriverState *bs)
 {
     BdrvChild *c;
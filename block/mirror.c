@@ -28,6 +28,7 @@
 #define MAX_IN_FLIGHT 16
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
 #define DEFAULT_MIRROR_BUF_SIZE (MAX_IN_FLIGHT * MAX_IO_BYTES)
+#define MAX_IN_FLIGHT_LIMIT 256
 
 /* The mirroring buffer is a list of granularity-sized chunks.
  * Free chunks are organized in a list.
@@ -89,6 +90,10 @@ typedef struct MirrorBlockJob {
     bool unmap;
     int target_cluster_size;
     int max_iov;
+    /* Maximum number of copy operations in flight */
+    int max_in_flight;
+    /* Try copy offloading, cleared on the first failure */
+    bool use_copy_range;
     bool initial_zeroing_ongoing;
     int in_active_write_counter;
     int64_t active_write_bytes_in_flight;
@@ -377,6 +382,34 @@ static void coroutine_fn mirror_co_read(void *opaque)
     assert(QEMU_IS_ALIGNED(op->offset, s->granularity));
     /* The range is sector-aligned, since bdrv_getlength() rounds up. */
     assert(QEMU_IS_ALIGNED(op->bytes, BDRV_SECTOR_SIZE));
+
+    if (s->use_copy_range) {
+        s->in_flight++;
+        s->bytes_in_flight += op->bytes;
+        op->is_in_flight = true;
+        trace_mirror_one_iteration(s, op->offset, op->bytes);
+
+        WITH_GRAPH_RDLOCK_GUARD() {
+            ret = blk_co_copy_range_from(s->mirror_top_bs->backing, op->offset,
+                                         s->target, op->offset, op->bytes,
+                                         0, 0);
+        }
+        if (ret >= 0) {
+            mirror_write_complete(op, ret);
+            return;
+        }
+
+        /*
+         * Fall back to copying through the buffer, which also reports any
+         * error that is not caused by the offloading itself
+         */
+        trace_mirror_copy_range_fail(s, op->offset, ret);
+        s->use_copy_range = false;
+        s->in_flight--;
+        s->bytes_in_flight -= op->bytes;
+        op->is_in_flight = false;
+    }
+
     nb_chunks = DIV_ROUND_UP(op->bytes, s->granularity);
 
     while (s->buf_free_count < nb_chunks) {
@@ -526,7 +559,7 @@ static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
     /* At least the first dirty chunk is mirrored in one iteration. */
     int nb_chunks = 1;
     bool write_zeroes_ok = bdrv_can_write_zeroes_with_unmap(blk_bs(s->target));
-    int max_io_bytes = MAX(s->buf_size / MAX_IN_FLIGHT, MAX_IO_BYTES);
+    int max_io_bytes = MAX(s->buf_size / s->max_in_flight, MAX_IO_BYTES);
 
     bdrv_graph_co_rdlock();
     source = s->mirror_top_bs->backing->bs;
@@ -639,7 +672,7 @@ static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
             }
         }
 
-        while (s->in_flight >= MAX_IN_FLIGHT) {
+        while (s->in_flight >= s->max_in_flight) {
             trace_mirror_yield_in_flight(s, offset, s->in_flight);
             mirror_wait_for_free_in_flight_slot(s);
         }
@@ -954,7 +987,7 @@ static int coroutine_fn GRAPH_UNLOCKED mirror_dirty_init(MirrorBlockJob *s)
                 return 0;
             }
 
-            if (s->in_flight >= MAX_IN_FLIGHT) {
+            if (s->in_flight >= s->max_in_flight) {
                 trace_mirror_yield(s, UINT64_MAX, s->buf_free_count,
                                    s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
@@ -1160,7 +1193,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
         }
         if (delta < BLOCK_JOB_SLICE_TIME &&
             iostatus == BLOCK_DEVICE_IO_STATUS_OK) {
-            if (s->in_flight >= MAX_IN_FLIGHT || s->buf_free_count == 0 ||
+            if (s->in_flight >= s->max_in_flight || s->buf_free_count == 0 ||
                 (cnt == 0 && s->in_flight > 0)) {
                 trace_mirror_yield(s, cnt, s->buf_free_count, s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
@@ -1844,7 +1877,7 @@ static BlockJob *mirror_start_job(
                              BlockDriverState *base,
                              bool auto_complete, const char *filter_node_name,
                              bool is_mirror, MirrorCopyMode copy_mode,
-                             bool base_ro,
+                             bool base_ro, const MirrorPerf *perf,
                              Error **errp)
 {
     MirrorBlockJob *s;
@@ -1852,6 +1885,7 @@ static BlockJob *mirror_start_job(
     BlockDriverState *mirror_top_bs;
     bool target_is_backing;
     uint64_t target_perms, target_shared_perms;
+    int max_in_flight;
     int ret;
 
     GLOBAL_STATE_CODE();
@@ -1867,8 +1901,22 @@ static BlockJob *mirror_start_job(
         return NULL;
     }
 
+    if (perf && perf->has_max_in_flight) {
+        if (perf->max_in_flight < 1 ||
+            perf->max_in_flight > MAX_IN_FLIGHT_LIMIT) {
+            error_setg(errp, "max-in-flight must be between 1 and %d",
+                       MAX_IN_FLIGHT_LIMIT);
+            return NULL;
+        }
+        max_in_flight = perf->max_in_flight;
+    } else {
+        max_in_flight = MAX_IN_FLIGHT;
+    }
+
     if (buf_size == 0) {
-        buf_size = DEFAULT_MIRROR_BUF_SIZE;
+        /* Give each operation of a deeper queue a buffer of its own */
+        buf_size = MAX(DEFAULT_MIRROR_BUF_SIZE,
+                       (int64_t)max_in_flight * MAX_IO_BYTES);
     }
 
     bdrv_graph_rdlock_main_loop();
@@ -2030,6 +2078,9 @@ static BlockJob *mirror_start_job(
     s->base_overlay = bdrv_find_overlay(bs, base);
     s->granularity = granularity;
     s->buf_size = ROUND_UP(buf_size, granularity);
+    s->max_in_flight = max_in_flight;
+    s->use_copy_range = perf && perf->has_use_copy_range &&
+                        perf->use_copy_range;
     s->dirty_bitmap = bs_opaque->dirty_bitmap;
     s->unmap = unmap;
     if (auto_complete) {
@@ -2144,7 +2195,8 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                   BlockdevOnError on_source_error,
                   BlockdevOnError on_target_error,
                   bool unmap, const char *filter_node_name,
-                  MirrorCopyMode copy_mode, Error **errp)
+                  MirrorCopyMode copy_mode, const MirrorPerf *perf,
+                  Error **errp)
 {
     BlockDriverState *base;
 
@@ -2165,7 +2217,7 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                      speed, granularity, buf_size, mode, backing_mode,
                      target_is_zero, on_source_error, on_target_error, unmap,
                      NULL, NULL, &mirror_job_driver, base, false,
-                     filter_node_name, true, copy_mode, false, errp);
+                     filter_node_name, true, copy_mode, false, perf, errp);
 }
 
 BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
@@ -2194,7 +2246,7 @@ BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
                      on_error, on_error, true, cb, opaque,
                      &commit_active_job_driver, base, auto_complete,
                      filter_node_name, false, MIRROR_COPY_MODE_BACKGROUND,
-                     base_read_only, errp);
+                     base_read_only, NULL, errp);
     if (!job) {
         goto error_restore_flags;
     }
@@ -50,7 +50,10 @@ typedef struct BDRVNVMeState BDRVNVMeState;
 #define INDEX_ADMIN     0
 #define INDEX_IO(n)     (1 + n)
 
-/* This driver shares a single MSIX IRQ for the admin and I/O queues */
+/*
+ * This driver shares a single MSIX IRQ for the admin queue and the first I/O
+ * queue.  Every further I/O queue INDEX_IO(n) has its own MSIX vector n.
+ */
 enum {
     MSIX_SHARED_IRQ_IDX = 0,
     MSIX_IRQ_COUNT = 1
@@ -65,9 +68,11 @@ typedef struct {
 } NVMeQueue;
 
 typedef struct {
-    /* Called from nvme_process_completion() in the BDS's main AioContext */
+    /* Called from nvme_process_completion() in the queue's AioContext */
     BlockCompletionFunc *cb;
     void *opaque;
+    /* If not NULL, receives dword 0 of the completion before cb() runs */
+    uint32_t *result;
     int cid;
     void *prp_list_page;
     uint64_t prp_list_iova;
@@ -80,6 +85,17 @@ typedef struct {
     /* Read from I/O code path, initialized under BQL */
     BDRVNVMeState   *s;
     int             index;
+    /* Interrupt of queues that do not use MSIX_SHARED_IRQ_IDX */
+    EventNotifier   *irq_notifier;
+
+    /*
+     * AioContext that kicks the queue and processes its completions.  The
+     * admin queue and the first I/O queue run in the BDS's main AioContext,
+     * the other I/O queues are claimed by the first AioContext that submits
+     * a request and released under BQL when they have no users.  Those two
+     * changes are made with @lock held, and the pointer is set atomically.
+     */
+    AioContext  *aio_context;
 
     /* Fields protected by BQL */
     uint8_t     *prp_list_pages;
@@ -93,8 +109,10 @@ typedef struct {
     NVMeRequest reqs[NVME_NUM_REQS];
     int         need_kick;
     int         inflight;
+    /* Requests between nvme_get_io_queue() and nvme_put_io_queue() */
+    int         users;
 
-    /* Thread-safe, no lock necessary; runs in the BDS's main context */
+    /* Thread-safe, no lock necessary; runs in @aio_context */
     QEMUBH      *completion_bh;
 } NVMeQueuePair;
 
@@ -118,6 +136,9 @@ struct BDRVNVMeState {
     size_t doorbell_scale;
     bool write_cache_supported;
     EventNotifier irq_notifier[MSIX_IRQ_COUNT];
+    /* MSIX vectors 1..nr_queue_irqs of the I/O queues after the first one */
+    EventNotifier *queue_irq_notifiers;
+    unsigned nr_queue_irqs;
 
     uint64_t nsze; /* Namespace size reported by identify command */
     int nsid;      /* The namespace id to read/write data. */
@@ -146,6 +167,7 @@ struct BDRVNVMeState {
 
 #define NVME_BLOCK_OPT_DEVICE "device"
 #define NVME_BLOCK_OPT_NAMESPACE "namespace"
+#define NVME_BLOCK_OPT_NUM_QUEUES "num-queues"
 
 static void nvme_process_completion_bh(void *opaque);
 
@@ -163,6 +185,11 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "NVMe namespace",
         },
+        {
+            .name = NVME_BLOCK_OPT_NUM_QUEUES,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of I/O queue pairs",
+        },
         { /* end of list */ }
     },
 };
@@ -208,7 +235,7 @@ static void nvme_free_queue_pair(NVMeQueuePair *q)
     g_free(q);
 }
 
-/* Runs in the BDS's main AioContext */
+/* Runs in q->aio_context */
 static void nvme_free_req_queue_cb(void *opaque)
 {
     NVMeQueuePair *q = opaque;
@@ -252,7 +279,11 @@ static NVMeQueuePair *nvme_create_queue_pair(BDRVNVMeState *s,
     q->s = s;
     q->index = idx;
     qemu_co_queue_init(&q->free_req_queue);
-    q->completion_bh = aio_bh_new(aio_context, nvme_process_completion_bh, q);
+    if (aio_context) {
+        q->aio_context = aio_context;
+        q->completion_bh = aio_bh_new(aio_context,
+                                      nvme_process_completion_bh, q);
+    }
     r = qemu_vfio_dma_map(s->vfio, q->prp_list_pages, bytes,
                           false, &prp_list_iova, errp);
     if (r) {
@@ -285,7 +316,7 @@ fail:
     return NULL;
 }
 
-/* With q->lock, must be run in the BDS's main AioContext */
+/* With q->lock, must be run in q->aio_context */
 static void nvme_kick(NVMeQueuePair *q)
 {
     BDRVNVMeState *s = q->s;
@@ -354,7 +385,7 @@ static void nvme_put_free_req_locked(NVMeQueuePair *q, NVMeRequest *req)
 static void nvme_wake_free_req_locked(NVMeQueuePair *q)
 {
     if (!qemu_co_queue_empty(&q->free_req_queue)) {
-        replay_bh_schedule_oneshot_event(q->s->aio_context,
+        replay_bh_schedule_oneshot_event(qatomic_read(&q->aio_context),
                 nvme_free_req_queue_cb, q);
     }
 }
@@ -390,17 +421,23 @@ static inline int nvme_translate_error(const NvmeCqe *c)
     }
 }
 
-/* With q->lock, must be run in the BDS's main AioContext */
+/* With q->lock, must be run in q->aio_context */
 static bool nvme_process_completion(NVMeQueuePair *q)
 {
     BDRVNVMeState *s = q->s;
     bool progress = false;
+    bool released = false;
     NVMeRequest *preq;
     NVMeRequest req;
     NvmeCqe *c;
 
     trace_nvme_process_completion(s, q->index, q->inflight);
 
+    /* A stale event or BH, @q was released by nvme_drain_end() */
+    if (qatomic_read(&q->aio_context) != qemu_get_current_aio_context()) {
+        return false;
+    }
+
     /*
      * Support re-entrancy when a request cb() function invokes aio_poll().
      * Pending completions must be visible to aio_poll() so that a cb()
@@ -440,13 +477,26 @@ static bool nvme_process_completion(NVMeQueuePair *q)
         req = *preq;
         assert(req.cid == cid);
         assert(req.cb);
+        if (req.result) {
+            *req.result = le32_to_cpu(c->result);
+        }
         nvme_put_free_req_locked(q, preq);
         preq->cb = preq->opaque = NULL;
+        preq->result = NULL;
         q->inflight--;
         qemu_mutex_unlock(&q->lock);
         req.cb(req.opaque, ret);
         qemu_mutex_lock(&q->lock);
         progress = true;
+
+        /*
+         * The callback may have ended the last use of @q, so that
+         * nvme_drain_end() released it while the lock was dropped.
+         */
+        if (qatomic_read(&q->aio_context) != qemu_get_current_aio_context()) {
+            released = true;
+            break;
+        }
     }
     if (progress) {
         /* Notify the device so it can post more completions. */
@@ -455,12 +505,14 @@ static bool nvme_process_completion(NVMeQueuePair *q)
         nvme_wake_free_req_locked(q);
     }
 
-    qemu_bh_cancel(q->completion_bh);
+    if (!released) {
+        qemu_bh_cancel(q->completion_bh);
+    }
 
     return progress;
 }
 
-/* As q->completion_bh, runs in the BDS's main AioContext */
+/* As q->completion_bh, runs in q->aio_context */
 static void nvme_process_completion_bh(void *opaque)
 {
     NVMeQueuePair *q = opaque;
@@ -491,7 +543,7 @@ static void nvme_trace_command(const NvmeCmd *cmd)
     }
 }
 
-/* Must be run in the BDS's main AioContext */
+/* Must be run in q->aio_context */
 static void nvme_kick_and_check_completions(void *opaque)
 {
     NVMeQueuePair *q = opaque;
@@ -505,12 +557,12 @@ static void nvme_kick_and_check_completions(void *opaque)
 static void nvme_deferred_fn(void *opaque)
 {
     NVMeQueuePair *q = opaque;
+    AioContext *ctx = qatomic_read(&q->aio_context);
 
-    if (qemu_get_current_aio_context() == q->s->aio_context) {
+    if (qemu_get_current_aio_context() == ctx) {
         nvme_kick_and_check_completions(q);
     } else {
-        aio_bh_schedule_oneshot(q->s->aio_context,
-                                nvme_kick_and_check_completions, q);
+        aio_bh_schedule_oneshot(ctx, nvme_kick_and_check_completions, q);
     }
 }
 
@@ -544,8 +596,12 @@ static void nvme_admin_cmd_sync_cb(void *opaque, int ret)
     aio_wait_kick();
 }
 
-/* Must be run in the BDS's or qemu's main AioContext */
-static int nvme_admin_cmd_sync(BlockDriverState *bs, NvmeCmd *cmd)
+/*
+ * Must be run in the BDS's or qemu's main AioContext.  If @result is not
+ * NULL, it receives dword 0 of the completion.
+ */
+static int nvme_admin_cmd_sync_result(BlockDriverState *bs, NvmeCmd *cmd,
+                                      uint32_t *result)
 {
     BDRVNVMeState *s = bs->opaque;
     NVMeQueuePair *q = s->queues[INDEX_ADMIN];
@@ -556,12 +612,19 @@ static int nvme_admin_cmd_sync(BlockDriverState *bs, NvmeCmd *cmd)
     if (!req) {
         return -EBUSY;
     }
+    req->result = result;
     nvme_submit_command(q, req, cmd, nvme_admin_cmd_sync_cb, &ret);
 
     AIO_WAIT_WHILE(aio_context, ret == -EINPROGRESS);
     return ret;
 }
 
+/* Must be run in the BDS's or qemu's main AioContext */
+static int nvme_admin_cmd_sync(BlockDriverState *bs, NvmeCmd *cmd)
+{
+    return nvme_admin_cmd_sync_result(bs, cmd, NULL);
+}
+
 /* Returns true on success, false on failure. */
 static bool nvme_identify(BlockDriverState *bs, int namespace, Error **errp)
 {
@@ -653,7 +716,7 @@ out:
     return ret;
 }
 
-/* Must be run in the BDS's main AioContext */
+/* Must be run in q->aio_context */
 static void nvme_poll_queue(NVMeQueuePair *q)
 {
     const size_t cqe_offset = q->cq.head * NVME_CQ_ENTRY_BYTES;
@@ -681,7 +744,8 @@ static void nvme_poll_queues(BDRVNVMeState *s)
 {
     int i;
 
-    for (i = 0; i < s->queue_count; i++) {
+    /* Only the queues on MSIX_SHARED_IRQ_IDX run in this AioContext */
+    for (i = 0; i < MIN(s->queue_count, INDEX_IO(1)); i++) {
         nvme_poll_queue(s->queues[i]);
     }
 }
@@ -697,25 +761,63 @@ static void nvme_handle_event(EventNotifier *n)
     nvme_poll_queues(s);
 }
 
+/*
+ * Ask the controller for @num_queues I/O queue pairs, and return how many
+ * it allocated (at most @num_queues), or 0 on error.  Must be called
+ * before any I/O queue is created.
+ */
+static unsigned nvme_set_num_queues(BlockDriverState *bs, unsigned num_queues,
+                                    Error **errp)
+{
+    BDRVNVMeState *s = bs->opaque;
+    uint32_t result;
+    unsigned nsqa, ncqa;
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_SET_FEATURES,
+        .cdw10 = cpu_to_le32(NVME_NUMBER_OF_QUEUES),
+        /* NCQR and NSQR, both 0's based */
+        .cdw11 = cpu_to_le32(((num_queues - 1) << 16) | (num_queues - 1)),
+    };
+
+    assert(num_queues >= 1 && num_queues <= UINT16_MAX);
+    if (nvme_admin_cmd_sync_result(bs, &cmd, &result)) {
+        error_setg(errp, "Failed to set the number of I/O queues");
+        return 0;
+    }
+
+    /* NSQA and NCQA, both 0's based; the controller may allocate more */
+    nsqa = extract32(result, 0, 16) + 1;
+    ncqa = extract32(result, 16, 16) + 1;
+    trace_nvme_set_num_queues(s, num_queues, nsqa, ncqa);
+    return MIN(num_queues, MIN(nsqa, ncqa));
+}
+
 static bool nvme_add_io_queue(BlockDriverState *bs, Error **errp)
 {
     BDRVNVMeState *s = bs->opaque;
     unsigned n = s->queue_count;
+    /* MSIX vector, see MSIX_SHARED_IRQ_IDX */
+    unsigned iv = n - INDEX_IO(0);
     NVMeQueuePair *q;
     NvmeCmd cmd;
     unsigned queue_size = NVME_QUEUE_SIZE;
 
     assert(n <= UINT16_MAX);
-    q = nvme_create_queue_pair(s, bdrv_get_aio_context(bs),
+    /* Queues after the first one get their AioContext in nvme_get_io_queue() */
+    q = nvme_create_queue_pair(s, iv ? NULL : bdrv_get_aio_context(bs),
                                n, queue_size, errp);
     if (!q) {
         return false;
     }
+    if (iv) {
+        assert(iv <= s->nr_queue_irqs);
+        q->irq_notifier = &s->queue_irq_notifiers[iv - 1];
+    }
     cmd = (NvmeCmd) {
         .opcode = NVME_ADM_CMD_CREATE_CQ,
         .dptr.prp1 = cpu_to_le64(q->cq.iova),
         .cdw10 = cpu_to_le32(((queue_size - 1) << 16) | n),
-        .cdw11 = cpu_to_le32(NVME_CQ_IEN | NVME_CQ_PC),
+        .cdw11 = cpu_to_le32(NVME_CQ_IEN | NVME_CQ_PC | (iv << 16)),
     };
     if (nvme_admin_cmd_sync(bs, &cmd)) {
         error_setg(errp, "Failed to create CQ io queue [%u]", n);
@@ -740,6 +842,19 @@ out_error:
     return false;
 }
 
+/* Must be run in q->aio_context */
+static bool nvme_queue_has_completions(NVMeQueuePair *q)
+{
+    const size_t cqe_offset = q->cq.head * NVME_CQ_ENTRY_BYTES;
+    NvmeCqe *cqe = (NvmeCqe *)&q->cq.queue[cqe_offset];
+
+    /*
+     * q->lock isn't needed because nvme_process_completion() only runs in
+     * the event loop thread and cannot race with itself.
+     */
+    return (le16_to_cpu(cqe->status) & 0x1) != q->cq_phase;
+}
+
 /* Run as an event notifier in the BDS's main AioContext */
 static bool nvme_poll_cb(void *opaque)
 {
@@ -748,16 +863,8 @@ static bool nvme_poll_cb(void *opaque)
                                     irq_notifier[MSIX_SHARED_IRQ_IDX]);
     int i;
 
-    for (i = 0; i < s->queue_count; i++) {
-        NVMeQueuePair *q = s->queues[i];
-        const size_t cqe_offset = q->cq.head * NVME_CQ_ENTRY_BYTES;
-        NvmeCqe *cqe = (NvmeCqe *)&q->cq.queue[cqe_offset];
-
-        /*
-         * q->lock isn't needed because nvme_process_completion() only runs in
-         * the event loop thread and cannot race with itself.
-         */
-        if ((le16_to_cpu(cqe->status) & 0x1) != q->cq_phase) {
+    for (i = 0; i < MIN(s->queue_count, INDEX_IO(1)); i++) {
+        if (nvme_queue_has_completions(s->queues[i])) {
             return true;
         }
     }
@@ -773,12 +880,150 @@ static void nvme_poll_ready(EventNotifier *e)
     nvme_poll_queues(s);
 }
 
+/* Run as an fd handler in q->aio_context */
+static void nvme_queue_handle_event(void *opaque)
+{
+    NVMeQueuePair *q = opaque;
+
+    trace_nvme_handle_event(q->s);
+    event_notifier_test_and_clear(q->irq_notifier);
+    nvme_poll_queue(q);
+}
+
+/* Run as an fd handler in q->aio_context */
+static bool nvme_queue_poll_cb(void *opaque)
+{
+    return nvme_queue_has_completions(opaque);
+}
+
+/* Run as an fd handler in q->aio_context */
+static void nvme_queue_poll_ready(void *opaque)
+{
+    nvme_poll_queue(opaque);
+}
+
+/* With q->lock, must be run in @ctx */
+static void nvme_claim_io_queue(NVMeQueuePair *q, AioContext *ctx)
+{
+    trace_nvme_claim_queue_pair(q->s, q->index, ctx);
+    qatomic_set(&q->aio_context, ctx);
+    aio_context_ref(ctx);
+    q->completion_bh = aio_bh_new(ctx, nvme_process_completion_bh, q);
+    aio_set_fd_handler(ctx, event_notifier_get_fd(q->irq_notifier),
+                       nvme_queue_handle_event, NULL, nvme_queue_poll_cb,
+                       nvme_queue_poll_ready, q);
+}
+
+/*
+ * Release @q unless a request is using it.  Taking q->lock makes this atomic
+ * with respect to nvme_get_io_queue() in the AioContext that claimed @q, and
+ * nvme_process_completion() ignores the events and BHs still pending there.
+ *
+ * Called under BQL.
+ */
+static void nvme_release_io_queue(NVMeQueuePair *q)
+{
+    AioContext *ctx;
+
+    WITH_QEMU_LOCK_GUARD(&q->lock) {
+        ctx = q->aio_context;
+        if (!ctx || q->users) {
+            return;
+        }
+        trace_nvme_release_queue_pair(q->s, q->index, ctx);
+        aio_set_fd_handler(ctx, event_notifier_get_fd(q->irq_notifier),
+                           NULL, NULL, NULL, NULL, NULL);
+        qemu_bh_delete(q->completion_bh);
+        q->completion_bh = NULL;
+        qatomic_set(&q->aio_context, NULL);
+    }
+    aio_context_unref(ctx);
+}
+
+/*
+ * Count a request as a user of @q, so that @q is not released under it.
+ * Unless @shared, only if @q belongs to @ctx.  If nobody has claimed @q,
+ * @ctx claims it.  Must be run in @ctx.
+ */
+static bool nvme_use_io_queue(NVMeQueuePair *q, AioContext *ctx, bool shared)
+{
+    QEMU_LOCK_GUARD(&q->lock);
+    if (!q->aio_context) {
+        nvme_claim_io_queue(q, ctx);
+    } else if (q->aio_context != ctx && !shared) {
+        return false;
+    }
+    q->users++;
+    return true;
+}
+
+/* Ends the use of @q started by nvme_get_io_queue(), in any AioContext */
+static void nvme_put_io_queue(NVMeQueuePair *q)
+{
+    QEMU_LOCK_GUARD(&q->lock);
+    assert(q->users > 0);
+    q->users--;
+}
+
+/*
+ * Returns the I/O queue pair for requests from the current AioContext.
+ *
+ * The first I/O queue belongs to the BDS's main AioContext.  Each further
+ * one is claimed by the first other AioContext that submits a request, so
+ * that with multiqueue devices every iothread submits to and polls the
+ * completions of its own queue pair, without contending for q->lock or
+ * bouncing doorbell writes and completions through another thread.  If there
+ * are more AioContexts than queue pairs, the remaining ones share them.
+ * Claims without users are dropped when a drained section ends, see
+ * nvme_drain_end().
+ *
+ * The caller must end its use of the queue pair with nvme_put_io_queue()
+ * once its command has completed, or once it gave up on submitting it.
+ *
+ * May be run in any AioContext.
+ */
+static NVMeQueuePair *nvme_get_io_queue(BDRVNVMeState *s)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    NVMeQueuePair *q;
+    unsigned i;
+
+    assert(s->queue_count > 1);
+    if (ctx == s->aio_context || s->queue_count == INDEX_IO(1)) {
+        q = s->queues[INDEX_IO(0)];
+        nvme_use_io_queue(q, ctx, true);
+        return q;
+    }
+
+    /* Our own queue pair first, then one that nobody has claimed */
+    for (i = INDEX_IO(1); i < s->queue_count; i++) {
+        q = s->queues[i];
+        if (qatomic_read(&q->aio_context) == ctx &&
+            nvme_use_io_queue(q, ctx, false)) {
+            return q;
+        }
+    }
+    for (i = INDEX_IO(1); i < s->queue_count; i++) {
+        q = s->queues[i];
+        if (!qatomic_read(&q->aio_context) &&
+            nvme_use_io_queue(q, ctx, false)) {
+            return q;
+        }
+    }
+
+    q = s->queues[INDEX_IO(0) +
+                  ((uintptr_t)ctx / sizeof(*ctx)) % (s->queue_count - 1)];
+    nvme_use_io_queue(q, ctx, true);
+    return q;
+}
+
 static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
-                     Error **errp)
+                     unsigned num_queues, Error **errp)
 {
     BDRVNVMeState *s = bs->opaque;
     NVMeQueuePair *q;
     AioContext *aio_context = bdrv_get_aio_context(bs);
+    g_autofree EventNotifier **irq_notifiers = NULL;
     int ret;
     uint64_t cap;
     uint32_t ver;
@@ -798,6 +1043,20 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
         return ret;
     }
 
+    irq_notifiers = g_new(EventNotifier *, num_queues);
+    irq_notifiers[MSIX_SHARED_IRQ_IDX] = &s->irq_notifier[MSIX_SHARED_IRQ_IDX];
+    s->queue_irq_notifiers = g_new0(EventNotifier, num_queues - 1);
+    for (; s->nr_queue_irqs < num_queues - 1; s->nr_queue_irqs++) {
+        EventNotifier *e = &s->queue_irq_notifiers[s->nr_queue_irqs];
+
+        ret = event_notifier_init(e, 0);
+        if (ret) {
+            error_setg(errp, "Failed to init event notifier");
+            return ret;
+        }
+        irq_notifiers[s->nr_queue_irqs + 1] = e;
+    }
+
     s->vfio = qemu_vfio_open_pci(device, errp);
     if (!s->vfio) {
         ret = -EINVAL;
@@ -902,8 +1161,8 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
         }
     }
 
-    ret = qemu_vfio_pci_init_irq(s->vfio, s->irq_notifier,
-                                 VFIO_PCI_MSIX_IRQ_INDEX, errp);
+    ret = qemu_vfio_pci_init_irqs(s->vfio, irq_notifiers, num_queues,
+                                  VFIO_PCI_MSIX_IRQ_INDEX, errp);
     if (ret) {
         goto out;
     }
@@ -917,9 +1176,23 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
         goto out;
     }
 
-    /* Set up command queues. */
-    if (!nvme_add_io_queue(bs, errp)) {
-        ret = -EIO;
+    /*
+     * Set up command queues.  The controller may grant fewer I/O queues
+     * than requested, so use only as many as it allocates.  Every
+     * controller supports one without being asked.
+     */
+    if (num_queues > 1) {
+        num_queues = nvme_set_num_queues(bs, num_queues, errp);
+        if (!num_queues) {
+            ret = -EIO;
+            goto out;
+        }
+    }
+    while (s->queue_count < INDEX_IO(num_queues)) {
+        if (!nvme_add_io_queue(bs, errp)) {
+            ret = -EIO;
+            break;
+        }
     }
 out:
     if (regs) {
@@ -990,6 +1263,9 @@ static void nvme_close(BlockDriverState *bs)
     BDRVNVMeState *s = bs->opaque;
 
     for (unsigned i = 0; i < s->queue_count; ++i) {
+        if (i >= INDEX_IO(1)) {
+            nvme_release_io_queue(s->queues[i]);
+        }
         nvme_free_queue_pair(s->queues[i]);
     }
     g_free(s->queues);
@@ -997,6 +1273,10 @@ static void nvme_close(BlockDriverState *bs)
                            &s->irq_notifier[MSIX_SHARED_IRQ_IDX],
                            NULL, NULL, NULL);
     event_notifier_cleanup(&s->irq_notifier[MSIX_SHARED_IRQ_IDX]);
+    for (unsigned i = 0; i < s->nr_queue_irqs; i++) {
+        event_notifier_cleanup(&s->queue_irq_notifiers[i]);
+    }
+    g_free(s->queue_irq_notifiers);
     qemu_vfio_pci_unmap_bar(s->vfio, 0, s->bar0_wo_map,
                             0, sizeof(NvmeBar) + NVME_DOORBELL_SIZE);
     qemu_vfio_close(s->vfio);
@@ -1010,6 +1290,7 @@ static int nvme_open(BlockDriverState *bs, QDict *options, int flags,
     const char *device;
     QemuOpts *opts;
     int namespace;
+    uint64_t num_queues;
     int ret;
     BDRVNVMeState *s = bs->opaque;
 
@@ -1025,7 +1306,14 @@ static int nvme_open(BlockDriverState *bs, QDict *options, int flags,
     }
 
     namespace = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NAMESPACE, 1);
-    ret = nvme_init(bs, device, namespace, errp);
+    num_queues = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NUM_QUEUES, 1);
+    if (num_queues < 1 || num_queues > UINT16_MAX) {
+        error_setg(errp, "'" NVME_BLOCK_OPT_NUM_QUEUES "' must be between 1 "
+                   "and %d", UINT16_MAX);
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+    ret = nvme_init(bs, device, namespace, num_queues, errp);
     qemu_opts_del(opts);
     if (ret) {
         goto fail;
@@ -1201,6 +1489,7 @@ fail:
 typedef struct {
     Coroutine *co;
     int ret;
+    /* The request coroutine's AioContext, where it is reentered */
     AioContext *ctx;
 } NVMeCoData;
 
@@ -1210,7 +1499,7 @@ static void nvme_rw_cb_bh(void *opaque)
     qemu_coroutine_enter(data->co);
 }
 
-/* Put into NVMeRequest.cb, so runs in the BDS's main AioContext */
+/* Put into NVMeRequest.cb, so runs in the queue's AioContext */
 static void nvme_rw_cb(void *opaque, int ret)
 {
     NVMeCoData *data = opaque;
@@ -1230,7 +1519,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
 {
     int r;
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq;
     NVMeRequest *req;
 
     uint32_t cdw12 = (((bytes >> s->blkshift) - 1) & 0xFFFF) |
@@ -1243,12 +1532,12 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
         .cdw12 = cpu_to_le32(cdw12),
     };
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
     trace_nvme_prw_aligned(s, is_write, offset, bytes, flags, qiov->niov);
-    assert(s->queue_count > 1);
+    ioq = nvme_get_io_queue(s);
     req = nvme_get_free_req(ioq);
     assert(req);
 
@@ -1257,6 +1546,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
     qemu_co_mutex_unlock(&s->dma_map_lock);
     if (r) {
         nvme_put_free_req_and_wake(ioq, req);
+        nvme_put_io_queue(ioq);
         return r;
     }
     nvme_submit_command(ioq, req, &cmd, nvme_rw_cb, &data);
@@ -1265,6 +1555,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
     while (data.ret == -EINPROGRESS) {
         qemu_coroutine_yield();
     }
+    nvme_put_io_queue(ioq);
 
     qemu_co_mutex_lock(&s->dma_map_lock);
     r = nvme_cmd_unmap_qiov(bs, qiov);
@@ -1351,18 +1642,18 @@ static coroutine_fn int nvme_co_pwritev(BlockDriverState *bs,
 static coroutine_fn int nvme_co_flush(BlockDriverState *bs)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq;
     NVMeRequest *req;
     NvmeCmd cmd = {
         .opcode = NVME_CMD_FLUSH,
         .nsid = cpu_to_le32(s->nsid),
     };
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
-    assert(s->queue_count > 1);
+    ioq = nvme_get_io_queue(s);
     req = nvme_get_free_req(ioq);
     assert(req);
     nvme_submit_command(ioq, req, &cmd, nvme_rw_cb, &data);
@@ -1371,6 +1662,7 @@ static coroutine_fn int nvme_co_flush(BlockDriverState *bs)
     if (data.ret == -EINPROGRESS) {
         qemu_coroutine_yield();
     }
+    nvme_put_io_queue(ioq);
 
     return data.ret;
 }
@@ -1382,7 +1674,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
                                               BdrvRequestFlags flags)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq;
     NVMeRequest *req;
     uint32_t cdw12;
 
@@ -1409,7 +1701,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
     };
 
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
@@ -1424,7 +1716,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
     cmd.cdw12 = cpu_to_le32(cdw12);
 
     trace_nvme_write_zeroes(s, offset, bytes, flags);
-    assert(s->queue_count > 1);
+    ioq = nvme_get_io_queue(s);
     req = nvme_get_free_req(ioq);
     assert(req);
 
@@ -1434,6 +1726,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
     while (data.ret == -EINPROGRESS) {
         qemu_coroutine_yield();
     }
+    nvme_put_io_queue(ioq);
 
     trace_nvme_rw_done(s, true, offset, bytes, data.ret);
     return data.ret;
@@ -1445,7 +1738,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
                                          int64_t bytes)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq;
     NVMeRequest *req;
     QEMU_AUTO_VFREE NvmeDsmRange *buf = NULL;
     QEMUIOVector local_qiov;
@@ -1459,7 +1752,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
     };
 
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
@@ -1467,8 +1760,6 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
         return -ENOTSUP;
     }
 
-    assert(s->queue_count > 1);
-
     /*
      * Filling the @buf requires @offset and @bytes to satisfy restrictions
      * defined in nvme_refresh_limits().
@@ -1489,6 +1780,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
     qemu_iovec_init(&local_qiov, 1);
     qemu_iovec_add(&local_qiov, buf, 4096);
 
+    ioq = nvme_get_io_queue(s);
     req = nvme_get_free_req(ioq);
     assert(req);
 
@@ -1498,6 +1790,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
 
     if (ret) {
         nvme_put_free_req_and_wake(ioq, req);
+        nvme_put_io_queue(ioq);
         goto out;
     }
 
@@ -1509,6 +1802,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
     while (data.ret == -EINPROGRESS) {
         qemu_coroutine_yield();
     }
+    nvme_put_io_queue(ioq);
 
     qemu_co_mutex_lock(&s->dma_map_lock);
     ret = nvme_cmd_unmap_qiov(bs, &local_qiov);
@@ -1592,6 +1886,11 @@ static void nvme_detach_aio_context(BlockDriverState *bs)
     for (unsigned i = 0; i < s->queue_count; i++) {
         NVMeQueuePair *q = s->queues[i];
 
+        /* Let the AioContexts claim the other I/O queues again */
+        if (i >= INDEX_IO(1)) {
+            nvme_release_io_queue(q);
+            continue;
+        }
         qemu_bh_delete(q->completion_bh);
         q->completion_bh = NULL;
     }
@@ -1611,14 +1910,31 @@ static void nvme_attach_aio_context(BlockDriverState *bs,
                            nvme_handle_event, nvme_poll_cb,
                            nvme_poll_ready);
 
-    for (unsigned i = 0; i < s->queue_count; i++) {
+    for (unsigned i = 0; i < MIN(s->queue_count, INDEX_IO(1)); i++) {
         NVMeQueuePair *q = s->queues[i];
 
+        q->aio_context = new_context;
         q->completion_bh =
             aio_bh_new(new_context, nvme_process_completion_bh, q);
     }
 }
 
+/*
+ * Let the AioContexts claim the other I/O queues again, so that an
+ * AioContext that went away, e.g. the IOThread of an unplugged device, does
+ * not keep a queue pair whose completions nobody processes.  Not every
+ * drained section waits for the requests to complete, so queue pairs that
+ * are still in use keep their claim until the next drain.
+ */
+static void nvme_drain_end(BlockDriverState *bs)
+{
+    BDRVNVMeState *s = bs->opaque;
+
+    for (unsigned i = INDEX_IO(1); i < s->queue_count; i++) {
+        nvme_release_io_queue(s->queues[i]);
+    }
+}
+
 static bool nvme_register_buf(BlockDriverState *bs, void *host, size_t size,
                               Error **errp)
 {
@@ -1694,6 +2010,7 @@ static BlockDriver bdrv_nvme = {
 
     .bdrv_detach_aio_context  = nvme_detach_aio_context,
     .bdrv_attach_aio_context  = nvme_attach_aio_context,
+    .bdrv_drain_end           = nvme_drain_end,
 
     .bdrv_register_buf        = nvme_register_buf,
     .bdrv_unregister_buf      = nvme_unregister_buf,
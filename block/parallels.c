@@ -952,7 +952,8 @@ static void parallels_collect_statistics(BlockDriverState *bs,
 
 static int coroutine_fn GRAPH_RDLOCK
 parallels_co_check(BlockDriverState *bs, BdrvCheckResult *res,
-                   BdrvCheckMode fix)
+                   BdrvCheckMode fix, BlockDriverCheckStatusCB *status_cb,
+                   void *cb_opaque)
 {
     BDRVParallelsState *s = bs->opaque;
     int ret;
@@ -1402,7 +1403,8 @@ static int parallels_open(BlockDriverState *bs, QDict *options, int flags,
     /* Repair the image if corruption was detected. */
     if (need_check) {
         BdrvCheckResult res;
-        ret = bdrv_check(bs, &res, BDRV_FIX_ERRORS | BDRV_FIX_LEAKS);
+        ret = bdrv_check(bs, &res, BDRV_FIX_ERRORS | BDRV_FIX_LEAKS,
+                         NULL, NULL);
         if (ret < 0) {
             error_setg_errno(errp, -ret, "Could not repair corrupted image");
             migrate_del_blocker(&s->migration_blocker);
@@ -23,6 +23,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "block/aio_task.h"
 #include "block/block-io.h"
 #include "qapi/error.h"
 #include "qcow2.h"
@@ -1607,6 +1608,37 @@ enum {
     CHECK_FRAG_INFO = 0x2,      /* update BlockFragInfo counters */
 };
 
+/*
+ * Number of L2 tables that check_refcounts_l1() reads ahead, further limited
+ * so that the buffers do not exceed CHECK_L2_READ_AHEAD_BYTES
+ */
+#define CHECK_L2_READ_AHEAD         64
+#define CHECK_L2_READ_AHEAD_BYTES   (32 * MiB)
+
+/* Progress of the L1/L2 walk, counted in L1 entries */
+typedef struct CheckProgress {
+    BlockDriverCheckStatusCB *cb;
+    void *opaque;
+    int64_t done;
+    int64_t total;
+} CheckProgress;
+
+typedef struct CheckL2Slot {
+    uint64_t *l2_table;
+    int64_t l2_offset;
+    /* res->corruptions_fixed at the time the read was started */
+    int corruptions_fixed;
+    bool done;
+    int ret;
+} CheckL2Slot;
+
+typedef struct CheckL2Task {
+    AioTask task;
+    BlockDriverState *bs;
+    CheckL2Slot *slot;
+    size_t bytes;
+} CheckL2Task;
+
 /*
  * Fix L2 entry by making it QCOW2_CLUSTER_ZERO_PLAIN (or making all its present
  * subclusters QCOW2_SUBCLUSTER_ZERO_PLAIN).
@@ -1670,8 +1702,8 @@ fail:
 
 /*
  * Increases the refcount in the given refcount table for the all clusters
- * referenced in the L2 table. While doing so, performs some checks on L2
- * entries.
+ * referenced in the L2 table @l2_table, which has been read from @l2_offset.
+ * While doing so, performs some checks on L2 entries.
  *
  * Returns the number of errors found by the checks or -errno if an internal
  * error occurred.
@@ -1680,24 +1712,15 @@ static int coroutine_fn GRAPH_RDLOCK
 check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
                    void **refcount_table,
                    int64_t *refcount_table_size, int64_t l2_offset,
-                   int flags, BdrvCheckMode fix, bool active)
+                   uint64_t *l2_table, int flags, BdrvCheckMode fix,
+                   bool active)
 {
     BDRVQcow2State *s = bs->opaque;
     uint64_t l2_entry, l2_bitmap;
     uint64_t next_contiguous_offset = 0;
     int i, ret;
-    size_t l2_size_bytes = s->l2_size * l2_entry_size(s);
-    g_autofree uint64_t *l2_table = g_malloc(l2_size_bytes);
     bool metadata_overlap;
 
-    /* Read L2 table from disk */
-    ret = bdrv_co_pread(bs->file, l2_offset, l2_size_bytes, l2_table, 0);
-    if (ret < 0) {
-        fprintf(stderr, "ERROR: I/O error in check_refcounts_l2\n");
-        res->check_errors++;
-        return ret;
-    }
-
     /* Do the actual checks */
     for (i = 0; i < s->l2_size; i++) {
         uint64_t coffset;
@@ -1868,11 +1891,80 @@ check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
     return 0;
 }
 
+static int coroutine_fn GRAPH_RDLOCK check_l2_read_task_entry(AioTask *task)
+{
+    CheckL2Task *t = container_of(task, CheckL2Task, task);
+    CheckL2Slot *slot = t->slot;
+
+    slot->ret = bdrv_co_pread(t->bs->file, slot->l2_offset, t->bytes,
+                              slot->l2_table, 0);
+    slot->done = true;
+
+    return slot->ret;
+}
+
+/*
+ * Starts reading the L2 table at @l2_offset into @slot.  Waits for a free
+ * task in @pool if all of them are busy.
+ */
+static void coroutine_fn
+check_l2_read_start(BlockDriverState *bs, BdrvCheckResult *res,
+                    AioTaskPool *pool, CheckL2Slot *slot, int64_t l2_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    CheckL2Task *t = g_new(CheckL2Task, 1);
+
+    *slot = (CheckL2Slot) {
+        .l2_table = slot->l2_table,
+        .l2_offset = l2_offset,
+        .corruptions_fixed = res->corruptions_fixed,
+    };
+    *t = (CheckL2Task) {
+        .task.func = check_l2_read_task_entry,
+        .bs = bs,
+        .slot = slot,
+        .bytes = s->l2_size * l2_entry_size(s),
+    };
+
+    aio_task_pool_start_task(pool, &t->task);
+}
+
+/*
+ * Waits until the L2 table in @slot has been read.  If L2 entries have been
+ * repaired since the read was started, the table might be stale (when
+ * several L1 entries point to the same L2 table), so it is read again.
+ *
+ * Returns 0 on success and -errno if the table could not be read.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+check_l2_read_wait(BlockDriverState *bs, BdrvCheckResult *res,
+                   AioTaskPool *pool, CheckL2Slot *slot)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    while (!slot->done) {
+        aio_task_pool_wait_one(pool);
+    }
+
+    if (slot->ret >= 0 && slot->corruptions_fixed != res->corruptions_fixed) {
+        slot->ret = bdrv_co_pread(bs->file, slot->l2_offset,
+                                  s->l2_size * l2_entry_size(s),
+                                  slot->l2_table, 0);
+    }
+
+    return slot->ret;
+}
+
 /*
  * Increases the refcount for the L1 table, its L2 tables and all referenced
  * clusters in the given refcount table. While doing so, performs some checks
  * on L1 and L2 entries.
  *
+ * L2 tables are read ahead with up to CHECK_L2_READ_AHEAD requests in flight,
+ * but they are checked one at a time in L1 order, so the refcount table is
+ * only ever updated by the calling coroutine and errors are reported in the
+ * same order as with a sequential walk.
+ *
  * Returns the number of errors found by the checks or -errno if an internal
  * error occurred.
  */
@@ -1880,13 +1972,19 @@ static int coroutine_fn GRAPH_RDLOCK
 check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
                    void **refcount_table, int64_t *refcount_table_size,
                    int64_t l1_table_offset, int l1_size,
-                   int flags, BdrvCheckMode fix, bool active)
+                   int flags, BdrvCheckMode fix, bool active,
+                   CheckProgress *progress)
 {
     BDRVQcow2State *s = bs->opaque;
     size_t l1_size_bytes = l1_size * L1E_SIZE;
+    size_t l2_size_bytes = s->l2_size * l2_entry_size(s);
     g_autofree uint64_t *l1_table = NULL;
+    g_autofree uint64_t *l2_tables = NULL;
+    g_autofree CheckL2Slot *slots = NULL;
+    AioTaskPool *pool = NULL;
     uint64_t l2_offset;
-    int i, ret;
+    int64_t nb_started = 0, nb_checked = 0;
+    int i, next, nb_slots, ret;
 
     if (!l1_size) {
         return 0;
@@ -1917,12 +2015,39 @@ check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
         be64_to_cpus(&l1_table[i]);
     }
 
+    nb_slots = MIN(CHECK_L2_READ_AHEAD,
+                   MAX(1, CHECK_L2_READ_AHEAD_BYTES / l2_size_bytes));
+    nb_slots = MIN(nb_slots, l1_size);
+    l2_tables = g_try_malloc(nb_slots * l2_size_bytes);
+    if (l2_tables == NULL) {
+        res->check_errors++;
+        return -ENOMEM;
+    }
+    slots = g_new0(CheckL2Slot, nb_slots);
+    for (i = 0; i < nb_slots; i++) {
+        slots[i].l2_table = l2_tables + i * (l2_size_bytes / sizeof(uint64_t));
+    }
+    pool = aio_task_pool_new(nb_slots);
+
     /* Do the actual checks */
+    next = 0;
     for (i = 0; i < l1_size; i++) {
+        CheckL2Slot *slot;
+
         if (!l1_table[i]) {
             continue;
         }
 
+        /* Keep the read-ahead window full */
+        for (; next < l1_size && nb_started - nb_checked < nb_slots; next++) {
+            if (l1_table[next]) {
+                check_l2_read_start(bs, res, pool,
+                                    &slots[nb_started++ % nb_slots],
+                                    l1_table[next] & L1E_OFFSET_MASK);
+            }
+        }
+        slot = &slots[nb_checked++ % nb_slots];
+
         if (l1_table[i] & L1E_RESERVED_MASK) {
             fprintf(stderr, "ERROR found L1 entry with reserved bits set: "
                     "%" PRIx64 "\n", l1_table[i]);
@@ -1936,7 +2061,7 @@ check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
                                        refcount_table, refcount_table_size,
                                        l2_offset, s->cluster_size);
         if (ret < 0) {
-            return ret;
+            goto out;
         }
 
         /* L2 tables are cluster aligned */
@@ -1946,16 +2071,35 @@ check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
             res->corruptions++;
         }
 
+        /* Read L2 table from disk */
+        ret = check_l2_read_wait(bs, res, pool, slot);
+        if (ret < 0) {
+            fprintf(stderr, "ERROR: I/O error in check_refcounts_l2\n");
+            res->check_errors++;
+            goto out;
+        }
+
         /* Process and check L2 entries */
         ret = check_refcounts_l2(bs, res, refcount_table,
-                                 refcount_table_size, l2_offset, flags,
-                                 fix, active);
+                                 refcount_table_size, l2_offset,
+                                 slot->l2_table, flags, fix, active);
         if (ret < 0) {
-            return ret;
+            goto out;
+        }
+
+        if (progress->cb) {
+            progress->cb(bs, progress->done + i + 1, progress->total,
+                         progress->opaque);
         }
     }
 
-    return 0;
+    ret = 0;
+out:
+    /* The buffers must not be freed while reads are still in flight */
+    aio_task_pool_wait_all(pool);
+    aio_task_pool_free(pool);
+    progress->done += l1_size;
+    return ret;
 }
 
 /*
@@ -2217,13 +2361,23 @@ resize_fail:
 static int coroutine_fn GRAPH_RDLOCK
 calculate_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
                     BdrvCheckMode fix, bool *rebuild,
-                    void **refcount_table, int64_t *nb_clusters)
+                    void **refcount_table, int64_t *nb_clusters,
+                    BlockDriverCheckStatusCB *status_cb, void *cb_opaque)
 {
     BDRVQcow2State *s = bs->opaque;
     int64_t i;
     QCowSnapshot *sn;
+    CheckProgress progress = {
+        .cb = status_cb,
+        .opaque = cb_opaque,
+        .total = s->l1_size,
+    };
     int ret;
 
+    for (i = 0; i < s->nb_snapshots; i++) {
+        progress.total += s->snapshots[i].l1_size;
+    }
+
     if (!*refcount_table) {
         int64_t old_size = 0;
         ret = realloc_refcount_array(s, refcount_table,
@@ -2244,7 +2398,7 @@ calculate_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
     /* current L1 table */
     ret = check_refcounts_l1(bs, res, refcount_table, nb_clusters,
                              s->l1_table_offset, s->l1_size, CHECK_FRAG_INFO,
-                             fix, true);
+                             fix, true, &progress);
     if (ret < 0) {
         return ret;
     }
@@ -2274,7 +2428,7 @@ calculate_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
         }
         ret = check_refcounts_l1(bs, res, refcount_table, nb_clusters,
                                  sn->l1_table_offset, sn->l1_size, 0, fix,
-                                 false);
+                                 false, &progress);
         if (ret < 0) {
             return ret;
         }
@@ -2797,7 +2951,9 @@ fail:
  * detected as corrupted, and -errno when an internal error occurred.
  */
 int coroutine_fn GRAPH_RDLOCK
-qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode fix)
+qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
+                      BdrvCheckMode fix, BlockDriverCheckStatusCB *status_cb,
+                      void *cb_opaque)
 {
     BDRVQcow2State *s = bs->opaque;
     BdrvCheckResult pre_compare_res;
@@ -2822,7 +2978,7 @@ qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode
         size_to_clusters(s, bs->total_sectors * BDRV_SECTOR_SIZE);
 
     ret = calculate_refcounts(bs, res, fix, &rebuild, &refcount_table,
-                              &nb_clusters);
+                              &nb_clusters, status_cb, cb_opaque);
     if (ret < 0) {
         goto fail;
     }
@@ -2855,7 +3011,7 @@ qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode
         rebuild = false;
         memset(refcount_table, 0, refcount_array_byte_size(s, nb_clusters));
         ret = calculate_refcounts(bs, res, 0, &rebuild, &refcount_table,
-                                  &nb_clusters);
+                                  &nb_clusters, status_cb, cb_opaque);
         if (ret < 0) {
             goto fail;
         }
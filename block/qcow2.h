@@ -896,7 +896,9 @@ qcow2_update_snapshot_refcount(BlockDriverState *bs, int64_t l1_table_offset,
 int GRAPH_RDLOCK qcow2_flush_caches(BlockDriverState *bs);
 int GRAPH_RDLOCK qcow2_write_caches(BlockDriverState *bs);
 int coroutine_fn qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
-                                       BdrvCheckMode fix);
+                                       BdrvCheckMode fix,
+                                       BlockDriverCheckStatusCB *status_cb,
+                                       void *cb_opaque);
 
 void GRAPH_RDLOCK qcow2_process_discards(BlockDriverState *bs, int ret);
 
@@ -1597,7 +1597,8 @@ bdrv_qed_co_invalidate_cache(BlockDriverState *bs, Error **errp)
 
 static int coroutine_fn GRAPH_RDLOCK
 bdrv_qed_co_check(BlockDriverState *bs, BdrvCheckResult *result,
-                  BdrvCheckMode fix)
+                  BdrvCheckMode fix, BlockDriverCheckStatusCB *status_cb,
+                  void *cb_opaque)
 {
     BDRVQEDState *s = bs->opaque;
     int ret;
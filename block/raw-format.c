@@ -221,6 +221,19 @@ raw_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
     return bdrv_co_preadv(bs->file, offset, bytes, qiov, flags);
 }
 
+static int coroutine_fn GRAPH_RDLOCK
+raw_co_get_data_fd(BlockDriverState *bs, int64_t *offset, int64_t bytes)
+{
+    int ret;
+
+    ret = raw_adjust_offset(bs, offset, bytes, false);
+    if (ret) {
+        return ret;
+    }
+
+    return bdrv_co_get_data_fd(bs->file, offset, bytes);
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 raw_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
                QEMUIOVector *qiov, BdrvRequestFlags flags)
@@ -656,6 +669,7 @@ BlockDriver bdrv_raw = {
     .bdrv_co_block_status = &raw_co_block_status,
     .bdrv_co_copy_range_from = &raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = &raw_co_copy_range_to,
+    .bdrv_co_get_data_fd    = &raw_co_get_data_fd,
     .bdrv_co_truncate     = &raw_co_truncate,
     .bdrv_co_getlength    = &raw_co_getlength,
     .is_format            = true,
@@ -2731,6 +2731,9 @@ static BlockJob *do_backup_common(BackupCommon *backup,
         if (backup->x_perf->has_min_cluster_size) {
             perf.min_cluster_size = backup->x_perf->min_cluster_size;
         }
+        if (backup->x_perf->has_adaptive) {
+            perf.adaptive = backup->x_perf->adaptive;
+        }
     }
 
     if ((backup->sync == MIRROR_SYNC_MODE_BITMAP) ||
@@ -2873,6 +2876,7 @@ static void blockdev_mirror_common(const char *job_id, BlockDriverState *bs,
                                    bool has_copy_mode, MirrorCopyMode copy_mode,
                                    bool has_auto_finalize, bool auto_finalize,
                                    bool has_auto_dismiss, bool auto_dismiss,
+                                   MirrorPerf *x_perf,
                                    Error **errp)
 {
     BlockDriverState *unfiltered_bs;
@@ -2908,7 +2912,6 @@ static void blockdev_mirror_common(const char *job_id, BlockDriverState *bs,
     if (has_auto_dismiss && !auto_dismiss) {
         job_flags |= JOB_MANUAL_DISMISS;
     }
-
     if (granularity != 0 && (granularity < 512 || granularity > 1048576 * 64)) {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "granularity",
                    "a value in range [512B, 64MB]");
@@ -2970,7 +2973,7 @@ static void blockdev_mirror_common(const char *job_id, BlockDriverState *bs,
     mirror_start(job_id, bs, target, replaces, job_flags,
                  speed, granularity, buf_size, sync, backing_mode,
                  target_is_zero, on_source_error, on_target_error, unmap,
-                 filter_node_name, copy_mode, errp);
+                 filter_node_name, copy_mode, x_perf, errp);
 }
 
 void qmp_drive_mirror(DriveMirror *arg, Error **errp)
@@ -3122,7 +3125,7 @@ void qmp_drive_mirror(DriveMirror *arg, Error **errp)
                            arg->has_copy_mode, arg->copy_mode,
                            arg->has_auto_finalize, arg->auto_finalize,
                            arg->has_auto_dismiss, arg->auto_dismiss,
-                           errp);
+                           arg->x_perf, errp);
     bdrv_unref(target_bs);
 }
 
@@ -3142,7 +3145,7 @@ void qmp_blockdev_mirror(const char *job_id,
                          bool has_auto_finalize, bool auto_finalize,
                          bool has_auto_dismiss, bool auto_dismiss,
                          bool has_target_is_zero, bool target_is_zero,
-                         Error **errp)
+                         MirrorPerf *x_perf, Error **errp)
 {
     BlockDriverState *bs;
     BlockDriverState *target_bs;
@@ -3179,7 +3182,7 @@ void qmp_blockdev_mirror(const char *job_id,
                            has_copy_mode, copy_mode,
                            has_auto_finalize, auto_finalize,
                            has_auto_dismiss, auto_dismiss,
-                           errp);
+                           x_perf, errp);
 }
 
 /*
@@ -71,6 +71,7 @@ typedef struct VubrDev {
     int sock;
     int ready;
     int quit;
+    bool busy_poll;
     struct {
         int fd;
         void *addr;
@@ -232,6 +233,12 @@ vubr_handle_tx(VuDev *dev, int qidx)
     }
 
     free(elem);
+
+    /*
+     * The guest is sending; if the front-end asked for it, poll the
+     * ring from vubr_run() instead of waiting for the next kick.
+     */
+    vu_queue_poll_begin(dev, vq);
 }
 
 
@@ -465,6 +472,15 @@ vubr_get_features(VuDev *dev)
         1ULL << VIRTIO_F_VERSION_1;
 }
 
+static uint64_t
+vubr_get_protocol_features(VuDev *dev)
+{
+    VubrDev *vubr = container_of(dev, VubrDev, vudev);
+
+    /* vubr_run() polls the TX rings */
+    return vubr->busy_poll ? 1ULL << VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL : 0;
+}
+
 static void
 vubr_queue_set_started(VuDev *dev, int qidx, bool started)
 {
@@ -502,6 +518,7 @@ vubr_queue_is_processed_in_order(VuDev *dev, int qidx)
 static const VuDevIface vuiface = {
     .get_features = vubr_get_features,
     .set_features = vubr_set_features,
+    .get_protocol_features = vubr_get_protocol_features,
     .process_msg = vubr_process_msg,
     .queue_set_started = vubr_queue_set_started,
     .queue_is_processed_in_order = vubr_queue_is_processed_in_order,
@@ -740,13 +757,36 @@ vubr_backend_udp_setup(VubrDev *dev,
            local_host, lport);
 }
 
+/*
+ * Serve the TX rings that are being busy polled.  Returns true if any
+ * ring is still polled, i.e. has guest kicks suppressed.
+ */
+static bool
+vubr_poll(VubrDev *vubr)
+{
+    VuDev *dev = &vubr->vudev;
+    bool polling = false;
+    int qidx;
+
+    for (qidx = 1; qidx < dev->max_queues; qidx += 2) {
+        VuVirtq *vq = vu_get_queue(dev, qidx);
+
+        if (vu_queue_poll(dev, vq)) {
+            vu_queue_poll_ready(dev, vq);
+        }
+        polling |= vq->busy_polling;
+    }
+    return polling;
+}
+
 static void
 vubr_run(VubrDev *dev)
 {
     while (!dev->quit) {
-        /* timeout 200ms */
-        dispatcher_wait(&dev->dispatcher, 200000);
-        /* Here one can try polling strategy. */
+        bool polling = dev->busy_poll && vubr_poll(dev);
+
+        /* timeout 200ms, or just check the sockets while polling */
+        dispatcher_wait(&dev->dispatcher, polling ? 0 : 200000);
     }
 }
 
@@ -781,8 +821,9 @@ main(int argc, char *argv[])
     int opt;
     bool client = false;
     bool host_notifier = false;
+    bool busy_poll = false;
 
-    while ((opt = getopt(argc, argv, "l:r:u:cH")) != -1) {
+    while ((opt = getopt(argc, argv, "l:r:u:cHP")) != -1) {
 
         switch (opt) {
         case 'l':
@@ -804,6 +845,9 @@ main(int argc, char *argv[])
         case 'H':
             host_notifier = true;
             break;
+        case 'P':
+            busy_poll = true;
+            break;
         default:
             goto out;
         }
@@ -818,6 +862,7 @@ main(int argc, char *argv[])
     if (!dev) {
         return 1;
     }
+    dev->busy_poll = busy_poll;
 
     if (host_notifier) {
         vubr_host_notifier_setup(dev);
@@ -832,7 +877,7 @@ main(int argc, char *argv[])
 
 out:
     fprintf(stderr, "Usage: %s ", argv[0]);
-    fprintf(stderr, "[-c] [-H] [-u ud_socket_path] [-l lhost:lport] [-r rhost:rport]\n");
+    fprintf(stderr, "[-c] [-H] [-P] [-u ud_socket_path] [-l lhost:lport] [-r rhost:rport]\n");
     fprintf(stderr, "\t-u path to unix domain socket. default: %s\n",
             DEFAULT_UD_SOCKET);
     fprintf(stderr, "\t-l local host and port. default: %s:%s\n",
@@ -841,6 +886,7 @@ out:
             DEFAULT_RHOST, DEFAULT_RPORT);
     fprintf(stderr, "\t-c client mode\n");
     fprintf(stderr, "\t-H use host notifier\n");
+    fprintf(stderr, "\t-P busy poll the TX rings if the front-end asks\n");
 
     return 1;
 }
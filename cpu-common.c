@@ -20,7 +20,9 @@
 #include "qemu/osdep.h"
 #include "qemu/main-loop.h"
 #include "exec/cpu-common.h"
+#include "exec/tb-flush.h"
 #include "hw/core/cpu.h"
+#include "system/tcg.h"
 #include "qemu/lockable.h"
 #include "trace/trace-root.h"
 
@@ -414,6 +416,14 @@ int cpu_breakpoint_insert(CPUState *cpu, vaddr pc, int flags,
         *breakpoint = bp;
     }
 
+    /*
+     * Predicted returns can enter the page of the breakpoint without
+     * looking up the next TB, and thus without checking for breakpoints.
+     */
+    if (tcg_enabled()) {
+        tcg_flush_jmp_cache(cpu);
+    }
+
     trace_breakpoint_insert(cpu->cpu_index, pc, flags);
     return 0;
 }
@@ -31,7 +31,7 @@ bool ebpf_rss_load(struct EBPFRSSContext *ctx, Error **errp)
 
 bool ebpf_rss_load_fds(struct EBPFRSSContext *ctx, int program_fd,
                        int config_fd, int toeplitz_fd, int table_fd,
-                       Error **errp)
+                       int flow_table_fd, int flow_stats_fd, Error **errp)
 {
     error_setg(errp, "eBPF support is not compiled in");
     return false;
@@ -44,6 +44,18 @@ bool ebpf_rss_set_all(struct EBPFRSSContext *ctx, struct EBPFRSSConfig *config,
     abort();
 }
 
+uint64_t *ebpf_rss_flow_table(struct EBPFRSSContext *ctx)
+{
+    return NULL;
+}
+
+void ebpf_rss_get_flow_stats(struct EBPFRSSContext *ctx, uint64_t *hits,
+                             uint64_t *misses)
+{
+    *hits = 0;
+    *misses = 0;
+}
+
 void ebpf_rss_unload(struct EBPFRSSContext *ctx)
 {
 
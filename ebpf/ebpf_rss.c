@@ -19,7 +19,7 @@
 #include <bpf/libbpf.h>
 #include <bpf/bpf.h>
 
-#include "hw/virtio/virtio-net.h" /* VIRTIO_NET_RSS_MAX_TABLE_LEN */
+#include "hw/virtio/virtio-net.h" /* VIRTIO_NET_*_TABLE_{LEN,SIZE} */
 
 #include "ebpf/ebpf_rss.h"
 #include "ebpf/rss.bpf.skeleton.h"
@@ -35,13 +35,22 @@ void ebpf_rss_init(struct EBPFRSSContext *ctx)
         ctx->map_configuration = -1;
         ctx->map_toeplitz_key = -1;
         ctx->map_indirections_table = -1;
+        ctx->map_flow_table = -1;
+        ctx->map_flow_stats = -1;
 
         ctx->mmap_configuration = NULL;
         ctx->mmap_toeplitz_key = NULL;
         ctx->mmap_indirections_table = NULL;
+        ctx->mmap_flow_table = NULL;
     }
 }
 
+static size_t ebpf_rss_flow_table_size(void)
+{
+    return ROUND_UP(VIRTIO_NET_FLOW_TABLE_SIZE * sizeof(uint64_t),
+                    qemu_real_host_page_size());
+}
+
 bool ebpf_rss_is_loaded(struct EBPFRSSContext *ctx)
 {
     return ctx != NULL && (ctx->obj != NULL || ctx->program_fd != -1);
@@ -73,6 +82,14 @@ static bool ebpf_rss_mmap(struct EBPFRSSContext *ctx, Error **errp)
         error_setg(errp, "Unable to map eBPF indirection array");
         goto indirection_fail;
     }
+    ctx->mmap_flow_table = mmap(NULL, ebpf_rss_flow_table_size(),
+                                PROT_READ | PROT_WRITE, MAP_SHARED,
+                                ctx->map_flow_table, 0);
+    if (ctx->mmap_flow_table == MAP_FAILED) {
+        trace_ebpf_rss_mmap_error(ctx, "flow table");
+        error_setg(errp, "Unable to map eBPF flow table array");
+        goto flow_table_fail;
+    }
 
     trace_ebpf_rss_mmap(ctx,
                         ctx->mmap_configuration,
@@ -80,6 +97,8 @@ static bool ebpf_rss_mmap(struct EBPFRSSContext *ctx, Error **errp)
                         ctx->mmap_indirections_table);
     return true;
 
+flow_table_fail:
+    munmap(ctx->mmap_indirections_table, qemu_real_host_page_size());
 indirection_fail:
     munmap(ctx->mmap_toeplitz_key, qemu_real_host_page_size());
     ctx->mmap_toeplitz_key = NULL;
@@ -88,11 +107,13 @@ toeplitz_fail:
     ctx->mmap_configuration = NULL;
 
     ctx->mmap_indirections_table = NULL;
+    ctx->mmap_flow_table = NULL;
     return false;
 }
 
 static void ebpf_rss_munmap(struct EBPFRSSContext *ctx)
 {
+    munmap(ctx->mmap_flow_table, ebpf_rss_flow_table_size());
     munmap(ctx->mmap_indirections_table, qemu_real_host_page_size());
     munmap(ctx->mmap_toeplitz_key, qemu_real_host_page_size());
     munmap(ctx->mmap_configuration, qemu_real_host_page_size());
@@ -100,6 +121,7 @@ static void ebpf_rss_munmap(struct EBPFRSSContext *ctx)
     ctx->mmap_configuration = NULL;
     ctx->mmap_toeplitz_key = NULL;
     ctx->mmap_indirections_table = NULL;
+    ctx->mmap_flow_table = NULL;
 }
 
 bool ebpf_rss_load(struct EBPFRSSContext *ctx, Error **errp)
@@ -132,6 +154,10 @@ bool ebpf_rss_load(struct EBPFRSSContext *ctx, Error **errp)
             rss_bpf_ctx->maps.tap_rss_map_indirection_table);
     ctx->map_toeplitz_key = bpf_map__fd(
             rss_bpf_ctx->maps.tap_rss_map_toeplitz_key);
+    ctx->map_flow_table = bpf_map__fd(
+            rss_bpf_ctx->maps.tap_rss_map_flow_table);
+    ctx->map_flow_stats = bpf_map__fd(
+            rss_bpf_ctx->maps.tap_rss_map_flow_stats);
 
     trace_ebpf_rss_load(ctx,
                         ctx->program_fd,
@@ -150,13 +176,15 @@ error:
     ctx->map_configuration = -1;
     ctx->map_toeplitz_key = -1;
     ctx->map_indirections_table = -1;
+    ctx->map_flow_table = -1;
+    ctx->map_flow_stats = -1;
 
     return false;
 }
 
 bool ebpf_rss_load_fds(struct EBPFRSSContext *ctx, int program_fd,
                        int config_fd, int toeplitz_fd, int table_fd,
-                       Error **errp)
+                       int flow_table_fd, int flow_stats_fd, Error **errp)
 {
     if (ebpf_rss_is_loaded(ctx)) {
         error_setg(errp, "eBPF program is already loaded");
@@ -179,11 +207,21 @@ bool ebpf_rss_load_fds(struct EBPFRSSContext *ctx, int program_fd,
         error_setg(errp, "eBPF indirection FD is not open");
         return false;
     }
+    if (flow_table_fd < 0) {
+        error_setg(errp, "eBPF flow table FD is not open");
+        return false;
+    }
+    if (flow_stats_fd < 0) {
+        error_setg(errp, "eBPF flow statistics FD is not open");
+        return false;
+    }
 
     ctx->program_fd = program_fd;
     ctx->map_configuration = config_fd;
     ctx->map_toeplitz_key = toeplitz_fd;
     ctx->map_indirections_table = table_fd;
+    ctx->map_flow_table = flow_table_fd;
+    ctx->map_flow_stats = flow_stats_fd;
 
     trace_ebpf_rss_load(ctx,
                         ctx->program_fd,
@@ -196,6 +234,8 @@ bool ebpf_rss_load_fds(struct EBPFRSSContext *ctx, int program_fd,
         ctx->map_configuration = -1;
         ctx->map_toeplitz_key = -1;
         ctx->map_indirections_table = -1;
+        ctx->map_flow_table = -1;
+        ctx->map_flow_stats = -1;
         return false;
     }
 
@@ -275,6 +315,38 @@ bool ebpf_rss_set_all(struct EBPFRSSContext *ctx, struct EBPFRSSConfig *config,
     return true;
 }
 
+uint64_t *ebpf_rss_flow_table(struct EBPFRSSContext *ctx)
+{
+    return ebpf_rss_is_loaded(ctx) ? ctx->mmap_flow_table : NULL;
+}
+
+/* Sum the per-CPU counters of the flow table lookups */
+void ebpf_rss_get_flow_stats(struct EBPFRSSContext *ctx, uint64_t *hits,
+                             uint64_t *misses)
+{
+    int ncpus = libbpf_num_possible_cpus();
+    g_autofree uint64_t *values = NULL;
+    uint32_t key;
+
+    *hits = 0;
+    *misses = 0;
+    if (!ebpf_rss_is_loaded(ctx) || ncpus <= 0) {
+        return;
+    }
+
+    values = g_new(uint64_t, ncpus);
+    for (key = 0; key < 2; key++) {
+        uint64_t *sum = key ? misses : hits;
+
+        if (bpf_map_lookup_elem(ctx->map_flow_stats, &key, values)) {
+            continue;
+        }
+        for (int i = 0; i < ncpus; i++) {
+            *sum += values[i];
+        }
+    }
+}
+
 void ebpf_rss_unload(struct EBPFRSSContext *ctx)
 {
     if (!ebpf_rss_is_loaded(ctx)) {
@@ -292,6 +364,8 @@ void ebpf_rss_unload(struct EBPFRSSContext *ctx)
         close(ctx->map_configuration);
         close(ctx->map_toeplitz_key);
         close(ctx->map_indirections_table);
+        close(ctx->map_flow_table);
+        close(ctx->map_flow_stats);
     }
 
     ctx->obj = NULL;
@@ -299,6 +373,8 @@ void ebpf_rss_unload(struct EBPFRSSContext *ctx)
     ctx->map_configuration = -1;
     ctx->map_toeplitz_key = -1;
     ctx->map_indirections_table = -1;
+    ctx->map_flow_table = -1;
+    ctx->map_flow_stats = -1;
 }
 
 ebpf_binary_init(EBPF_PROGRAM_ID_RSS, rss_bpf__elf_bytes)
@@ -16,7 +16,7 @@
 
 #include "qapi/error.h"
 
-#define EBPF_RSS_MAX_FDS 4
+#define EBPF_RSS_MAX_FDS 6
 
 struct EBPFRSSContext {
     void *obj;
@@ -24,11 +24,14 @@ struct EBPFRSSContext {
     int map_configuration;
     int map_toeplitz_key;
     int map_indirections_table;
+    int map_flow_table;
+    int map_flow_stats;
 
     /* mapped eBPF maps for direct access to omit bpf_map_update_elem() */
     void *mmap_configuration;
     void *mmap_toeplitz_key;
     void *mmap_indirections_table;
+    void *mmap_flow_table;
 };
 
 struct EBPFRSSConfig {
@@ -37,6 +40,7 @@ struct EBPFRSSConfig {
     uint32_t hash_types;
     uint16_t indirections_len;
     uint16_t default_queue;
+    uint8_t flow_affinity;
 } __attribute__((packed));
 
 void ebpf_rss_init(struct EBPFRSSContext *ctx);
@@ -47,12 +51,21 @@ bool ebpf_rss_load(struct EBPFRSSContext *ctx, Error **errp);
 
 bool ebpf_rss_load_fds(struct EBPFRSSContext *ctx, int program_fd,
                        int config_fd, int toeplitz_fd, int table_fd,
-                       Error **errp);
+                       int flow_table_fd, int flow_stats_fd, Error **errp);
 
 bool ebpf_rss_set_all(struct EBPFRSSContext *ctx, struct EBPFRSSConfig *config,
                       uint16_t *indirections_table, uint8_t *toeplitz_key,
                       Error **errp);
 
+/*
+ * The flow table of the loaded program, VIRTIO_NET_FLOW_TABLE_SIZE entries
+ * of (flow hash << 32 | queue + 1), or NULL.
+ */
+uint64_t *ebpf_rss_flow_table(struct EBPFRSSContext *ctx);
+
+void ebpf_rss_get_flow_stats(struct EBPFRSSContext *ctx, uint64_t *hits,
+                             uint64_t *misses);
+
 void ebpf_rss_unload(struct EBPFRSSContext *ctx);
 
 #endif /* QEMU_EBPF_RSS_H */
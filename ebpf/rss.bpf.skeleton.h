@@ -15,6 +15,8 @@ struct rss_bpf {
 		struct bpf_map *tap_rss_map_configurations;
 		struct bpf_map *tap_rss_map_toeplitz_key;
 		struct bpf_map *tap_rss_map_indirection_table;
+		struct bpf_map *tap_rss_map_flow_table;
+		struct bpf_map *tap_rss_map_flow_stats;
 	} maps;
 	struct {
 		struct bpf_program *tun_rss_steering_prog;
@@ -135,7 +137,7 @@ rss_bpf__create_skeleton(struct rss_bpf *obj)
 	s->obj = &obj->obj;
 
 	/* maps */
-	s->map_cnt = 3;
+	s->map_cnt = 5;
 	s->map_skel_sz = sizeof(*s->maps);
 	s->maps = (struct bpf_map_skeleton *)calloc(s->map_cnt, s->map_skel_sz);
 	if (!s->maps) {
@@ -152,6 +154,12 @@ rss_bpf__create_skeleton(struct rss_bpf *obj)
 	s->maps[2].name = "tap_rss_map_indirection_table";
 	s->maps[2].map = &obj->maps.tap_rss_map_indirection_table;
 
+	s->maps[3].name = "tap_rss_map_flow_table";
+	s->maps[3].map = &obj->maps.tap_rss_map_flow_table;
+
+	s->maps[4].name = "tap_rss_map_flow_stats";
+	s->maps[4].map = &obj->maps.tap_rss_map_flow_stats;
+
 	/* programs */
 	s->prog_cnt = 1;
 	s->prog_skel_sz = sizeof(*s->progs);
@@ -178,786 +186,1128 @@ static inline const void *rss_bpf__elf_bytes(size_t *sz)
 {
 	static const char data[] __attribute__((__aligned__(8))) = "\
 \x7f\x45\x4c\x46\x02\x01\x01\0\0\0\0\0\0\0\0\0\x01\0\xf7\0\x01\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\0\0\0\0\0\0\xb0\x4b\0\0\0\0\0\0\0\0\0\0\x40\0\0\0\0\0\x40\0\x0d\0\
-\x01\0\x7b\x1a\x48\xff\0\0\0\0\xb7\x09\0\0\0\0\0\0\x63\x9a\x54\xff\0\0\0\0\xbf\
-\xa7\0\0\0\0\0\0\x07\x07\0\0\x54\xff\xff\xff\x18\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\
-\0\xbf\x72\0\0\0\0\0\0\x85\0\0\0\x01\0\0\0\xbf\x06\0\0\0\0\0\0\x18\x01\0\0\0\0\
-\0\0\0\0\0\0\0\0\0\0\xbf\x72\0\0\0\0\0\0\x85\0\0\0\x01\0\0\0\xbf\x07\0\0\0\0\0\
-\0\x15\x06\x4e\x02\0\0\0\0\xbf\x78\0\0\0\0\0\0\x15\x08\x4c\x02\0\0\0\0\x71\x61\
-\0\0\0\0\0\0\x55\x01\x01\0\0\0\0\0\x05\0\x45\x02\0\0\0\0\xb7\x01\0\0\0\0\0\0\
-\x63\x1a\xc8\xff\0\0\0\0\x7b\x1a\xc0\xff\0\0\0\0\x7b\x1a\xb8\xff\0\0\0\0\x7b\
-\x1a\xb0\xff\0\0\0\0\x7b\x1a\xa8\xff\0\0\0\0\x63\x1a\xa0\xff\0\0\0\0\x7b\x1a\
-\x98\xff\0\0\0\0\x7b\x1a\x90\xff\0\0\0\0\x7b\x1a\x88\xff\0\0\0\0\x7b\x1a\x80\
-\xff\0\0\0\0\x7b\x1a\x78\xff\0\0\0\0\x7b\x1a\x70\xff\0\0\0\0\x7b\x1a\x68\xff\0\
-\0\0\0\x7b\x1a\x60\xff\0\0\0\0\x7b\x1a\x58\xff\0\0\0\0\x79\xa9\x48\xff\0\0\0\0\
-\x15\x09\x33\x02\0\0\0\0\x6b\x1a\xd0\xff\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\
-\0\xd0\xff\xff\xff\xbf\x91\0\0\0\0\0\0\xb7\x02\0\0\x0c\0\0\0\xb7\x04\0\0\x02\0\
-\0\0\xb7\x05\0\0\0\0\0\0\x85\0\0\0\x44\0\0\0\x67\0\0\0\x20\0\0\0\x77\0\0\0\x20\
-\0\0\0\x55\0\x28\x02\0\0\0\0\xb7\x02\0\0\x10\0\0\0\x69\xa1\xd0\xff\0\0\0\0\xbf\
-\x13\0\0\0\0\0\0\xdc\x03\0\0\x10\0\0\0\x15\x03\x02\0\0\x81\0\0\x55\x03\x0b\0\
-\xa8\x88\0\0\xb7\x02\0\0\x14\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\xd0\xff\xff\
-\xff\xbf\x91\0\0\0\0\0\0\xb7\x04\0\0\x02\0\0\0\xb7\x05\0\0\0\0\0\0\x85\0\0\0\
-\x44\0\0\0\x67\0\0\0\x20\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\x18\x02\0\0\0\0\x69\
-\xa1\xd0\xff\0\0\0\0\x15\x01\x16\x02\0\0\0\0\x15\x01\x20\0\x86\xdd\0\0\x55\x01\
-\xf5\0\x08\0\0\0\xb7\x01\0\0\x01\0\0\0\x73\x1a\x58\xff\0\0\0\0\xb7\x01\0\0\0\0\
-\0\0\x63\x1a\xe0\xff\0\0\0\0\x7b\x1a\xd8\xff\0\0\0\0\x7b\x1a\xd0\xff\0\0\0\0\
-\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\xd0\xff\xff\xff\x79\xa1\x48\xff\0\0\0\0\xb7\
-\x02\0\0\0\0\0\0\xb7\x04\0\0\x14\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\
-\0\x67\0\0\0\x20\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\x04\x02\0\0\0\0\x69\xa1\xd6\
-\xff\0\0\0\0\x57\x01\0\0\x3f\xff\0\0\xb7\x04\0\0\x01\0\0\0\x55\x01\x01\0\0\0\0\
-\0\xb7\x04\0\0\0\0\0\0\x61\xa1\xdc\xff\0\0\0\0\x63\x1a\x64\xff\0\0\0\0\x61\xa1\
-\xe0\xff\0\0\0\0\x63\x1a\x68\xff\0\0\0\0\x71\xa9\xd9\xff\0\0\0\0\x71\xa2\xd0\
-\xff\0\0\0\0\x67\x02\0\0\x02\0\0\0\x57\x02\0\0\x3c\0\0\0\x73\x4a\x5e\xff\0\0\0\
-\0\x05\0\xbb\0\0\0\0\0\xb7\x01\0\0\x01\0\0\0\x73\x1a\x59\xff\0\0\0\0\xb7\x01\0\
-\0\0\0\0\0\x7b\x1a\xf0\xff\0\0\0\0\x7b\x1a\xe8\xff\0\0\0\0\x7b\x1a\xe0\xff\0\0\
-\0\0\x7b\x1a\xd8\xff\0\0\0\0\x7b\x1a\xd0\xff\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\
-\x03\0\0\xd0\xff\xff\xff\xbf\x91\0\0\0\0\0\0\xb7\x02\0\0\0\0\0\0\xb7\x04\0\0\
-\x28\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\x67\0\0\0\x20\0\0\0\x77\0\
-\0\0\x20\0\0\0\x55\0\xe3\x01\0\0\0\0\xb7\x03\0\0\x28\0\0\0\x79\xa1\xe0\xff\0\0\
-\0\0\x63\x1a\x6c\xff\0\0\0\0\x77\x01\0\0\x20\0\0\0\x63\x1a\x70\xff\0\0\0\0\x79\
-\xa1\xd8\xff\0\0\0\0\x63\x1a\x64\xff\0\0\0\0\x77\x01\0\0\x20\0\0\0\x63\x1a\x68\
-\xff\0\0\0\0\x79\xa1\xe8\xff\0\0\0\0\x63\x1a\x74\xff\0\0\0\0\x77\x01\0\0\x20\0\
-\0\0\x63\x1a\x78\xff\0\0\0\0\x79\xa1\xf0\xff\0\0\0\0\x63\x1a\x7c\xff\0\0\0\0\
-\x77\x01\0\0\x20\0\0\0\x63\x1a\x80\xff\0\0\0\0\x71\xa9\xd6\xff\0\0\0\0\x25\x09\
-\x93\0\x3c\0\0\0\xb7\x01\0\0\x01\0\0\0\x6f\x91\0\0\0\0\0\0\x18\x02\0\0\x01\0\0\
-\0\0\0\0\0\0\x18\0\x1c\x5f\x21\0\0\0\0\0\0\x55\x01\x01\0\0\0\0\0\x05\0\x8c\0\0\
-\0\0\0\xb7\x01\0\0\0\0\0\0\x6b\x1a\xfe\xff\0\0\0\0\xb7\x02\0\0\x28\0\0\0\xbf\
-\xa1\0\0\0\0\0\0\x07\x01\0\0\x94\xff\xff\xff\x7b\x1a\x20\xff\0\0\0\0\xbf\xa1\0\
-\0\0\0\0\0\x07\x01\0\0\x84\xff\xff\xff\x7b\x1a\x18\xff\0\0\0\0\xb7\x01\0\0\0\0\
-\0\0\x7b\x1a\x38\xff\0\0\0\0\x7b\x7a\x30\xff\0\0\0\0\x7b\x8a\x28\xff\0\0\0\0\
-\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\xfe\xff\xff\xff\x79\xa1\x48\xff\0\0\0\0\x7b\
-\x2a\x40\xff\0\0\0\0\xb7\x04\0\0\x02\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\
-\0\0\0\x67\0\0\0\x20\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\xb2\x01\0\0\0\0\xbf\x91\0\
-\0\0\0\0\0\x15\x01\x22\0\x3c\0\0\0\x15\x01\x58\0\x2c\0\0\0\x79\xa2\x40\xff\0\0\
-\0\0\x55\x01\x59\0\x2b\0\0\0\xb7\x01\0\0\0\0\0\0\x63\x1a\xf8\xff\0\0\0\0\xbf\
-\xa3\0\0\0\0\0\0\x07\x03\0\0\xf8\xff\xff\xff\x79\xa9\x48\xff\0\0\0\0\xbf\x91\0\
-\0\0\0\0\0\xb7\x04\0\0\x04\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\x67\
-\0\0\0\x20\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\xa1\x01\0\0\0\0\x71\xa1\xfa\xff\0\0\
-\0\0\x55\x01\x4a\0\x02\0\0\0\x71\xa1\xf9\xff\0\0\0\0\x55\x01\x48\0\x02\0\0\0\
-\x71\xa1\xfb\xff\0\0\0\0\x55\x01\x46\0\x01\0\0\0\x79\xa2\x40\xff\0\0\0\0\x07\
-\x02\0\0\x08\0\0\0\xbf\x91\0\0\0\0\0\0\x79\xa3\x20\xff\0\0\0\0\xb7\x04\0\0\x10\
+\0\0\0\0\0\0\0\0\0\0\0\x48\x6e\0\0\0\0\0\0\0\0\0\0\x40\0\0\0\0\0\x40\0\x0d\0\
+\x01\0\xbf\x18\0\0\0\0\0\0\xb7\x09\0\0\0\0\0\0\x63\x9a\xa0\xff\0\0\0\0\x7b\x9a\
+\x98\xff\0\0\0\0\x7b\x9a\x90\xff\0\0\0\0\x7b\x9a\x88\xff\0\0\0\0\x7b\x9a\x80\
+\xff\0\0\0\0\x7b\x9a\x78\xff\0\0\0\0\x7b\x9a\x70\xff\0\0\0\0\x7b\x9a\x68\xff\0\
+\0\0\0\x7b\x9a\x60\xff\0\0\0\0\x7b\x9a\x58\xff\0\0\0\0\x63\x9a\x54\xff\0\0\0\0\
+\xbf\xa7\0\0\0\0\0\0\x07\x07\0\0\x54\xff\xff\xff\x18\x01\0\0\0\0\0\0\0\0\0\0\0\
+\0\0\0\xbf\x72\0\0\0\0\0\0\x85\0\0\0\x01\0\0\0\xbf\x06\0\0\0\0\0\0\x18\x01\0\0\
+\0\0\0\0\0\0\0\0\0\0\0\0\xbf\x72\0\0\0\0\0\0\x85\0\0\0\x01\0\0\0\xbf\x07\0\0\0\
+\0\0\0\x15\x06\xa8\x01\0\0\0\0\xbf\x72\0\0\0\0\0\0\x15\x02\xa6\x01\0\0\0\0\x71\
+\x61\0\0\0\0\0\0\x15\x01\xa0\x01\0\0\0\0\xb7\x01\0\0\0\0\0\0\x63\x1a\xc8\xff\0\
+\0\0\0\x7b\x1a\xc0\xff\0\0\0\0\x7b\x1a\xb8\xff\0\0\0\0\x7b\x1a\xb0\xff\0\0\0\0\
+\x7b\x1a\xa8\xff\0\0\0\0\x15\x08\x99\x01\0\0\0\0\x7b\x2a\x48\xff\0\0\0\0\x6b\
+\x1a\xd0\xff\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\xd0\xff\xff\xff\xbf\x81\0\
+\0\0\0\0\0\xb7\x02\0\0\x0c\0\0\0\xb7\x04\0\0\x02\0\0\0\xb7\x05\0\0\0\0\0\0\x85\
+\0\0\0\x44\0\0\0\x67\0\0\0\x20\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\x8d\x01\0\0\0\0\
+\xb7\x02\0\0\x10\0\0\0\x69\xa1\xd0\xff\0\0\0\0\xbf\x13\0\0\0\0\0\0\xdc\x03\0\0\
+\x10\0\0\0\x15\x03\x02\0\0\x81\0\0\x55\x03\x0b\0\xa8\x88\0\0\xb7\x02\0\0\x14\0\
+\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\xd0\xff\xff\xff\xbf\x81\0\0\0\0\0\0\xb7\
+\x04\0\0\x02\0\0\0\xb7\x05\0\0\0\0\0\0\x85\0\0\0\x44\0\0\0\x67\0\0\0\x20\0\0\0\
+\x77\0\0\0\x20\0\0\0\x55\0\x7d\x01\0\0\0\0\x69\xa1\xd0\xff\0\0\0\0\x79\xa5\x48\
+\xff\0\0\0\0\x15\x01\x7a\x01\0\0\0\0\x15\x01\x5b\0\x86\xdd\0\0\x55\x01\x3d\0\
+\x08\0\0\0\xb7\x01\0\0\x01\0\0\0\x73\x1a\x58\xff\0\0\0\0\xb7\x01\0\0\0\0\0\0\
+\x63\x1a\xe0\xff\0\0\0\0\x7b\x1a\xd8\xff\0\0\0\0\x7b\x1a\xd0\xff\0\0\0\0\xbf\
+\xa3\0\0\0\0\0\0\x07\x03\0\0\xd0\xff\xff\xff\xbf\x81\0\0\0\0\0\0\xb7\x02\0\0\0\
+\0\0\0\xb7\x04\0\0\x14\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\x67\0\0\
+\0\x20\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\x68\x01\0\0\0\0\x69\xa1\xd6\xff\0\0\0\0\
+\x57\x01\0\0\x3f\xff\0\0\xb7\x02\0\0\x01\0\0\0\x55\x01\x01\0\0\0\0\0\xb7\x02\0\
+\0\0\0\0\0\x61\xa1\xdc\xff\0\0\0\0\x63\x1a\x64\xff\0\0\0\0\x61\xa1\xe0\xff\0\0\
+\0\0\x63\x1a\x68\xff\0\0\0\0\x71\xa9\xd9\xff\0\0\0\0\x71\xa1\xd0\xff\0\0\0\0\
+\x67\x01\0\0\x02\0\0\0\x57\x01\0\0\x3c\0\0\0\x7b\x1a\x40\xff\0\0\0\0\x73\x2a\
+\x5e\xff\0\0\0\0\x79\xa5\x48\xff\0\0\0\0\xbf\x91\0\0\0\0\0\0\x57\x01\0\0\xff\0\
+\0\0\x15\x01\x1a\0\0\0\0\0\x57\x02\0\0\xff\0\0\0\x55\x02\x18\0\0\0\0\0\x57\x09\
+\0\0\xff\0\0\0\x15\x09\x8a\x01\x11\0\0\0\x55\x09\x15\0\x06\0\0\0\xb7\x01\0\0\
+\x01\0\0\0\x73\x1a\x5b\xff\0\0\0\0\xb7\x01\0\0\0\0\0\0\x63\x1a\xe0\xff\0\0\0\0\
+\x7b\x1a\xd8\xff\0\0\0\0\x7b\x1a\xd0\xff\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\
+\0\xd0\xff\xff\xff\xbf\x81\0\0\0\0\0\0\x79\xa2\x40\xff\0\0\0\0\xb7\x04\0\0\x14\
 \0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\x67\0\0\0\x20\0\0\0\x77\0\0\0\
-\x20\0\0\0\x55\0\x91\x01\0\0\0\0\xb7\x01\0\0\x01\0\0\0\x73\x1a\x5d\xff\0\0\0\0\
-\x05\0\x39\0\0\0\0\0\xb7\x08\0\0\x02\0\0\0\xb7\x07\0\0\0\0\0\0\x6b\x7a\xf8\xff\
-\0\0\0\0\x05\0\x12\0\0\0\0\0\x0f\x81\0\0\0\0\0\0\xbf\x12\0\0\0\0\0\0\x07\x02\0\
-\0\x01\0\0\0\x71\xa3\xff\xff\0\0\0\0\x67\x03\0\0\x03\0\0\0\x3d\x32\x09\0\0\0\0\
-\0\xbf\x72\0\0\0\0\0\0\x07\x02\0\0\x01\0\0\0\x67\x07\0\0\x20\0\0\0\xbf\x73\0\0\
-\0\0\0\0\x77\x03\0\0\x20\0\0\0\xbf\x27\0\0\0\0\0\0\xbf\x18\0\0\0\0\0\0\xb7\x01\
-\0\0\x1d\0\0\0\x2d\x31\x03\0\0\0\0\0\x79\xa7\x30\xff\0\0\0\0\x79\xa8\x28\xff\0\
-\0\0\0\x05\0\x23\0\0\0\0\0\xbf\x89\0\0\0\0\0\0\x79\xa1\x40\xff\0\0\0\0\x0f\x19\
-\0\0\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\xf8\xff\xff\xff\x79\xa1\x48\xff\0\
-\0\0\0\xbf\x92\0\0\0\0\0\0\xb7\x04\0\0\x02\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\
-\0\x44\0\0\0\x67\0\0\0\x20\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\x6b\x01\0\0\0\0\x71\
-\xa2\xf8\xff\0\0\0\0\x55\x02\x0d\0\xc9\0\0\0\x07\x09\0\0\x02\0\0\0\x79\xa1\x48\
-\xff\0\0\0\0\xbf\x92\0\0\0\0\0\0\x79\xa3\x18\xff\0\0\0\0\xb7\x04\0\0\x10\0\0\0\
-\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\x67\0\0\0\x20\0\0\0\x77\0\0\0\x20\0\
-\0\0\x55\0\x5f\x01\0\0\0\0\xb7\x01\0\0\x01\0\0\0\x73\x1a\x5c\xff\0\0\0\0\x05\0\
-\xe1\xff\0\0\0\0\xb7\x01\0\0\x01\0\0\0\x15\x02\xd0\xff\0\0\0\0\x71\xa1\xf9\xff\
-\0\0\0\0\x07\x01\0\0\x02\0\0\0\x05\0\xcd\xff\0\0\0\0\xb7\x01\0\0\x01\0\0\0\x73\
-\x1a\x5e\xff\0\0\0\0\x79\xa2\x40\xff\0\0\0\0\x71\xa1\xff\xff\0\0\0\0\x67\x01\0\
-\0\x03\0\0\0\x0f\x12\0\0\0\0\0\0\x07\x02\0\0\x08\0\0\0\x71\xa9\xfe\xff\0\0\0\0\
-\x25\x09\x0e\0\x3c\0\0\0\xb7\x01\0\0\x01\0\0\0\x6f\x91\0\0\0\0\0\0\x18\x03\0\0\
-\x01\0\0\0\0\0\0\0\0\x18\0\x1c\x5f\x31\0\0\0\0\0\0\x55\x01\x01\0\0\0\0\0\x05\0\
-\x07\0\0\0\0\0\x79\xa1\x38\xff\0\0\0\0\x07\x01\0\0\x01\0\0\0\x7b\x1a\x38\xff\0\
-\0\0\0\x67\x01\0\0\x20\0\0\0\x77\x01\0\0\x20\0\0\0\x15\x01\x02\0\x0b\0\0\0\x05\
-\0\x84\xff\0\0\0\0\x15\x09\xf8\xff\x87\0\0\0\xbf\x23\0\0\0\0\0\0\x05\0\x01\0\0\
-\0\0\0\x15\x09\x73\xff\x87\0\0\0\x71\xa4\x5e\xff\0\0\0\0\xbf\x32\0\0\0\0\0\0\
-\xbf\x91\0\0\0\0\0\0\x57\x01\0\0\xff\0\0\0\x15\x01\x18\0\0\0\0\0\x57\x04\0\0\
-\xff\0\0\0\x55\x04\x16\0\0\0\0\0\x57\x09\0\0\xff\0\0\0\x15\x09\xb4\0\x11\0\0\0\
-\x55\x09\x13\0\x06\0\0\0\xb7\x01\0\0\x01\0\0\0\x73\x1a\x5b\xff\0\0\0\0\xb7\x01\
-\0\0\0\0\0\0\x63\x1a\xe0\xff\0\0\0\0\x7b\x1a\xd8\xff\0\0\0\0\x7b\x1a\xd0\xff\0\
-\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\xd0\xff\xff\xff\x79\xa1\x48\xff\0\0\0\0\
-\xb7\x04\0\0\x14\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\x67\0\0\0\x20\
-\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\x23\x01\0\0\0\0\x69\xa1\xd0\xff\0\0\0\0\x6b\
-\x1a\x60\xff\0\0\0\0\x69\xa1\xd2\xff\0\0\0\0\x6b\x1a\x62\xff\0\0\0\0\x71\xa1\
-\x58\xff\0\0\0\0\x15\x01\x18\0\0\0\0\0\x71\x62\x03\0\0\0\0\0\x67\x02\0\0\x08\0\
-\0\0\x71\x61\x02\0\0\0\0\0\x4f\x12\0\0\0\0\0\0\x71\x63\x04\0\0\0\0\0\x67\x03\0\
-\0\x10\0\0\0\x71\x61\x05\0\0\0\0\0\x67\x01\0\0\x18\0\0\0\x4f\x31\0\0\0\0\0\0\
-\x4f\x21\0\0\0\0\0\0\x71\xa2\x5b\xff\0\0\0\0\x15\x02\x49\0\0\0\0\0\xbf\x12\0\0\
-\0\0\0\0\x57\x02\0\0\x02\0\0\0\x15\x02\x46\0\0\0\0\0\x61\xa1\x64\xff\0\0\0\0\
-\x63\x1a\xa8\xff\0\0\0\0\x61\xa1\x68\xff\0\0\0\0\x63\x1a\xac\xff\0\0\0\0\x69\
-\xa1\x60\xff\0\0\0\0\x6b\x1a\xb0\xff\0\0\0\0\x69\xa1\x62\xff\0\0\0\0\x6b\x1a\
-\xb2\xff\0\0\0\0\x05\0\x9c\0\0\0\0\0\x71\xa1\x59\xff\0\0\0\0\x15\x01\x03\x01\0\
-\0\0\0\x71\x62\x03\0\0\0\0\0\x67\x02\0\0\x08\0\0\0\x71\x61\x02\0\0\0\0\0\x4f\
-\x12\0\0\0\0\0\0\x71\x63\x04\0\0\0\0\0\x67\x03\0\0\x10\0\0\0\x71\x61\x05\0\0\0\
-\0\0\x67\x01\0\0\x18\0\0\0\x4f\x31\0\0\0\0\0\0\x4f\x21\0\0\0\0\0\0\x71\xa2\x5b\
-\xff\0\0\0\0\x15\x02\x3c\0\0\0\0\0\xbf\x12\0\0\0\0\0\0\x57\x02\0\0\x10\0\0\0\
-\x15\x02\x39\0\0\0\0\0\xbf\xa2\0\0\0\0\0\0\x07\x02\0\0\x64\xff\xff\xff\x71\xa4\
-\x5c\xff\0\0\0\0\xbf\x23\0\0\0\0\0\0\x15\x04\x02\0\0\0\0\0\xbf\xa3\0\0\0\0\0\0\
-\x07\x03\0\0\x84\xff\xff\xff\x57\x01\0\0\x80\0\0\0\x15\x01\x01\0\0\0\0\0\xbf\
-\x32\0\0\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\x74\xff\xff\xff\x71\xa5\x5d\
-\xff\0\0\0\0\xbf\x34\0\0\0\0\0\0\x15\x05\x02\0\0\0\0\0\xbf\xa4\0\0\0\0\0\0\x07\
-\x04\0\0\x94\xff\xff\xff\x15\x01\x01\0\0\0\0\0\xbf\x43\0\0\0\0\0\0\x61\x21\x04\
-\0\0\0\0\0\x67\x01\0\0\x20\0\0\0\x61\x24\0\0\0\0\0\0\x4f\x41\0\0\0\0\0\0\x7b\
-\x1a\xa8\xff\0\0\0\0\x61\x21\x08\0\0\0\0\0\x61\x22\x0c\0\0\0\0\0\x67\x02\0\0\
-\x20\0\0\0\x4f\x12\0\0\0\0\0\0\x7b\x2a\xb0\xff\0\0\0\0\x61\x31\0\0\0\0\0\0\x61\
-\x32\x04\0\0\0\0\0\x61\x34\x08\0\0\0\0\0\x61\x33\x0c\0\0\0\0\0\x69\xa5\x62\xff\
-\0\0\0\0\x6b\x5a\xca\xff\0\0\0\0\x69\xa5\x60\xff\0\0\0\0\x6b\x5a\xc8\xff\0\0\0\
-\0\x67\x03\0\0\x20\0\0\0\x4f\x43\0\0\0\0\0\0\x7b\x3a\xc0\xff\0\0\0\0\x67\x02\0\
-\0\x20\0\0\0\x4f\x12\0\0\0\0\0\0\x7b\x2a\xb8\xff\0\0\0\0\x05\0\x5f\0\0\0\0\0\
-\x71\xa2\x5a\xff\0\0\0\0\x15\x02\x04\0\0\0\0\0\xbf\x12\0\0\0\0\0\0\x57\x02\0\0\
-\x04\0\0\0\x15\x02\x01\0\0\0\0\0\x05\0\xb4\xff\0\0\0\0\x57\x01\0\0\x01\0\0\0\
-\x15\x01\xc0\0\0\0\0\0\x61\xa1\x64\xff\0\0\0\0\x63\x1a\xa8\xff\0\0\0\0\x61\xa1\
-\x68\xff\0\0\0\0\x63\x1a\xac\xff\0\0\0\0\x05\0\x52\0\0\0\0\0\x71\xa2\x5a\xff\0\
-\0\0\0\x15\x02\x16\0\0\0\0\0\xbf\x12\0\0\0\0\0\0\x57\x02\0\0\x20\0\0\0\x15\x02\
-\x13\0\0\0\0\0\xbf\xa2\0\0\0\0\0\0\x07\x02\0\0\x64\xff\xff\xff\x71\xa4\x5c\xff\
-\0\0\0\0\xbf\x23\0\0\0\0\0\0\x15\x04\x02\0\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\
-\0\0\x84\xff\xff\xff\x57\x01\0\0\0\x01\0\0\x15\x01\x01\0\0\0\0\0\xbf\x32\0\0\0\
-\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\x74\xff\xff\xff\x71\xa5\x5d\xff\0\0\0\0\
-\xbf\x34\0\0\0\0\0\0\x15\x05\x02\0\0\0\0\0\xbf\xa4\0\0\0\0\0\0\x07\x04\0\0\x94\
-\xff\xff\xff\x15\x01\xc3\xff\0\0\0\0\x05\0\xc1\xff\0\0\0\0\xbf\x12\0\0\0\0\0\0\
-\x57\x02\0\0\x08\0\0\0\x15\x02\xa0\0\0\0\0\0\xbf\xa2\0\0\0\0\0\0\x07\x02\0\0\
-\x64\xff\xff\xff\x71\xa4\x5c\xff\0\0\0\0\xbf\x23\0\0\0\0\0\0\x15\x04\x02\0\0\0\
-\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\x84\xff\xff\xff\x57\x01\0\0\x40\0\0\0\x15\
-\x01\x01\0\0\0\0\0\xbf\x32\0\0\0\0\0\0\x61\x23\x04\0\0\0\0\0\x67\x03\0\0\x20\0\
-\0\0\x61\x24\0\0\0\0\0\0\x4f\x43\0\0\0\0\0\0\x7b\x3a\xa8\xff\0\0\0\0\x61\x23\
-\x08\0\0\0\0\0\x61\x22\x0c\0\0\0\0\0\x67\x02\0\0\x20\0\0\0\x4f\x32\0\0\0\0\0\0\
-\x7b\x2a\xb0\xff\0\0\0\0\xbf\xa2\0\0\0\0\0\0\x07\x02\0\0\xb8\xff\xff\xff\x15\
-\x01\x18\0\0\0\0\0\x71\xa1\x5d\xff\0\0\0\0\x15\x01\x16\0\0\0\0\0\x61\xa1\xa0\
-\xff\0\0\0\0\x63\x12\x0c\0\0\0\0\0\x61\xa1\x9c\xff\0\0\0\0\x63\x12\x08\0\0\0\0\
-\0\x61\xa1\x98\xff\0\0\0\0\x63\x12\x04\0\0\0\0\0\x61\xa1\x94\xff\0\0\0\0\x05\0\
-\x15\0\0\0\0\0\xb7\x01\0\0\x01\0\0\0\x73\x1a\x5a\xff\0\0\0\0\xb7\x01\0\0\0\0\0\
-\0\x7b\x1a\xd0\xff\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\xd0\xff\xff\xff\x79\
-\xa1\x48\xff\0\0\0\0\xb7\x04\0\0\x08\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\
-\0\0\0\x67\0\0\0\x20\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\x72\0\0\0\0\0\x05\0\x4e\
-\xff\0\0\0\0\x61\xa1\x80\xff\0\0\0\0\x63\x12\x0c\0\0\0\0\0\x61\xa1\x7c\xff\0\0\
-\0\0\x63\x12\x08\0\0\0\0\0\x61\xa1\x78\xff\0\0\0\0\x63\x12\x04\0\0\0\0\0\x61\
-\xa1\x74\xff\0\0\0\0\x63\x12\0\0\0\0\0\0\xb7\x01\0\0\0\0\0\0\x07\x07\0\0\x04\0\
-\0\0\x61\x83\0\0\0\0\0\0\xb7\x05\0\0\0\0\0\0\xbf\xa2\0\0\0\0\0\0\x07\x02\0\0\
-\xa8\xff\xff\xff\x0f\x12\0\0\0\0\0\0\x71\x24\0\0\0\0\0\0\xbf\x42\0\0\0\0\0\0\
-\x67\x02\0\0\x38\0\0\0\xc7\x02\0\0\x3f\0\0\0\x5f\x32\0\0\0\0\0\0\xaf\x52\0\0\0\
-\0\0\0\xbf\x75\0\0\0\0\0\0\x0f\x15\0\0\0\0\0\0\x71\x55\0\0\0\0\0\0\x67\x03\0\0\
-\x01\0\0\0\xbf\x50\0\0\0\0\0\0\x77\0\0\0\x07\0\0\0\x4f\x03\0\0\0\0\0\0\xbf\x40\
-\0\0\0\0\0\0\x67\0\0\0\x39\0\0\0\xc7\0\0\0\x3f\0\0\0\x5f\x30\0\0\0\0\0\0\xaf\
-\x02\0\0\0\0\0\0\xbf\x50\0\0\0\0\0\0\x77\0\0\0\x06\0\0\0\x57\0\0\0\x01\0\0\0\
-\x67\x03\0\0\x01\0\0\0\x4f\x03\0\0\0\0\0\0\xbf\x40\0\0\0\0\0\0\x67\0\0\0\x3a\0\
-\0\0\xc7\0\0\0\x3f\0\0\0\x5f\x30\0\0\0\0\0\0\xaf\x02\0\0\0\0\0\0\x67\x03\0\0\
-\x01\0\0\0\xbf\x50\0\0\0\0\0\0\x77\0\0\0\x05\0\0\0\x57\0\0\0\x01\0\0\0\x4f\x03\
-\0\0\0\0\0\0\xbf\x40\0\0\0\0\0\0\x67\0\0\0\x3b\0\0\0\xc7\0\0\0\x3f\0\0\0\x5f\
-\x30\0\0\0\0\0\0\xaf\x02\0\0\0\0\0\0\x67\x03\0\0\x01\0\0\0\xbf\x50\0\0\0\0\0\0\
-\x77\0\0\0\x04\0\0\0\x57\0\0\0\x01\0\0\0\x4f\x03\0\0\0\0\0\0\xbf\x40\0\0\0\0\0\
-\0\x67\0\0\0\x3c\0\0\0\xc7\0\0\0\x3f\0\0\0\x5f\x30\0\0\0\0\0\0\xaf\x02\0\0\0\0\
-\0\0\xbf\x50\0\0\0\0\0\0\x77\0\0\0\x03\0\0\0\x57\0\0\0\x01\0\0\0\x67\x03\0\0\
-\x01\0\0\0\x4f\x03\0\0\0\0\0\0\xbf\x40\0\0\0\0\0\0\x67\0\0\0\x3d\0\0\0\xc7\0\0\
-\0\x3f\0\0\0\x5f\x30\0\0\0\0\0\0\xaf\x02\0\0\0\0\0\0\xbf\x50\0\0\0\0\0\0\x77\0\
-\0\0\x02\0\0\0\x57\0\0\0\x01\0\0\0\x67\x03\0\0\x01\0\0\0\x4f\x03\0\0\0\0\0\0\
-\xbf\x40\0\0\0\0\0\0\x67\0\0\0\x3e\0\0\0\xc7\0\0\0\x3f\0\0\0\x5f\x30\0\0\0\0\0\
-\0\xaf\x02\0\0\0\0\0\0\xbf\x50\0\0\0\0\0\0\x77\0\0\0\x01\0\0\0\x57\0\0\0\x01\0\
-\0\0\x67\x03\0\0\x01\0\0\0\x4f\x03\0\0\0\0\0\0\x57\x04\0\0\x01\0\0\0\x87\x04\0\
-\0\0\0\0\0\x5f\x34\0\0\0\0\0\0\xaf\x42\0\0\0\0\0\0\x57\x05\0\0\x01\0\0\0\x67\
-\x03\0\0\x01\0\0\0\x4f\x53\0\0\0\0\0\0\x07\x01\0\0\x01\0\0\0\xbf\x25\0\0\0\0\0\
-\0\x15\x01\x01\0\x24\0\0\0\x05\0\xa9\xff\0\0\0\0\x71\x61\x06\0\0\0\0\0\x71\x63\
-\x07\0\0\0\0\0\x67\x03\0\0\x08\0\0\0\x4f\x13\0\0\0\0\0\0\x67\x02\0\0\x20\0\0\0\
-\x77\x02\0\0\x20\0\0\0\x9f\x32\0\0\0\0\0\0\x63\x2a\x58\xff\0\0\0\0\xbf\xa2\0\0\
-\0\0\0\0\x07\x02\0\0\x58\xff\xff\xff\x18\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x85\0\
-\0\0\x01\0\0\0\x55\0\x07\0\0\0\0\0\x71\x61\x08\0\0\0\0\0\x71\x69\x09\0\0\0\0\0\
-\x67\x09\0\0\x08\0\0\0\x4f\x19\0\0\0\0\0\0\x57\x09\0\0\xff\xff\0\0\xbf\x90\0\0\
-\0\0\0\0\x95\0\0\0\0\0\0\0\x69\x09\0\0\0\0\0\0\x05\0\xfb\xff\0\0\0\0\0\0\0\0\0\
+\x20\0\0\0\x55\0\x40\x01\0\0\0\0\x69\xa1\xd0\xff\0\0\0\0\x6b\x1a\x60\xff\0\0\0\
+\0\x69\xa1\xd2\xff\0\0\0\0\x6b\x1a\x62\xff\0\0\0\0\x79\xa5\x48\xff\0\0\0\0\x71\
+\xa1\x58\xff\0\0\0\0\x15\x01\xda\0\0\0\0\0\x71\x62\x03\0\0\0\0\0\x67\x02\0\0\
+\x08\0\0\0\x71\x63\x02\0\0\0\0\0\x4f\x32\0\0\0\0\0\0\x71\x64\x04\0\0\0\0\0\x71\
+\x63\x05\0\0\0\0\0\x67\x03\0\0\x08\0\0\0\x4f\x43\0\0\0\0\0\0\x67\x03\0\0\x10\0\
+\0\0\x4f\x23\0\0\0\0\0\0\x71\xa2\x5b\xff\0\0\0\0\x15\x02\x0e\x01\0\0\0\0\xbf\
+\x34\0\0\0\0\0\0\x57\x04\0\0\x02\0\0\0\x15\x04\x0b\x01\0\0\0\0\xbf\x79\0\0\0\0\
+\0\0\xbf\x67\0\0\0\0\0\0\x61\xa2\x64\xff\0\0\0\0\x63\x2a\xa8\xff\0\0\0\0\x61\
+\xa2\x68\xff\0\0\0\0\x63\x2a\xac\xff\0\0\0\0\x69\xa2\x60\xff\0\0\0\0\x6b\x2a\
+\xb0\xff\0\0\0\0\x69\xa2\x62\xff\0\0\0\0\x6b\x2a\xb2\xff\0\0\0\0\xb7\x02\0\0\
+\x01\0\0\0\x05\0\x9b\x01\0\0\0\0\xb7\x01\0\0\x01\0\0\0\x73\x1a\x59\xff\0\0\0\0\
+\xb7\x01\0\0\0\0\0\0\x7b\x1a\xf0\xff\0\0\0\0\x7b\x1a\xe8\xff\0\0\0\0\x7b\x1a\
+\xe0\xff\0\0\0\0\x7b\x1a\xd8\xff\0\0\0\0\x7b\x1a\xd0\xff\0\0\0\0\xbf\xa3\0\0\0\
+\0\0\0\x07\x03\0\0\xd0\xff\xff\xff\xb7\x01\0\0\x28\0\0\0\x7b\x1a\x40\xff\0\0\0\
+\0\xbf\x81\0\0\0\0\0\0\xb7\x02\0\0\0\0\0\0\xb7\x04\0\0\x28\0\0\0\xb7\x05\0\0\
+\x01\0\0\0\x85\0\0\0\x44\0\0\0\x67\0\0\0\x20\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\
+\x0a\x01\0\0\0\0\x79\xa1\xe0\xff\0\0\0\0\x63\x1a\x6c\xff\0\0\0\0\x77\x01\0\0\
+\x20\0\0\0\x63\x1a\x70\xff\0\0\0\0\x79\xa1\xd8\xff\0\0\0\0\x63\x1a\x64\xff\0\0\
+\0\0\x77\x01\0\0\x20\0\0\0\x63\x1a\x68\xff\0\0\0\0\x79\xa1\xe8\xff\0\0\0\0\x63\
+\x1a\x74\xff\0\0\0\0\x77\x01\0\0\x20\0\0\0\x63\x1a\x78\xff\0\0\0\0\x79\xa1\xf0\
+\xff\0\0\0\0\x63\x1a\x7c\xff\0\0\0\0\x77\x01\0\0\x20\0\0\0\x63\x1a\x80\xff\0\0\
+\0\0\x71\xa9\xd6\xff\0\0\0\0\x25\x09\x40\x01\x3c\0\0\0\xb7\x01\0\0\x01\0\0\0\
+\x6f\x91\0\0\0\0\0\0\x18\x02\0\0\x01\0\0\0\0\0\0\0\0\x18\0\x1c\x5f\x21\0\0\0\0\
+\0\0\x55\x01\x01\0\0\0\0\0\x05\0\x39\x01\0\0\0\0\xb7\x01\0\0\0\0\0\0\x6b\x1a\
+\xfe\xff\0\0\0\0\xb7\x01\0\0\x28\0\0\0\x7b\x1a\x40\xff\0\0\0\0\xbf\xa1\0\0\0\0\
+\0\0\x07\x01\0\0\x94\xff\xff\xff\x7b\x1a\x20\xff\0\0\0\0\xbf\xa1\0\0\0\0\0\0\
+\x07\x01\0\0\x84\xff\xff\xff\x7b\x1a\x18\xff\0\0\0\0\xb7\x01\0\0\0\0\0\0\x7b\
+\x1a\x38\xff\0\0\0\0\x7b\x6a\x30\xff\0\0\0\0\x7b\x7a\x28\xff\0\0\0\0\xbf\xa3\0\
+\0\0\0\0\0\x07\x03\0\0\xfe\xff\xff\xff\xbf\x81\0\0\0\0\0\0\x79\xa2\x40\xff\0\0\
+\0\0\xb7\x04\0\0\x02\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\x67\0\0\0\
+\x20\0\0\0\x77\0\0\0\x20\0\0\0\x15\0\x01\0\0\0\0\0\x05\0\xd8\0\0\0\0\0\xbf\x91\
+\0\0\0\0\0\0\x15\x01\x23\0\x3c\0\0\0\x15\x01\x5b\0\x2c\0\0\0\x55\x01\x5c\0\x2b\
+\0\0\0\xb7\x01\0\0\0\0\0\0\x63\x1a\xf8\xff\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\
+\0\0\xf8\xff\xff\xff\xbf\x81\0\0\0\0\0\0\x79\xa2\x40\xff\0\0\0\0\xb7\x04\0\0\
+\x04\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\xbf\x01\0\0\0\0\0\0\x67\
+\x01\0\0\x20\0\0\0\x77\x01\0\0\x20\0\0\0\x55\x01\x37\x01\0\0\0\0\x71\xa1\xfa\
+\xff\0\0\0\0\x55\x01\x4d\0\x02\0\0\0\x71\xa1\xf9\xff\0\0\0\0\x55\x01\x4b\0\x02\
+\0\0\0\x71\xa1\xfb\xff\0\0\0\0\x55\x01\x49\0\x01\0\0\0\x79\xa2\x40\xff\0\0\0\0\
+\x07\x02\0\0\x08\0\0\0\xbf\x81\0\0\0\0\0\0\x79\xa3\x20\xff\0\0\0\0\xb7\x04\0\0\
+\x10\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\xbf\x01\0\0\0\0\0\0\x67\
+\x01\0\0\x20\0\0\0\x77\x01\0\0\x20\0\0\0\x55\x01\x26\x01\0\0\0\0\xb7\x01\0\0\
+\x01\0\0\0\x73\x1a\x5d\xff\0\0\0\0\x05\0\x3b\0\0\0\0\0\xb7\x06\0\0\x02\0\0\0\
+\xb7\x07\0\0\0\0\0\0\x6b\x7a\xf8\xff\0\0\0\0\x05\0\x12\0\0\0\0\0\x0f\x61\0\0\0\
+\0\0\0\xbf\x12\0\0\0\0\0\0\x07\x02\0\0\x01\0\0\0\x71\xa3\xff\xff\0\0\0\0\x67\
+\x03\0\0\x03\0\0\0\x3d\x32\x09\0\0\0\0\0\xbf\x72\0\0\0\0\0\0\x07\x02\0\0\x01\0\
+\0\0\x67\x07\0\0\x20\0\0\0\xbf\x73\0\0\0\0\0\0\x77\x03\0\0\x20\0\0\0\xbf\x27\0\
+\0\0\0\0\0\xbf\x16\0\0\0\0\0\0\xb7\x01\0\0\x1d\0\0\0\x2d\x31\x03\0\0\0\0\0\x79\
+\xa6\x30\xff\0\0\0\0\x79\xa7\x28\xff\0\0\0\0\x05\0\x25\0\0\0\0\0\xbf\x69\0\0\0\
+\0\0\0\x79\xa1\x40\xff\0\0\0\0\x0f\x19\0\0\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\
+\0\0\xf8\xff\xff\xff\xbf\x81\0\0\0\0\0\0\xbf\x92\0\0\0\0\0\0\xb7\x04\0\0\x02\0\
+\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\xbf\x01\0\0\0\0\0\0\x67\x01\0\0\
+\x20\0\0\0\x77\x01\0\0\x20\0\0\0\x55\x01\x89\0\0\0\0\0\x71\xa2\xf8\xff\0\0\0\0\
+\x55\x02\x0e\0\xc9\0\0\0\x07\x09\0\0\x02\0\0\0\xbf\x81\0\0\0\0\0\0\xbf\x92\0\0\
+\0\0\0\0\x79\xa3\x18\xff\0\0\0\0\xb7\x04\0\0\x10\0\0\0\xb7\x05\0\0\x01\0\0\0\
+\x85\0\0\0\x44\0\0\0\xbf\x01\0\0\0\0\0\0\x67\x01\0\0\x20\0\0\0\x77\x01\0\0\x20\
+\0\0\0\x55\x01\x7c\0\0\0\0\0\xb7\x01\0\0\x01\0\0\0\x73\x1a\x5c\xff\0\0\0\0\x05\
+\0\xdf\xff\0\0\0\0\xb7\x01\0\0\x01\0\0\0\x15\x02\xce\xff\0\0\0\0\x71\xa1\xf9\
+\xff\0\0\0\0\x07\x01\0\0\x02\0\0\0\x05\0\xcb\xff\0\0\0\0\xb7\x01\0\0\x01\0\0\0\
+\x73\x1a\x5e\xff\0\0\0\0\x71\xa1\xff\xff\0\0\0\0\x67\x01\0\0\x03\0\0\0\x79\xa2\
+\x40\xff\0\0\0\0\x0f\x12\0\0\0\0\0\0\x07\x02\0\0\x08\0\0\0\x7b\x2a\x40\xff\0\0\
+\0\0\x71\xa9\xfe\xff\0\0\0\0\x25\x09\x0f\0\x3c\0\0\0\xb7\x01\0\0\x01\0\0\0\x6f\
+\x91\0\0\0\0\0\0\x18\x02\0\0\x01\0\0\0\0\0\0\0\0\x18\0\x1c\x5f\x21\0\0\0\0\0\0\
+\x55\x01\x01\0\0\0\0\0\x05\0\x08\0\0\0\0\0\x79\xa1\x38\xff\0\0\0\0\x07\x01\0\0\
+\x01\0\0\0\x7b\x1a\x38\xff\0\0\0\0\x67\x01\0\0\x20\0\0\0\x77\x01\0\0\x20\0\0\0\
+\x55\x01\x80\xff\x0b\0\0\0\x71\xa2\x5e\xff\0\0\0\0\x05\0\x08\xff\0\0\0\0\x15\
+\x09\xf7\xff\x87\0\0\0\x05\0\xfc\xff\0\0\0\0\x71\xa2\x59\xff\0\0\0\0\x15\x02\
+\x5d\0\0\0\0\0\x71\x62\x03\0\0\0\0\0\x67\x02\0\0\x08\0\0\0\x71\x63\x02\0\0\0\0\
+\0\x4f\x32\0\0\0\0\0\0\x71\x64\x04\0\0\0\0\0\x71\x63\x05\0\0\0\0\0\x67\x03\0\0\
+\x08\0\0\0\x4f\x43\0\0\0\0\0\0\x67\x03\0\0\x10\0\0\0\x4f\x23\0\0\0\0\0\0\x71\
+\xa2\x5b\xff\0\0\0\0\x15\x02\x57\0\0\0\0\0\xbf\x34\0\0\0\0\0\0\x57\x04\0\0\x10\
+\0\0\0\x15\x04\x54\0\0\0\0\0\x57\x03\0\0\x80\0\0\0\xb7\x02\0\0\x10\0\0\0\xb7\
+\x04\0\0\x10\0\0\0\x15\x03\x01\0\0\0\0\0\xb7\x04\0\0\x30\0\0\0\x71\xa5\x5d\xff\
+\0\0\0\0\x15\x05\x01\0\0\0\0\0\xbf\x42\0\0\0\0\0\0\xbf\x79\0\0\0\0\0\0\xbf\xa4\
+\0\0\0\0\0\0\x07\x04\0\0\x64\xff\xff\xff\xbf\x45\0\0\0\0\0\0\x15\x03\x02\0\0\0\
+\0\0\xbf\xa5\0\0\0\0\0\0\x07\x05\0\0\x84\xff\xff\xff\xbf\x67\0\0\0\0\0\0\x71\
+\xa0\x5c\xff\0\0\0\0\xbf\x43\0\0\0\0\0\0\x15\0\x01\0\0\0\0\0\xbf\x53\0\0\0\0\0\
+\0\x61\x35\x04\0\0\0\0\0\x67\x05\0\0\x20\0\0\0\x61\x30\0\0\0\0\0\0\x4f\x05\0\0\
+\0\0\0\0\x7b\x5a\xa8\xff\0\0\0\0\x61\x35\x08\0\0\0\0\0\x61\x33\x0c\0\0\0\0\0\
+\x67\x03\0\0\x20\0\0\0\x4f\x53\0\0\0\0\0\0\x7b\x3a\xb0\xff\0\0\0\0\x0f\x24\0\0\
+\0\0\0\0\x61\x42\x0c\0\0\0\0\0\x67\x02\0\0\x20\0\0\0\x61\x43\x08\0\0\0\0\0\x4f\
+\x32\0\0\0\0\0\0\x61\x43\0\0\0\0\0\0\x61\x44\x04\0\0\0\0\0\x69\xa5\x62\xff\0\0\
+\0\0\x6b\x5a\xca\xff\0\0\0\0\x69\xa5\x60\xff\0\0\0\0\x6b\x5a\xc8\xff\0\0\0\0\
+\x7b\x2a\xc0\xff\0\0\0\0\x67\x04\0\0\x20\0\0\0\x4f\x34\0\0\0\0\0\0\x7b\x4a\xb8\
+\xff\0\0\0\0\xb7\x02\0\0\x01\0\0\0\x05\0\x9b\0\0\0\0\0\x71\xa4\x5a\xff\0\0\0\0\
+\x15\x04\x0e\0\0\0\0\0\xbf\x34\0\0\0\0\0\0\x57\x04\0\0\x04\0\0\0\x15\x04\x0b\0\
+\0\0\0\0\xbf\x79\0\0\0\0\0\0\xbf\x67\0\0\0\0\0\0\x61\xa3\x64\xff\0\0\0\0\x63\
+\x3a\xa8\xff\0\0\0\0\x61\xa3\x68\xff\0\0\0\0\x63\x3a\xac\xff\0\0\0\0\x69\xa3\
+\x60\xff\0\0\0\0\x6b\x3a\xb0\xff\0\0\0\0\x69\xa3\x62\xff\0\0\0\0\x6b\x3a\xb2\
+\xff\0\0\0\0\x05\0\x8c\0\0\0\0\0\x57\x03\0\0\x01\0\0\0\x15\x03\x0d\0\0\0\0\0\
+\xbf\x79\0\0\0\0\0\0\xbf\x67\0\0\0\0\0\0\x61\xa3\x64\xff\0\0\0\0\x63\x3a\xa8\
+\xff\0\0\0\0\x61\xa3\x68\xff\0\0\0\0\x63\x3a\xac\xff\0\0\0\0\x05\0\x83\0\0\0\0\
+\0\xb7\x09\0\0\x3c\0\0\0\x79\xa6\x30\xff\0\0\0\0\x79\xa7\x28\xff\0\0\0\0\x67\0\
+\0\0\x20\0\0\0\x77\0\0\0\x20\0\0\0\x15\0\x9d\xff\0\0\0\0\x71\x61\x08\0\0\0\0\0\
+\x71\x69\x09\0\0\0\0\0\x67\x09\0\0\x08\0\0\0\x4f\x19\0\0\0\0\0\0\xbf\x90\0\0\0\
+\0\0\0\x95\0\0\0\0\0\0\0\x71\xa4\x5a\xff\0\0\0\0\x15\x04\x42\0\0\0\0\0\xbf\x34\
+\0\0\0\0\0\0\x57\x04\0\0\x20\0\0\0\x15\x04\x3f\0\0\0\0\0\x57\x03\0\0\0\x01\0\0\
+\xb7\x04\0\0\x10\0\0\0\xb7\x05\0\0\x10\0\0\0\x15\x03\x01\0\0\0\0\0\xb7\x05\0\0\
+\x30\0\0\0\xbf\x79\0\0\0\0\0\0\x71\xa0\x5d\xff\0\0\0\0\x15\0\x01\0\0\0\0\0\xbf\
+\x54\0\0\0\0\0\0\xbf\x67\0\0\0\0\0\0\xbf\xa5\0\0\0\0\0\0\x07\x05\0\0\x64\xff\
+\xff\xff\xbf\x50\0\0\0\0\0\0\x15\x03\x02\0\0\0\0\0\xbf\xa0\0\0\0\0\0\0\x07\0\0\
+\0\x84\xff\xff\xff\x71\xa6\x5c\xff\0\0\0\0\xbf\x53\0\0\0\0\0\0\x15\x06\x01\0\0\
+\0\0\0\xbf\x03\0\0\0\0\0\0\x61\x30\x04\0\0\0\0\0\x67\0\0\0\x20\0\0\0\x61\x36\0\
+\0\0\0\0\0\x4f\x60\0\0\0\0\0\0\x7b\x0a\xa8\xff\0\0\0\0\x61\x30\x08\0\0\0\0\0\
+\x61\x33\x0c\0\0\0\0\0\x67\x03\0\0\x20\0\0\0\x4f\x03\0\0\0\0\0\0\x7b\x3a\xb0\
+\xff\0\0\0\0\x0f\x45\0\0\0\0\0\0\x61\x53\0\0\0\0\0\0\x61\x54\x04\0\0\0\0\0\x61\
+\x50\x08\0\0\0\0\0\x61\x55\x0c\0\0\0\0\0\x69\xa6\x62\xff\0\0\0\0\x6b\x6a\xca\
+\xff\0\0\0\0\x69\xa6\x60\xff\0\0\0\0\x6b\x6a\xc8\xff\0\0\0\0\x67\x05\0\0\x20\0\
+\0\0\x4f\x05\0\0\0\0\0\0\x7b\x5a\xc0\xff\0\0\0\0\x67\x04\0\0\x20\0\0\0\x4f\x34\
+\0\0\0\0\0\0\x7b\x4a\xb8\xff\0\0\0\0\x05\0\x43\0\0\0\0\0\xb7\x01\0\0\x01\0\0\0\
+\x73\x1a\x5a\xff\0\0\0\0\xb7\x01\0\0\0\0\0\0\x7b\x1a\xd0\xff\0\0\0\0\xbf\xa3\0\
+\0\0\0\0\0\x07\x03\0\0\xd0\xff\xff\xff\xbf\x81\0\0\0\0\0\0\x79\xa2\x40\xff\0\0\
+\0\0\xb7\x04\0\0\x08\0\0\0\xb7\x05\0\0\x01\0\0\0\x85\0\0\0\x44\0\0\0\x67\0\0\0\
+\x20\0\0\0\x77\0\0\0\x20\0\0\0\x55\0\xb9\xff\0\0\0\0\x05\0\x78\xfe\0\0\0\0\x15\
+\x09\xc6\xfe\x87\0\0\0\x05\0\x53\xff\0\0\0\0\xbf\x34\0\0\0\0\0\0\x57\x04\0\0\
+\x08\0\0\0\x15\x04\xb3\xff\0\0\0\0\x57\x03\0\0\x40\0\0\0\xb7\x04\0\0\x0c\0\0\0\
+\xb7\x05\0\0\x0c\0\0\0\x15\x03\x01\0\0\0\0\0\xb7\x05\0\0\x2c\0\0\0\xbf\x79\0\0\
+\0\0\0\0\x71\xa0\x5c\xff\0\0\0\0\x15\0\x01\0\0\0\0\0\xbf\x54\0\0\0\0\0\0\xbf\
+\x67\0\0\0\0\0\0\xbf\xa5\0\0\0\0\0\0\x07\x05\0\0\x58\xff\xff\xff\x0f\x45\0\0\0\
+\0\0\0\x61\x54\x04\0\0\0\0\0\x67\x04\0\0\x20\0\0\0\x61\x50\0\0\0\0\0\0\x4f\x04\
+\0\0\0\0\0\0\x7b\x4a\xa8\xff\0\0\0\0\x61\x54\x08\0\0\0\0\0\x61\x55\x0c\0\0\0\0\
+\0\x67\x05\0\0\x20\0\0\0\x4f\x45\0\0\0\0\0\0\x7b\x5a\xb0\xff\0\0\0\0\x71\xa4\
+\x5d\xff\0\0\0\0\x15\x04\x0c\0\0\0\0\0\x15\x03\x0b\0\0\0\0\0\x61\xa3\xa0\xff\0\
+\0\0\0\x67\x03\0\0\x20\0\0\0\x61\xa4\x9c\xff\0\0\0\0\x4f\x43\0\0\0\0\0\0\x7b\
+\x3a\xc0\xff\0\0\0\0\x61\xa3\x98\xff\0\0\0\0\x67\x03\0\0\x20\0\0\0\x61\xa4\x94\
+\xff\0\0\0\0\x05\0\x0a\0\0\0\0\0\xb7\x09\0\0\x2b\0\0\0\x05\0\x8b\xff\0\0\0\0\
+\x61\xa3\x80\xff\0\0\0\0\x67\x03\0\0\x20\0\0\0\x61\xa4\x7c\xff\0\0\0\0\x4f\x43\
+\0\0\0\0\0\0\x7b\x3a\xc0\xff\0\0\0\0\x61\xa3\x78\xff\0\0\0\0\x67\x03\0\0\x20\0\
+\0\0\x61\xa4\x74\xff\0\0\0\0\x4f\x43\0\0\0\0\0\0\x7b\x3a\xb8\xff\0\0\0\0\x79\
+\xa5\x48\xff\0\0\0\0\xb7\x04\0\0\0\0\0\0\x07\x09\0\0\x04\0\0\0\x61\x55\0\0\0\0\
+\0\0\xb7\x06\0\0\0\0\0\0\xbf\xa3\0\0\0\0\0\0\x07\x03\0\0\xa8\xff\xff\xff\x0f\
+\x43\0\0\0\0\0\0\x71\x30\0\0\0\0\0\0\xbf\x03\0\0\0\0\0\0\x67\x03\0\0\x38\0\0\0\
+\xc7\x03\0\0\x3f\0\0\0\x5f\x53\0\0\0\0\0\0\xaf\x63\0\0\0\0\0\0\xbf\x96\0\0\0\0\
+\0\0\x0f\x46\0\0\0\0\0\0\x71\x68\0\0\0\0\0\0\x67\x05\0\0\x01\0\0\0\xbf\x86\0\0\
+\0\0\0\0\x77\x06\0\0\x07\0\0\0\x4f\x65\0\0\0\0\0\0\xbf\x06\0\0\0\0\0\0\x67\x06\
+\0\0\x39\0\0\0\xc7\x06\0\0\x3f\0\0\0\x5f\x56\0\0\0\0\0\0\xaf\x63\0\0\0\0\0\0\
+\xbf\x86\0\0\0\0\0\0\x77\x06\0\0\x06\0\0\0\x57\x06\0\0\x01\0\0\0\x67\x05\0\0\
+\x01\0\0\0\x4f\x65\0\0\0\0\0\0\xbf\x06\0\0\0\0\0\0\x67\x06\0\0\x3a\0\0\0\xc7\
+\x06\0\0\x3f\0\0\0\x5f\x56\0\0\0\0\0\0\xaf\x63\0\0\0\0\0\0\x67\x05\0\0\x01\0\0\
+\0\xbf\x86\0\0\0\0\0\0\x77\x06\0\0\x05\0\0\0\x57\x06\0\0\x01\0\0\0\x4f\x65\0\0\
+\0\0\0\0\xbf\x06\0\0\0\0\0\0\x67\x06\0\0\x3b\0\0\0\xc7\x06\0\0\x3f\0\0\0\x5f\
+\x56\0\0\0\0\0\0\xaf\x63\0\0\0\0\0\0\x67\x05\0\0\x01\0\0\0\xbf\x86\0\0\0\0\0\0\
+\x77\x06\0\0\x04\0\0\0\x57\x06\0\0\x01\0\0\0\x4f\x65\0\0\0\0\0\0\xbf\x06\0\0\0\
+\0\0\0\x67\x06\0\0\x3c\0\0\0\xc7\x06\0\0\x3f\0\0\0\x5f\x56\0\0\0\0\0\0\xaf\x63\
+\0\0\0\0\0\0\xbf\x86\0\0\0\0\0\0\x77\x06\0\0\x03\0\0\0\x57\x06\0\0\x01\0\0\0\
+\x67\x05\0\0\x01\0\0\0\x4f\x65\0\0\0\0\0\0\xbf\x06\0\0\0\0\0\0\x67\x06\0\0\x3d\
+\0\0\0\xc7\x06\0\0\x3f\0\0\0\x5f\x56\0\0\0\0\0\0\xaf\x63\0\0\0\0\0\0\xbf\x86\0\
+\0\0\0\0\0\x77\x06\0\0\x02\0\0\0\x57\x06\0\0\x01\0\0\0\x67\x05\0\0\x01\0\0\0\
+\x4f\x65\0\0\0\0\0\0\xbf\x06\0\0\0\0\0\0\x67\x06\0\0\x3e\0\0\0\xc7\x06\0\0\x3f\
+\0\0\0\x5f\x56\0\0\0\0\0\0\xaf\x63\0\0\0\0\0\0\xbf\x86\0\0\0\0\0\0\x77\x06\0\0\
+\x01\0\0\0\x57\x06\0\0\x01\0\0\0\x67\x05\0\0\x01\0\0\0\x4f\x65\0\0\0\0\0\0\x57\
+\0\0\0\x01\0\0\0\x87\0\0\0\0\0\0\0\x5f\x50\0\0\0\0\0\0\xaf\x03\0\0\0\0\0\0\x57\
+\x08\0\0\x01\0\0\0\x67\x05\0\0\x01\0\0\0\x4f\x85\0\0\0\0\0\0\x07\x04\0\0\x01\0\
+\0\0\xbf\x36\0\0\0\0\0\0\x15\x04\x01\0\x24\0\0\0\x05\0\xa9\xff\0\0\0\0\xbf\x76\
+\0\0\0\0\0\0\x71\x64\x07\0\0\0\0\0\x67\x04\0\0\x08\0\0\0\x71\x65\x06\0\0\0\0\0\
+\x4f\x54\0\0\0\0\0\0\xbf\x35\0\0\0\0\0\0\x67\x05\0\0\x20\0\0\0\x77\x05\0\0\x20\
+\0\0\0\x3f\x45\0\0\0\0\0\0\x2f\x45\0\0\0\0\0\0\x1f\x53\0\0\0\0\0\0\x63\x3a\xf8\
+\xff\0\0\0\0\x71\x63\x0a\0\0\0\0\0\x15\x03\xdd\0\0\0\0\0\x18\x05\0\0\x8a\x15\
+\x30\x90\0\0\0\0\0\0\0\0\x69\xa3\x62\xff\0\0\0\0\x69\xa0\x60\xff\0\0\0\0\x7b\
+\x6a\x30\xff\0\0\0\0\x55\x02\x04\0\0\0\0\0\x18\x05\0\0\x29\x92\xdd\xed\0\0\0\0\
+\0\0\0\0\x71\xa2\x5a\xff\0\0\0\0\x15\x02\xbf\0\0\0\0\0\x15\x01\x05\0\0\0\0\0\
+\x61\xa1\x68\xff\0\0\0\0\x61\xa2\x64\xff\0\0\0\0\xbf\x16\0\0\0\0\0\0\x2d\x12\
+\x1c\0\0\0\0\0\x05\0\x16\0\0\0\0\0\x71\xa1\x59\xff\0\0\0\0\x15\x01\xb7\0\0\0\0\
+\0\x61\xa2\x78\xff\0\0\0\0\x67\x02\0\0\x20\0\0\0\x61\xa1\x74\xff\0\0\0\0\x4f\
+\x12\0\0\0\0\0\0\x61\xa1\x80\xff\0\0\0\0\x67\x01\0\0\x20\0\0\0\x61\xa4\x7c\xff\
+\0\0\0\0\x4f\x41\0\0\0\0\0\0\xaf\x21\0\0\0\0\0\0\x61\xa4\x68\xff\0\0\0\0\x67\
+\x04\0\0\x20\0\0\0\x61\xa2\x64\xff\0\0\0\0\x4f\x24\0\0\0\0\0\0\x61\xa2\x70\xff\
+\0\0\0\0\x67\x02\0\0\x20\0\0\0\x61\xa6\x6c\xff\0\0\0\0\x4f\x62\0\0\0\0\0\0\xaf\
+\x42\0\0\0\0\0\0\xbf\x16\0\0\0\0\0\0\x2d\x12\x05\0\0\0\0\0\xbf\x04\0\0\0\0\0\0\
+\x5d\x12\x07\0\0\0\0\0\xbf\x16\0\0\0\0\0\0\xbf\x04\0\0\0\0\0\0\x3d\x03\x04\0\0\
+\0\0\0\xbf\x21\0\0\0\0\0\0\xbf\x62\0\0\0\0\0\0\xbf\x34\0\0\0\0\0\0\xbf\x03\0\0\
+\0\0\0\0\xbf\x18\0\0\0\0\0\0\x27\x08\0\0\x77\xca\xeb\x85\x07\x08\0\0\x01\0\0\0\
+\x18\x07\0\0\0\0\xf8\xff\0\0\0\0\0\0\0\0\xbf\x80\0\0\0\0\0\0\x5f\x70\0\0\0\0\0\
+\0\x77\0\0\0\x13\0\0\0\x67\x08\0\0\x0d\0\0\0\x4f\x08\0\0\0\0\0\0\xbf\x80\0\0\0\
+\0\0\0\x27\0\0\0\0\x10\x9b\x77\x0f\x50\0\0\0\0\0\0\xbf\x25\0\0\0\0\0\0\x27\x05\
+\0\0\x77\xca\xeb\x85\x07\x05\0\0\x29\x44\x23\x24\xbf\x56\0\0\0\0\0\0\x5f\x76\0\
+\0\0\0\0\0\x77\x06\0\0\x13\0\0\0\x67\x05\0\0\x0d\0\0\0\x4f\x65\0\0\0\0\0\0\xbf\
+\x56\0\0\0\0\0\0\x27\x06\0\0\x62\xf3\x6e\x3c\x0f\x60\0\0\0\0\0\0\x77\x01\0\0\
+\x20\0\0\0\x27\x01\0\0\x77\xca\xeb\x85\x07\x01\0\0\x50\x86\xc8\x61\xbf\x16\0\0\
+\0\0\0\0\x5f\x76\0\0\0\0\0\0\x77\x06\0\0\x13\0\0\0\x67\x01\0\0\x0d\0\0\0\x4f\
+\x61\0\0\0\0\0\0\xbf\x16\0\0\0\0\0\0\x27\x06\0\0\0\0\xc4\xe6\x0f\x60\0\0\0\0\0\
+\0\x27\x08\0\0\xb1\x79\x37\x9e\x18\x06\0\0\0\0\xf0\xff\0\0\0\0\0\0\0\0\x5f\x68\
+\0\0\0\0\0\0\x77\x08\0\0\x14\0\0\0\x0f\x80\0\0\0\0\0\0\x27\x05\0\0\xb1\x79\x37\
+\x9e\x18\x06\0\0\0\0\0\x80\0\0\0\0\0\0\0\0\x5f\x65\0\0\0\0\0\0\x77\x05\0\0\x1f\
+\0\0\0\x0f\x50\0\0\0\0\0\0\x77\x02\0\0\x20\0\0\0\x27\x02\0\0\x77\xca\xeb\x85\
+\x07\x02\0\0\x78\xca\xeb\x85\xbf\x25\0\0\0\0\0\0\x5f\x75\0\0\0\0\0\0\x77\x05\0\
+\0\x13\0\0\0\x67\x02\0\0\x0d\0\0\0\x4f\x52\0\0\0\0\0\0\xbf\x25\0\0\0\0\0\0\x27\
+\x05\0\0\x80\xd8\xbc\x1b\x0f\x50\0\0\0\0\0\0\x27\x01\0\0\xb1\x79\x37\x9e\x18\
+\x05\0\0\0\xc0\xff\xff\0\0\0\0\0\0\0\0\x5f\x51\0\0\0\0\0\0\x77\x01\0\0\x0e\0\0\
+\0\x0f\x10\0\0\0\0\0\0\x27\x02\0\0\xb1\x79\x37\x9e\x18\x01\0\0\0\0\0\xfe\0\0\0\
+\0\0\0\0\0\x5f\x12\0\0\0\0\0\0\x77\x02\0\0\x19\0\0\0\x0f\x20\0\0\0\0\0\0\x18\
+\x01\0\0\0\x80\xff\xff\0\0\0\0\0\0\0\0\xbf\x02\0\0\0\0\0\0\x67\x02\0\0\x11\0\0\
+\0\x5f\x10\0\0\0\0\0\0\x77\0\0\0\x0f\0\0\0\x4f\x02\0\0\0\0\0\0\xbf\x25\0\0\0\0\
+\0\0\x27\x05\0\0\0\0\x5e\xd6\x27\x02\0\0\x2f\xeb\xd4\x27\x5f\x12\0\0\0\0\0\0\
+\x77\x02\0\0\x0f\0\0\0\x4f\x52\0\0\0\0\0\0\x27\x04\0\0\x3d\xae\xb2\xc2\x27\x02\
+\0\0\x2f\xeb\xd4\x27\x0f\x42\0\0\0\0\0\0\xbf\x24\0\0\0\0\0\0\x67\x04\0\0\x11\0\
+\0\0\x5f\x12\0\0\0\0\0\0\x77\x02\0\0\x0f\0\0\0\x4f\x24\0\0\0\0\0\0\x27\x03\0\0\
+\x3d\xae\xb2\xc2\x27\x04\0\0\x2f\xeb\xd4\x27\x0f\x34\0\0\0\0\0\0\xbf\x42\0\0\0\
+\0\0\0\x67\x02\0\0\x11\0\0\0\x5f\x14\0\0\0\0\0\0\x77\x04\0\0\x0f\0\0\0\x4f\x42\
+\0\0\0\0\0\0\x27\x02\0\0\x2f\xeb\xd4\x27\xbf\x23\0\0\0\0\0\0\x5f\x13\0\0\0\0\0\
+\0\x77\x03\0\0\x0f\0\0\0\xaf\x23\0\0\0\0\0\0\x27\x03\0\0\x77\xca\xeb\x85\x18\
+\x01\0\0\0\xe0\xff\xff\0\0\0\0\0\0\0\0\xbf\x32\0\0\0\0\0\0\x5f\x12\0\0\0\0\0\0\
+\x77\x02\0\0\x0d\0\0\0\xaf\x32\0\0\0\0\0\0\x27\x02\0\0\x3d\xae\xb2\xc2\x18\x03\
+\0\0\0\0\xff\xff\0\0\0\0\0\0\0\0\xbf\x21\0\0\0\0\0\0\x5f\x31\0\0\0\0\0\0\x77\
+\x01\0\0\x10\0\0\0\xaf\x21\0\0\0\0\0\0\xbf\x12\0\0\0\0\0\0\x67\x02\0\0\x20\0\0\
+\0\x77\x02\0\0\x20\0\0\0\xb7\x06\0\0\x01\0\0\0\x15\x02\x01\0\0\0\0\0\xbf\x16\0\
+\0\0\0\0\0\xbf\x61\0\0\0\0\0\0\x57\x01\0\0\xff\x0f\0\0\x63\x1a\xa8\xff\0\0\0\0\
+\xbf\xa2\0\0\0\0\0\0\x07\x02\0\0\xa8\xff\xff\xff\x18\x01\0\0\0\0\0\0\0\0\0\0\0\
+\0\0\0\x85\0\0\0\x01\0\0\0\x15\0\x15\0\0\0\0\0\x67\x06\0\0\x20\0\0\0\x77\x06\0\
+\0\x20\0\0\0\x79\x09\0\0\0\0\0\0\xbf\x91\0\0\0\0\0\0\x77\x01\0\0\x20\0\0\0\x5d\
+\x61\x04\0\0\0\0\0\xbf\x91\0\0\0\0\0\0\x67\x01\0\0\x20\0\0\0\x77\x01\0\0\x20\0\
+\0\0\x55\x01\x0d\0\0\0\0\0\xb7\x01\0\0\x01\0\0\0\x63\x1a\xd0\xff\0\0\0\0\xbf\
+\xa2\0\0\0\0\0\0\x07\x02\0\0\xd0\xff\xff\xff\x18\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\
+\0\x85\0\0\0\x01\0\0\0\x15\0\x03\0\0\0\0\0\x79\x01\0\0\0\0\0\0\x07\x01\0\0\x01\
+\0\0\0\x7b\x10\0\0\0\0\0\0\x79\xa6\x30\xff\0\0\0\0\x05\0\x12\0\0\0\0\0\xb7\x01\
+\0\0\0\0\0\0\x63\x1a\xd0\xff\0\0\0\0\xbf\xa2\0\0\0\0\0\0\x07\x02\0\0\xd0\xff\
+\xff\xff\x18\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x85\0\0\0\x01\0\0\0\x79\xa6\x30\
+\xff\0\0\0\0\x15\0\x03\0\0\0\0\0\x79\x01\0\0\0\0\0\0\x07\x01\0\0\x01\0\0\0\x7b\
+\x10\0\0\0\0\0\0\x67\x09\0\0\x20\0\0\0\x18\x01\0\0\0\0\0\0\0\0\0\0\xff\xff\xff\
+\xff\x0f\x19\0\0\0\0\0\0\xc7\x09\0\0\x20\0\0\0\x65\x09\x41\xfe\xff\xff\xff\xff\
+\xbf\xa2\0\0\0\0\0\0\x07\x02\0\0\xf8\xff\xff\xff\x18\x01\0\0\0\0\0\0\0\0\0\0\0\
+\0\0\0\x85\0\0\0\x01\0\0\0\x15\0\x37\xfe\0\0\0\0\x69\x09\0\0\0\0\0\0\x05\0\x39\
+\xfe\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
 \0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
 \0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x47\
-\x50\x4c\x20\x76\x32\0\0\x9f\xeb\x01\0\x18\0\0\0\0\0\0\0\x58\x05\0\0\x58\x05\0\
-\0\x71\x11\0\0\0\0\0\0\0\0\0\x02\x03\0\0\0\x01\0\0\0\0\0\0\x01\x04\0\0\0\x20\0\
-\0\x01\0\0\0\0\0\0\0\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\x02\0\0\0\x05\0\0\0\0\0\0\
-\x01\x04\0\0\0\x20\0\0\0\0\0\0\0\0\0\0\x02\x06\0\0\0\0\0\0\0\0\0\0\x03\0\0\0\0\
-\x02\0\0\0\x04\0\0\0\x04\0\0\0\0\0\0\0\0\0\0\x02\x08\0\0\0\0\0\0\0\0\0\0\x03\0\
-\0\0\0\x02\0\0\0\x04\0\0\0\x0a\0\0\0\0\0\0\0\0\0\0\x02\x0a\0\0\0\0\0\0\0\0\0\0\
-\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\x02\x0c\0\0\0\0\0\0\0\
-\0\0\0\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\0\x04\0\0\0\0\0\0\x05\0\0\x04\x28\0\0\0\
-\x19\0\0\0\x01\0\0\0\0\0\0\0\x1e\0\0\0\x05\0\0\0\x40\0\0\0\x27\0\0\0\x07\0\0\0\
-\x80\0\0\0\x32\0\0\0\x09\0\0\0\xc0\0\0\0\x3e\0\0\0\x0b\0\0\0\0\x01\0\0\x48\0\0\
-\0\0\0\0\x0e\x0d\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\x02\x10\0\0\0\0\0\0\0\0\0\0\x03\
-\0\0\0\0\x02\0\0\0\x04\0\0\0\x28\0\0\0\0\0\0\0\x05\0\0\x04\x28\0\0\0\x19\0\0\0\
-\x01\0\0\0\0\0\0\0\x1e\0\0\0\x05\0\0\0\x40\0\0\0\x27\0\0\0\x0f\0\0\0\x80\0\0\0\
-\x32\0\0\0\x09\0\0\0\xc0\0\0\0\x3e\0\0\0\x0b\0\0\0\0\x01\0\0\x63\0\0\0\0\0\0\
-\x0e\x11\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\x02\x14\0\0\0\0\0\0\0\0\0\0\x03\0\0\0\0\
-\x02\0\0\0\x04\0\0\0\x80\0\0\0\0\0\0\0\x05\0\0\x04\x28\0\0\0\x19\0\0\0\x01\0\0\
-\0\0\0\0\0\x1e\0\0\0\x05\0\0\0\x40\0\0\0\x27\0\0\0\x01\0\0\0\x80\0\0\0\x32\0\0\
-\0\x13\0\0\0\xc0\0\0\0\x3e\0\0\0\x0b\0\0\0\0\x01\0\0\x7c\0\0\0\0\0\0\x0e\x15\0\
-\0\0\x01\0\0\0\0\0\0\0\0\0\0\x02\x18\0\0\0\x9a\0\0\0\x22\0\0\x04\xc0\0\0\0\xa4\
-\0\0\0\x19\0\0\0\0\0\0\0\xa8\0\0\0\x19\0\0\0\x20\0\0\0\xb1\0\0\0\x19\0\0\0\x40\
-\0\0\0\xb6\0\0\0\x19\0\0\0\x60\0\0\0\xc4\0\0\0\x19\0\0\0\x80\0\0\0\xcd\0\0\0\
-\x19\0\0\0\xa0\0\0\0\xda\0\0\0\x19\0\0\0\xc0\0\0\0\xe3\0\0\0\x19\0\0\0\xe0\0\0\
-\0\xee\0\0\0\x19\0\0\0\0\x01\0\0\xf7\0\0\0\x19\0\0\0\x20\x01\0\0\x07\x01\0\0\
-\x19\0\0\0\x40\x01\0\0\x0f\x01\0\0\x19\0\0\0\x60\x01\0\0\x18\x01\0\0\x1b\0\0\0\
-\x80\x01\0\0\x1b\x01\0\0\x19\0\0\0\x20\x02\0\0\x20\x01\0\0\x19\0\0\0\x40\x02\0\
-\0\x2b\x01\0\0\x19\0\0\0\x60\x02\0\0\x30\x01\0\0\x19\0\0\0\x80\x02\0\0\x39\x01\
-\0\0\x19\0\0\0\xa0\x02\0\0\x41\x01\0\0\x19\0\0\0\xc0\x02\0\0\x48\x01\0\0\x19\0\
-\0\0\xe0\x02\0\0\x53\x01\0\0\x19\0\0\0\0\x03\0\0\x5d\x01\0\0\x1c\0\0\0\x20\x03\
-\0\0\x68\x01\0\0\x1c\0\0\0\xa0\x03\0\0\x72\x01\0\0\x19\0\0\0\x20\x04\0\0\x7e\
-\x01\0\0\x19\0\0\0\x40\x04\0\0\x89\x01\0\0\x19\0\0\0\x60\x04\0\0\0\0\0\0\x1d\0\
-\0\0\x80\x04\0\0\x93\x01\0\0\x1f\0\0\0\xc0\x04\0\0\x9a\x01\0\0\x19\0\0\0\0\x05\
-\0\0\xa3\x01\0\0\x19\0\0\0\x20\x05\0\0\0\0\0\0\x21\0\0\0\x40\x05\0\0\xac\x01\0\
-\0\x19\0\0\0\x80\x05\0\0\xb5\x01\0\0\x23\0\0\0\xa0\x05\0\0\xc1\x01\0\0\x1f\0\0\
-\0\xc0\x05\0\0\xca\x01\0\0\0\0\0\x08\x1a\0\0\0\xd0\x01\0\0\0\0\0\x01\x04\0\0\0\
-\x20\0\0\0\0\0\0\0\0\0\0\x03\0\0\0\0\x19\0\0\0\x04\0\0\0\x05\0\0\0\0\0\0\0\0\0\
-\0\x03\0\0\0\0\x19\0\0\0\x04\0\0\0\x04\0\0\0\0\0\0\0\x01\0\0\x05\x08\0\0\0\xdd\
-\x01\0\0\x1e\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x02\x2c\0\0\0\xe7\x01\0\0\0\0\0\x08\
-\x20\0\0\0\xed\x01\0\0\0\0\0\x01\x08\0\0\0\x40\0\0\0\0\0\0\0\x01\0\0\x05\x08\0\
-\0\0\0\x02\0\0\x22\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x02\x2d\0\0\0\x03\x02\0\0\0\0\0\
-\x08\x24\0\0\0\x08\x02\0\0\0\0\0\x01\x01\0\0\0\x08\0\0\0\0\0\0\0\x01\0\0\x0d\
-\x02\0\0\0\x16\x02\0\0\x17\0\0\0\x1a\x02\0\0\x01\0\0\x0c\x25\0\0\0\x3e\x11\0\0\
-\0\0\0\x01\x01\0\0\0\x08\0\0\x01\0\0\0\0\0\0\0\x03\0\0\0\0\x27\0\0\0\x04\0\0\0\
-\x07\0\0\0\x43\x11\0\0\0\0\0\x0e\x28\0\0\0\x01\0\0\0\x4c\x11\0\0\x03\0\0\x0f\0\
-\0\0\0\x0e\0\0\0\0\0\0\0\x28\0\0\0\x12\0\0\0\0\0\0\0\x28\0\0\0\x16\0\0\0\0\0\0\
-\0\x28\0\0\0\x52\x11\0\0\x01\0\0\x0f\0\0\0\0\x29\0\0\0\0\0\0\0\x07\0\0\0\x5a\
-\x11\0\0\0\0\0\x07\0\0\0\0\x68\x11\0\0\0\0\0\x07\0\0\0\0\0\x69\x6e\x74\0\x5f\
-\x5f\x41\x52\x52\x41\x59\x5f\x53\x49\x5a\x45\x5f\x54\x59\x50\x45\x5f\x5f\0\x74\
-\x79\x70\x65\0\x6b\x65\x79\x5f\x73\x69\x7a\x65\0\x76\x61\x6c\x75\x65\x5f\x73\
-\x69\x7a\x65\0\x6d\x61\x78\x5f\x65\x6e\x74\x72\x69\x65\x73\0\x6d\x61\x70\x5f\
-\x66\x6c\x61\x67\x73\0\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x63\x6f\
-\x6e\x66\x69\x67\x75\x72\x61\x74\x69\x6f\x6e\x73\0\x74\x61\x70\x5f\x72\x73\x73\
-\x5f\x6d\x61\x70\x5f\x74\x6f\x65\x70\x6c\x69\x74\x7a\x5f\x6b\x65\x79\0\x74\x61\
-\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x69\x6e\x64\x69\x72\x65\x63\x74\x69\
-\x6f\x6e\x5f\x74\x61\x62\x6c\x65\0\x5f\x5f\x73\x6b\x5f\x62\x75\x66\x66\0\x6c\
-\x65\x6e\0\x70\x6b\x74\x5f\x74\x79\x70\x65\0\x6d\x61\x72\x6b\0\x71\x75\x65\x75\
-\x65\x5f\x6d\x61\x70\x70\x69\x6e\x67\0\x70\x72\x6f\x74\x6f\x63\x6f\x6c\0\x76\
-\x6c\x61\x6e\x5f\x70\x72\x65\x73\x65\x6e\x74\0\x76\x6c\x61\x6e\x5f\x74\x63\x69\
-\0\x76\x6c\x61\x6e\x5f\x70\x72\x6f\x74\x6f\0\x70\x72\x69\x6f\x72\x69\x74\x79\0\
-\x69\x6e\x67\x72\x65\x73\x73\x5f\x69\x66\x69\x6e\x64\x65\x78\0\x69\x66\x69\x6e\
-\x64\x65\x78\0\x74\x63\x5f\x69\x6e\x64\x65\x78\0\x63\x62\0\x68\x61\x73\x68\0\
-\x74\x63\x5f\x63\x6c\x61\x73\x73\x69\x64\0\x64\x61\x74\x61\0\x64\x61\x74\x61\
-\x5f\x65\x6e\x64\0\x6e\x61\x70\x69\x5f\x69\x64\0\x66\x61\x6d\x69\x6c\x79\0\x72\
-\x65\x6d\x6f\x74\x65\x5f\x69\x70\x34\0\x6c\x6f\x63\x61\x6c\x5f\x69\x70\x34\0\
-\x72\x65\x6d\x6f\x74\x65\x5f\x69\x70\x36\0\x6c\x6f\x63\x61\x6c\x5f\x69\x70\x36\
-\0\x72\x65\x6d\x6f\x74\x65\x5f\x70\x6f\x72\x74\0\x6c\x6f\x63\x61\x6c\x5f\x70\
-\x6f\x72\x74\0\x64\x61\x74\x61\x5f\x6d\x65\x74\x61\0\x74\x73\x74\x61\x6d\x70\0\
-\x77\x69\x72\x65\x5f\x6c\x65\x6e\0\x67\x73\x6f\x5f\x73\x65\x67\x73\0\x67\x73\
-\x6f\x5f\x73\x69\x7a\x65\0\x74\x73\x74\x61\x6d\x70\x5f\x74\x79\x70\x65\0\x68\
-\x77\x74\x73\x74\x61\x6d\x70\0\x5f\x5f\x75\x33\x32\0\x75\x6e\x73\x69\x67\x6e\
-\x65\x64\x20\x69\x6e\x74\0\x66\x6c\x6f\x77\x5f\x6b\x65\x79\x73\0\x5f\x5f\x75\
-\x36\x34\0\x75\x6e\x73\x69\x67\x6e\x65\x64\x20\x6c\x6f\x6e\x67\x20\x6c\x6f\x6e\
-\x67\0\x73\x6b\0\x5f\x5f\x75\x38\0\x75\x6e\x73\x69\x67\x6e\x65\x64\x20\x63\x68\
-\x61\x72\0\x73\x6b\x62\0\x74\x75\x6e\x5f\x72\x73\x73\x5f\x73\x74\x65\x65\x72\
-\x69\x6e\x67\x5f\x70\x72\x6f\x67\0\x73\x6f\x63\x6b\x65\x74\0\x2f\x68\x6f\x6d\
-\x65\x2f\x6d\x65\x2f\x71\x2f\x76\x61\x72\x2f\x71\x65\x6d\x75\x2f\x74\x6f\x6f\
-\x6c\x73\x2f\x65\x62\x70\x66\x2f\x72\x73\x73\x2e\x62\x70\x66\x2e\x63\0\x69\x6e\
-\x74\x20\x74\x75\x6e\x5f\x72\x73\x73\x5f\x73\x74\x65\x65\x72\x69\x6e\x67\x5f\
-\x70\x72\x6f\x67\x28\x73\x74\x72\x75\x63\x74\x20\x5f\x5f\x73\x6b\x5f\x62\x75\
-\x66\x66\x20\x2a\x73\x6b\x62\x29\0\x20\x20\x20\x20\x5f\x5f\x75\x33\x32\x20\x6b\
-\x65\x79\x20\x3d\x20\x30\x3b\0\x20\x20\x20\x20\x63\x6f\x6e\x66\x69\x67\x20\x3d\
-\x20\x62\x70\x66\x5f\x6d\x61\x70\x5f\x6c\x6f\x6f\x6b\x75\x70\x5f\x65\x6c\x65\
-\x6d\x28\x26\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x63\x6f\x6e\x66\
-\x69\x67\x75\x72\x61\x74\x69\x6f\x6e\x73\x2c\x20\x26\x6b\x65\x79\x29\x3b\0\x20\
-\x20\x20\x20\x74\x6f\x65\x20\x3d\x20\x62\x70\x66\x5f\x6d\x61\x70\x5f\x6c\x6f\
-\x6f\x6b\x75\x70\x5f\x65\x6c\x65\x6d\x28\x26\x74\x61\x70\x5f\x72\x73\x73\x5f\
-\x6d\x61\x70\x5f\x74\x6f\x65\x70\x6c\x69\x74\x7a\x5f\x6b\x65\x79\x2c\x20\x26\
-\x6b\x65\x79\x29\x3b\0\x20\x20\x20\x20\x69\x66\x20\x28\x63\x6f\x6e\x66\x69\x67\
-\x20\x26\x26\x20\x74\x6f\x65\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\
-\x66\x20\x28\x21\x63\x6f\x6e\x66\x69\x67\x2d\x3e\x72\x65\x64\x69\x72\x65\x63\
-\x74\x29\x20\x7b\0\x20\x20\x20\x20\x5f\x5f\x75\x38\x20\x72\x73\x73\x5f\x69\x6e\
-\x70\x75\x74\x5b\x48\x41\x53\x48\x5f\x43\x41\x4c\x43\x55\x4c\x41\x54\x49\x4f\
-\x4e\x5f\x42\x55\x46\x46\x45\x52\x5f\x53\x49\x5a\x45\x5d\x20\x3d\x20\x7b\x7d\
-\x3b\0\x20\x20\x20\x20\x73\x74\x72\x75\x63\x74\x20\x70\x61\x63\x6b\x65\x74\x5f\
-\x68\x61\x73\x68\x5f\x69\x6e\x66\x6f\x5f\x74\x20\x70\x61\x63\x6b\x65\x74\x5f\
-\x69\x6e\x66\x6f\x20\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\x69\x66\x20\x28\x21\
-\x69\x6e\x66\x6f\x20\x7c\x7c\x20\x21\x73\x6b\x62\x29\x20\x7b\0\x20\x20\x20\x20\
-\x5f\x5f\x62\x65\x31\x36\x20\x72\x65\x74\x20\x3d\x20\x30\x3b\0\x20\x20\x20\x20\
-\x65\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\
-\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\
-\x20\x6f\x66\x66\x73\x65\x74\x2c\x20\x26\x72\x65\x74\x2c\x20\x73\x69\x7a\x65\
-\x6f\x66\x28\x72\x65\x74\x29\x2c\0\x20\x20\x20\x20\x69\x66\x20\x28\x65\x72\x72\
-\x29\x20\x7b\0\x20\x20\x20\x20\x73\x77\x69\x74\x63\x68\x20\x28\x62\x70\x66\x5f\
-\x6e\x74\x6f\x68\x73\x28\x72\x65\x74\x29\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\
-\x20\x20\x65\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\
-\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\
-\x62\x2c\x20\x6f\x66\x66\x73\x65\x74\x2c\x20\x26\x72\x65\x74\x2c\x20\x73\x69\
-\x7a\x65\x6f\x66\x28\x72\x65\x74\x29\x2c\0\x20\x20\x20\x20\x72\x65\x74\x75\x72\
-\x6e\x20\x72\x65\x74\x3b\0\x20\x20\x20\x20\x69\x66\x20\x28\x6c\x33\x5f\x70\x72\
-\x6f\x74\x6f\x63\x6f\x6c\x20\x3d\x3d\x20\x30\x29\x20\x7b\0\x20\x20\x20\x20\x20\
-\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x69\x70\x76\x34\x20\x3d\x20\
-\x31\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x73\x74\x72\x75\x63\x74\x20\x69\x70\
-\x68\x64\x72\x20\x69\x70\x20\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\
-\x20\x65\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\
-\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\
-\x2c\x20\x30\x2c\x20\x26\x69\x70\x2c\x20\x73\x69\x7a\x65\x6f\x66\x28\x69\x70\
-\x29\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x65\x72\x72\x29\x20\
-\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x66\
-\x72\x61\x67\x6d\x65\x6e\x74\x65\x64\x20\x3d\x20\x21\x21\x28\x62\x70\x66\x5f\
-\x6e\x74\x6f\x68\x73\x28\x69\x70\x2e\x66\x72\x61\x67\x5f\x6f\x66\x66\x29\x20\
-\x26\x20\x28\x30\x78\x32\x30\x30\x30\x20\x7c\x20\x30\x78\x31\x66\x66\x66\x29\
-\x29\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x6e\x5f\
-\x73\x72\x63\x20\x3d\x20\x69\x70\x2e\x73\x61\x64\x64\x72\x3b\0\x20\x20\x20\x20\
-\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x6e\x5f\x64\x73\x74\x20\x3d\x20\
-\x69\x70\x2e\x64\x61\x64\x64\x72\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x6c\x34\
-\x5f\x70\x72\x6f\x74\x6f\x63\x6f\x6c\x20\x3d\x20\x69\x70\x2e\x70\x72\x6f\x74\
-\x6f\x63\x6f\x6c\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x6c\x34\x5f\x6f\x66\x66\
-\x73\x65\x74\x20\x3d\x20\x69\x70\x2e\x69\x68\x6c\x20\x2a\x20\x34\x3b\0\x20\x20\
-\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x69\x70\x76\x36\
-\x20\x3d\x20\x31\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x73\x74\x72\x75\x63\x74\
-\x20\x69\x70\x76\x36\x68\x64\x72\x20\x69\x70\x36\x20\x3d\x20\x7b\x7d\x3b\0\x20\
-\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\
-\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\
-\x76\x65\x28\x73\x6b\x62\x2c\x20\x30\x2c\x20\x26\x69\x70\x36\x2c\x20\x73\x69\
-\x7a\x65\x6f\x66\x28\x69\x70\x36\x29\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\
-\x6e\x66\x6f\x2d\x3e\x69\x6e\x36\x5f\x73\x72\x63\x20\x3d\x20\x69\x70\x36\x2e\
-\x73\x61\x64\x64\x72\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\
-\x3e\x69\x6e\x36\x5f\x64\x73\x74\x20\x3d\x20\x69\x70\x36\x2e\x64\x61\x64\x64\
-\x72\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x6c\x34\x5f\x70\x72\x6f\x74\x6f\x63\
-\x6f\x6c\x20\x3d\x20\x69\x70\x36\x2e\x6e\x65\x78\x74\x68\x64\x72\x3b\0\x20\x20\
-\x20\x20\x73\x77\x69\x74\x63\x68\x20\x28\x68\x64\x72\x5f\x74\x79\x70\x65\x29\
-\x20\x7b\0\x20\x20\x20\x20\x73\x74\x72\x75\x63\x74\x20\x69\x70\x76\x36\x5f\x6f\
-\x70\x74\x5f\x68\x64\x72\x20\x65\x78\x74\x5f\x68\x64\x72\x20\x3d\x20\x7b\x7d\
-\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\
-\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\
-\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\x20\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\
-\x74\x2c\x20\x26\x65\x78\x74\x5f\x68\x64\x72\x2c\0\x20\x20\x20\x20\x20\x20\x20\
-\x20\x69\x66\x20\x28\x2a\x6c\x34\x5f\x70\x72\x6f\x74\x6f\x63\x6f\x6c\x20\x3d\
-\x3d\x20\x49\x50\x50\x52\x4f\x54\x4f\x5f\x52\x4f\x55\x54\x49\x4e\x47\x29\x20\
-\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x73\x74\x72\x75\x63\x74\
-\x20\x69\x70\x76\x36\x5f\x72\x74\x5f\x68\x64\x72\x20\x65\x78\x74\x5f\x72\x74\
-\x20\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x65\
-\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\
-\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\x20\
-\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x2c\x20\x26\x65\x78\x74\x5f\x72\x74\
-\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x65\x72\
-\x72\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\
-\x28\x28\x65\x78\x74\x5f\x72\x74\x2e\x74\x79\x70\x65\x20\x3d\x3d\x20\x49\x50\
-\x56\x36\x5f\x53\x52\x43\x52\x54\x5f\x54\x59\x50\x45\x5f\x32\x29\x20\x26\x26\0\
-\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x20\x2b\x20\x6f\x66\x66\x73\x65\
-\x74\x6f\x66\x28\x73\x74\x72\x75\x63\x74\x20\x72\x74\x32\x5f\x68\x64\x72\x2c\
-\x20\x61\x64\x64\x72\x29\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\
-\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\
-\x73\x6b\x62\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x69\x66\x20\x28\x65\x72\x72\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x69\x70\
-\x76\x36\x5f\x65\x78\x74\x5f\x64\x73\x74\x20\x3d\x20\x31\x3b\0\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x20\x20\x20\x7d\x20\x5f\x5f\x61\x74\x74\x72\x69\x62\x75\
-\x74\x65\x5f\x5f\x28\x28\x70\x61\x63\x6b\x65\x64\x29\x29\x20\x6f\x70\x74\x20\
-\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x6f\x70\x74\x5f\x6f\x66\x66\x73\x65\x74\x20\x2b\x3d\x20\x28\x6f\x70\
-\x74\x2e\x74\x79\x70\x65\x20\x3d\x3d\x20\x49\x50\x56\x36\x5f\x54\x4c\x56\x5f\
-\x50\x41\x44\x31\x29\x20\x3f\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x20\x20\x69\x66\x20\x28\x6f\x70\x74\x5f\x6f\x66\x66\x73\x65\x74\x20\
-\x2b\x20\x31\x20\x3e\x3d\x20\x65\x78\x74\x5f\x68\x64\x72\x2e\x68\x64\x72\x6c\
-\x65\x6e\x20\x2a\x20\x38\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\
-\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\
-\x65\x28\x73\x6b\x62\x2c\x20\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x20\x2b\
-\x20\x6f\x70\x74\x5f\x6f\x66\x66\x73\x65\x74\x2c\0\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x6f\x70\x74\x2e\x74\x79\
-\x70\x65\x20\x3d\x3d\x20\x49\x50\x56\x36\x5f\x54\x4c\x56\x5f\x48\x41\x4f\x29\
-\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x20\x20\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x20\x2b\
-\x20\x6f\x70\x74\x5f\x6f\x66\x66\x73\x65\x74\0\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\x62\
-\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\
-\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\0\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x65\x72\
-\x72\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x69\x70\x76\x36\x5f\
-\x65\x78\x74\x5f\x73\x72\x63\x20\x3d\x20\x31\x3b\0\x20\x20\x20\x20\x20\x20\x20\
+\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
+\0\0\0\x47\x50\x4c\x20\x76\x32\0\0\x9f\xeb\x01\0\x18\0\0\0\0\0\0\0\x80\x06\0\0\
+\x80\x06\0\0\x4b\x18\0\0\0\0\0\0\0\0\0\x02\x03\0\0\0\x01\0\0\0\0\0\0\x01\x04\0\
+\0\0\x20\0\0\x01\0\0\0\0\0\0\0\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\x02\0\0\0\x05\0\
+\0\0\0\0\0\x01\x04\0\0\0\x20\0\0\0\0\0\0\0\0\0\0\x02\x06\0\0\0\0\0\0\0\0\0\0\
+\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\x04\0\0\0\0\0\0\0\0\0\0\x02\x08\0\0\0\0\0\0\0\
+\0\0\0\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\x0b\0\0\0\0\0\0\0\0\0\0\x02\x0a\0\0\0\0\
+\0\0\0\0\0\0\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\x02\x0c\0\
+\0\0\0\0\0\0\0\0\0\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\0\x04\0\0\0\0\0\0\x05\0\0\
+\x04\x28\0\0\0\x19\0\0\0\x01\0\0\0\0\0\0\0\x1e\0\0\0\x05\0\0\0\x40\0\0\0\x27\0\
+\0\0\x07\0\0\0\x80\0\0\0\x32\0\0\0\x09\0\0\0\xc0\0\0\0\x3e\0\0\0\x0b\0\0\0\0\
+\x01\0\0\x48\0\0\0\0\0\0\x0e\x0d\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\x02\x10\0\0\0\0\
+\0\0\0\0\0\0\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\x28\0\0\0\0\0\0\0\x05\0\0\x04\x28\
+\0\0\0\x19\0\0\0\x01\0\0\0\0\0\0\0\x1e\0\0\0\x05\0\0\0\x40\0\0\0\x27\0\0\0\x0f\
+\0\0\0\x80\0\0\0\x32\0\0\0\x09\0\0\0\xc0\0\0\0\x3e\0\0\0\x0b\0\0\0\0\x01\0\0\
+\x63\0\0\0\0\0\0\x0e\x11\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\x02\x14\0\0\0\0\0\0\0\0\
+\0\0\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\x80\0\0\0\0\0\0\0\x05\0\0\x04\x28\0\0\0\
+\x19\0\0\0\x01\0\0\0\0\0\0\0\x1e\0\0\0\x05\0\0\0\x40\0\0\0\x27\0\0\0\x01\0\0\0\
+\x80\0\0\0\x32\0\0\0\x13\0\0\0\xc0\0\0\0\x3e\0\0\0\x0b\0\0\0\0\x01\0\0\x7c\0\0\
+\0\0\0\0\x0e\x15\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\x02\x18\0\0\0\0\0\0\0\0\0\0\x03\
+\0\0\0\0\x02\0\0\0\x04\0\0\0\x08\0\0\0\0\0\0\0\0\0\0\x02\x1a\0\0\0\0\0\0\0\0\0\
+\0\x03\0\0\0\0\x02\0\0\0\x04\0\0\0\0\x10\0\0\0\0\0\0\x05\0\0\x04\x28\0\0\0\x19\
+\0\0\0\x01\0\0\0\0\0\0\0\x1e\0\0\0\x05\0\0\0\x40\0\0\0\x27\0\0\0\x17\0\0\0\x80\
+\0\0\0\x32\0\0\0\x19\0\0\0\xc0\0\0\0\x3e\0\0\0\x0b\0\0\0\0\x01\0\0\x9a\0\0\0\0\
+\0\0\x0e\x1b\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\x02\x1e\0\0\0\0\0\0\0\0\0\0\x03\0\0\
+\0\0\x02\0\0\0\x04\0\0\0\x06\0\0\0\0\0\0\0\x04\0\0\x04\x20\0\0\0\x19\0\0\0\x1d\
+\0\0\0\0\0\0\0\x1e\0\0\0\x05\0\0\0\x40\0\0\0\x27\0\0\0\x17\0\0\0\x80\0\0\0\x32\
+\0\0\0\x01\0\0\0\xc0\0\0\0\xb1\0\0\0\0\0\0\x0e\x1f\0\0\0\x01\0\0\0\0\0\0\0\0\0\
+\0\x02\x22\0\0\0\xc8\0\0\0\x22\0\0\x04\xc0\0\0\0\xd2\0\0\0\x23\0\0\0\0\0\0\0\
+\xd6\0\0\0\x23\0\0\0\x20\0\0\0\xdf\0\0\0\x23\0\0\0\x40\0\0\0\xe4\0\0\0\x23\0\0\
+\0\x60\0\0\0\xf2\0\0\0\x23\0\0\0\x80\0\0\0\xfb\0\0\0\x23\0\0\0\xa0\0\0\0\x08\
+\x01\0\0\x23\0\0\0\xc0\0\0\0\x11\x01\0\0\x23\0\0\0\xe0\0\0\0\x1c\x01\0\0\x23\0\
+\0\0\0\x01\0\0\x25\x01\0\0\x23\0\0\0\x20\x01\0\0\x35\x01\0\0\x23\0\0\0\x40\x01\
+\0\0\x3d\x01\0\0\x23\0\0\0\x60\x01\0\0\x46\x01\0\0\x25\0\0\0\x80\x01\0\0\x49\
+\x01\0\0\x23\0\0\0\x20\x02\0\0\x4e\x01\0\0\x23\0\0\0\x40\x02\0\0\x59\x01\0\0\
+\x23\0\0\0\x60\x02\0\0\x5e\x01\0\0\x23\0\0\0\x80\x02\0\0\x67\x01\0\0\x23\0\0\0\
+\xa0\x02\0\0\x6f\x01\0\0\x23\0\0\0\xc0\x02\0\0\x76\x01\0\0\x23\0\0\0\xe0\x02\0\
+\0\x81\x01\0\0\x23\0\0\0\0\x03\0\0\x8b\x01\0\0\x26\0\0\0\x20\x03\0\0\x96\x01\0\
+\0\x26\0\0\0\xa0\x03\0\0\xa0\x01\0\0\x23\0\0\0\x20\x04\0\0\xac\x01\0\0\x23\0\0\
+\0\x40\x04\0\0\xb7\x01\0\0\x23\0\0\0\x60\x04\0\0\0\0\0\0\x27\0\0\0\x80\x04\0\0\
+\xc1\x01\0\0\x29\0\0\0\xc0\x04\0\0\xc8\x01\0\0\x23\0\0\0\0\x05\0\0\xd1\x01\0\0\
+\x23\0\0\0\x20\x05\0\0\0\0\0\0\x2b\0\0\0\x40\x05\0\0\xda\x01\0\0\x23\0\0\0\x80\
+\x05\0\0\xe3\x01\0\0\x2d\0\0\0\xa0\x05\0\0\xef\x01\0\0\x29\0\0\0\xc0\x05\0\0\
+\xf8\x01\0\0\0\0\0\x08\x24\0\0\0\xfe\x01\0\0\0\0\0\x01\x04\0\0\0\x20\0\0\0\0\0\
+\0\0\0\0\0\x03\0\0\0\0\x23\0\0\0\x04\0\0\0\x05\0\0\0\0\0\0\0\0\0\0\x03\0\0\0\0\
+\x23\0\0\0\x04\0\0\0\x04\0\0\0\0\0\0\0\x01\0\0\x05\x08\0\0\0\x0b\x02\0\0\x28\0\
+\0\0\0\0\0\0\0\0\0\0\0\0\0\x02\x36\0\0\0\x15\x02\0\0\0\0\0\x08\x2a\0\0\0\x1b\
+\x02\0\0\0\0\0\x01\x08\0\0\0\x40\0\0\0\0\0\0\0\x01\0\0\x05\x08\0\0\0\x2e\x02\0\
+\0\x2c\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x02\x37\0\0\0\x31\x02\0\0\0\0\0\x08\x2e\0\0\
+\0\x36\x02\0\0\0\0\0\x01\x01\0\0\0\x08\0\0\0\0\0\0\0\x01\0\0\x0d\x02\0\0\0\x44\
+\x02\0\0\x21\0\0\0\x48\x02\0\0\x01\0\0\x0c\x2f\0\0\0\x18\x18\0\0\0\0\0\x01\x01\
+\0\0\0\x08\0\0\x01\0\0\0\0\0\0\0\x03\0\0\0\0\x31\0\0\0\x04\0\0\0\x07\0\0\0\x1d\
+\x18\0\0\0\0\0\x0e\x32\0\0\0\x01\0\0\0\x26\x18\0\0\x05\0\0\x0f\0\0\0\0\x0e\0\0\
+\0\0\0\0\0\x28\0\0\0\x12\0\0\0\0\0\0\0\x28\0\0\0\x16\0\0\0\0\0\0\0\x28\0\0\0\
+\x1c\0\0\0\0\0\0\0\x28\0\0\0\x20\0\0\0\0\0\0\0\x20\0\0\0\x2c\x18\0\0\x01\0\0\
+\x0f\0\0\0\0\x33\0\0\0\0\0\0\0\x07\0\0\0\x34\x18\0\0\0\0\0\x07\0\0\0\0\x42\x18\
+\0\0\0\0\0\x07\0\0\0\0\0\x69\x6e\x74\0\x5f\x5f\x41\x52\x52\x41\x59\x5f\x53\x49\
+\x5a\x45\x5f\x54\x59\x50\x45\x5f\x5f\0\x74\x79\x70\x65\0\x6b\x65\x79\x5f\x73\
+\x69\x7a\x65\0\x76\x61\x6c\x75\x65\x5f\x73\x69\x7a\x65\0\x6d\x61\x78\x5f\x65\
+\x6e\x74\x72\x69\x65\x73\0\x6d\x61\x70\x5f\x66\x6c\x61\x67\x73\0\x74\x61\x70\
+\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x63\x6f\x6e\x66\x69\x67\x75\x72\x61\x74\
+\x69\x6f\x6e\x73\0\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x74\x6f\x65\
+\x70\x6c\x69\x74\x7a\x5f\x6b\x65\x79\0\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\
+\x70\x5f\x69\x6e\x64\x69\x72\x65\x63\x74\x69\x6f\x6e\x5f\x74\x61\x62\x6c\x65\0\
+\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x66\x6c\x6f\x77\x5f\x74\x61\
+\x62\x6c\x65\0\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x66\x6c\x6f\x77\
+\x5f\x73\x74\x61\x74\x73\0\x5f\x5f\x73\x6b\x5f\x62\x75\x66\x66\0\x6c\x65\x6e\0\
+\x70\x6b\x74\x5f\x74\x79\x70\x65\0\x6d\x61\x72\x6b\0\x71\x75\x65\x75\x65\x5f\
+\x6d\x61\x70\x70\x69\x6e\x67\0\x70\x72\x6f\x74\x6f\x63\x6f\x6c\0\x76\x6c\x61\
+\x6e\x5f\x70\x72\x65\x73\x65\x6e\x74\0\x76\x6c\x61\x6e\x5f\x74\x63\x69\0\x76\
+\x6c\x61\x6e\x5f\x70\x72\x6f\x74\x6f\0\x70\x72\x69\x6f\x72\x69\x74\x79\0\x69\
+\x6e\x67\x72\x65\x73\x73\x5f\x69\x66\x69\x6e\x64\x65\x78\0\x69\x66\x69\x6e\x64\
+\x65\x78\0\x74\x63\x5f\x69\x6e\x64\x65\x78\0\x63\x62\0\x68\x61\x73\x68\0\x74\
+\x63\x5f\x63\x6c\x61\x73\x73\x69\x64\0\x64\x61\x74\x61\0\x64\x61\x74\x61\x5f\
+\x65\x6e\x64\0\x6e\x61\x70\x69\x5f\x69\x64\0\x66\x61\x6d\x69\x6c\x79\0\x72\x65\
+\x6d\x6f\x74\x65\x5f\x69\x70\x34\0\x6c\x6f\x63\x61\x6c\x5f\x69\x70\x34\0\x72\
+\x65\x6d\x6f\x74\x65\x5f\x69\x70\x36\0\x6c\x6f\x63\x61\x6c\x5f\x69\x70\x36\0\
+\x72\x65\x6d\x6f\x74\x65\x5f\x70\x6f\x72\x74\0\x6c\x6f\x63\x61\x6c\x5f\x70\x6f\
+\x72\x74\0\x64\x61\x74\x61\x5f\x6d\x65\x74\x61\0\x74\x73\x74\x61\x6d\x70\0\x77\
+\x69\x72\x65\x5f\x6c\x65\x6e\0\x67\x73\x6f\x5f\x73\x65\x67\x73\0\x67\x73\x6f\
+\x5f\x73\x69\x7a\x65\0\x74\x73\x74\x61\x6d\x70\x5f\x74\x79\x70\x65\0\x68\x77\
+\x74\x73\x74\x61\x6d\x70\0\x5f\x5f\x75\x33\x32\0\x75\x6e\x73\x69\x67\x6e\x65\
+\x64\x20\x69\x6e\x74\0\x66\x6c\x6f\x77\x5f\x6b\x65\x79\x73\0\x5f\x5f\x75\x36\
+\x34\0\x75\x6e\x73\x69\x67\x6e\x65\x64\x20\x6c\x6f\x6e\x67\x20\x6c\x6f\x6e\x67\
+\0\x73\x6b\0\x5f\x5f\x75\x38\0\x75\x6e\x73\x69\x67\x6e\x65\x64\x20\x63\x68\x61\
+\x72\0\x73\x6b\x62\0\x74\x75\x6e\x5f\x72\x73\x73\x5f\x73\x74\x65\x65\x72\x69\
+\x6e\x67\x5f\x70\x72\x6f\x67\0\x73\x6f\x63\x6b\x65\x74\0\x2f\x74\x6d\x70\x2f\
+\x62\x70\x66\x63\x63\x2f\x72\x73\x73\x2e\x62\x70\x66\x2e\x63\0\x69\x6e\x74\x20\
+\x74\x75\x6e\x5f\x72\x73\x73\x5f\x73\x74\x65\x65\x72\x69\x6e\x67\x5f\x70\x72\
+\x6f\x67\x28\x73\x74\x72\x75\x63\x74\x20\x5f\x5f\x73\x6b\x5f\x62\x75\x66\x66\
+\x20\x2a\x73\x6b\x62\x29\0\x20\x20\x20\x20\x73\x74\x72\x75\x63\x74\x20\x70\x61\
+\x63\x6b\x65\x74\x5f\x68\x61\x73\x68\x5f\x69\x6e\x66\x6f\x5f\x74\x20\x70\x61\
+\x63\x6b\x65\x74\x5f\x69\x6e\x66\x6f\x20\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\
+\x5f\x5f\x75\x33\x32\x20\x6b\x65\x79\x20\x3d\x20\x30\x3b\0\x20\x20\x20\x20\x63\
+\x6f\x6e\x66\x69\x67\x20\x3d\x20\x62\x70\x66\x5f\x6d\x61\x70\x5f\x6c\x6f\x6f\
+\x6b\x75\x70\x5f\x65\x6c\x65\x6d\x28\x26\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\
+\x61\x70\x5f\x63\x6f\x6e\x66\x69\x67\x75\x72\x61\x74\x69\x6f\x6e\x73\x2c\x20\
+\x26\x6b\x65\x79\x29\x3b\0\x20\x20\x20\x20\x74\x6f\x65\x20\x3d\x20\x62\x70\x66\
+\x5f\x6d\x61\x70\x5f\x6c\x6f\x6f\x6b\x75\x70\x5f\x65\x6c\x65\x6d\x28\x26\x74\
+\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x74\x6f\x65\x70\x6c\x69\x74\x7a\
+\x5f\x6b\x65\x79\x2c\x20\x26\x6b\x65\x79\x29\x3b\0\x20\x20\x20\x20\x69\x66\x20\
+\x28\x21\x63\x6f\x6e\x66\x69\x67\x20\x7c\x7c\x20\x21\x74\x6f\x65\x29\x20\x7b\0\
+\x20\x20\x20\x20\x69\x66\x20\x28\x63\x6f\x6e\x66\x69\x67\x2d\x3e\x72\x65\x64\
+\x69\x72\x65\x63\x74\x20\x26\x26\0\x20\x20\x20\x20\x5f\x5f\x75\x38\x20\x72\x73\
+\x73\x5f\x69\x6e\x70\x75\x74\x5b\x48\x41\x53\x48\x5f\x43\x41\x4c\x43\x55\x4c\
+\x41\x54\x49\x4f\x4e\x5f\x42\x55\x46\x46\x45\x52\x5f\x53\x49\x5a\x45\x5d\x20\
+\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\x69\x66\x20\x28\x21\x69\x6e\x66\x6f\x20\
+\x7c\x7c\x20\x21\x73\x6b\x62\x29\x20\x7b\0\x20\x20\x20\x20\x5f\x5f\x62\x65\x31\
+\x36\x20\x72\x65\x74\x20\x3d\x20\x30\x3b\0\x20\x20\x20\x20\x65\x72\x72\x20\x3d\
+\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\
+\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\x20\x6f\x66\x66\x73\
+\x65\x74\x2c\x20\x26\x72\x65\x74\x2c\x20\x73\x69\x7a\x65\x6f\x66\x28\x72\x65\
+\x74\x29\x2c\0\x20\x20\x20\x20\x69\x66\x20\x28\x65\x72\x72\x29\x20\x7b\0\x20\
+\x20\x20\x20\x73\x77\x69\x74\x63\x68\x20\x28\x62\x70\x66\x5f\x6e\x74\x6f\x68\
+\x73\x28\x72\x65\x74\x29\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x65\x72\
+\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\
+\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\x20\x6f\
+\x66\x66\x73\x65\x74\x2c\x20\x26\x72\x65\x74\x2c\x20\x73\x69\x7a\x65\x6f\x66\
+\x28\x72\x65\x74\x29\x2c\0\x20\x20\x20\x20\x72\x65\x74\x75\x72\x6e\x20\x72\x65\
+\x74\x3b\0\x20\x20\x20\x20\x69\x66\x20\x28\x6c\x33\x5f\x70\x72\x6f\x74\x6f\x63\
+\x6f\x6c\x20\x3d\x3d\x20\x30\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\
+\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x69\x70\x76\x34\x20\x3d\x20\x31\x3b\0\x20\x20\
+\x20\x20\x20\x20\x20\x20\x73\x74\x72\x75\x63\x74\x20\x69\x70\x68\x64\x72\x20\
+\x69\x70\x20\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\
+\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\
+\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\x20\x30\x2c\
+\x20\x26\x69\x70\x2c\x20\x73\x69\x7a\x65\x6f\x66\x28\x69\x70\x29\x2c\0\x20\x20\
+\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x65\x72\x72\x29\x20\x7b\0\x20\x20\x20\
 \x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x66\x72\x61\x67\x6d\
-\x65\x6e\x74\x65\x64\x20\x3d\x20\x74\x72\x75\x65\x3b\0\x20\x20\x20\x20\x20\x20\
-\x20\x20\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x20\x2b\x3d\x20\x28\x65\x78\
-\x74\x5f\x68\x64\x72\x2e\x68\x64\x72\x6c\x65\x6e\x20\x2b\x20\x31\x29\x20\x2a\
-\x20\x38\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x2a\x6c\x34\x5f\x70\x72\x6f\x74\
-\x6f\x63\x6f\x6c\x20\x3d\x20\x65\x78\x74\x5f\x68\x64\x72\x2e\x6e\x65\x78\x74\
-\x68\x64\x72\x3b\0\x20\x20\x20\x20\x66\x6f\x72\x20\x28\x75\x6e\x73\x69\x67\x6e\
-\x65\x64\x20\x69\x6e\x74\x20\x69\x20\x3d\x20\x30\x3b\x20\x69\x20\x3c\x20\x49\
-\x50\x36\x5f\x45\x58\x54\x45\x4e\x53\x49\x4f\x4e\x53\x5f\x43\x4f\x55\x4e\x54\
-\x3b\x20\x2b\x2b\x69\x29\x20\x7b\0\x20\x20\x20\x20\x69\x66\x20\x28\x6c\x34\x5f\
-\x70\x72\x6f\x74\x6f\x63\x6f\x6c\x20\x21\x3d\x20\x30\x20\x26\x26\x20\x21\x69\
-\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x66\x72\x61\x67\x6d\x65\x6e\x74\x65\x64\x29\
-\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x6c\x34\x5f\x70\x72\
-\x6f\x74\x6f\x63\x6f\x6c\x20\x3d\x3d\x20\x49\x50\x50\x52\x4f\x54\x4f\x5f\x54\
-\x43\x50\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x6e\
-\x66\x6f\x2d\x3e\x69\x73\x5f\x74\x63\x70\x20\x3d\x20\x31\x3b\0\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x20\x20\x20\x73\x74\x72\x75\x63\x74\x20\x74\x63\x70\x68\
-\x64\x72\x20\x74\x63\x70\x20\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\
+\x65\x6e\x74\x65\x64\x20\x3d\x20\x21\x21\x28\x62\x70\x66\x5f\x6e\x74\x6f\x68\
+\x73\x28\x69\x70\x2e\x66\x72\x61\x67\x5f\x6f\x66\x66\x29\x20\x26\x20\x28\x30\
+\x78\x32\x30\x30\x30\x20\x7c\x20\x30\x78\x31\x66\x66\x66\x29\x29\x3b\0\x20\x20\
+\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x6e\x5f\x73\x72\x63\x20\
+\x3d\x20\x69\x70\x2e\x73\x61\x64\x64\x72\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\
+\x69\x6e\x66\x6f\x2d\x3e\x69\x6e\x5f\x64\x73\x74\x20\x3d\x20\x69\x70\x2e\x64\
+\x61\x64\x64\x72\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x6c\x34\x5f\x70\x72\x6f\
+\x74\x6f\x63\x6f\x6c\x20\x3d\x20\x69\x70\x2e\x70\x72\x6f\x74\x6f\x63\x6f\x6c\
+\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x20\
+\x3d\x20\x69\x70\x2e\x69\x68\x6c\x20\x2a\x20\x34\x3b\0\x20\x20\x20\x20\x69\x66\
+\x20\x28\x6c\x34\x5f\x70\x72\x6f\x74\x6f\x63\x6f\x6c\x20\x21\x3d\x20\x30\x20\
+\x26\x26\x20\x21\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x66\x72\x61\x67\x6d\x65\
+\x6e\x74\x65\x64\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\
+\x6c\x34\x5f\x70\x72\x6f\x74\x6f\x63\x6f\x6c\x20\x3d\x3d\x20\x49\x50\x50\x52\
+\x4f\x54\x4f\x5f\x54\x43\x50\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x74\x63\x70\x20\x3d\x20\x31\
+\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x73\x74\x72\x75\x63\x74\
+\x20\x74\x63\x70\x68\x64\x72\x20\x74\x63\x70\x20\x3d\x20\x7b\x7d\x3b\0\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\x62\x70\x66\
+\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\
+\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\x20\x6c\x34\x5f\x6f\x66\x66\x73\x65\
+\x74\x2c\x20\x26\x74\x63\x70\x2c\x20\x73\x69\x7a\x65\x6f\x66\x28\x74\x63\x70\
+\x29\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x65\
+\x72\x72\x29\x20\x7b\0\x20\x20\x20\x20\x69\x66\x20\x28\x69\x6e\x66\x6f\x2d\x3e\
+\x69\x73\x5f\x69\x70\x76\x34\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\
+\x66\x20\x28\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x74\x63\x70\x20\x26\x26\0\x20\
+\x20\x20\x20\x5f\x5f\x62\x75\x69\x6c\x74\x69\x6e\x5f\x6d\x65\x6d\x63\x70\x79\
+\x28\x26\x72\x73\x73\x5f\x69\x6e\x70\x75\x74\x5b\x2a\x62\x79\x74\x65\x73\x5f\
+\x77\x72\x69\x74\x74\x65\x6e\x5d\x2c\x20\x70\x74\x72\x2c\x20\x73\x69\x7a\x65\
+\x29\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\
+\x69\x70\x76\x36\x20\x3d\x20\x31\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x73\x74\
+\x72\x75\x63\x74\x20\x69\x70\x76\x36\x68\x64\x72\x20\x69\x70\x36\x20\x3d\x20\
+\x7b\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\x62\x70\
+\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\
+\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\x20\x30\x2c\x20\x26\x69\x70\x36\
+\x2c\x20\x73\x69\x7a\x65\x6f\x66\x28\x69\x70\x36\x29\x2c\0\x20\x20\x20\x20\x20\
+\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x6e\x36\x5f\x73\x72\x63\x20\x3d\x20\
+\x69\x70\x36\x2e\x73\x61\x64\x64\x72\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\
+\x6e\x66\x6f\x2d\x3e\x69\x6e\x36\x5f\x64\x73\x74\x20\x3d\x20\x69\x70\x36\x2e\
+\x64\x61\x64\x64\x72\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x6c\x34\x5f\x70\x72\
+\x6f\x74\x6f\x63\x6f\x6c\x20\x3d\x20\x69\x70\x36\x2e\x6e\x65\x78\x74\x68\x64\
+\x72\x3b\0\x20\x20\x20\x20\x73\x77\x69\x74\x63\x68\x20\x28\x68\x64\x72\x5f\x74\
+\x79\x70\x65\x29\x20\x7b\0\x20\x20\x20\x20\x73\x74\x72\x75\x63\x74\x20\x69\x70\
+\x76\x36\x5f\x6f\x70\x74\x5f\x68\x64\x72\x20\x65\x78\x74\x5f\x68\x64\x72\x20\
+\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\
+\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\
+\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\x20\x2a\x6c\x34\x5f\x6f\
+\x66\x66\x73\x65\x74\x2c\x20\x26\x65\x78\x74\x5f\x68\x64\x72\x2c\0\x20\x20\x20\
+\x20\x20\x20\x20\x20\x69\x66\x20\x28\x2a\x6c\x34\x5f\x70\x72\x6f\x74\x6f\x63\
+\x6f\x6c\x20\x3d\x3d\x20\x49\x50\x50\x52\x4f\x54\x4f\x5f\x52\x4f\x55\x54\x49\
+\x4e\x47\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x73\x74\
+\x72\x75\x63\x74\x20\x69\x70\x76\x36\x5f\x72\x74\x5f\x68\x64\x72\x20\x65\x78\
+\x74\x5f\x72\x74\x20\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x65\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\
+\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\
+\x6b\x62\x2c\x20\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x2c\x20\x26\x65\x78\
+\x74\x5f\x72\x74\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\
+\x20\x28\x28\x65\x78\x74\x5f\x72\x74\x2e\x74\x79\x70\x65\x20\x3d\x3d\x20\x49\
+\x50\x56\x36\x5f\x53\x52\x43\x52\x54\x5f\x54\x59\x50\x45\x5f\x32\x29\x20\x26\
+\x26\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x20\x2b\x20\x6f\x66\x66\x73\
+\x65\x74\x6f\x66\x28\x73\x74\x72\x75\x63\x74\x20\x72\x74\x32\x5f\x68\x64\x72\
+\x2c\x20\x61\x64\x64\x72\x29\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
 \x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\
 \x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\
-\x28\x73\x6b\x62\x2c\x20\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x2c\x20\x26\x74\
-\x63\x70\x2c\x20\x73\x69\x7a\x65\x6f\x66\x28\x74\x63\x70\x29\x2c\0\x20\x20\x20\
-\x20\x69\x66\x20\x28\x70\x61\x63\x6b\x65\x74\x5f\x69\x6e\x66\x6f\x2e\x69\x73\
-\x5f\x69\x70\x76\x34\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\
-\x28\x70\x61\x63\x6b\x65\x74\x5f\x69\x6e\x66\x6f\x2e\x69\x73\x5f\x74\x63\x70\
-\x20\x26\x26\0\x20\x20\x20\x20\x5f\x5f\x62\x75\x69\x6c\x74\x69\x6e\x5f\x6d\x65\
-\x6d\x63\x70\x79\x28\x26\x72\x73\x73\x5f\x69\x6e\x70\x75\x74\x5b\x2a\x62\x79\
-\x74\x65\x73\x5f\x77\x72\x69\x74\x74\x65\x6e\x5d\x2c\x20\x70\x74\x72\x2c\x20\
-\x73\x69\x7a\x65\x29\x3b\0\x20\x20\x20\x20\x7d\x20\x65\x6c\x73\x65\x20\x69\x66\
-\x20\x28\x70\x61\x63\x6b\x65\x74\x5f\x69\x6e\x66\x6f\x2e\x69\x73\x5f\x69\x70\
-\x76\x36\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\
-\x20\x28\x70\x61\x63\x6b\x65\x74\x5f\x69\x6e\x66\x6f\x2e\x69\x73\x5f\x69\x70\
-\x76\x36\x5f\x65\x78\x74\x5f\x73\x72\x63\x20\x26\x26\0\x20\x20\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x70\x61\x63\x6b\x65\x74\x5f\x69\x6e\
-\x66\x6f\x2e\x69\x73\x5f\x69\x70\x76\x36\x5f\x65\x78\x74\x5f\x64\x73\x74\x20\
+\x28\x73\x6b\x62\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x69\x66\x20\x28\x65\x72\x72\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x69\
+\x70\x76\x36\x5f\x65\x78\x74\x5f\x64\x73\x74\x20\x3d\x20\x31\x3b\0\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x20\x20\x7d\x20\x5f\x5f\x61\x74\x74\x72\x69\x62\
+\x75\x74\x65\x5f\x5f\x28\x28\x70\x61\x63\x6b\x65\x64\x29\x29\x20\x6f\x70\x74\
+\x20\x3d\x20\x7b\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x6f\x70\x74\x5f\x6f\x66\x66\x73\x65\x74\x20\x2b\x3d\x20\x28\x6f\
+\x70\x74\x2e\x74\x79\x70\x65\x20\x3d\x3d\x20\x49\x50\x56\x36\x5f\x54\x4c\x56\
+\x5f\x50\x41\x44\x31\x29\x20\x3f\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x69\x66\x20\x28\x6f\x70\x74\x5f\x6f\x66\x66\x73\x65\x74\
+\x20\x2b\x20\x31\x20\x3e\x3d\x20\x65\x78\x74\x5f\x68\x64\x72\x2e\x68\x64\x72\
+\x6c\x65\x6e\x20\x2a\x20\x38\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\x62\x70\x66\x5f\x73\x6b\
+\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\x72\x65\x6c\x61\x74\x69\
+\x76\x65\x28\x73\x6b\x62\x2c\x20\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x20\
+\x2b\x20\x6f\x70\x74\x5f\x6f\x66\x66\x73\x65\x74\x2c\0\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x6f\x70\x74\x2e\x74\
+\x79\x70\x65\x20\x3d\x3d\x20\x49\x50\x56\x36\x5f\x54\x4c\x56\x5f\x48\x41\x4f\
+\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x20\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x20\
+\x2b\x20\x6f\x70\x74\x5f\x6f\x66\x66\x73\x65\x74\0\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\x20\
+\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\x5f\
+\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\0\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x65\
+\x72\x72\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x69\x70\x76\x36\
+\x5f\x65\x78\x74\x5f\x73\x72\x63\x20\x3d\x20\x31\x3b\0\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x66\x72\x61\x67\
+\x6d\x65\x6e\x74\x65\x64\x20\x3d\x20\x74\x72\x75\x65\x3b\0\x20\x20\x20\x20\x20\
+\x20\x20\x20\x2a\x6c\x34\x5f\x6f\x66\x66\x73\x65\x74\x20\x2b\x3d\x20\x28\x65\
+\x78\x74\x5f\x68\x64\x72\x2e\x68\x64\x72\x6c\x65\x6e\x20\x2b\x20\x31\x29\x20\
+\x2a\x20\x38\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x2a\x6c\x34\x5f\x70\x72\x6f\
+\x74\x6f\x63\x6f\x6c\x20\x3d\x20\x65\x78\x74\x5f\x68\x64\x72\x2e\x6e\x65\x78\
+\x74\x68\x64\x72\x3b\0\x20\x20\x20\x20\x66\x6f\x72\x20\x28\x75\x6e\x73\x69\x67\
+\x6e\x65\x64\x20\x69\x6e\x74\x20\x69\x20\x3d\x20\x30\x3b\x20\x69\x20\x3c\x20\
+\x49\x50\x36\x5f\x45\x58\x54\x45\x4e\x53\x49\x4f\x4e\x53\x5f\x43\x4f\x55\x4e\
+\x54\x3b\x20\x2b\x2b\x69\x29\x20\x7b\0\x20\x20\x20\x20\x7d\x20\x65\x6c\x73\x65\
+\x20\x69\x66\x20\x28\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x69\x70\x76\x36\x29\
+\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x69\
+\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x69\x70\x76\x36\x5f\x65\x78\x74\x5f\x64\x73\
+\x74\x20\x26\x26\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\
+\x28\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x69\x70\x76\x36\x5f\x65\x78\x74\x5f\
+\x73\x72\x63\x20\x26\x26\0\x20\x20\x20\x20\x20\x20\x20\x20\x7d\x20\x65\x6c\x73\
+\x65\x20\x69\x66\x20\x28\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x75\x64\x70\x20\
 \x26\x26\0\x20\x20\x20\x20\x20\x20\x20\x20\x7d\x20\x65\x6c\x73\x65\x20\x69\x66\
-\x20\x28\x70\x61\x63\x6b\x65\x74\x5f\x69\x6e\x66\x6f\x2e\x69\x73\x5f\x75\x64\
-\x70\x20\x26\x26\0\x20\x20\x20\x20\x20\x20\x20\x20\x7d\x20\x65\x6c\x73\x65\x20\
-\x69\x66\x20\x28\x63\x6f\x6e\x66\x69\x67\x2d\x3e\x68\x61\x73\x68\x5f\x74\x79\
-\x70\x65\x73\x20\x26\x20\x56\x49\x52\x54\x49\x4f\x5f\x4e\x45\x54\x5f\x52\x53\
-\x53\x5f\x48\x41\x53\x48\x5f\x54\x59\x50\x45\x5f\x49\x50\x76\x34\x29\x20\x7b\0\
-\x20\x20\x20\x20\x20\x20\x20\x20\x7d\x20\x65\x6c\x73\x65\x20\x69\x66\x20\x28\
-\x63\x6f\x6e\x66\x69\x67\x2d\x3e\x68\x61\x73\x68\x5f\x74\x79\x70\x65\x73\x20\
-\x26\x20\x56\x49\x52\x54\x49\x4f\x5f\x4e\x45\x54\x5f\x52\x53\x53\x5f\x48\x41\
-\x53\x48\x5f\x54\x59\x50\x45\x5f\x49\x50\x76\x36\x29\x20\x7b\0\x20\x20\x20\x20\
-\x20\x20\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x75\x64\
-\x70\x20\x3d\x20\x31\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x73\
-\x74\x72\x75\x63\x74\x20\x75\x64\x70\x68\x64\x72\x20\x75\x64\x70\x20\x3d\x20\
-\x7b\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\
-\x3d\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\
-\x73\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\x20\x6c\x34\x5f\
-\x6f\x66\x66\x73\x65\x74\x2c\x20\x26\x75\x64\x70\x2c\x20\x73\x69\x7a\x65\x6f\
-\x66\x28\x75\x64\x70\x29\x2c\0\x20\x20\x20\x20\x66\x6f\x72\x20\x28\x62\x79\x74\
-\x65\x20\x3d\x20\x30\x3b\x20\x62\x79\x74\x65\x20\x3c\x20\x48\x41\x53\x48\x5f\
-\x43\x41\x4c\x43\x55\x4c\x41\x54\x49\x4f\x4e\x5f\x42\x55\x46\x46\x45\x52\x5f\
-\x53\x49\x5a\x45\x3b\x20\x62\x79\x74\x65\x2b\x2b\x29\x20\x7b\0\x20\x20\x20\x20\
-\x5f\x5f\x75\x33\x32\x20\x6c\x65\x66\x74\x6d\x6f\x73\x74\x5f\x33\x32\x5f\x62\
-\x69\x74\x73\x20\x3d\x20\x6b\x65\x79\x2d\x3e\x6c\x65\x66\x74\x6d\x6f\x73\x74\
-\x5f\x33\x32\x5f\x62\x69\x74\x73\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x5f\x5f\
-\x75\x38\x20\x69\x6e\x70\x75\x74\x5f\x62\x79\x74\x65\x20\x3d\x20\x69\x6e\x70\
-\x75\x74\x5b\x62\x79\x74\x65\x5d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x69\x66\x20\x28\x69\x6e\x70\x75\x74\x5f\x62\x79\x74\x65\x20\x26\x20\
-\x28\x31\x20\x3c\x3c\x20\x37\x29\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\
-\x5f\x5f\x75\x38\x20\x6b\x65\x79\x5f\x62\x79\x74\x65\x20\x3d\x20\x6b\x65\x79\
-\x2d\x3e\x6e\x65\x78\x74\x5f\x62\x79\x74\x65\x5b\x62\x79\x74\x65\x5d\x3b\0\x20\
-\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x28\x6c\x65\x66\x74\x6d\x6f\x73\x74\x5f\x33\x32\x5f\x62\x69\x74\x73\x20\x3c\
-\x3c\x20\x31\x29\x20\x7c\x20\x28\x28\x6b\x65\x79\x5f\x62\x79\x74\x65\x20\x26\
-\x20\x28\x31\x20\x3c\x3c\x20\x37\x29\x29\x20\x3e\x3e\x20\x37\x29\x3b\0\x20\x20\
-\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x5f\x5f\x75\x33\x32\x20\x74\x61\x62\
-\x6c\x65\x5f\x69\x64\x78\x20\x3d\x20\x68\x61\x73\x68\x20\x25\x20\x63\x6f\x6e\
-\x66\x69\x67\x2d\x3e\x69\x6e\x64\x69\x72\x65\x63\x74\x69\x6f\x6e\x73\x5f\x6c\
-\x65\x6e\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x71\x75\x65\x75\
-\x65\x20\x3d\x20\x62\x70\x66\x5f\x6d\x61\x70\x5f\x6c\x6f\x6f\x6b\x75\x70\x5f\
-\x65\x6c\x65\x6d\x28\x26\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x69\
-\x6e\x64\x69\x72\x65\x63\x74\x69\x6f\x6e\x5f\x74\x61\x62\x6c\x65\x2c\0\x20\x20\
-\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x71\x75\x65\x75\x65\
-\x29\x20\x7b\0\x7d\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\
-\x20\x20\x72\x65\x74\x75\x72\x6e\x20\x2a\x71\x75\x65\x75\x65\x3b\0\x63\x68\x61\
-\x72\0\x5f\x6c\x69\x63\x65\x6e\x73\x65\0\x2e\x6d\x61\x70\x73\0\x6c\x69\x63\x65\
-\x6e\x73\x65\0\x62\x70\x66\x5f\x66\x6c\x6f\x77\x5f\x6b\x65\x79\x73\0\x62\x70\
-\x66\x5f\x73\x6f\x63\x6b\0\0\0\0\x9f\xeb\x01\0\x20\0\0\0\0\0\0\0\x14\0\0\0\x14\
-\0\0\0\x6c\x0c\0\0\x80\x0c\0\0\0\0\0\0\x08\0\0\0\x30\x02\0\0\x01\0\0\0\0\0\0\0\
-\x26\0\0\0\x10\0\0\0\x30\x02\0\0\xc6\0\0\0\0\0\0\0\x37\x02\0\0\x60\x02\0\0\0\
-\x68\x08\0\x10\0\0\0\x37\x02\0\0\x91\x02\0\0\x0b\x80\x08\0\x20\0\0\0\x37\x02\0\
-\0\0\0\0\0\0\0\0\0\x28\0\0\0\x37\x02\0\0\xa4\x02\0\0\x0e\x8c\x08\0\x50\0\0\0\
-\x37\x02\0\0\xe9\x02\0\0\x0b\x90\x08\0\x78\0\0\0\x37\x02\0\0\x29\x03\0\0\x10\
-\x98\x08\0\x80\0\0\0\x37\x02\0\0\0\0\0\0\0\0\0\0\x88\0\0\0\x37\x02\0\0\x29\x03\
-\0\0\x10\x98\x08\0\x90\0\0\0\x37\x02\0\0\x42\x03\0\0\x16\x9c\x08\0\x98\0\0\0\
-\x37\x02\0\0\x42\x03\0\0\x0d\x9c\x08\0\xb0\0\0\0\x37\x02\0\0\x63\x03\0\0\x0a\
-\x10\x06\0\xd8\0\0\0\x37\x02\0\0\x9a\x03\0\0\x1f\x1c\x06\0\x30\x01\0\0\x37\x02\
-\0\0\xca\x03\0\0\x0f\xac\x04\0\x38\x01\0\0\x37\x02\0\0\xe3\x03\0\0\x0c\x2c\x04\
-\0\x48\x01\0\0\x37\x02\0\0\0\0\0\0\0\0\0\0\x50\x01\0\0\x37\x02\0\0\xf7\x03\0\0\
-\x0b\x38\x04\0\x78\x01\0\0\x37\x02\0\0\x3d\x04\0\0\x09\x40\x04\0\x88\x01\0\0\
-\x37\x02\0\0\x3d\x04\0\0\x09\x40\x04\0\x98\x01\0\0\x37\x02\0\0\x4c\x04\0\0\x0d\
-\x50\x04\0\xb0\x01\0\0\x37\x02\0\0\x4c\x04\0\0\x05\x50\x04\0\xd0\x01\0\0\x37\
-\x02\0\0\0\0\0\0\0\0\0\0\xd8\x01\0\0\x37\x02\0\0\x6a\x04\0\0\x0f\x64\x04\0\xf8\
-\x01\0\0\x37\x02\0\0\x3d\x04\0\0\x09\x7c\x04\0\x08\x02\0\0\x37\x02\0\0\x3d\x04\
-\0\0\x09\x7c\x04\0\x10\x02\0\0\x37\x02\0\0\xb4\x04\0\0\x0c\x8c\x04\0\x18\x02\0\
-\0\x37\x02\0\0\xc4\x04\0\0\x09\xc8\x04\0\x38\x02\0\0\x37\x02\0\0\xe0\x04\0\0\
-\x17\xe0\x04\0\x48\x02\0\0\x37\x02\0\0\xfb\x04\0\0\x16\xe8\x04\0\x68\x02\0\0\
-\x37\x02\0\0\xe0\x04\0\0\x17\xe0\x04\0\x70\x02\0\0\x37\x02\0\0\x19\x05\0\0\x0f\
-\xec\x04\0\x98\x02\0\0\x37\x02\0\0\x5c\x05\0\0\x0d\xf4\x04\0\xa8\x02\0\0\x37\
-\x02\0\0\x5c\x05\0\0\x0d\xf4\x04\0\xb0\x02\0\0\x37\x02\0\0\x6f\x05\0\0\x22\x0c\
-\x05\0\xb8\x02\0\0\x37\x02\0\0\x6f\x05\0\0\x39\x0c\x05\0\xc8\x02\0\0\x37\x02\0\
-\0\x6f\x05\0\0\x20\x0c\x05\0\xd8\x02\0\0\x37\x02\0\0\xbd\x05\0\0\x1b\x04\x05\0\
-\xe0\x02\0\0\x37\x02\0\0\xbd\x05\0\0\x16\x04\x05\0\xe8\x02\0\0\x37\x02\0\0\xde\
-\x05\0\0\x1b\x08\x05\0\xf0\x02\0\0\x37\x02\0\0\xde\x05\0\0\x16\x08\x05\0\xf8\
-\x02\0\0\x37\x02\0\0\xff\x05\0\0\x1a\x14\x05\0\0\x03\0\0\x37\x02\0\0\x22\x06\0\
-\0\x18\x18\x05\0\x08\x03\0\0\x37\x02\0\0\x22\x06\0\0\x1c\x18\x05\0\x18\x03\0\0\
-\x37\x02\0\0\x6f\x05\0\0\x1d\x0c\x05\0\x30\x03\0\0\x37\x02\0\0\x42\x06\0\0\x17\
-\x20\x05\0\x40\x03\0\0\x37\x02\0\0\x5d\x06\0\0\x18\x28\x05\0\x70\x03\0\0\x37\
-\x02\0\0\x42\x06\0\0\x17\x20\x05\0\x78\x03\0\0\x37\x02\0\0\x7e\x06\0\0\x0f\x2c\
-\x05\0\xa0\x03\0\0\x37\x02\0\0\x5c\x05\0\0\x0d\x34\x05\0\xb0\x03\0\0\x37\x02\0\
-\0\x5c\x05\0\0\x0d\x34\x05\0\xc0\x03\0\0\x37\x02\0\0\xc3\x06\0\0\x1d\x44\x05\0\
-\0\x04\0\0\x37\x02\0\0\xe6\x06\0\0\x1d\x48\x05\0\x40\x04\0\0\x37\x02\0\0\x09\
-\x07\0\0\x1b\x50\x05\0\x48\x04\0\0\x37\x02\0\0\x2c\x07\0\0\x05\x3c\x02\0\x90\
-\x04\0\0\x37\x02\0\0\x44\x07\0\0\x19\xc4\x02\0\xf8\x04\0\0\x37\x02\0\0\0\0\0\0\
-\0\0\0\0\0\x05\0\0\x37\x02\0\0\x6a\x07\0\0\x0f\xd4\x02\0\x28\x05\0\0\x37\x02\0\
-\0\x5c\x05\0\0\x0d\xdc\x02\0\x38\x05\0\0\x37\x02\0\0\x5c\x05\0\0\x0d\xdc\x02\0\
-\x40\x05\0\0\x37\x02\0\0\xaf\x07\0\0\x0d\xec\x02\0\x68\x05\0\0\x37\x02\0\0\xde\
-\x07\0\0\x20\xf0\x02\0\x90\x05\0\0\x37\x02\0\0\x0a\x08\0\0\x13\xf8\x02\0\xb0\
-\x05\0\0\x37\x02\0\0\x52\x08\0\0\x11\0\x03\0\xc0\x05\0\0\x37\x02\0\0\x52\x08\0\
-\0\x11\0\x03\0\xc8\x05\0\0\x37\x02\0\0\x69\x08\0\0\x19\x10\x03\0\xd0\x05\0\0\
-\x37\x02\0\0\x69\x08\0\0\x34\x10\x03\0\xf8\x05\0\0\x37\x02\0\0\x9f\x08\0\0\x15\
-\x24\x03\0\x08\x06\0\0\x37\x02\0\0\xe0\x08\0\0\x17\x20\x03\0\x30\x06\0\0\x37\
-\x02\0\0\x17\x09\0\0\x15\x30\x03\0\x40\x06\0\0\x37\x02\0\0\x17\x09\0\0\x15\x30\
-\x03\0\x48\x06\0\0\x37\x02\0\0\x32\x09\0\0\x27\x40\x03\0\x70\x06\0\0\x37\x02\0\
-\0\x5d\x09\0\0\x27\x5c\x03\0\x80\x06\0\0\x37\x02\0\0\x8d\x09\0\0\x1c\xc0\x03\0\
-\x88\x06\0\0\x37\x02\0\0\xc9\x09\0\0\x20\xcc\x03\0\x98\x06\0\0\x37\x02\0\0\xc9\
-\x09\0\0\x2f\xcc\x03\0\xa0\x06\0\0\x37\x02\0\0\xc9\x09\0\0\x36\xcc\x03\0\xa8\
-\x06\0\0\x37\x02\0\0\xc9\x09\0\0\x15\xcc\x03\0\x10\x07\0\0\x37\x02\0\0\x05\x0a\
-\0\0\x43\x70\x03\0\x30\x07\0\0\x37\x02\0\0\0\0\0\0\0\0\0\0\x38\x07\0\0\x37\x02\
-\0\0\x05\x0a\0\0\x17\x70\x03\0\x60\x07\0\0\x37\x02\0\0\x17\x09\0\0\x15\x78\x03\
-\0\x70\x07\0\0\x37\x02\0\0\x17\x09\0\0\x15\x78\x03\0\x78\x07\0\0\x37\x02\0\0\
-\x55\x0a\0\0\x19\x88\x03\0\x80\x07\0\0\x37\x02\0\0\x55\x0a\0\0\x15\x88\x03\0\
-\x88\x07\0\0\x37\x02\0\0\x85\x0a\0\0\x19\x90\x03\0\x90\x07\0\0\x37\x02\0\0\xb5\
-\x0a\0\0\x1b\x8c\x03\0\xc0\x07\0\0\x37\x02\0\0\xf0\x0a\0\0\x19\xa0\x03\0\xd0\
-\x07\0\0\x37\x02\0\0\xf0\x0a\0\0\x19\xa0\x03\0\xd8\x07\0\0\x37\x02\0\0\x0f\x0b\
-\0\0\x2b\xb0\x03\0\xf8\x07\0\0\x37\x02\0\0\x8d\x09\0\0\x1f\xc0\x03\0\x18\x08\0\
-\0\x37\x02\0\0\x3e\x0b\0\0\x21\xe0\x03\0\x30\x08\0\0\x37\x02\0\0\x66\x0b\0\0\
-\x20\xf0\x03\0\x38\x08\0\0\x37\x02\0\0\x66\x0b\0\0\x2c\xf0\x03\0\x48\x08\0\0\
-\x37\x02\0\0\x66\x0b\0\0\x14\xf0\x03\0\x50\x08\0\0\x37\x02\0\0\x96\x0b\0\0\x20\
-\xec\x03\0\x58\x08\0\0\x37\x02\0\0\x2c\x07\0\0\x05\x3c\x02\0\xa0\x08\0\0\x37\
-\x02\0\0\xbe\x0b\0\0\x38\xcc\x02\0\xc0\x08\0\0\x37\x02\0\0\xbe\x0b\0\0\x05\xcc\
-\x02\0\xd0\x08\0\0\x37\x02\0\0\x2c\x07\0\0\x05\x3c\x02\0\xe8\x08\0\0\x37\x02\0\
-\0\x2c\x07\0\0\x05\x3c\x02\0\0\x09\0\0\x37\x02\0\0\xfc\x0b\0\0\x15\x74\x05\0\
-\x10\x09\0\0\x37\x02\0\0\xfc\x0b\0\0\x1a\x74\x05\0\x28\x09\0\0\x37\x02\0\0\x30\
-\x0c\0\0\x0d\x78\x05\0\x48\x09\0\0\x37\x02\0\0\x5a\x0c\0\0\x1a\x7c\x05\0\x58\
-\x09\0\0\x37\x02\0\0\x78\x0c\0\0\x1b\x84\x05\0\x78\x09\0\0\x37\x02\0\0\x5a\x0c\
-\0\0\x1a\x7c\x05\0\x80\x09\0\0\x37\x02\0\0\x9c\x0c\0\0\x13\x88\x05\0\xa0\x09\0\
-\0\x37\x02\0\0\x52\x08\0\0\x11\x90\x05\0\xb0\x09\0\0\x37\x02\0\0\x52\x08\0\0\
-\x11\x90\x05\0\xb8\x09\0\0\x37\x02\0\0\0\0\0\0\0\0\0\0\xd8\x09\0\0\x37\x02\0\0\
-\xed\x0c\0\0\x15\x38\x06\0\xe0\x09\0\0\x37\x02\0\0\xed\x0c\0\0\x09\x38\x06\0\
-\xe8\x09\0\0\x37\x02\0\0\0\0\0\0\0\0\0\0\x38\x0a\0\0\x37\x02\0\0\x0c\x0d\0\0\
-\x19\x3c\x06\0\x40\x0a\0\0\x37\x02\0\0\x0c\x0d\0\0\x20\x3c\x06\0\x60\x0a\0\0\
-\x37\x02\0\0\x2e\x0d\0\0\x05\xa4\x01\0\xa8\x0a\0\0\x37\x02\0\0\x6b\x0d\0\0\x1c\
-\xd4\x06\0\xb0\x0a\0\0\x37\x02\0\0\x6b\x0d\0\0\x10\xd4\x06\0\xb8\x0a\0\0\x37\
-\x02\0\0\0\0\0\0\0\0\0\0\x08\x0b\0\0\x37\x02\0\0\x0c\x0d\0\0\x19\xd8\x06\0\x10\
-\x0b\0\0\x37\x02\0\0\x0c\x0d\0\0\x20\xd8\x06\0\x30\x0b\0\0\x37\x02\0\0\x91\x0d\
-\0\0\x2d\xe4\x06\0\x40\x0b\0\0\x37\x02\0\0\x91\x0d\0\0\x1d\xe4\x06\0\x50\x0b\0\
-\0\x37\x02\0\0\x91\x0d\0\0\x2d\xe4\x06\0\x80\x0b\0\0\x37\x02\0\0\xc0\x0d\0\0\
-\x2d\x10\x07\0\x90\x0b\0\0\x37\x02\0\0\xc0\x0d\0\0\x1d\x10\x07\0\xa0\x0b\0\0\
-\x37\x02\0\0\xc0\x0d\0\0\x2d\x10\x07\0\xc8\x0b\0\0\x37\x02\0\0\x2e\x0d\0\0\x05\
-\xa4\x01\0\x90\x0c\0\0\x37\x02\0\0\xef\x0d\0\0\x20\x78\x06\0\x98\x0c\0\0\x37\
-\x02\0\0\xef\x0d\0\0\x27\x78\x06\0\xc0\x0c\0\0\x37\x02\0\0\x18\x0e\0\0\x27\xb4\
-\x06\0\xc8\x0c\0\0\x37\x02\0\0\x18\x0e\0\0\x14\xb4\x06\0\xd0\x0c\0\0\x37\x02\0\
-\0\x2e\x0d\0\0\x05\xa4\x01\0\xe0\x0c\0\0\x37\x02\0\0\x2e\x0d\0\0\x05\xa4\x01\0\
-\xf8\x0c\0\0\x37\x02\0\0\xef\x0d\0\0\x20\x54\x07\0\0\x0d\0\0\x37\x02\0\0\xef\
-\x0d\0\0\x27\x54\x07\0\x20\x0d\0\0\x37\x02\0\0\x91\x0d\0\0\x2d\x60\x07\0\x30\
-\x0d\0\0\x37\x02\0\0\x91\x0d\0\0\x1d\x60\x07\0\x40\x0d\0\0\x37\x02\0\0\x91\x0d\
-\0\0\x2d\x60\x07\0\x70\x0d\0\0\x37\x02\0\0\xc0\x0d\0\0\x2d\x8c\x07\0\x80\x0d\0\
-\0\x37\x02\0\0\xc0\x0d\0\0\x1d\x8c\x07\0\x90\x0d\0\0\x37\x02\0\0\xc0\x0d\0\0\
-\x2d\x8c\x07\0\xb8\x0d\0\0\x37\x02\0\0\x61\x0e\0\0\x27\xd8\x07\0\xc8\x0d\0\0\
-\x37\x02\0\0\x61\x0e\0\0\x14\xd8\x07\0\xd0\x0d\0\0\x37\x02\0\0\x91\x0d\0\0\x2d\
-\xdc\x07\0\xe0\x0d\0\0\x37\x02\0\0\x91\x0d\0\0\x1d\xdc\x07\0\xf0\x0d\0\0\x37\
-\x02\0\0\x91\x0d\0\0\x2d\xdc\x07\0\x20\x0e\0\0\x37\x02\0\0\x2e\x0d\0\0\x05\xa4\
-\x01\0\x70\x0e\0\0\x37\x02\0\0\x2e\x0d\0\0\x17\xa4\x01\0\x80\x0e\0\0\x37\x02\0\
-\0\xc0\x0d\0\0\x2d\x08\x08\0\x98\x0e\0\0\x37\x02\0\0\x2e\x0d\0\0\x05\xa4\x01\0\
-\xe0\x0e\0\0\x37\x02\0\0\xaa\x0e\0\0\x1a\xac\x05\0\xf0\x0e\0\0\x37\x02\0\0\xc8\
-\x0e\0\0\x1b\xb4\x05\0\0\x0f\0\0\x37\x02\0\0\xaa\x0e\0\0\x1a\xac\x05\0\x08\x0f\
-\0\0\x37\x02\0\0\xec\x0e\0\0\x13\xb8\x05\0\x28\x0f\0\0\x37\x02\0\0\x52\x08\0\0\
-\x11\xc0\x05\0\x38\x0f\0\0\x37\x02\0\0\x52\x08\0\0\x11\xc0\x05\0\x48\x0f\0\0\
-\x37\x02\0\0\x2e\x0d\0\0\x05\xa4\x01\0\x80\x0f\0\0\x37\x02\0\0\x2e\x0d\0\0\x05\
-\xa4\x01\0\x90\x0f\0\0\x37\x02\0\0\x3d\x0f\0\0\x05\xdc\x01\0\x98\x0f\0\0\x37\
-\x02\0\0\x7f\x0f\0\0\x23\xd0\x01\0\xb0\x0f\0\0\x37\x02\0\0\0\0\0\0\0\0\0\0\xb8\
-\x0f\0\0\x37\x02\0\0\xb3\x0f\0\0\x1b\xe0\x01\0\xd8\x0f\0\0\x37\x02\0\0\xda\x0f\
-\0\0\x11\xf4\x01\0\xf0\x0f\0\0\x37\x02\0\0\x03\x10\0\0\x19\xe4\x01\0\x08\x10\0\
-\0\x37\x02\0\0\x31\x10\0\0\x27\x08\x02\0\x20\x10\0\0\x37\x02\0\0\x31\x10\0\0\
-\x2d\x08\x02\0\x28\x10\0\0\x37\x02\0\0\xda\x0f\0\0\x11\xf4\x01\0\x68\x10\0\0\
-\x37\x02\0\0\x31\x10\0\0\x27\x08\x02\0\x70\x10\0\0\x37\x02\0\0\x31\x10\0\0\x2d\
-\x08\x02\0\x78\x10\0\0\x37\x02\0\0\xda\x0f\0\0\x11\xf4\x01\0\xa0\x10\0\0\x37\
-\x02\0\0\x31\x10\0\0\x27\x08\x02\0\xc0\x10\0\0\x37\x02\0\0\x31\x10\0\0\x2d\x08\
-\x02\0\xc8\x10\0\0\x37\x02\0\0\xda\x0f\0\0\x11\xf4\x01\0\xf0\x10\0\0\x37\x02\0\
-\0\x31\x10\0\0\x27\x08\x02\0\x10\x11\0\0\x37\x02\0\0\x31\x10\0\0\x2d\x08\x02\0\
-\x18\x11\0\0\x37\x02\0\0\xda\x0f\0\0\x11\xf4\x01\0\x58\x11\0\0\x37\x02\0\0\x31\
-\x10\0\0\x27\x08\x02\0\x60\x11\0\0\x37\x02\0\0\x31\x10\0\0\x2d\x08\x02\0\x68\
-\x11\0\0\x37\x02\0\0\xda\x0f\0\0\x11\xf4\x01\0\xa8\x11\0\0\x37\x02\0\0\x31\x10\
-\0\0\x27\x08\x02\0\xb0\x11\0\0\x37\x02\0\0\x31\x10\0\0\x2d\x08\x02\0\xb8\x11\0\
-\0\x37\x02\0\0\xda\x0f\0\0\x11\xf4\x01\0\xf8\x11\0\0\x37\x02\0\0\x31\x10\0\0\
-\x27\x08\x02\0\0\x12\0\0\x37\x02\0\0\x31\x10\0\0\x2d\x08\x02\0\x08\x12\0\0\x37\
-\x02\0\0\xda\x0f\0\0\x11\xf4\x01\0\x30\x12\0\0\x37\x02\0\0\x31\x10\0\0\x27\x08\
-\x02\0\x38\x12\0\0\x37\x02\0\0\x31\x10\0\0\x2d\x08\x02\0\x40\x12\0\0\x37\x02\0\
-\0\x3d\x0f\0\0\x3d\xdc\x01\0\x50\x12\0\0\x37\x02\0\0\x3d\x0f\0\0\x05\xdc\x01\0\
-\x60\x12\0\0\x37\x02\0\0\x7d\x10\0\0\x2e\xb0\x08\0\x80\x12\0\0\x37\x02\0\0\x7d\
-\x10\0\0\x24\xb0\x08\0\x98\x12\0\0\x37\x02\0\0\x7d\x10\0\0\x13\xb0\x08\0\xa8\
-\x12\0\0\x37\x02\0\0\0\0\0\0\0\0\0\0\xb0\x12\0\0\x37\x02\0\0\xbc\x10\0\0\x15\
-\xbc\x08\0\xc8\x12\0\0\x37\x02\0\0\x04\x11\0\0\x11\xc8\x08\0\xd0\x12\0\0\x37\
-\x02\0\0\0\0\0\0\0\0\0\0\xf0\x12\0\0\x37\x02\0\0\x1d\x11\0\0\x01\xec\x08\0\x08\
-\x13\0\0\x37\x02\0\0\x1f\x11\0\0\x18\xcc\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x03\0\x03\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
-\x94\x01\0\0\0\0\x03\0\xf0\x12\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x75\x01\0\0\0\0\x03\
-\0\xa8\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xcd\x01\0\0\0\0\x03\0\xd0\x12\0\0\0\0\0\0\
-\0\0\0\0\0\0\0\0\xbd\0\0\0\0\0\x03\0\xc8\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xff\
-\x01\0\0\0\0\x03\0\x18\x02\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x14\x01\0\0\0\0\x03\0\
-\x28\x03\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x24\x01\0\0\0\0\x03\0\xd8\x09\0\0\0\0\0\0\
-\0\0\0\0\0\0\0\0\x2c\x01\0\0\0\0\x03\0\xd8\x02\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xf7\
-\x01\0\0\0\0\x03\0\0\x09\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x30\x02\0\0\0\0\x03\0\xe8\
-\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xe6\x01\0\0\0\0\x03\0\x88\x04\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\0\xc5\x01\0\0\0\0\x03\0\xf0\x04\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xbd\x01\
-\0\0\0\0\x03\0\x60\x06\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xb5\x01\0\0\0\0\x03\0\x18\
-\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x64\x01\0\0\0\0\x03\0\x30\x08\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\0\x84\x01\0\0\0\0\x03\0\x28\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x8c\x01\
-\0\0\0\0\x03\0\x10\x07\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x28\x02\0\0\0\0\x03\0\x80\
-\x06\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xde\x01\0\0\0\0\x03\0\xf8\x06\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\0\x0c\x01\0\0\0\0\x03\0\xf0\x07\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x4c\x01\
-\0\0\0\0\x03\0\xd0\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x04\x01\0\0\0\0\x03\0\x98\
-\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xd4\0\0\0\0\0\x03\0\xd8\x08\0\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\x20\x02\0\0\0\0\x03\0\xf0\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xfc\0\0\0\
-\0\0\x03\0\xd8\x0e\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x44\x01\0\0\0\0\x03\0\xb8\x09\0\
-\0\0\0\0\0\0\0\0\0\0\0\0\0\xf4\0\0\0\0\0\x03\0\xa8\x0a\0\0\0\0\0\0\0\0\0\0\0\0\
-\0\0\xad\x01\0\0\0\0\x03\0\x90\x0c\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xd6\x01\0\0\0\0\
-\x03\0\x60\x0a\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x38\x02\0\0\0\0\x03\0\x88\x0f\0\0\0\
-\0\0\0\0\0\0\0\0\0\0\0\x18\x02\0\0\0\0\x03\0\xf8\x0c\0\0\0\0\0\0\0\0\0\0\0\0\0\
-\0\xa5\x01\0\0\0\0\x03\0\x68\x0b\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x5c\x01\0\0\0\0\
-\x03\0\x80\x0b\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x1c\x01\0\0\0\0\x03\0\xb8\x0b\0\0\0\
-\0\0\0\0\0\0\0\0\0\0\0\xcc\0\0\0\0\0\x03\0\xc8\x0b\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
-\xec\0\0\0\0\0\x03\0\xc0\x0b\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x3c\x01\0\0\0\0\x03\0\
-\xc0\x0c\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x10\x02\0\0\0\0\x03\0\xb8\x0d\0\0\0\0\0\0\
-\0\0\0\0\0\0\0\0\x7c\x01\0\0\0\0\x03\0\x58\x0d\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x34\
-\x01\0\0\0\0\x03\0\x70\x0d\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xe4\0\0\0\0\0\x03\0\xa8\
-\x0d\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x9d\x01\0\0\0\0\x03\0\x08\x0e\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\0\x54\x01\0\0\0\0\x03\0\x20\x0e\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xdc\0\0\
-\0\0\0\x03\0\x48\x0f\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xc4\0\0\0\0\0\x03\0\x80\x0f\0\
-\0\0\0\0\0\0\0\0\0\0\0\0\0\x07\x02\0\0\0\0\x03\0\xa8\x0f\0\0\0\0\0\0\0\0\0\0\0\
-\0\0\0\xee\x01\0\0\0\0\x03\0\x60\x12\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x6c\x01\0\0\0\
-\0\x03\0\x08\x13\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x59\0\0\0\x12\0\x03\0\0\0\0\0\0\0\
-\0\0\x18\x13\0\0\0\0\0\0\x3e\0\0\0\x11\0\x05\0\0\0\0\0\0\0\0\0\x28\0\0\0\0\0\0\
-\0\x01\0\0\0\x11\0\x05\0\x28\0\0\0\0\0\0\0\x28\0\0\0\0\0\0\0\x86\0\0\0\x11\0\
-\x05\0\x50\0\0\0\0\0\0\0\x28\0\0\0\0\0\0\0\x7d\0\0\0\x11\0\x06\0\0\0\0\0\0\0\0\
-\0\x07\0\0\0\0\0\0\0\x28\0\0\0\0\0\0\0\x01\0\0\0\x33\0\0\0\x50\0\0\0\0\0\0\0\
-\x01\0\0\0\x34\0\0\0\xb0\x12\0\0\0\0\0\0\x01\0\0\0\x35\0\0\0\x20\x05\0\0\0\0\0\
-\0\x04\0\0\0\x33\0\0\0\x2c\x05\0\0\0\0\0\0\x04\0\0\0\x34\0\0\0\x38\x05\0\0\0\0\
-\0\0\x04\0\0\0\x35\0\0\0\x50\x05\0\0\0\0\0\0\x04\0\0\0\x36\0\0\0\x2c\0\0\0\0\0\
-\0\0\x04\0\0\0\x01\0\0\0\x40\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\0\0\0\0\0\0\
-\0\x04\0\0\0\x01\0\0\0\x60\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\0\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\x80\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\0\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\xa0\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\0\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\xc0\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\0\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\xe0\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\0\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\0\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x01\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\x20\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x01\0\0\0\0\0\
-\0\x04\0\0\0\x01\0\0\0\x40\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x01\0\0\0\0\
-\0\0\x04\0\0\0\x01\0\0\0\x60\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x01\0\0\0\
-\0\0\0\x04\0\0\0\x01\0\0\0\x80\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x01\0\0\
-\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x01\0\
-\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x01\
-\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\
-\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\
-\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
-\x30\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
-\0\x50\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\
-\0\0\x70\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x02\0\0\0\0\0\0\x04\0\0\0\x01\
-\0\0\0\x90\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x02\0\0\0\0\0\0\x04\0\0\0\
-\x01\0\0\0\xb0\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x02\0\0\0\0\0\0\x04\0\0\
-\0\x01\0\0\0\xd0\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x02\0\0\0\0\0\0\x04\0\
-\0\0\x01\0\0\0\xf0\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x03\0\0\0\0\0\0\x04\0\
-\0\0\x01\0\0\0\x10\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x03\0\0\0\0\0\0\x04\
-\0\0\0\x01\0\0\0\x30\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x03\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\x50\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x03\0\0\0\0\0\
-\0\x04\0\0\0\x01\0\0\0\x70\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x03\0\0\0\0\
-\0\0\x04\0\0\0\x01\0\0\0\x90\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x03\0\0\0\
-\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x03\0\0\
-\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x03\0\
-\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x04\0\
-\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x04\
-\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\
-\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
-\x60\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
-\0\x80\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\
-\0\0\xa0\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x04\0\0\0\0\0\0\x04\0\0\0\x01\
-\0\0\0\xc0\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x04\0\0\0\0\0\0\x04\0\0\0\
-\x01\0\0\0\xe0\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x04\0\0\0\0\0\0\x04\0\0\
-\0\x01\0\0\0\0\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x05\0\0\0\0\0\0\x04\0\0\
-\0\x01\0\0\0\x20\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x05\0\0\0\0\0\0\x04\0\
-\0\0\x01\0\0\0\x40\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x05\0\0\0\0\0\0\x04\
-\0\0\0\x01\0\0\0\x60\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x05\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\x80\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x05\0\0\0\0\0\
-\0\x04\0\0\0\x01\0\0\0\xa0\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x05\0\0\0\0\
-\0\0\x04\0\0\0\x01\0\0\0\xc0\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x05\0\0\0\
-\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x05\0\0\
-\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x06\0\0\
-\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x06\0\
-\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x06\
-\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\
-\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
-\x90\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
-\0\xb0\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\
-\0\0\xd0\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x06\0\0\0\0\0\0\x04\0\0\0\x01\
-\0\0\0\xf0\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x07\0\0\0\0\0\0\x04\0\0\0\x01\
-\0\0\0\x10\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x07\0\0\0\0\0\0\x04\0\0\0\
-\x01\0\0\0\x30\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x07\0\0\0\0\0\0\x04\0\0\
-\0\x01\0\0\0\x50\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x07\0\0\0\0\0\0\x04\0\
-\0\0\x01\0\0\0\x70\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x07\0\0\0\0\0\0\x04\
-\0\0\0\x01\0\0\0\x90\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x07\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\xb0\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x07\0\0\0\0\0\
-\0\x04\0\0\0\x01\0\0\0\xd0\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x07\0\0\0\0\
-\0\0\x04\0\0\0\x01\0\0\0\xf0\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x08\0\0\0\0\
-\0\0\x04\0\0\0\x01\0\0\0\x10\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x08\0\0\0\
-\0\0\0\x04\0\0\0\x01\0\0\0\x30\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x08\0\0\
-\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x08\0\
-\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x08\
-\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\
-\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
-\xc0\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
-\0\xe0\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\
-\0\0\0\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\
-\0\0\x20\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x09\0\0\0\0\0\0\x04\0\0\0\x01\
-\0\0\0\x40\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x09\0\0\0\0\0\0\x04\0\0\0\
-\x01\0\0\0\x60\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x09\0\0\0\0\0\0\x04\0\0\
-\0\x01\0\0\0\x80\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x09\0\0\0\0\0\0\x04\0\
-\0\0\x01\0\0\0\xa0\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x09\0\0\0\0\0\0\x04\
-\0\0\0\x01\0\0\0\xc0\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x09\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\xe0\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x09\0\0\0\0\0\
-\0\x04\0\0\0\x01\0\0\0\0\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x0a\0\0\0\0\0\
-\0\x04\0\0\0\x01\0\0\0\x20\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x0a\0\0\0\0\
-\0\0\x04\0\0\0\x01\0\0\0\x40\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x0a\0\0\0\
-\0\0\0\x04\0\0\0\x01\0\0\0\x60\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x0a\0\0\
-\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x0a\0\
-\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x0a\
-\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\
-\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
-\xf0\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
-\x10\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
-\0\x30\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\
-\0\0\x50\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x0b\0\0\0\0\0\0\x04\0\0\0\x01\
-\0\0\0\x70\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x0b\0\0\0\0\0\0\x04\0\0\0\
-\x01\0\0\0\x90\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x0b\0\0\0\0\0\0\x04\0\0\
-\0\x01\0\0\0\xb0\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x0b\0\0\0\0\0\0\x04\0\
-\0\0\x01\0\0\0\xd0\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x0b\0\0\0\0\0\0\x04\
-\0\0\0\x01\0\0\0\xf0\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x0c\0\0\0\0\0\0\x04\
-\0\0\0\x01\0\0\0\x10\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x0c\0\0\0\0\0\0\
-\x04\0\0\0\x01\0\0\0\x30\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x0c\0\0\0\0\0\
-\0\x04\0\0\0\x01\0\0\0\x50\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x0c\0\0\0\0\
-\0\0\x04\0\0\0\x01\0\0\0\x70\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x0c\0\0\0\
-\0\0\0\x04\0\0\0\x01\0\0\0\x90\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x39\x3a\x3b\
-\x3c\x3d\0\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x74\x6f\x65\x70\x6c\
-\x69\x74\x7a\x5f\x6b\x65\x79\0\x2e\x74\x65\x78\x74\0\x2e\x72\x65\x6c\x2e\x42\
-\x54\x46\x2e\x65\x78\x74\0\x2e\x72\x65\x6c\x73\x6f\x63\x6b\x65\x74\0\x2e\x6d\
-\x61\x70\x73\0\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x63\x6f\x6e\x66\
-\x69\x67\x75\x72\x61\x74\x69\x6f\x6e\x73\0\x74\x75\x6e\x5f\x72\x73\x73\x5f\x73\
-\x74\x65\x65\x72\x69\x6e\x67\x5f\x70\x72\x6f\x67\0\x2e\x6c\x6c\x76\x6d\x5f\x61\
-\x64\x64\x72\x73\x69\x67\0\x5f\x6c\x69\x63\x65\x6e\x73\x65\0\x74\x61\x70\x5f\
-\x72\x73\x73\x5f\x6d\x61\x70\x5f\x69\x6e\x64\x69\x72\x65\x63\x74\x69\x6f\x6e\
-\x5f\x74\x61\x62\x6c\x65\0\x2e\x73\x74\x72\x74\x61\x62\0\x2e\x73\x79\x6d\x74\
-\x61\x62\0\x2e\x72\x65\x6c\x2e\x42\x54\x46\0\x4c\x42\x42\x30\x5f\x39\0\x4c\x42\
-\x42\x30\x5f\x39\x39\0\x4c\x42\x42\x30\x5f\x37\x39\0\x4c\x42\x42\x30\x5f\x34\
-\x39\0\x4c\x42\x42\x30\x5f\x39\x38\0\x4c\x42\x42\x30\x5f\x38\x38\0\x4c\x42\x42\
-\x30\x5f\x37\x38\0\x4c\x42\x42\x30\x5f\x36\x38\0\x4c\x42\x42\x30\x5f\x35\x38\0\
-\x4c\x42\x42\x30\x5f\x34\x38\0\x4c\x42\x42\x30\x5f\x33\x38\0\x4c\x42\x42\x30\
-\x5f\x31\x38\0\x4c\x42\x42\x30\x5f\x37\x37\0\x4c\x42\x42\x30\x5f\x35\x37\0\x4c\
-\x42\x42\x30\x5f\x31\x37\0\x4c\x42\x42\x30\x5f\x38\x36\0\x4c\x42\x42\x30\x5f\
-\x36\x36\0\x4c\x42\x42\x30\x5f\x35\x36\0\x4c\x42\x42\x30\x5f\x34\x36\0\x4c\x42\
-\x42\x30\x5f\x39\x35\0\x4c\x42\x42\x30\x5f\x37\x35\0\x4c\x42\x42\x30\x5f\x34\
-\x35\0\x4c\x42\x42\x30\x5f\x31\x30\x35\0\x4c\x42\x42\x30\x5f\x34\0\x4c\x42\x42\
-\x30\x5f\x38\x34\0\x4c\x42\x42\x30\x5f\x34\x34\0\x4c\x42\x42\x30\x5f\x33\x34\0\
-\x4c\x42\x42\x30\x5f\x31\x30\x34\0\x4c\x42\x42\x30\x5f\x39\x33\0\x4c\x42\x42\
-\x30\x5f\x37\x33\0\x4c\x42\x42\x30\x5f\x36\x33\0\x4c\x42\x42\x30\x5f\x34\x33\0\
-\x4c\x42\x42\x30\x5f\x33\x33\0\x4c\x42\x42\x30\x5f\x32\x33\0\x4c\x42\x42\x30\
-\x5f\x31\x30\x33\0\x4c\x42\x42\x30\x5f\x36\x32\0\x4c\x42\x42\x30\x5f\x34\x32\0\
-\x4c\x42\x42\x30\x5f\x32\x32\0\x4c\x42\x42\x30\x5f\x31\x30\x32\0\x4c\x42\x42\
-\x30\x5f\x35\x31\0\x4c\x42\x42\x30\x5f\x31\x31\0\x4c\x42\x42\x30\x5f\x31\x30\
-\x31\0\x4c\x42\x42\x30\x5f\x39\x30\0\x4c\x42\x42\x30\x5f\x38\x30\0\x4c\x42\x42\
-\x30\x5f\x35\x30\0\x4c\x42\x42\x30\x5f\x34\x30\0\x4c\x42\x42\x30\x5f\x32\x30\0\
-\x4c\x42\x42\x30\x5f\x31\x30\x30\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
+\x20\x28\x63\x6f\x6e\x66\x69\x67\x2d\x3e\x68\x61\x73\x68\x5f\x74\x79\x70\x65\
+\x73\x20\x26\x20\x56\x49\x52\x54\x49\x4f\x5f\x4e\x45\x54\x5f\x52\x53\x53\x5f\
+\x48\x41\x53\x48\x5f\x54\x59\x50\x45\x5f\x49\x50\x76\x34\x29\x20\x7b\0\x20\x20\
+\x20\x20\x72\x65\x74\x75\x72\x6e\x20\x63\x6f\x6e\x66\x69\x67\x2d\x3e\x64\x65\
+\x66\x61\x75\x6c\x74\x5f\x71\x75\x65\x75\x65\x3b\0\x7d\0\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x75\x64\x70\
+\x20\x3d\x20\x31\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x73\x74\
+\x72\x75\x63\x74\x20\x75\x64\x70\x68\x64\x72\x20\x75\x64\x70\x20\x3d\x20\x7b\
+\x7d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x65\x72\x72\x20\x3d\
+\x20\x62\x70\x66\x5f\x73\x6b\x62\x5f\x6c\x6f\x61\x64\x5f\x62\x79\x74\x65\x73\
+\x5f\x72\x65\x6c\x61\x74\x69\x76\x65\x28\x73\x6b\x62\x2c\x20\x6c\x34\x5f\x6f\
+\x66\x66\x73\x65\x74\x2c\x20\x26\x75\x64\x70\x2c\x20\x73\x69\x7a\x65\x6f\x66\
+\x28\x75\x64\x70\x29\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x7d\x20\x65\x6c\x73\
+\x65\x20\x69\x66\x20\x28\x63\x6f\x6e\x66\x69\x67\x2d\x3e\x68\x61\x73\x68\x5f\
+\x74\x79\x70\x65\x73\x20\x26\x20\x56\x49\x52\x54\x49\x4f\x5f\x4e\x45\x54\x5f\
+\x52\x53\x53\x5f\x48\x41\x53\x48\x5f\x54\x59\x50\x45\x5f\x49\x50\x76\x36\x29\
+\x20\x7b\0\x20\x20\x20\x20\x66\x6f\x72\x20\x28\x62\x79\x74\x65\x20\x3d\x20\x30\
+\x3b\x20\x62\x79\x74\x65\x20\x3c\x20\x48\x41\x53\x48\x5f\x43\x41\x4c\x43\x55\
+\x4c\x41\x54\x49\x4f\x4e\x5f\x42\x55\x46\x46\x45\x52\x5f\x53\x49\x5a\x45\x3b\
+\x20\x62\x79\x74\x65\x2b\x2b\x29\x20\x7b\0\x20\x20\x20\x20\x5f\x5f\x75\x33\x32\
+\x20\x6c\x65\x66\x74\x6d\x6f\x73\x74\x5f\x33\x32\x5f\x62\x69\x74\x73\x20\x3d\
+\x20\x6b\x65\x79\x2d\x3e\x6c\x65\x66\x74\x6d\x6f\x73\x74\x5f\x33\x32\x5f\x62\
+\x69\x74\x73\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x5f\x5f\x75\x38\x20\x69\x6e\
+\x70\x75\x74\x5f\x62\x79\x74\x65\x20\x3d\x20\x69\x6e\x70\x75\x74\x5b\x62\x79\
+\x74\x65\x5d\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\
+\x28\x69\x6e\x70\x75\x74\x5f\x62\x79\x74\x65\x20\x26\x20\x28\x31\x20\x3c\x3c\
+\x20\x37\x29\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x5f\x5f\x75\x38\x20\
+\x6b\x65\x79\x5f\x62\x79\x74\x65\x20\x3d\x20\x6b\x65\x79\x2d\x3e\x6e\x65\x78\
+\x74\x5f\x62\x79\x74\x65\x5b\x62\x79\x74\x65\x5d\x3b\0\x20\x20\x20\x20\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x28\x6c\x65\x66\x74\
+\x6d\x6f\x73\x74\x5f\x33\x32\x5f\x62\x69\x74\x73\x20\x3c\x3c\x20\x31\x29\x20\
+\x7c\x20\x28\x28\x6b\x65\x79\x5f\x62\x79\x74\x65\x20\x26\x20\x28\x31\x20\x3c\
+\x3c\x20\x37\x29\x29\x20\x3e\x3e\x20\x37\x29\x3b\0\x20\x20\x20\x20\x20\x20\x20\
+\x20\x5f\x5f\x75\x33\x32\x20\x74\x61\x62\x6c\x65\x5f\x69\x64\x78\x20\x3d\x20\
+\x68\x61\x73\x68\x20\x25\x20\x63\x6f\x6e\x66\x69\x67\x2d\x3e\x69\x6e\x64\x69\
+\x72\x65\x63\x74\x69\x6f\x6e\x73\x5f\x6c\x65\x6e\x3b\0\x20\x20\x20\x20\x20\x20\
+\x20\x20\x69\x66\x20\x28\x63\x6f\x6e\x66\x69\x67\x2d\x3e\x66\x6c\x6f\x77\x5f\
+\x61\x66\x66\x69\x6e\x69\x74\x79\x29\x20\x7b\0\x20\x20\x20\x20\x5f\x5f\x75\x33\
+\x32\x20\x64\x70\x6f\x72\x74\x20\x3d\x20\x69\x6e\x66\x6f\x2d\x3e\x64\x73\x74\
+\x5f\x70\x6f\x72\x74\x3b\0\x20\x20\x20\x20\x5f\x5f\x75\x33\x32\x20\x73\x70\x6f\
+\x72\x74\x20\x3d\x20\x69\x6e\x66\x6f\x2d\x3e\x73\x72\x63\x5f\x70\x6f\x72\x74\
+\x3b\0\x20\x20\x20\x20\x69\x66\x20\x28\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x74\
+\x63\x70\x29\x20\x7b\0\x20\x20\x20\x20\x7d\x20\x65\x6c\x73\x65\x20\x69\x66\x20\
+\x28\x69\x6e\x66\x6f\x2d\x3e\x69\x73\x5f\x75\x64\x70\x29\x20\x7b\0\x20\x20\x20\
+\x20\x20\x20\x20\x20\x64\x73\x74\x20\x3d\x20\x69\x6e\x66\x6f\x2d\x3e\x69\x6e\
+\x5f\x64\x73\x74\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x73\x72\x63\x20\x3d\x20\
+\x69\x6e\x66\x6f\x2d\x3e\x69\x6e\x5f\x73\x72\x63\x3b\0\x20\x20\x20\x20\x69\x66\
+\x20\x28\x73\x72\x63\x20\x3e\x20\x64\x73\x74\x20\x7c\x7c\x20\x28\x73\x72\x63\
+\x20\x3d\x3d\x20\x64\x73\x74\x20\x26\x26\x20\x73\x70\x6f\x72\x74\x20\x3e\x20\
+\x64\x70\x6f\x72\x74\x29\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x5f\x5f\
+\x62\x75\x69\x6c\x74\x69\x6e\x5f\x6d\x65\x6d\x63\x70\x79\x28\x26\x64\x73\x74\
+\x2c\x20\x26\x69\x6e\x66\x6f\x2d\x3e\x69\x6e\x36\x5f\x64\x73\x74\x2c\x20\x73\
+\x69\x7a\x65\x6f\x66\x28\x64\x73\x74\x29\x29\x3b\0\x20\x20\x20\x20\x20\x20\x20\
+\x20\x5f\x5f\x62\x75\x69\x6c\x74\x69\x6e\x5f\x6d\x65\x6d\x63\x70\x79\x28\x26\
+\x64\x73\x74\x5f\x68\x69\x2c\x20\x28\x5f\x5f\x75\x38\x20\x2a\x29\x26\x69\x6e\
+\x66\x6f\x2d\x3e\x69\x6e\x36\x5f\x64\x73\x74\x20\x2b\x20\x38\x2c\x20\x73\x69\
+\x7a\x65\x6f\x66\x28\x64\x73\x74\x5f\x68\x69\x29\x29\x3b\0\x20\x20\x20\x20\x20\
+\x20\x20\x20\x64\x73\x74\x20\x5e\x3d\x20\x64\x73\x74\x5f\x68\x69\x3b\0\x20\x20\
+\x20\x20\x20\x20\x20\x20\x5f\x5f\x62\x75\x69\x6c\x74\x69\x6e\x5f\x6d\x65\x6d\
+\x63\x70\x79\x28\x26\x73\x72\x63\x2c\x20\x26\x69\x6e\x66\x6f\x2d\x3e\x69\x6e\
+\x36\x5f\x73\x72\x63\x2c\x20\x73\x69\x7a\x65\x6f\x66\x28\x73\x72\x63\x29\x29\
+\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x5f\x5f\x62\x75\x69\x6c\x74\x69\x6e\x5f\
+\x6d\x65\x6d\x63\x70\x79\x28\x26\x73\x72\x63\x5f\x68\x69\x2c\x20\x28\x5f\x5f\
+\x75\x38\x20\x2a\x29\x26\x69\x6e\x66\x6f\x2d\x3e\x69\x6e\x36\x5f\x73\x72\x63\
+\x20\x2b\x20\x38\x2c\x20\x73\x69\x7a\x65\x6f\x66\x28\x73\x72\x63\x5f\x68\x69\
+\x29\x29\x3b\0\x20\x20\x20\x20\x20\x20\x20\x20\x73\x72\x63\x20\x5e\x3d\x20\x73\
+\x72\x63\x5f\x68\x69\x3b\0\x20\x20\x20\x20\x76\x33\x20\x3d\x20\x72\x6f\x6c\x33\
+\x32\x28\x76\x33\x20\x2b\x20\x28\x5f\x5f\x75\x33\x32\x29\x63\x64\x20\x2a\x20\
+\x32\x32\x34\x36\x38\x32\x32\x35\x31\x39\x55\x2c\x20\x31\x33\x29\x20\x2a\x20\
+\x32\x36\x35\x34\x34\x33\x35\x37\x36\x31\x55\x3b\0\x20\x20\x20\x20\x72\x65\x74\
+\x75\x72\x6e\x20\x28\x77\x6f\x72\x64\x20\x3c\x3c\x20\x73\x68\x69\x66\x74\x29\
+\x20\x7c\x20\x28\x77\x6f\x72\x64\x20\x3e\x3e\x20\x28\x33\x32\x20\x2d\x20\x73\
+\x68\x69\x66\x74\x29\x29\x3b\0\x20\x20\x20\x20\x76\x31\x20\x3d\x20\x72\x6f\x6c\
+\x33\x32\x28\x76\x31\x20\x2b\x20\x28\x5f\x5f\x75\x33\x32\x29\x61\x62\x20\x2a\
+\x20\x32\x32\x34\x36\x38\x32\x32\x35\x31\x39\x55\x2c\x20\x31\x33\x29\x20\x2a\
+\x20\x32\x36\x35\x34\x34\x33\x35\x37\x36\x31\x55\x3b\0\x20\x20\x20\x20\x68\x33\
+\x32\x20\x3d\x20\x72\x6f\x6c\x33\x32\x28\x76\x31\x2c\x20\x31\x29\x20\x2b\x20\
+\x72\x6f\x6c\x33\x32\x28\x76\x32\x2c\x20\x37\x29\x20\x2b\x20\x72\x6f\x6c\x33\
+\x32\x28\x76\x33\x2c\x20\x31\x32\x29\x20\x2b\x20\x72\x6f\x6c\x33\x32\x28\x76\
+\x34\x2c\x20\x31\x38\x29\x3b\0\x20\x20\x20\x20\x76\x34\x20\x3d\x20\x72\x6f\x6c\
+\x33\x32\x28\x76\x34\x20\x2b\x20\x28\x5f\x5f\x75\x33\x32\x29\x28\x63\x64\x20\
+\x3e\x3e\x20\x33\x32\x29\x20\x2a\x20\x32\x32\x34\x36\x38\x32\x32\x35\x31\x39\
+\x55\x2c\x20\x31\x33\x29\x20\x2a\x20\x32\x36\x35\x34\x34\x33\x35\x37\x36\x31\
+\x55\x3b\0\x20\x20\x20\x20\x76\x32\x20\x3d\x20\x72\x6f\x6c\x33\x32\x28\x76\x32\
+\x20\x2b\x20\x28\x5f\x5f\x75\x33\x32\x29\x28\x61\x62\x20\x3e\x3e\x20\x33\x32\
+\x29\x20\x2a\x20\x32\x32\x34\x36\x38\x32\x32\x35\x31\x39\x55\x2c\x20\x31\x33\
+\x29\x20\x2a\x20\x32\x36\x35\x34\x34\x33\x35\x37\x36\x31\x55\x3b\0\x20\x20\x20\
+\x20\x68\x33\x32\x20\x2b\x3d\x20\x32\x38\x3b\0\x20\x20\x20\x20\x68\x33\x32\x20\
+\x3d\x20\x72\x6f\x6c\x33\x32\x28\x68\x33\x32\x20\x2b\x20\x28\x5f\x5f\x75\x33\
+\x32\x29\x65\x66\x20\x2a\x20\x33\x32\x36\x36\x34\x38\x39\x39\x31\x37\x55\x2c\
+\x20\x31\x37\x29\x20\x2a\x20\x36\x36\x38\x32\x36\x35\x32\x36\x33\x55\x3b\0\x20\
+\x20\x20\x20\x68\x33\x32\x20\x3d\x20\x72\x6f\x6c\x33\x32\x28\x68\x33\x32\x20\
+\x2b\x20\x67\x20\x2a\x20\x33\x32\x36\x36\x34\x38\x39\x39\x31\x37\x55\x2c\x20\
+\x31\x37\x29\x20\x2a\x20\x36\x36\x38\x32\x36\x35\x32\x36\x33\x55\x3b\0\x20\x20\
+\x20\x20\x68\x33\x32\x20\x3d\x20\x72\x6f\x6c\x33\x32\x28\x68\x33\x32\x20\x2b\
+\x20\x28\x5f\x5f\x75\x33\x32\x29\x28\x65\x66\x20\x3e\x3e\x20\x33\x32\x29\x20\
+\x2a\x20\x33\x32\x36\x36\x34\x38\x39\x39\x31\x37\x55\x2c\x20\x31\x37\x29\x20\
+\x2a\x20\x36\x36\x38\x32\x36\x35\x32\x36\x33\x55\x3b\0\x20\x20\x20\x20\x68\x33\
+\x32\x20\x3d\x20\x72\x6f\x6c\x33\x32\x28\x68\x33\x32\x20\x2b\x20\x68\x20\x2a\
+\x20\x33\x32\x36\x36\x34\x38\x39\x39\x31\x37\x55\x2c\x20\x31\x37\x29\x20\x2a\
+\x20\x36\x36\x38\x32\x36\x35\x32\x36\x33\x55\x3b\0\x20\x20\x20\x20\x68\x33\x32\
+\x20\x5e\x3d\x20\x68\x33\x32\x20\x3e\x3e\x20\x31\x35\x3b\0\x20\x20\x20\x20\x68\
+\x33\x32\x20\x2a\x3d\x20\x32\x32\x34\x36\x38\x32\x32\x35\x31\x39\x55\x3b\0\x20\
+\x20\x20\x20\x68\x33\x32\x20\x5e\x3d\x20\x68\x33\x32\x20\x3e\x3e\x20\x31\x33\
+\x3b\0\x20\x20\x20\x20\x68\x33\x32\x20\x2a\x3d\x20\x33\x32\x36\x36\x34\x38\x39\
+\x39\x31\x37\x55\x3b\0\x20\x20\x20\x20\x68\x33\x32\x20\x5e\x3d\x20\x68\x33\x32\
+\x20\x3e\x3e\x20\x31\x36\x3b\0\x20\x20\x20\x20\x5f\x5f\x75\x33\x32\x20\x69\x64\
+\x78\x20\x3d\x20\x68\x61\x73\x68\x20\x26\x20\x28\x46\x4c\x4f\x57\x5f\x54\x41\
+\x42\x4c\x45\x5f\x53\x49\x5a\x45\x20\x2d\x20\x31\x29\x3b\0\x20\x20\x20\x20\x65\
+\x6e\x74\x72\x79\x20\x3d\x20\x62\x70\x66\x5f\x6d\x61\x70\x5f\x6c\x6f\x6f\x6b\
+\x75\x70\x5f\x65\x6c\x65\x6d\x28\x26\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\
+\x70\x5f\x66\x6c\x6f\x77\x5f\x74\x61\x62\x6c\x65\x2c\x20\x26\x69\x64\x78\x29\
+\x3b\0\x20\x20\x20\x20\x69\x66\x20\x28\x21\x65\x6e\x74\x72\x79\x29\x20\x7b\0\
+\x20\x20\x20\x20\x69\x66\x20\x28\x76\x61\x6c\x75\x65\x20\x3e\x3e\x20\x33\x32\
+\x20\x21\x3d\x20\x68\x61\x73\x68\x20\x7c\x7c\x20\x21\x28\x5f\x5f\x75\x33\x32\
+\x29\x76\x61\x6c\x75\x65\x29\x20\x7b\0\x20\x20\x20\x20\x76\x61\x6c\x75\x65\x20\
+\x3d\x20\x2a\x65\x6e\x74\x72\x79\x3b\0\x20\x20\x20\x20\x5f\x5f\x75\x36\x34\x20\
+\x2a\x63\x6f\x75\x6e\x74\x65\x72\x20\x3d\x20\x62\x70\x66\x5f\x6d\x61\x70\x5f\
+\x6c\x6f\x6f\x6b\x75\x70\x5f\x65\x6c\x65\x6d\x28\x26\x74\x61\x70\x5f\x72\x73\
+\x73\x5f\x6d\x61\x70\x5f\x66\x6c\x6f\x77\x5f\x73\x74\x61\x74\x73\x2c\x20\x26\
+\x73\x74\x61\x74\x29\x3b\0\x20\x20\x20\x20\x69\x66\x20\x28\x63\x6f\x75\x6e\x74\
+\x65\x72\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x2a\x63\x6f\x75\x6e\x74\
+\x65\x72\x20\x2b\x3d\x20\x31\x3b\0\x20\x20\x20\x20\x72\x65\x74\x75\x72\x6e\x20\
+\x28\x5f\x5f\x75\x33\x32\x29\x76\x61\x6c\x75\x65\x20\x2d\x20\x31\x3b\0\x20\x20\
+\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x66\x6c\x6f\x77\x5f\
+\x71\x75\x65\x75\x65\x20\x3e\x3d\x20\x30\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\
+\x20\x20\x71\x75\x65\x75\x65\x20\x3d\x20\x62\x70\x66\x5f\x6d\x61\x70\x5f\x6c\
+\x6f\x6f\x6b\x75\x70\x5f\x65\x6c\x65\x6d\x28\x26\x74\x61\x70\x5f\x72\x73\x73\
+\x5f\x6d\x61\x70\x5f\x69\x6e\x64\x69\x72\x65\x63\x74\x69\x6f\x6e\x5f\x74\x61\
+\x62\x6c\x65\x2c\0\x20\x20\x20\x20\x20\x20\x20\x20\x69\x66\x20\x28\x71\x75\x65\
+\x75\x65\x29\x20\x7b\0\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x20\x72\x65\
+\x74\x75\x72\x6e\x20\x2a\x71\x75\x65\x75\x65\x3b\0\x63\x68\x61\x72\0\x5f\x6c\
+\x69\x63\x65\x6e\x73\x65\0\x2e\x6d\x61\x70\x73\0\x6c\x69\x63\x65\x6e\x73\x65\0\
+\x62\x70\x66\x5f\x66\x6c\x6f\x77\x5f\x6b\x65\x79\x73\0\x62\x70\x66\x5f\x73\x6f\
+\x63\x6b\0\0\x9f\xeb\x01\0\x20\0\0\0\0\0\0\0\x14\0\0\0\x14\0\0\0\xec\x13\0\0\0\
+\x14\0\0\0\0\0\0\x08\0\0\0\x5e\x02\0\0\x01\0\0\0\0\0\0\0\x30\0\0\0\x10\0\0\0\
+\x5e\x02\0\0\x3e\x01\0\0\0\0\0\0\x65\x02\0\0\x7a\x02\0\0\0\xc0\x0a\0\x10\0\0\0\
+\x65\x02\0\0\xab\x02\0\0\x1f\xd4\x0a\0\x60\0\0\0\x65\x02\0\0\xdb\x02\0\0\x0b\
+\xdc\x0a\0\x70\0\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\x78\0\0\0\x65\x02\0\0\xee\x02\
+\0\0\x0e\xe8\x0a\0\xa0\0\0\0\x65\x02\0\0\x33\x03\0\0\x0b\xec\x0a\0\xc8\0\0\0\
+\x65\x02\0\0\x73\x03\0\0\x11\xf4\x0a\0\xd0\0\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\
+\xd8\0\0\0\x65\x02\0\0\x73\x03\0\0\x11\xf4\x0a\0\xe0\0\0\0\x65\x02\0\0\x8e\x03\
+\0\0\x11\x04\x0b\0\xe8\0\0\0\x65\x02\0\0\x8e\x03\0\0\x1a\x04\x0b\0\xf8\0\0\0\
+\x65\x02\0\0\xaa\x03\0\0\x0a\x78\x06\0\x20\x01\0\0\x65\x02\0\0\xe1\x03\0\0\x0f\
+\x10\x05\0\x30\x01\0\0\x65\x02\0\0\xfa\x03\0\0\x0c\x90\x04\0\x40\x01\0\0\x65\
+\x02\0\0\0\0\0\0\0\0\0\0\x48\x01\0\0\x65\x02\0\0\x0e\x04\0\0\x0b\x9c\x04\0\x80\
+\x01\0\0\x65\x02\0\0\x54\x04\0\0\x09\xa4\x04\0\x90\x01\0\0\x65\x02\0\0\x63\x04\
+\0\0\x0d\xb4\x04\0\xa8\x01\0\0\x65\x02\0\0\x63\x04\0\0\x05\xb4\x04\0\xc8\x01\0\
+\0\x65\x02\0\0\0\0\0\0\0\0\0\0\xd0\x01\0\0\x65\x02\0\0\x81\x04\0\0\x0f\xc8\x04\
+\0\0\x02\0\0\x65\x02\0\0\x54\x04\0\0\x09\xe0\x04\0\x08\x02\0\0\x65\x02\0\0\xcb\
+\x04\0\0\x0c\xf0\x04\0\x18\x02\0\0\x65\x02\0\0\xdb\x04\0\0\x09\x2c\x05\0\x38\
+\x02\0\0\x65\x02\0\0\xf7\x04\0\0\x17\x44\x05\0\x48\x02\0\0\x65\x02\0\0\x12\x05\
+\0\0\x16\x4c\x05\0\x68\x02\0\0\x65\x02\0\0\xf7\x04\0\0\x17\x44\x05\0\x70\x02\0\
+\0\x65\x02\0\0\x30\x05\0\0\x0f\x50\x05\0\xa8\x02\0\0\x65\x02\0\0\x73\x05\0\0\
+\x0d\x58\x05\0\xb0\x02\0\0\x65\x02\0\0\x86\x05\0\0\x22\x70\x05\0\xb8\x02\0\0\
+\x65\x02\0\0\x86\x05\0\0\x39\x70\x05\0\xc8\x02\0\0\x65\x02\0\0\x86\x05\0\0\x20\
+\x70\x05\0\xd8\x02\0\0\x65\x02\0\0\xd4\x05\0\0\x1b\x68\x05\0\xe0\x02\0\0\x65\
+\x02\0\0\xd4\x05\0\0\x16\x68\x05\0\xe8\x02\0\0\x65\x02\0\0\xf5\x05\0\0\x1b\x6c\
+\x05\0\xf0\x02\0\0\x65\x02\0\0\xf5\x05\0\0\x16\x6c\x05\0\xf8\x02\0\0\x65\x02\0\
+\0\x16\x06\0\0\x1a\x78\x05\0\0\x03\0\0\x65\x02\0\0\x39\x06\0\0\x18\x7c\x05\0\
+\x08\x03\0\0\x65\x02\0\0\x39\x06\0\0\x1c\x7c\x05\0\x20\x03\0\0\x65\x02\0\0\x86\
+\x05\0\0\x1d\x70\x05\0\x30\x03\0\0\x65\x02\0\0\x59\x06\0\0\x15\xd8\x05\0\x40\
+\x03\0\0\x65\x02\0\0\x59\x06\0\0\x1a\xd8\x05\0\x58\x03\0\0\x65\x02\0\0\x8d\x06\
+\0\0\x0d\xdc\x05\0\x78\x03\0\0\x65\x02\0\0\xb7\x06\0\0\x1a\xe0\x05\0\x88\x03\0\
+\0\x65\x02\0\0\xd5\x06\0\0\x1b\xe8\x05\0\xa8\x03\0\0\x65\x02\0\0\xb7\x06\0\0\
+\x1a\xe0\x05\0\xb0\x03\0\0\x65\x02\0\0\xf9\x06\0\0\x13\xec\x05\0\xe8\x03\0\0\
+\x65\x02\0\0\x4a\x07\0\0\x11\xf4\x05\0\xf0\x03\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\
+\x18\x04\0\0\x65\x02\0\0\x61\x07\0\0\x0f\x9c\x06\0\x20\x04\0\0\x65\x02\0\0\x61\
+\x07\0\0\x09\x9c\x06\0\x28\x04\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\x78\x04\0\0\x65\
+\x02\0\0\x7a\x07\0\0\x13\xa0\x06\0\x80\x04\0\0\x65\x02\0\0\x7a\x07\0\0\x1a\xa0\
+\x06\0\xb0\x04\0\0\x65\x02\0\0\x96\x07\0\0\x05\x08\x02\0\xc0\x04\0\0\x65\x02\0\
+\0\x96\x07\0\0\x05\x08\x02\0\xd0\x04\0\0\x65\x02\0\0\x96\x07\0\0\x05\x08\x02\0\
+\xe0\x04\0\0\x65\x02\0\0\x96\x07\0\0\x05\x08\x02\0\x08\x05\0\0\x65\x02\0\0\xd3\
+\x07\0\0\x17\x84\x05\0\x18\x05\0\0\x65\x02\0\0\xee\x07\0\0\x18\x8c\x05\0\x48\
+\x05\0\0\x65\x02\0\0\xd3\x07\0\0\x17\x84\x05\0\x58\x05\0\0\x65\x02\0\0\x0f\x08\
+\0\0\x0f\x90\x05\0\x98\x05\0\0\x65\x02\0\0\x73\x05\0\0\x0d\x98\x05\0\xa0\x05\0\
+\0\x65\x02\0\0\x54\x08\0\0\x1d\xa8\x05\0\xe0\x05\0\0\x65\x02\0\0\x77\x08\0\0\
+\x1d\xac\x05\0\x20\x06\0\0\x65\x02\0\0\x9a\x08\0\0\x1b\xb4\x05\0\x28\x06\0\0\
+\x65\x02\0\0\xbd\x08\0\0\x05\xa0\x02\0\x70\x06\0\0\x65\x02\0\0\xd5\x08\0\0\x19\
+\x28\x03\0\xe0\x06\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\xe8\x06\0\0\x65\x02\0\0\xfb\
+\x08\0\0\x0f\x38\x03\0\x20\x07\0\0\x65\x02\0\0\x73\x05\0\0\x0d\x40\x03\0\x30\
+\x07\0\0\x65\x02\0\0\x40\x09\0\0\x0d\x50\x03\0\x50\x07\0\0\x65\x02\0\0\x6f\x09\
+\0\0\x20\x54\x03\0\x70\x07\0\0\x65\x02\0\0\x9b\x09\0\0\x13\x5c\x03\0\xb0\x07\0\
+\0\x65\x02\0\0\x4a\x07\0\0\x11\x64\x03\0\xb8\x07\0\0\x65\x02\0\0\xe3\x09\0\0\
+\x19\x74\x03\0\xc0\x07\0\0\x65\x02\0\0\xe3\x09\0\0\x34\x74\x03\0\xe8\x07\0\0\
+\x65\x02\0\0\x19\x0a\0\0\x15\x88\x03\0\xf8\x07\0\0\x65\x02\0\0\x5a\x0a\0\0\x17\
+\x84\x03\0\x38\x08\0\0\x65\x02\0\0\x91\x0a\0\0\x15\x94\x03\0\x40\x08\0\0\x65\
+\x02\0\0\xac\x0a\0\0\x27\xa4\x03\0\x68\x08\0\0\x65\x02\0\0\xd7\x0a\0\0\x27\xc0\
+\x03\0\x78\x08\0\0\x65\x02\0\0\x07\x0b\0\0\x1c\x24\x04\0\x80\x08\0\0\x65\x02\0\
+\0\x43\x0b\0\0\x20\x30\x04\0\x90\x08\0\0\x65\x02\0\0\x43\x0b\0\0\x2f\x30\x04\0\
+\x98\x08\0\0\x65\x02\0\0\x43\x0b\0\0\x36\x30\x04\0\xa0\x08\0\0\x65\x02\0\0\x43\
+\x0b\0\0\x15\x30\x04\0\x08\x09\0\0\x65\x02\0\0\x7f\x0b\0\0\x43\xd4\x03\0\x28\
+\x09\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\x30\x09\0\0\x65\x02\0\0\x7f\x0b\0\0\x17\
+\xd4\x03\0\x70\x09\0\0\x65\x02\0\0\x91\x0a\0\0\x15\xdc\x03\0\x78\x09\0\0\x65\
+\x02\0\0\xcf\x0b\0\0\x19\xec\x03\0\x80\x09\0\0\x65\x02\0\0\xcf\x0b\0\0\x15\xec\
+\x03\0\x88\x09\0\0\x65\x02\0\0\xff\x0b\0\0\x19\xf4\x03\0\x90\x09\0\0\x65\x02\0\
+\0\x2f\x0c\0\0\x1b\xf0\x03\0\xd8\x09\0\0\x65\x02\0\0\x6a\x0c\0\0\x19\x04\x04\0\
+\xe0\x09\0\0\x65\x02\0\0\x89\x0c\0\0\x2b\x14\x04\0\0\x0a\0\0\x65\x02\0\0\x07\
+\x0b\0\0\x1f\x24\x04\0\x20\x0a\0\0\x65\x02\0\0\xb8\x0c\0\0\x21\x44\x04\0\x30\
+\x0a\0\0\x65\x02\0\0\xe0\x0c\0\0\x20\x54\x04\0\x38\x0a\0\0\x65\x02\0\0\xe0\x0c\
+\0\0\x2c\x54\x04\0\x50\x0a\0\0\x65\x02\0\0\xe0\x0c\0\0\x14\x54\x04\0\x60\x0a\0\
+\0\x65\x02\0\0\x10\x0d\0\0\x20\x50\x04\0\x68\x0a\0\0\x65\x02\0\0\xbd\x08\0\0\
+\x05\xa0\x02\0\xb0\x0a\0\0\x65\x02\0\0\x38\x0d\0\0\x38\x30\x03\0\xd0\x0a\0\0\
+\x65\x02\0\0\x38\x0d\0\0\x05\x30\x03\0\xe8\x0a\0\0\x65\x02\0\0\xbd\x08\0\0\x05\
+\xa0\x02\0\xf8\x0a\0\0\x65\x02\0\0\x76\x0d\0\0\x16\x38\x07\0\0\x0b\0\0\x65\x02\
+\0\0\x76\x0d\0\0\x10\x38\x07\0\x08\x0b\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\x58\x0b\
+\0\0\x65\x02\0\0\x7a\x07\0\0\x13\x3c\x07\0\x60\x0b\0\0\x65\x02\0\0\x7a\x07\0\0\
+\x1a\x3c\x07\0\x98\x0b\0\0\x65\x02\0\0\x96\x0d\0\0\x27\x74\x07\0\xa8\x0b\0\0\
+\x65\x02\0\0\x96\x0d\0\0\x17\x74\x07\0\xb0\x0b\0\0\x65\x02\0\0\x96\x0d\0\0\x27\
+\x74\x07\0\xc8\x0b\0\0\x65\x02\0\0\xbf\x0d\0\0\x27\x48\x07\0\0\x0c\0\0\x65\x02\
+\0\0\xbf\x0d\0\0\x17\x48\x07\0\x10\x0c\0\0\x65\x02\0\0\xbf\x0d\0\0\x27\x48\x07\
+\0\x20\x0c\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\x70\x0c\0\0\x65\x02\0\0\x96\x0d\0\0\
+\x27\x74\x07\0\x78\x0c\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\xa8\x0c\0\0\x65\x02\0\0\
+\x96\x07\0\0\x05\x08\x02\0\xb8\x0c\0\0\x65\x02\0\0\x96\x07\0\0\x05\x08\x02\0\
+\xc8\x0c\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\xf8\x0c\0\0\x65\x02\0\0\xe8\x0d\0\0\
+\x1a\xdc\x06\0\0\x0d\0\0\x65\x02\0\0\xe8\x0d\0\0\x21\xdc\x06\0\x30\x0d\0\0\x65\
+\x02\0\0\x96\x07\0\0\x05\x08\x02\0\x40\x0d\0\0\x65\x02\0\0\x96\x07\0\0\x05\x08\
+\x02\0\x50\x0d\0\0\x65\x02\0\0\x96\x07\0\0\x05\x08\x02\0\x60\x0d\0\0\x65\x02\0\
+\0\x96\x07\0\0\x05\x08\x02\0\x78\x0d\0\0\x65\x02\0\0\x0b\x0e\0\0\x27\x18\x07\0\
+\x80\x0d\0\0\x65\x02\0\0\x0b\x0e\0\0\x14\x18\x07\0\x98\x0d\0\0\x65\x02\0\0\x96\
+\x07\0\0\x05\x08\x02\0\xa8\x0d\0\0\x65\x02\0\0\x96\x07\0\0\x05\x08\x02\0\xd8\
+\x0d\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\xe8\x0d\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\
+\xf0\x0d\0\0\x65\x02\0\0\x54\x0e\0\0\x14\x58\x0b\0\x10\x0e\0\0\x65\x02\0\0\x76\
+\x0e\0\0\x01\x5c\x0b\0\x20\x0e\0\0\x65\x02\0\0\xe8\x0d\0\0\x1a\xb8\x07\0\x28\
+\x0e\0\0\x65\x02\0\0\xe8\x0d\0\0\x21\xb8\x07\0\x60\x0e\0\0\x65\x02\0\0\x96\x0d\
+\0\0\x27\xf0\x07\0\x78\x0e\0\0\x65\x02\0\0\x96\x0d\0\0\x17\xf0\x07\0\x80\x0e\0\
+\0\x65\x02\0\0\x96\x0d\0\0\x27\xf0\x07\0\x98\x0e\0\0\x65\x02\0\0\xbf\x0d\0\0\
+\x27\xc4\x07\0\xc8\x0e\0\0\x65\x02\0\0\xbf\x0d\0\0\x17\xc4\x07\0\xd8\x0e\0\0\
+\x65\x02\0\0\xbf\x0d\0\0\x27\xc4\x07\0\xe8\x0e\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\
+\x38\x0f\0\0\x65\x02\0\0\x96\x0d\0\0\x27\xf0\x07\0\x40\x0f\0\0\x65\x02\0\0\0\0\
+\0\0\0\0\0\0\x60\x0f\0\0\x65\x02\0\0\x96\x07\0\0\x05\x08\x02\0\x70\x0f\0\0\x65\
+\x02\0\0\x96\x07\0\0\x05\x08\x02\0\x80\x0f\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\xc0\
+\x0f\0\0\x65\x02\0\0\x78\x0e\0\0\x1a\x10\x06\0\xd0\x0f\0\0\x65\x02\0\0\x96\x0e\
+\0\0\x1b\x18\x06\0\xe0\x0f\0\0\x65\x02\0\0\x78\x0e\0\0\x1a\x10\x06\0\xe8\x0f\0\
+\0\x65\x02\0\0\xba\x0e\0\0\x13\x1c\x06\0\x20\x10\0\0\x65\x02\0\0\x4a\x07\0\0\
+\x11\x24\x06\0\x30\x10\0\0\x65\x02\0\0\xbd\x08\0\0\x05\xa0\x02\0\x40\x10\0\0\
+\x65\x02\0\0\x0b\x0f\0\0\x27\x3c\x08\0\x50\x10\0\0\x65\x02\0\0\x0b\x0f\0\0\x14\
+\x3c\x08\0\x70\x10\0\0\x65\x02\0\0\xbf\x0d\0\0\x27\x40\x08\0\x88\x10\0\0\x65\
+\x02\0\0\xbf\x0d\0\0\x17\x40\x08\0\x90\x10\0\0\x65\x02\0\0\xbf\x0d\0\0\x27\x40\
+\x08\0\xc0\x10\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\x10\x11\0\0\x65\x02\0\0\x96\x0d\
+\0\0\x17\x6c\x08\0\x18\x11\0\0\x65\x02\0\0\x96\x0d\0\0\x27\x6c\x08\0\x28\x11\0\
+\0\x65\x02\0\0\x96\x07\0\0\x05\x08\x02\0\x80\x11\0\0\x65\x02\0\0\x96\x07\0\0\
+\x05\x08\x02\0\xc0\x11\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\xe0\x11\0\0\x65\x02\0\0\
+\x54\x0f\0\0\x05\x40\x02\0\xe8\x11\0\0\x65\x02\0\0\x96\x0f\0\0\x23\x34\x02\0\0\
+\x12\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\x08\x12\0\0\x65\x02\0\0\xca\x0f\0\0\x1b\
+\x44\x02\0\x28\x12\0\0\x65\x02\0\0\xf1\x0f\0\0\x11\x58\x02\0\x40\x12\0\0\x65\
+\x02\0\0\x1a\x10\0\0\x19\x48\x02\0\x58\x12\0\0\x65\x02\0\0\x48\x10\0\0\x27\x6c\
+\x02\0\x60\x12\0\0\x65\x02\0\0\x48\x10\0\0\x46\x6c\x02\0\x70\x12\0\0\x65\x02\0\
+\0\x48\x10\0\0\x2d\x6c\x02\0\x78\x12\0\0\x65\x02\0\0\xf1\x0f\0\0\x11\x58\x02\0\
+\xa0\x12\0\0\x65\x02\0\0\x48\x10\0\0\x46\x6c\x02\0\xb8\x12\0\0\x65\x02\0\0\x48\
+\x10\0\0\x27\x6c\x02\0\xc0\x12\0\0\x65\x02\0\0\x48\x10\0\0\x2d\x6c\x02\0\xc8\
+\x12\0\0\x65\x02\0\0\xf1\x0f\0\0\x11\x58\x02\0\xf0\x12\0\0\x65\x02\0\0\x48\x10\
+\0\0\x27\x6c\x02\0\xf8\x12\0\0\x65\x02\0\0\x48\x10\0\0\x46\x6c\x02\0\x10\x13\0\
+\0\x65\x02\0\0\x48\x10\0\0\x2d\x6c\x02\0\x18\x13\0\0\x65\x02\0\0\xf1\x0f\0\0\
+\x11\x58\x02\0\x40\x13\0\0\x65\x02\0\0\x48\x10\0\0\x27\x6c\x02\0\x48\x13\0\0\
+\x65\x02\0\0\x48\x10\0\0\x46\x6c\x02\0\x60\x13\0\0\x65\x02\0\0\x48\x10\0\0\x2d\
+\x6c\x02\0\x68\x13\0\0\x65\x02\0\0\xf1\x0f\0\0\x11\x58\x02\0\x90\x13\0\0\x65\
+\x02\0\0\x48\x10\0\0\x46\x6c\x02\0\xa8\x13\0\0\x65\x02\0\0\x48\x10\0\0\x27\x6c\
+\x02\0\xb0\x13\0\0\x65\x02\0\0\x48\x10\0\0\x2d\x6c\x02\0\xb8\x13\0\0\x65\x02\0\
+\0\xf1\x0f\0\0\x11\x58\x02\0\xe0\x13\0\0\x65\x02\0\0\x48\x10\0\0\x46\x6c\x02\0\
+\xf8\x13\0\0\x65\x02\0\0\x48\x10\0\0\x27\x6c\x02\0\0\x14\0\0\x65\x02\0\0\x48\
+\x10\0\0\x2d\x6c\x02\0\x08\x14\0\0\x65\x02\0\0\xf1\x0f\0\0\x11\x58\x02\0\x30\
+\x14\0\0\x65\x02\0\0\x48\x10\0\0\x46\x6c\x02\0\x48\x14\0\0\x65\x02\0\0\x48\x10\
+\0\0\x27\x6c\x02\0\x50\x14\0\0\x65\x02\0\0\x48\x10\0\0\x2d\x6c\x02\0\x58\x14\0\
+\0\x65\x02\0\0\xf1\x0f\0\0\x11\x58\x02\0\x78\x14\0\0\x65\x02\0\0\x48\x10\0\0\
+\x46\x6c\x02\0\x80\x14\0\0\x65\x02\0\0\x48\x10\0\0\x27\x6c\x02\0\x88\x14\0\0\
+\x65\x02\0\0\x48\x10\0\0\x2d\x6c\x02\0\x90\x14\0\0\x65\x02\0\0\x54\x0f\0\0\x3d\
+\x40\x02\0\xa0\x14\0\0\x65\x02\0\0\x54\x0f\0\0\x05\x40\x02\0\xb8\x14\0\0\x65\
+\x02\0\0\x94\x10\0\0\x2a\x0c\x0b\0\xd8\x14\0\0\x65\x02\0\0\x94\x10\0\0\x20\x0c\
+\x0b\0\x08\x15\0\0\x65\x02\0\0\x94\x10\0\0\x0f\x0c\x0b\0\x10\x15\0\0\x65\x02\0\
+\0\xcf\x10\0\0\x15\x1c\x0b\0\x18\x15\0\0\x65\x02\0\0\xcf\x10\0\0\x0d\x1c\x0b\0\
+\x30\x15\0\0\x65\x02\0\0\xf4\x10\0\0\x19\x84\x09\0\x38\x15\0\0\x65\x02\0\0\x16\
+\x11\0\0\x19\x80\x09\0\x40\x15\0\0\x65\x02\0\0\x38\x11\0\0\x09\x94\x09\0\x60\
+\x15\0\0\x65\x02\0\0\x50\x11\0\0\x16\x9c\x09\0\x68\x15\0\0\x65\x02\0\0\x50\x11\
+\0\0\x10\x9c\x09\0\x70\x15\0\0\x65\x02\0\0\x61\x07\0\0\x09\xb4\x09\0\x78\x15\0\
+\0\x65\x02\0\0\x6f\x11\0\0\x15\xbc\x09\0\x80\x15\0\0\x65\x02\0\0\x8b\x11\0\0\
+\x15\xb8\x09\0\x90\x15\0\0\x65\x02\0\0\xa7\x11\0\0\x13\xec\x09\0\xa0\x15\0\0\
+\x65\x02\0\0\x76\x0d\0\0\x16\xc0\x09\0\xa8\x15\0\0\x65\x02\0\0\x76\x0d\0\0\x10\
+\xc0\x09\0\xb0\x15\0\0\x65\x02\0\0\xdd\x11\0\0\x09\xcc\x09\0\xd0\x15\0\0\x65\
+\x02\0\0\x1a\x12\0\0\x09\xd0\x09\0\xf0\x15\0\0\x65\x02\0\0\x69\x12\0\0\x0d\xd8\
+\x09\0\xf8\x15\0\0\x65\x02\0\0\x80\x12\0\0\x09\xc4\x09\0\x18\x16\0\0\x65\x02\0\
+\0\xbd\x12\0\0\x09\xc8\x09\0\x38\x16\0\0\x65\x02\0\0\x0c\x13\0\0\x0d\xd4\x09\0\
+\x48\x16\0\0\x65\x02\0\0\xa7\x11\0\0\x13\xec\x09\0\x58\x16\0\0\x65\x02\0\0\xa7\
+\x11\0\0\x22\xec\x09\0\x98\x16\0\0\x65\x02\0\0\x23\x13\0\0\x1f\x0c\x09\0\xa8\
+\x16\0\0\x65\x02\0\0\x23\x13\0\0\x13\x0c\x09\0\xd0\x16\0\0\x65\x02\0\0\x63\x13\
+\0\0\x1c\xd0\x08\0\xe8\x16\0\0\x65\x02\0\0\x63\x13\0\0\x12\xd0\x08\0\xf8\x16\0\
+\0\x65\x02\0\0\x63\x13\0\0\x1c\xd0\x08\0\0\x17\0\0\x65\x02\0\0\x98\x13\0\0\x1f\
+\x04\x09\0\x10\x17\0\0\x65\x02\0\0\x98\x13\0\0\x13\x04\x09\0\x28\x17\0\0\x65\
+\x02\0\0\x63\x13\0\0\x1c\xd0\x08\0\x40\x17\0\0\x65\x02\0\0\x63\x13\0\0\x12\xd0\
+\x08\0\x50\x17\0\0\x65\x02\0\0\xd8\x13\0\0\x18\x18\x09\0\x58\x17\0\0\x65\x02\0\
+\0\x1f\x14\0\0\x20\x10\x09\0\x60\x17\0\0\x65\x02\0\0\x1f\x14\0\0\x27\x10\x09\0\
+\x68\x17\0\0\x65\x02\0\0\x1f\x14\0\0\x13\x10\x09\0\x80\x17\0\0\x65\x02\0\0\x63\
+\x13\0\0\x1c\xd0\x08\0\x98\x17\0\0\x65\x02\0\0\x63\x13\0\0\x12\xd0\x08\0\xa8\
+\x17\0\0\x65\x02\0\0\x63\x13\0\0\x1c\xd0\x08\0\xb0\x17\0\0\x65\x02\0\0\x23\x13\
+\0\0\x32\x0c\x09\0\xd0\x17\0\0\x65\x02\0\0\x63\x13\0\0\x24\xd0\x08\0\xd8\x17\0\
+\0\x65\x02\0\0\xd8\x13\0\0\x27\x18\x09\0\xe0\x17\0\0\x65\x02\0\0\x98\x13\0\0\
+\x32\x04\x09\0\0\x18\0\0\x65\x02\0\0\x63\x13\0\0\x24\xd0\x08\0\x08\x18\0\0\x65\
+\x02\0\0\x63\x13\0\0\x1c\xd0\x08\0\x10\x18\0\0\x65\x02\0\0\x67\x14\0\0\x20\x08\
+\x09\0\x18\x18\0\0\x65\x02\0\0\x67\x14\0\0\x27\x08\x09\0\x20\x18\0\0\x65\x02\0\
+\0\x67\x14\0\0\x13\x08\x09\0\x38\x18\0\0\x65\x02\0\0\x63\x13\0\0\x1c\xd0\x08\0\
+\x50\x18\0\0\x65\x02\0\0\x63\x13\0\0\x12\xd0\x08\0\x60\x18\0\0\x65\x02\0\0\xd8\
+\x13\0\0\x37\x18\x09\0\x68\x18\0\0\x65\x02\0\0\x1f\x14\0\0\x3a\x10\x09\0\x88\
+\x18\0\0\x65\x02\0\0\x63\x13\0\0\x24\xd0\x08\0\x90\x18\0\0\x65\x02\0\0\xaf\x14\
+\0\0\x09\x1c\x09\0\x98\x18\0\0\x65\x02\0\0\x67\x14\0\0\x3a\x08\x09\0\xb8\x18\0\
+\0\x65\x02\0\0\x63\x13\0\0\x24\xd0\x08\0\xc0\x18\0\0\x65\x02\0\0\xbe\x14\0\0\
+\x15\x24\x09\0\xd8\x18\0\0\x65\x02\0\0\x63\x13\0\0\x1c\xd0\x08\0\xe8\x18\0\0\
+\x65\x02\0\0\xbe\x14\0\0\x15\x24\x09\0\xf0\x18\0\0\x65\x02\0\0\x63\x13\0\0\x1c\
+\xd0\x08\0\0\x19\0\0\x65\x02\0\0\x63\x13\0\0\x12\xd0\x08\0\x10\x19\0\0\x65\x02\
+\0\0\xbe\x14\0\0\x34\x24\x09\0\x20\x19\0\0\x65\x02\0\0\x63\x13\0\0\x24\xd0\x08\
+\0\x28\x19\0\0\x65\x02\0\0\x63\x13\0\0\x1c\xd0\x08\0\x30\x19\0\0\x65\x02\0\0\
+\xff\x14\0\0\x19\x2c\x09\0\x38\x19\0\0\x65\x02\0\0\x38\x15\0\0\x3c\x28\x09\0\
+\x40\x19\0\0\x65\x02\0\0\xff\x14\0\0\x15\x2c\x09\0\x48\x19\0\0\x65\x02\0\0\x63\
+\x13\0\0\x1c\xd0\x08\0\x58\x19\0\0\x65\x02\0\0\xff\x14\0\0\x15\x2c\x09\0\x60\
+\x19\0\0\x65\x02\0\0\x63\x13\0\0\x1c\xd0\x08\0\x70\x19\0\0\x65\x02\0\0\x81\x15\
+\0\0\x19\x30\x09\0\x78\x19\0\0\x65\x02\0\0\xff\x14\0\0\x2c\x2c\x09\0\x80\x19\0\
+\0\x65\x02\0\0\x81\x15\0\0\x15\x30\x09\0\x88\x19\0\0\x65\x02\0\0\x63\x13\0\0\
+\x1c\xd0\x08\0\x98\x19\0\0\x65\x02\0\0\x81\x15\0\0\x15\x30\x09\0\xa0\x19\0\0\
+\x65\x02\0\0\x63\x13\0\0\x1c\xd0\x08\0\xb0\x19\0\0\x65\x02\0\0\x81\x15\0\0\x2c\
+\x30\x09\0\xc8\x19\0\0\x65\x02\0\0\xba\x15\0\0\x10\x38\x09\0\xd0\x19\0\0\x65\
+\x02\0\0\xba\x15\0\0\x09\x38\x09\0\xd8\x19\0\0\x65\x02\0\0\xd0\x15\0\0\x09\x3c\
+\x09\0\0\x1a\0\0\x65\x02\0\0\xe8\x15\0\0\x10\x40\x09\0\x08\x1a\0\0\x65\x02\0\0\
+\xe8\x15\0\0\x09\x40\x09\0\x10\x1a\0\0\x65\x02\0\0\xfe\x15\0\0\x09\x44\x09\0\
+\x38\x1a\0\0\x65\x02\0\0\x16\x16\0\0\x10\x48\x09\0\x40\x1a\0\0\x65\x02\0\0\x16\
+\x16\0\0\x09\x48\x09\0\x68\x1a\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\x78\x1a\0\0\x65\
+\x02\0\0\x2c\x16\0\0\x16\x60\x0a\0\x88\x1a\0\0\x65\x02\0\0\x2c\x16\0\0\x0b\x60\
+\x0a\0\x98\x1a\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\xa0\x1a\0\0\x65\x02\0\0\x5a\x16\
+\0\0\x0d\x80\x0a\0\xb8\x1a\0\0\x65\x02\0\0\x9a\x16\0\0\x09\x84\x0a\0\xc0\x1a\0\
+\0\x65\x02\0\0\xac\x16\0\0\x18\x98\x0a\0\xd0\x1a\0\0\x65\x02\0\0\xdc\x16\0\0\
+\x0d\x94\x0a\0\xd8\x1a\0\0\x65\x02\0\0\xac\x16\0\0\x0f\x98\x0a\0\xe8\x1a\0\0\
+\x65\x02\0\0\xac\x16\0\0\x1d\x98\x0a\0\x28\x1b\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\
+\x30\x1b\0\0\x65\x02\0\0\xf0\x16\0\0\x16\x28\x0a\0\x48\x1b\0\0\x65\x02\0\0\x3a\
+\x17\0\0\x09\x30\x0a\0\x50\x1b\0\0\x65\x02\0\0\x4d\x17\0\0\x12\x34\x0a\0\x90\
+\x1b\0\0\x65\x02\0\0\0\0\0\0\0\0\0\0\x98\x1b\0\0\x65\x02\0\0\xf0\x16\0\0\x16\
+\x28\x0a\0\xb8\x1b\0\0\x65\x02\0\0\x3a\x17\0\0\x09\x30\x0a\0\xc0\x1b\0\0\x65\
+\x02\0\0\x4d\x17\0\0\x12\x34\x0a\0\xd8\x1b\0\0\x65\x02\0\0\x64\x17\0\0\x19\xb0\
+\x0a\0\0\x1c\0\0\x65\x02\0\0\x81\x17\0\0\x11\x24\x0b\0\x10\x1c\0\0\x65\x02\0\0\
+\0\0\0\0\0\0\0\0\x18\x1c\0\0\x65\x02\0\0\xa4\x17\0\0\x11\x38\x0b\0\x30\x1c\0\0\
+\x65\x02\0\0\xe8\x17\0\0\x0d\x44\x0b\0\x38\x1c\0\0\x65\x02\0\0\xfd\x17\0\0\x14\
+\x48\x0b\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x03\
+\0\x03\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x03\x01\0\0\0\0\x03\0\x10\x0e\0\0\0\0\
+\0\0\0\0\0\0\0\0\0\0\x0d\x02\0\0\0\0\x03\0\xf0\x0d\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
+\x1d\x01\0\0\0\0\x03\0\xc0\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xcc\x02\0\0\0\0\x03\
+\0\x10\x02\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x6e\x01\0\0\0\0\x03\0\0\x05\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\xf3\0\0\0\0\0\x03\0\x18\x04\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x97\
+\x01\0\0\0\0\x03\0\xd8\x02\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xbc\x02\0\0\0\0\x03\0\
+\x28\x03\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xb4\x02\0\0\0\0\x03\0\xb8\x0f\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\x3c\x01\0\0\0\0\x03\0\xf0\x03\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xac\
+\x02\0\0\0\0\x03\0\xf8\x0a\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xb9\x01\0\0\0\0\x03\0\
+\xf8\x0c\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xfc\x01\0\0\0\0\x03\0\xd8\x11\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\x0c\x01\0\0\0\0\x03\0\x30\x10\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x81\
+\x02\0\0\0\0\x03\0\x68\x06\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x60\x02\0\0\0\0\x03\0\
+\xd8\x06\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xeb\x01\0\0\0\0\x03\0\x30\x07\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\x1d\x02\0\0\0\0\x03\0\x58\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xdb\
+\x01\0\0\0\0\x03\0\x20\x0a\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xc1\x01\0\0\0\0\x03\0\
+\x30\x0a\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x79\x02\0\0\0\0\x03\0\x70\x11\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\xe3\x01\0\0\0\0\x03\0\x08\x09\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xc4\
+\x02\0\0\0\0\x03\0\x78\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x58\x02\0\0\0\0\x03\0\
+\xf0\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x15\x02\0\0\0\0\x03\0\xc0\x0d\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\x4c\x01\0\0\0\0\x03\0\xf8\x09\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x86\
+\x01\0\0\0\0\x03\0\xe8\x0a\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x44\x01\0\0\0\0\x03\0\
+\xa8\x0a\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xfb\0\0\0\0\0\x03\0\xd8\x0a\0\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\x48\x02\0\0\0\0\x03\0\x20\x0e\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xb1\
+\x01\0\0\0\0\x03\0\xa8\x0b\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x5d\x01\0\0\0\0\x03\0\
+\xc0\x0b\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xeb\0\0\0\0\0\x03\0\xf8\x0b\0\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\x71\x02\0\0\0\0\x03\0\x20\x0c\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x37\
+\x02\0\0\0\0\x03\0\xd0\x11\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x34\x01\0\0\0\0\x03\0\
+\x78\x0d\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x50\x02\0\0\0\0\x03\0\xd8\x0d\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\x05\x02\0\0\0\0\x03\0\x40\x10\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x7e\
+\x01\0\0\0\0\x03\0\x70\x0e\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x2c\x01\0\0\0\0\x03\0\
+\x90\x0e\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xa4\x02\0\0\0\0\x03\0\xc8\x0e\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\x40\x02\0\0\0\0\x03\0\xe8\x0e\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x76\
+\x01\0\0\0\0\x03\0\x80\x10\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x24\x01\0\0\0\0\x03\0\
+\xa0\x10\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x9b\x02\0\0\0\0\x03\0\x80\x11\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\x68\x02\0\0\0\0\x03\0\xc0\x11\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xd2\
+\x01\0\0\0\0\x03\0\xf8\x11\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xa8\x01\0\0\0\0\x03\0\
+\xb0\x14\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x65\x01\0\0\0\0\x03\0\x08\x1c\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\x14\x01\0\0\0\0\x03\0\x70\x15\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x25\
+\x02\0\0\0\0\x03\0\x68\x1b\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x92\x02\0\0\0\0\x03\0\
+\xa0\x15\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xc9\x01\0\0\0\0\x03\0\x78\x16\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\x2e\x02\0\0\0\0\x03\0\x50\x16\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x9f\
+\x01\0\0\0\0\x03\0\x98\x16\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x54\x01\0\0\0\0\x03\0\
+\x78\x1a\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x89\x02\0\0\0\0\x03\0\x10\x1b\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\xf3\x01\0\0\0\0\x03\0\x78\x1b\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x8e\
+\x01\0\0\0\0\x03\0\xd8\x1b\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x70\0\0\0\x12\0\x03\0\0\
+\0\0\0\0\0\0\0\x48\x1c\0\0\0\0\0\0\x55\0\0\0\x11\0\x05\0\0\0\0\0\0\0\0\0\x28\0\
+\0\0\0\0\0\0\x01\0\0\0\x11\0\x05\0\x28\0\0\0\0\0\0\0\x28\0\0\0\0\0\0\0\x9d\0\0\
+\0\x11\0\x05\0\x78\0\0\0\0\0\0\0\x28\0\0\0\0\0\0\0\x38\0\0\0\x11\0\x05\0\xa0\0\
+\0\0\0\0\0\0\x20\0\0\0\0\0\0\0\xb4\0\0\0\x11\0\x05\0\x50\0\0\0\0\0\0\0\x28\0\0\
+\0\0\0\0\0\x94\0\0\0\x11\0\x06\0\0\0\0\0\0\0\0\0\x07\0\0\0\0\0\0\0\x78\0\0\0\0\
+\0\0\0\x01\0\0\0\x3e\0\0\0\xa0\0\0\0\0\0\0\0\x01\0\0\0\x3f\0\0\0\xa0\x1a\0\0\0\
+\0\0\0\x01\0\0\0\x40\0\0\0\x30\x1b\0\0\0\0\0\0\x01\0\0\0\x41\0\0\0\x98\x1b\0\0\
+\0\0\0\0\x01\0\0\0\x41\0\0\0\x18\x1c\0\0\0\0\0\0\x01\0\0\0\x42\0\0\0\x30\x06\0\
+\0\0\0\0\0\x04\0\0\0\x3e\0\0\0\x3c\x06\0\0\0\0\0\0\x04\0\0\0\x3f\0\0\0\x48\x06\
+\0\0\0\0\0\0\x04\0\0\0\x42\0\0\0\x54\x06\0\0\0\0\0\0\x04\0\0\0\x40\0\0\0\x60\
+\x06\0\0\0\0\0\0\x04\0\0\0\x41\0\0\0\x78\x06\0\0\0\0\0\0\x04\0\0\0\x43\0\0\0\
+\x2c\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\x50\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\x70\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\x90\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\xb0\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\xd0\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\xf0\0\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\x10\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
+\0\x30\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\
+\0\0\x50\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x01\0\0\0\0\0\0\x04\0\0\0\x01\
+\0\0\0\x70\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x01\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\x90\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x01\0\0\0\0\0\0\x04\0\0\
+\0\x01\0\0\0\xb0\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x01\0\0\0\0\0\0\x04\0\
+\0\0\x01\0\0\0\xd0\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x01\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\xf0\x01\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x02\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\x10\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x02\0\0\0\0\0\0\
+\x04\0\0\0\x01\0\0\0\x30\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x02\0\0\0\0\0\
+\0\x04\0\0\0\x01\0\0\0\x50\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x02\0\0\0\0\
+\0\0\x04\0\0\0\x01\0\0\0\x70\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x02\0\0\0\
+\0\0\0\x04\0\0\0\x01\0\0\0\x90\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x02\0\0\
+\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x02\0\
+\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x02\
+\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x02\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x03\
+\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\
+\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\x40\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
+\0\x60\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\
+\0\0\x80\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x03\0\0\0\0\0\0\x04\0\0\0\x01\
+\0\0\0\xa0\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x03\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\xc0\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x03\0\0\0\0\0\0\x04\0\0\
+\0\x01\0\0\0\xe0\x03\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x03\0\0\0\0\0\0\x04\0\
+\0\0\x01\0\0\0\0\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x04\0\0\0\0\0\0\x04\0\
+\0\0\x01\0\0\0\x20\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x04\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\x40\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x04\0\0\0\0\0\0\
+\x04\0\0\0\x01\0\0\0\x60\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x04\0\0\0\0\0\
+\0\x04\0\0\0\x01\0\0\0\x80\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x04\0\0\0\0\
+\0\0\x04\0\0\0\x01\0\0\0\xa0\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x04\0\0\0\
+\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x04\0\0\
+\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x04\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x04\0\
+\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x05\0\
+\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x05\
+\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\
+\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\x70\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
+\0\x90\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\
+\0\0\xb0\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x05\0\0\0\0\0\0\x04\0\0\0\x01\
+\0\0\0\xd0\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x05\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\xf0\x05\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x06\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\x10\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x06\0\0\0\0\0\0\x04\0\0\
+\0\x01\0\0\0\x30\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x06\0\0\0\0\0\0\x04\0\
+\0\0\x01\0\0\0\x50\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x06\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\x70\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x06\0\0\0\0\0\0\
+\x04\0\0\0\x01\0\0\0\x90\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x06\0\0\0\0\0\
+\0\x04\0\0\0\x01\0\0\0\xb0\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x06\0\0\0\0\
+\0\0\x04\0\0\0\x01\0\0\0\xd0\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x06\0\0\0\
+\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x06\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x07\0\0\0\
+\0\0\0\x04\0\0\0\x01\0\0\0\x10\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x07\0\0\
+\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x07\0\
+\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x07\
+\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\
+\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\xa0\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
+\0\xc0\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\
+\0\0\xe0\x07\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x07\0\0\0\0\0\0\x04\0\0\0\x01\
+\0\0\0\0\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x08\0\0\0\0\0\0\x04\0\0\0\x01\
+\0\0\0\x20\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x08\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\x40\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x08\0\0\0\0\0\0\x04\0\0\
+\0\x01\0\0\0\x60\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x08\0\0\0\0\0\0\x04\0\
+\0\0\x01\0\0\0\x80\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x08\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\xa0\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x08\0\0\0\0\0\0\
+\x04\0\0\0\x01\0\0\0\xc0\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x08\0\0\0\0\0\
+\0\x04\0\0\0\x01\0\0\0\xe0\x08\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x08\0\0\0\0\
+\0\0\x04\0\0\0\x01\0\0\0\0\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x09\0\0\0\0\
+\0\0\x04\0\0\0\x01\0\0\0\x20\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x09\0\0\0\
+\0\0\0\x04\0\0\0\x01\0\0\0\x40\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x09\0\0\
+\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x09\0\
+\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x09\
+\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\
+\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\xd0\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
+\0\xf0\x09\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
+\0\x10\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\
+\0\0\x30\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x0a\0\0\0\0\0\0\x04\0\0\0\x01\
+\0\0\0\x50\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x0a\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\x70\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x0a\0\0\0\0\0\0\x04\0\0\
+\0\x01\0\0\0\x90\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x0a\0\0\0\0\0\0\x04\0\
+\0\0\x01\0\0\0\xb0\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x0a\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\xd0\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x0a\0\0\0\0\0\0\
+\x04\0\0\0\x01\0\0\0\xf0\x0a\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x0b\0\0\0\0\0\0\
+\x04\0\0\0\x01\0\0\0\x10\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x0b\0\0\0\0\0\
+\0\x04\0\0\0\x01\0\0\0\x30\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x0b\0\0\0\0\
+\0\0\x04\0\0\0\x01\0\0\0\x50\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x0b\0\0\0\
+\0\0\0\x04\0\0\0\x01\0\0\0\x70\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x0b\0\0\
+\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x0b\0\
+\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x0b\
+\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\
+\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x0b\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\
+\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\x20\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
+\0\x40\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\
+\0\0\x60\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x0c\0\0\0\0\0\0\x04\0\0\0\x01\
+\0\0\0\x80\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x0c\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\xa0\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x0c\0\0\0\0\0\0\x04\0\0\
+\0\x01\0\0\0\xc0\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x0c\0\0\0\0\0\0\x04\0\
+\0\0\x01\0\0\0\xe0\x0c\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x0c\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\0\x0d\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x0d\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\x20\x0d\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x0d\0\0\0\0\0\0\
+\x04\0\0\0\x01\0\0\0\x40\x0d\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x0d\0\0\0\0\0\
+\0\x04\0\0\0\x01\0\0\0\x60\x0d\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x0d\0\0\0\0\
+\0\0\x04\0\0\0\x01\0\0\0\x80\x0d\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x0d\0\0\0\
+\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x0d\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x0d\0\0\
+\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x0d\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x0d\0\
+\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x0d\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x0d\
+\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x0e\
+\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\
+\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\x50\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
+\0\x70\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\
+\0\0\x90\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x0e\0\0\0\0\0\0\x04\0\0\0\x01\
+\0\0\0\xb0\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x0e\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\xd0\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x0e\0\0\0\0\0\0\x04\0\0\
+\0\x01\0\0\0\xf0\x0e\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x0f\0\0\0\0\0\0\x04\0\0\
+\0\x01\0\0\0\x10\x0f\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x0f\0\0\0\0\0\0\x04\0\
+\0\0\x01\0\0\0\x30\x0f\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x0f\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\x50\x0f\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x0f\0\0\0\0\0\0\
+\x04\0\0\0\x01\0\0\0\x70\x0f\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x0f\0\0\0\0\0\
+\0\x04\0\0\0\x01\0\0\0\x90\x0f\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x0f\0\0\0\0\
+\0\0\x04\0\0\0\x01\0\0\0\xb0\x0f\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x0f\0\0\0\
+\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x0f\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x0f\0\0\
+\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x0f\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x10\0\0\
+\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x10\0\
+\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x10\
+\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\
+\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\x80\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
+\0\xa0\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\
+\0\0\xc0\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x10\0\0\0\0\0\0\x04\0\0\0\x01\
+\0\0\0\xe0\x10\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x10\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\0\x11\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x11\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\x20\x11\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x11\0\0\0\0\0\0\x04\0\0\
+\0\x01\0\0\0\x40\x11\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x11\0\0\0\0\0\0\x04\0\
+\0\0\x01\0\0\0\x60\x11\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x11\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\x80\x11\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\x11\0\0\0\0\0\0\
+\x04\0\0\0\x01\0\0\0\xa0\x11\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xb0\x11\0\0\0\0\0\
+\0\x04\0\0\0\x01\0\0\0\xc0\x11\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xd0\x11\0\0\0\0\
+\0\0\x04\0\0\0\x01\0\0\0\xe0\x11\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xf0\x11\0\0\0\
+\0\0\0\x04\0\0\0\x01\0\0\0\0\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x10\x12\0\0\0\
+\0\0\0\x04\0\0\0\x01\0\0\0\x20\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x30\x12\0\0\
+\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x50\x12\0\
+\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x70\x12\
+\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x90\
+\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\
+\xb0\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\
+\0\xd0\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\
+\0\0\xf0\x12\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x13\0\0\0\0\0\0\x04\0\0\0\x01\0\
+\0\0\x10\x13\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x20\x13\0\0\0\0\0\0\x04\0\0\0\x01\
+\0\0\0\x30\x13\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x40\x13\0\0\0\0\0\0\x04\0\0\0\
+\x01\0\0\0\x50\x13\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x60\x13\0\0\0\0\0\0\x04\0\0\
+\0\x01\0\0\0\x70\x13\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x80\x13\0\0\0\0\0\0\x04\0\
+\0\0\x01\0\0\0\x90\x13\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xa0\x13\0\0\0\0\0\0\x04\
+\0\0\0\x01\0\0\0\xb0\x13\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xc0\x13\0\0\0\0\0\0\
+\x04\0\0\0\x01\0\0\0\xd0\x13\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\xe0\x13\0\0\0\0\0\
+\0\x04\0\0\0\x01\0\0\0\xf0\x13\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\0\x14\0\0\0\0\0\
+\0\x04\0\0\0\x01\0\0\0\x10\x14\0\0\0\0\0\0\x04\0\0\0\x01\0\0\0\x47\x48\x49\x4c\
+\x4d\x4a\x4b\0\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x74\x6f\x65\x70\
+\x6c\x69\x74\x7a\x5f\x6b\x65\x79\0\x2e\x74\x65\x78\x74\0\x2e\x72\x65\x6c\x2e\
+\x42\x54\x46\x2e\x65\x78\x74\0\x2e\x72\x65\x6c\x73\x6f\x63\x6b\x65\x74\0\x74\
+\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x66\x6c\x6f\x77\x5f\x73\x74\x61\
+\x74\x73\0\x2e\x6d\x61\x70\x73\0\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\
+\x5f\x63\x6f\x6e\x66\x69\x67\x75\x72\x61\x74\x69\x6f\x6e\x73\0\x74\x75\x6e\x5f\
+\x72\x73\x73\x5f\x73\x74\x65\x65\x72\x69\x6e\x67\x5f\x70\x72\x6f\x67\0\x2e\x6c\
+\x6c\x76\x6d\x5f\x61\x64\x64\x72\x73\x69\x67\0\x5f\x6c\x69\x63\x65\x6e\x73\x65\
+\0\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x66\x6c\x6f\x77\x5f\x74\x61\
+\x62\x6c\x65\0\x74\x61\x70\x5f\x72\x73\x73\x5f\x6d\x61\x70\x5f\x69\x6e\x64\x69\
+\x72\x65\x63\x74\x69\x6f\x6e\x5f\x74\x61\x62\x6c\x65\0\x2e\x73\x74\x72\x74\x61\
+\x62\0\x2e\x73\x79\x6d\x74\x61\x62\0\x2e\x72\x65\x6c\x2e\x42\x54\x46\0\x4c\x42\
+\x42\x30\x5f\x37\x39\0\x4c\x42\x42\x30\x5f\x35\x39\0\x4c\x42\x42\x30\x5f\x34\
+\x39\0\x4c\x42\x42\x30\x5f\x31\x32\x39\0\x4c\x42\x42\x30\x5f\x31\x39\0\x4c\x42\
+\x42\x30\x5f\x31\x30\x39\0\x4c\x42\x42\x30\x5f\x38\0\x4c\x42\x42\x30\x5f\x39\
+\x38\0\x4c\x42\x42\x30\x5f\x38\x38\0\x4c\x42\x42\x30\x5f\x36\x38\0\x4c\x42\x42\
+\x30\x5f\x35\x38\0\x4c\x42\x42\x30\x5f\x34\x38\0\x4c\x42\x42\x30\x5f\x33\x38\0\
+\x4c\x42\x42\x30\x5f\x31\x31\x38\0\x4c\x42\x42\x30\x5f\x37\x37\0\x4c\x42\x42\
+\x30\x5f\x31\x32\x37\0\x4c\x42\x42\x30\x5f\x31\x37\0\x4c\x42\x42\x30\x5f\x39\
+\x36\0\x4c\x42\x42\x30\x5f\x38\x36\0\x4c\x42\x42\x30\x5f\x34\x36\0\x4c\x42\x42\
+\x30\x5f\x31\x32\x36\0\x4c\x42\x42\x30\x5f\x31\x36\0\x4c\x42\x42\x30\x5f\x31\
+\x31\x36\0\x4c\x42\x42\x30\x5f\x31\x30\x36\0\x4c\x42\x42\x30\x5f\x37\x35\0\x4c\
+\x42\x42\x30\x5f\x36\x35\0\x4c\x42\x42\x30\x5f\x34\x35\0\x4c\x42\x42\x30\x5f\
+\x31\x31\x35\0\x4c\x42\x42\x30\x5f\x31\x30\x35\0\x4c\x42\x42\x30\x5f\x34\x34\0\
+\x4c\x42\x42\x30\x5f\x33\x34\0\x4c\x42\x42\x30\x5f\x32\x34\0\x4c\x42\x42\x30\
+\x5f\x31\x32\x34\0\x4c\x42\x42\x30\x5f\x31\x30\x34\0\x4c\x42\x42\x30\x5f\x39\
+\x33\0\x4c\x42\x42\x30\x5f\x35\x33\0\x4c\x42\x42\x30\x5f\x34\x33\0\x4c\x42\x42\
+\x30\x5f\x33\x33\0\x4c\x42\x42\x30\x5f\x31\x32\x33\0\x4c\x42\x42\x30\x5f\x31\
+\x31\x33\0\x4c\x42\x42\x30\x5f\x31\x30\x33\0\x4c\x42\x42\x30\x5f\x39\x32\0\x4c\
+\x42\x42\x30\x5f\x38\x32\0\x4c\x42\x42\x30\x5f\x35\x32\0\x4c\x42\x42\x30\x5f\
+\x34\x32\0\x4c\x42\x42\x30\x5f\x32\x32\0\x4c\x42\x42\x30\x5f\x31\x30\x32\0\x4c\
+\x42\x42\x30\x5f\x38\x31\0\x4c\x42\x42\x30\x5f\x35\x31\0\x4c\x42\x42\x30\x5f\
+\x32\x31\0\x4c\x42\x42\x30\x5f\x31\x32\x31\0\x4c\x42\x42\x30\x5f\x31\x31\x31\0\
+\x4c\x42\x42\x30\x5f\x31\x30\x31\0\x4c\x42\x42\x30\x5f\x39\x30\0\x4c\x42\x42\
+\x30\x5f\x37\x30\0\x4c\x42\x42\x30\x5f\x36\x30\0\x4c\x42\x42\x30\x5f\x35\x30\0\
+\x4c\x42\x42\x30\x5f\x34\x30\0\x4c\x42\x42\x30\x5f\x31\x30\0\0\0\0\0\0\0\0\0\0\
 \0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\xa4\0\0\0\x03\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x6d\x49\0\0\0\0\
-\0\0\x41\x02\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x1a\
-\0\0\0\x01\0\0\0\x06\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x40\0\0\0\0\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\0\0\0\0\0\0\x04\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x31\0\0\0\x01\0\0\0\
-\x06\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x40\0\0\0\0\0\0\0\x18\x13\0\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x2d\0\0\0\x09\0\0\0\x40\0\0\0\0\0\
-\0\0\0\0\0\0\0\0\0\0\x88\x3c\0\0\0\0\0\0\x30\0\0\0\0\0\0\0\x0c\0\0\0\x03\0\0\0\
-\x08\0\0\0\0\0\0\0\x10\0\0\0\0\0\0\0\x38\0\0\0\x01\0\0\0\x03\0\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\0\x58\x13\0\0\0\0\0\0\x78\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x08\0\0\0\0\
-\0\0\0\0\0\0\0\0\0\0\0\x7e\0\0\0\x01\0\0\0\x03\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
-\xd0\x13\0\0\0\0\0\0\x07\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\xb8\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xd8\x13\0\0\0\0\
-\0\0\xe1\x16\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x04\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xb4\
-\0\0\0\x09\0\0\0\x40\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xb8\x3c\0\0\0\0\0\0\x40\0\0\
-\0\0\0\0\0\x0c\0\0\0\x07\0\0\0\x08\0\0\0\0\0\0\0\x10\0\0\0\0\0\0\0\x24\0\0\0\
-\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xbc\x2a\0\0\0\0\0\0\xa0\x0c\0\0\0\0\
-\0\0\0\0\0\0\0\0\0\0\x04\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x20\0\0\0\x09\0\0\0\x40\
-\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xf8\x3c\0\0\0\0\0\0\x70\x0c\0\0\0\0\0\0\x0c\0\0\
-\0\x09\0\0\0\x08\0\0\0\0\0\0\0\x10\0\0\0\0\0\0\0\x6f\0\0\0\x03\x4c\xff\x6f\0\0\
-\0\x80\0\0\0\0\0\0\0\0\0\0\0\0\x68\x49\0\0\0\0\0\0\x05\0\0\0\0\0\0\0\0\0\0\0\0\
-\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xac\0\0\0\x02\0\0\0\0\0\0\0\0\0\0\0\0\
-\0\0\0\0\0\0\0\x60\x37\0\0\0\0\0\0\x28\x05\0\0\0\0\0\0\x01\0\0\0\x32\0\0\0\x08\
-\0\0\0\0\0\0\0\x18\0\0\0\0\0\0\0";
+\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xd2\0\0\0\x03\0\0\0\0\0\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\x6f\x6b\0\0\0\0\0\0\xd4\x02\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x01\0\
+\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x1a\0\0\0\x01\0\0\0\x06\0\0\0\0\0\0\0\0\0\0\0\0\0\
+\0\0\x40\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x04\0\0\0\0\0\0\0\0\0\0\
+\0\0\0\0\0\x31\0\0\0\x01\0\0\0\x06\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x40\0\0\0\0\0\
+\0\0\x48\x1c\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x2d\
+\0\0\0\x09\0\0\0\x40\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xb8\x56\0\0\0\0\0\0\x60\0\0\
+\0\0\0\0\0\x0c\0\0\0\x03\0\0\0\x08\0\0\0\0\0\0\0\x10\0\0\0\0\0\0\0\x4f\0\0\0\
+\x01\0\0\0\x03\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x88\x1c\0\0\0\0\0\0\xc0\0\0\0\0\0\
+\0\0\0\0\0\0\0\0\0\0\x08\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x95\0\0\0\x01\0\0\0\x03\
+\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x48\x1d\0\0\0\0\0\0\x07\0\0\0\0\0\0\0\0\0\0\0\0\
+\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xe6\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\0\0\
+\0\0\0\0\0\0\0\x50\x1d\0\0\0\0\0\0\xe3\x1e\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x04\0\0\
+\0\0\0\0\0\0\0\0\0\0\0\0\0\xe2\0\0\0\x09\0\0\0\x40\0\0\0\0\0\0\0\0\0\0\0\0\0\0\
+\0\x18\x57\0\0\0\0\0\0\x60\0\0\0\0\0\0\0\x0c\0\0\0\x07\0\0\0\x08\0\0\0\0\0\0\0\
+\x10\0\0\0\0\0\0\0\x24\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x34\x3c\
+\0\0\0\0\0\0\x20\x14\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x04\0\0\0\0\0\0\0\0\0\0\0\0\0\
+\0\0\x20\0\0\0\x09\0\0\0\x40\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x78\x57\0\0\0\0\0\0\
+\xf0\x13\0\0\0\0\0\0\x0c\0\0\0\x09\0\0\0\x08\0\0\0\0\0\0\0\x10\0\0\0\0\0\0\0\
+\x86\0\0\0\x03\x4c\xff\x6f\0\0\0\x80\0\0\0\0\0\0\0\0\0\0\0\0\x68\x6b\0\0\0\0\0\
+\0\x07\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x01\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xda\0\0\
+\0\x02\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x58\x50\0\0\0\0\0\0\x60\x06\0\0\0\
+\0\0\0\x01\0\0\0\x3d\0\0\0\x08\0\0\0\0\0\0\0\x18\0\0\0\0\0\0\0";
 
 	*sz = sizeof(data) - 1;
 	return (const void *)data;
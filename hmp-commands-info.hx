@@ -256,6 +256,21 @@ SRST
     Show dynamic compiler info.
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tcg-profile",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the most executed translation blocks",
+    },
+#endif
+
+SRST
+  ``info tcg-profile``
+    Show the most executed translation blocks, as recorded with
+    ``-accel tcg,profile=on``.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
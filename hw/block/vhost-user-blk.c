@@ -354,6 +354,7 @@ static int vhost_user_blk_connect(DeviceState *dev, Error **errp)
 
     s->vhost_user.supports_config = true;
     s->vhost_user.supports_inflight_migration = s->inflight_migration;
+    s->vhost_user.busy_poll_usecs = s->busy_poll_usecs;
     ret = vhost_dev_init(&s->dev, &s->vhost_user, VHOST_BACKEND_TYPE_USER, 0,
                          errp);
     if (ret < 0) {
@@ -618,6 +619,7 @@ static const Property vhost_user_blk_properties[] = {
                      skip_get_vring_base_on_force_shutdown, false),
     DEFINE_PROP_BOOL("inflight-migration", VHostUserBlk,
                      inflight_migration, false),
+    DEFINE_PROP_UINT32("busy-poll-usecs", VHostUserBlk, busy_poll_usecs, 0),
 };
 
 static void vhost_user_blk_class_init(ObjectClass *klass, const void *data)
@@ -51,18 +51,26 @@ static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
     req->mr_next = NULL;
 }
 
-void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
+/* Store the status and restore the iovecs, ready for the used ring */
+static void virtio_blk_req_finish(VirtIOBlockReq *req, unsigned char status)
 {
-    VirtIOBlock *s = req->dev;
-    VirtIODevice *vdev = VIRTIO_DEVICE(s);
-
-    trace_virtio_blk_req_complete(vdev, req, status);
+    trace_virtio_blk_req_complete(VIRTIO_DEVICE(req->dev), req, status);
 
     stb_p(&req->in->status, status);
     iov_discard_undo(&req->inhdr_undo);
     iov_discard_undo(&req->outhdr_undo);
-    virtqueue_push(req->vq, &req->elem, req->in_len);
-    virtio_notify(vdev, req->vq);
+}
+
+void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(req->dev);
+    VirtQueueElement *elem = &req->elem;
+    unsigned int len = req->in_len;
+
+    virtio_blk_req_finish(req, status);
+    if (virtqueue_push_batch(req->vq, &elem, &len, 1)) {
+        virtio_notify(vdev, req->vq);
+    }
 }
 
 static int virtio_blk_handle_rw_error(VirtIOBlockReq *req, int error,
@@ -92,12 +100,39 @@ static int virtio_blk_handle_rw_error(VirtIOBlockReq *req, int error,
     return action != BLOCK_ERROR_ACTION_IGNORE;
 }
 
+static void virtio_blk_push_done(VirtIOBlock *s, VirtQueue *vq,
+                                 VirtQueueElement **elems,
+                                 const unsigned int *lens, unsigned int num)
+{
+    unsigned int i;
+
+    if (!num) {
+        return;
+    }
+    /* An in-order completion that overtook an older request is silent */
+    if (virtqueue_push_batch(vq, elems, lens, num)) {
+        virtio_notify(VIRTIO_DEVICE(s), vq);
+    }
+    for (i = 0; i < num; i++) {
+        g_free(container_of(elems[i], VirtIOBlockReq, elem));
+    }
+}
+
 static void virtio_blk_rw_complete(void *opaque, int ret)
 {
     VirtIOBlockReq *next = opaque;
     VirtIOBlock *s = next->dev;
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtQueue *vq = next->vq;
+    VirtQueueElement *elems[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int lens[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int num_done = 0;
 
+    /*
+     * A merged chain holds at most VIRTIO_BLK_MAX_MERGE_REQS requests;
+     * complete those of each virtqueue with a single used ring update and
+     * a single notification.
+     */
     while (next) {
         VirtIOBlockReq *req = next;
         next = req->mr_next;
@@ -126,10 +161,21 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
             }
         }
 
-        virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
+        if (req->vq != vq) {
+            /* Requests restarted after an error may mix virtqueues */
+            virtio_blk_push_done(s, vq, elems, lens, num_done);
+            vq = req->vq;
+            num_done = 0;
+        }
+        assert(num_done < VIRTIO_BLK_MAX_MERGE_REQS);
+        virtio_blk_req_finish(req, VIRTIO_BLK_S_OK);
         block_acct_done(blk_get_stats(s->blk), &req->acct);
-        g_free(req);
+        elems[num_done] = &req->elem;
+        lens[num_done] = req->in_len;
+        num_done++;
     }
+
+    virtio_blk_push_done(s, vq, elems, lens, num_done);
 }
 
 static void virtio_blk_flush_complete(void *opaque, int ret)
@@ -164,14 +210,20 @@ static void virtio_blk_discard_write_zeroes_complete(void *opaque, int ret)
     g_free(req);
 }
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
+/* Number of requests popped from the virtqueue at a time */
+#define VIRTIO_BLK_POP_BATCH 32
+
+static unsigned int virtio_blk_get_requests(VirtIOBlock *s, VirtQueue *vq,
+                                            VirtIOBlockReq **reqs,
+                                            unsigned int max)
 {
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
+    unsigned int i, n;
 
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
+    n = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq), (void **)reqs, max);
+    for (i = 0; i < n; i++) {
+        virtio_blk_init_request(s, vq, reqs[i]);
     }
-    return req;
+    return n;
 }
 
 static void virtio_blk_handle_scsi(VirtIOBlockReq *req)
@@ -976,9 +1028,10 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
 void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
+    VirtIOBlockReq *reqs[VIRTIO_BLK_POP_BATCH];
     MultiReqBuffer mrb = {};
     bool suppress_notifications = virtio_queue_get_notification(vq);
+    unsigned int i, n;
 
     defer_call_begin();
 
@@ -987,10 +1040,19 @@ void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_blk_get_request(s, vq))) {
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                g_free(req);
+        while ((n = virtio_blk_get_requests(s, vq, reqs,
+                                            VIRTIO_BLK_POP_BATCH))) {
+            for (i = 0; i < n; i++) {
+                if (virtio_blk_handle_request(reqs[i], &mrb)) {
+                    break;
+                }
+            }
+            if (i < n) {
+                /* The device is broken, drop the rest of the batch */
+                for (; i < n; i++) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    g_free(reqs[i]);
+                }
                 break;
             }
         }
@@ -1262,6 +1324,14 @@ static uint64_t virtio_blk_get_features(VirtIODevice *vdev, uint64_t features,
     if (s->conf.num_queues > 1) {
         virtio_add_feature(&features, VIRTIO_BLK_F_MQ);
     }
+    /*
+     * On the packed layout, in-order completion lets a whole run of
+     * finished requests go back to the guest as one used descriptor.
+     */
+    if (s->conf.packed_in_order &&
+        virtio_has_feature(features, VIRTIO_F_RING_PACKED)) {
+        virtio_add_feature(&features, VIRTIO_F_IN_ORDER);
+    }
 
     return features;
 }
@@ -1775,7 +1845,11 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
     s->sector_mask = (s->conf.conf.logical_block_size / BDRV_SECTOR_SIZE) - 1;
 
     for (i = 0; i < conf->num_queues; i++) {
-        virtio_add_queue(vdev, conf->queue_size, virtio_blk_handle_output);
+        VirtQueue *vq = virtio_add_queue(vdev, conf->queue_size,
+                                         virtio_blk_handle_output);
+
+        /* Requests always report their full in_len */
+        virtio_queue_set_used_batching(vq, true);
     }
     qemu_coroutine_inc_pool_size(conf->num_queues * conf->queue_size / 2);
 
@@ -1881,6 +1955,8 @@ static const Property virtio_blk_properties[] = {
                        conf.max_write_zeroes_sectors, BDRV_REQUEST_MAX_SECTORS),
     DEFINE_PROP_BOOL("x-enable-wce-if-config-wce", VirtIOBlock,
                      conf.x_enable_wce_if_config_wce, true),
+    DEFINE_PROP_BOOL("packed-in-order", VirtIOBlock,
+                     conf.packed_in_order, true),
 };
 
 static void virtio_blk_class_init(ObjectClass *klass, const void *data)
@@ -31,6 +31,7 @@
 #include "net/vhost_net.h"
 #include "net/announce.h"
 #include "hw/virtio/virtio-bus.h"
+#include "hw/virtio/iothread-vq-mapping.h"
 #include "qapi/error.h"
 #include "qapi/qapi-events-net.h"
 #include "hw/core/qdev-properties.h"
@@ -46,6 +47,9 @@
 #include "monitor/monitor.h"
 #include "hw/pci/pci_device.h"
 #include "net_rx_pkt.h"
+#include "net/eth.h"
+#include "qemu/xxhash.h"
+#include "qapi/visitor.h"
 #include "hw/virtio/vhost.h"
 #include "system/qtest.h"
 
@@ -241,12 +245,101 @@ static bool virtio_net_started(VirtIONet *n, uint8_t status)
         (n->status & VIRTIO_NET_S_LINK_UP) && vdev->vm_running;
 }
 
+/* The device status as seen by queue pair @i */
+static uint8_t virtio_net_queue_status(VirtIONet *n, int i, uint8_t status)
+{
+    if ((!n->multiqueue && i != 0) || i >= n->curr_queue_pairs) {
+        return 0;
+    }
+    return status;
+}
+
+/* Context: BH in the IOThread that processes @opaque */
+static void virtio_net_quiesce_queue_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    VirtIONet *n = q->n;
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    /* tx=timer is rejected, so deleted queue pairs have no tx_bh */
+    if (q->tx_bh) {
+        virtio_queue_aio_detach_host_notifier(q->rx_vq, ctx);
+        virtio_queue_aio_detach_host_notifier(q->tx_vq, ctx);
+        qemu_bh_cancel(q->tx_bh);
+    }
+    qemu_set_net_aio_context(n->nic->ncs[q - n->vqs].peer, NULL);
+}
+
+/*
+ * Queue pairs that run in an IOThread share state with the main loop: the
+ * rx filters, RSS, the link status, the number of queue pairs and the
+ * backends.  Stop the IOThreads from processing them while that state
+ * changes: the host notifiers are detached, the TX bottom halves are
+ * cancelled and the backends move to the main loop.  Sections can nest.
+ *
+ * Context: BQL held
+ */
+static void virtio_net_quiesce_begin(VirtIONet *n)
+{
+    int i;
+
+    if (!n->vq_aio_context || n->quiesce_depth++) {
+        return;
+    }
+
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        aio_wait_bh_oneshot(n->vq_aio_context[i], virtio_net_quiesce_queue_bh,
+                            &n->vqs[i]);
+    }
+}
+
+/*
+ * @status is the device status once the section ends, the queue pairs that
+ * are started then get their TX bottom half back.
+ *
+ * Context: BQL held
+ */
+static void virtio_net_quiesce_end_status(VirtIONet *n, uint8_t status)
+{
+    VirtioBusState *bus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(n)));
+    int i;
+
+    if (!n->vq_aio_context || --n->quiesce_depth) {
+        return;
+    }
+
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+        AioContext *ctx = n->vq_aio_context[i];
+
+        if (q->tx_bh) {
+            if (bus->ioeventfd_started) {
+                /* This also kicks the virtqueues */
+                virtio_queue_aio_attach_host_notifier(q->rx_vq, ctx);
+                virtio_queue_aio_attach_host_notifier(q->tx_vq, ctx);
+            }
+            if (q->tx_waiting &&
+                virtio_net_started(n, virtio_net_queue_status(n, i, status))) {
+                replay_bh_schedule_event(q->tx_bh);
+            }
+        }
+        qemu_set_net_aio_context(n->nic->ncs[i].peer, ctx);
+    }
+}
+
+static void virtio_net_quiesce_end(VirtIONet *n)
+{
+    virtio_net_quiesce_end_status(n, VIRTIO_DEVICE(n)->status);
+}
+
 static void virtio_net_announce_notify(VirtIONet *net)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(net);
     trace_virtio_net_announce_notify();
 
+    virtio_net_quiesce_begin(net);
     net->status |= VIRTIO_NET_S_ANNOUNCE;
+    virtio_net_quiesce_end(net);
     virtio_notify_config(vdev);
 }
 
@@ -401,6 +494,31 @@ static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
     }
 }
 
+/*
+ * Queue pairs that run in an IOThread raise interrupts through the guest
+ * notifiers, see virtio_irq().
+ */
+static void virtio_net_set_guest_notifiers(VirtIONet *n, bool assign)
+{
+    BusState *qbus = qdev_get_parent_bus(DEVICE(n));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int r;
+
+    if (!n->vq_aio_context || n->guest_notifiers_set == assign ||
+        !k->set_guest_notifiers) {
+        return;
+    }
+
+    r = k->set_guest_notifiers(qbus->parent, n->max_queue_pairs * 2 + 1,
+                               assign);
+    if (r < 0) {
+        error_report("virtio-net: failed to %s guest notifiers (%d)",
+                     assign ? "set" : "unset", r);
+        return;
+    }
+    n->guest_notifiers_set = assign;
+}
+
 static int virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
@@ -408,19 +526,18 @@ static int virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
     int i;
     uint8_t queue_status;
 
+    virtio_net_quiesce_begin(n);
     virtio_net_vnet_endian_status(n, status);
     virtio_net_vhost_status(n, status);
+    virtio_net_set_guest_notifiers(n, virtio_net_started(n, status) &&
+                                      !n->vhost_started);
 
     for (i = 0; i < n->max_queue_pairs; i++) {
         NetClientState *ncs = qemu_get_subqueue(n->nic, i);
         bool queue_started;
         q = &n->vqs[i];
 
-        if ((!n->multiqueue && i != 0) || i >= n->curr_queue_pairs) {
-            queue_status = 0;
-        } else {
-            queue_status = status;
-        }
+        queue_status = virtio_net_queue_status(n, i, status);
         queue_started =
             virtio_net_started(n, queue_status) && !n->vhost_started;
 
@@ -436,6 +553,8 @@ static int virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
             if (q->tx_timer) {
                 timer_mod(q->tx_timer,
                                qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + n->tx_timeout);
+            } else if (n->vq_aio_context) {
+                /* Scheduled by virtio_net_quiesce_end_status() */
             } else {
                 replay_bh_schedule_event(q->tx_bh);
             }
@@ -456,6 +575,7 @@ static int virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
             }
         }
     }
+    virtio_net_quiesce_end_status(n, status);
     return 0;
 }
 
@@ -465,6 +585,7 @@ static void virtio_net_set_link_status(NetClientState *nc)
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
     uint16_t old_status = n->status;
 
+    virtio_net_quiesce_begin(n);
     if (nc->link_down)
         n->status &= ~VIRTIO_NET_S_LINK_UP;
     else
@@ -474,6 +595,7 @@ static void virtio_net_set_link_status(NetClientState *nc)
         virtio_notify_config(vdev);
 
     virtio_net_set_status(vdev, vdev->status);
+    virtio_net_quiesce_end(n);
 }
 
 static void rxfilter_notify(NetClientState *nc)
@@ -939,6 +1061,8 @@ static void virtio_net_set_features(VirtIODevice *vdev,
         virtio_clear_feature_ex(features, VIRTIO_NET_F_MTU);
     }
 
+    virtio_net_quiesce_begin(n);
+
     virtio_net_set_multiqueue(n,
                               virtio_has_feature_ex(features,
                                                     VIRTIO_NET_F_RSS) ||
@@ -987,6 +1111,7 @@ static void virtio_net_set_features(VirtIODevice *vdev,
         bool vlan = virtio_has_feature_ex(features, VIRTIO_NET_F_CTRL_VLAN);
         memset(n->vlans, vlan ? 0 : 0xff, MAX_VLAN >> 3);
     }
+    virtio_net_quiesce_end(n);
 
     if (virtio_has_feature_ex(features, VIRTIO_NET_F_STANDBY)) {
         qapi_event_send_failover_negotiated(n->netclient_name);
@@ -1251,6 +1376,7 @@ static bool virtio_net_attach_ebpf_rss(VirtIONet *n)
     }
 
     rss_data_to_rss_config(&n->rss_data, &config);
+    config.flow_affinity = n->flow_affinity;
 
     if (!ebpf_rss_set_all(&n->ebpf_rss, &config,
                           n->rss_data.indirections_table, n->rss_data.key,
@@ -1270,15 +1396,46 @@ static void virtio_net_detach_ebpf_rss(VirtIONet *n)
     virtio_net_attach_ebpf_to_backend(n->nic, -1);
 }
 
+/*
+ * When the eBPF program is loaded, the flow table is its map so that the
+ * steering done in the kernel sees the flows recorded on transmit.
+ */
+static uint64_t *virtio_net_flow_table(VirtIONet *n)
+{
+    if (!n->flow_table) {
+        return NULL;
+    }
+    return ebpf_rss_flow_table(&n->ebpf_rss) ?: n->flow_table;
+}
+
+/*
+ * Forget the queue of every flow.  The entries refer to queues chosen
+ * under the old RSS configuration and queue count, and would otherwise
+ * keep steering to queues that are no longer in use.
+ *
+ * Context: BQL held, IOThreads quiesced
+ */
+static void virtio_net_flow_clear(VirtIONet *n)
+{
+    uint64_t *flow_table = virtio_net_flow_table(n);
+
+    if (flow_table) {
+        memset(flow_table, 0,
+               VIRTIO_NET_FLOW_TABLE_SIZE * sizeof(*flow_table));
+    }
+}
+
 static void virtio_net_commit_rss_config(VirtIONet *n)
 {
+    virtio_net_flow_clear(n);
+
     if (n->rss_data.peer_hash_available) {
         return;
     }
 
     if (n->rss_data.enabled) {
         n->rss_data.enabled_software_rss = n->rss_data.populate_hash;
-        if (n->rss_data.populate_hash) {
+        if (n->rss_data.enabled_software_rss) {
             virtio_net_detach_ebpf_rss(n);
         } else if (!virtio_net_attach_ebpf_rss(n)) {
             if (get_vhost_net(qemu_get_queue(n->nic)->peer)) {
@@ -1329,7 +1486,8 @@ static bool virtio_net_load_ebpf_fds(VirtIONet *n, Error **errp)
         }
     }
 
-    ret = ebpf_rss_load_fds(&n->ebpf_rss, fds[0], fds[1], fds[2], fds[3], errp);
+    ret = ebpf_rss_load_fds(&n->ebpf_rss, fds[0], fds[1], fds[2], fds[3],
+                            fds[4], fds[5], errp);
 
 exit:
     if (!ret) {
@@ -1531,6 +1689,9 @@ static int virtio_net_handle_mq(VirtIONet *n, uint8_t cmd,
         return VIRTIO_NET_ERR;
     }
 
+    if (n->curr_queue_pairs != queue_pairs) {
+        virtio_net_flow_clear(n);
+    }
     n->curr_queue_pairs = queue_pairs;
     if (nc->peer && nc->peer->info->type == NET_CLIENT_DRIVER_VHOST_VDPA) {
         /*
@@ -1567,6 +1728,7 @@ size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
     iov2 = iov = g_memdup2(out_sg, sizeof(struct iovec) * out_num);
     s = iov_to_buf(iov, out_num, 0, &ctrl, sizeof(ctrl));
     iov_discard_front(&iov, &out_num, sizeof(ctrl));
+    virtio_net_quiesce_begin(n);
     if (s != sizeof(ctrl)) {
         status = VIRTIO_NET_ERR;
     } else if (ctrl.class == VIRTIO_NET_CTRL_RX) {
@@ -1582,6 +1744,7 @@ size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
     } else if (ctrl.class == VIRTIO_NET_CTRL_GUEST_OFFLOADS) {
         status = virtio_net_handle_offloads(n, ctrl.cmd, iov, out_num);
     }
+    virtio_net_quiesce_end(n);
 
     s = iov_from_buf(in_sg, in_num, 0, &status, sizeof(status));
     assert(s == sizeof(status));
@@ -1845,6 +2008,138 @@ static uint8_t virtio_net_get_hash_type(bool hasip4,
     return 0xff;
 }
 
+/*
+ * Hash the TCP/UDP 5-tuple of a packet so that both directions of a flow
+ * get the same value.  Returns 0 for packets that are not part of a flow.
+ */
+static uint32_t virtio_net_flow_hash(const struct iovec *iov, int iovcnt,
+                                     size_t iovoff)
+{
+    bool hasip4, hasip6;
+    size_t l3off, l4off, l5off;
+    eth_ip6_hdr_info ip6info;
+    eth_ip4_hdr_info ip4info;
+    eth_l4_hdr_info l4info;
+    uint64_t src, dst, tmp;
+    uint16_t sport, dport;
+    uint8_t proto;
+
+    eth_get_protocols(iov, iovcnt, iovoff, &hasip4, &hasip6,
+                      &l3off, &l4off, &l5off, &ip6info, &ip4info, &l4info);
+
+    switch (l4info.proto) {
+    case ETH_L4_HDR_PROTO_TCP:
+        proto = IP_PROTO_TCP;
+        sport = l4info.hdr.tcp.th_sport;
+        dport = l4info.hdr.tcp.th_dport;
+        break;
+    case ETH_L4_HDR_PROTO_UDP:
+        proto = IP_PROTO_UDP;
+        sport = l4info.hdr.udp.uh_sport;
+        dport = l4info.hdr.udp.uh_dport;
+        break;
+    default:
+        return 0;
+    }
+
+    if (hasip4) {
+        src = ip4info.ip4_hdr.ip_src;
+        dst = ip4info.ip4_hdr.ip_dst;
+    } else if (hasip6) {
+        src = ldq_he_p(&ip6info.ip6_hdr.ip6_src) ^
+              ldq_he_p((uint8_t *)&ip6info.ip6_hdr.ip6_src + 8);
+        dst = ldq_he_p(&ip6info.ip6_hdr.ip6_dst) ^
+              ldq_he_p((uint8_t *)&ip6info.ip6_hdr.ip6_dst + 8);
+    } else {
+        return 0;
+    }
+
+    if (src > dst || (src == dst && sport > dport)) {
+        tmp = src;
+        src = dst;
+        dst = tmp;
+        tmp = sport;
+        sport = dport;
+        dport = tmp;
+    }
+
+    return qemu_xxhash8(src, dst, proto, sport, dport) ?: 1;
+}
+
+static bool virtio_net_flow_affinity_active(VirtIONet *n)
+{
+    return n->flow_table && n->rss_data.enabled;
+}
+
+static void virtio_net_flow_record(VirtIONet *n, const struct iovec *iov,
+                                   int iovcnt, int queue_index)
+{
+    uint32_t hash = virtio_net_flow_hash(iov, iovcnt, n->guest_hdr_len);
+    uint64_t *entry;
+
+    if (!hash) {
+        return;
+    }
+
+    entry = &virtio_net_flow_table(n)[hash &
+                                      (VIRTIO_NET_FLOW_TABLE_SIZE - 1)];
+    if (qatomic_read(entry) != ((uint64_t)hash << 32 | (queue_index + 1))) {
+        qatomic_set(entry, (uint64_t)hash << 32 | (queue_index + 1));
+        stat64_inc(&n->flow_updates);
+    }
+}
+
+static int virtio_net_flow_lookup(VirtIONet *n, const uint8_t *buf,
+                                  size_t size)
+{
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = size
+    };
+    uint32_t hash = virtio_net_flow_hash(&iov, 1, n->host_hdr_len);
+    uint64_t entry;
+
+    if (!hash) {
+        return -1;
+    }
+
+    entry = qatomic_read(&virtio_net_flow_table(n)[hash &
+                                        (VIRTIO_NET_FLOW_TABLE_SIZE - 1)]);
+    if (entry >> 32 != hash || !(uint32_t)entry) {
+        stat64_inc(&n->flow_misses);
+        return -1;
+    }
+
+    stat64_inc(&n->flow_hits);
+    return (uint32_t)entry - 1;
+}
+
+static void virtio_net_get_flow_affinity_stats(Object *obj, Visitor *v,
+                                               const char *name,
+                                               void *opaque, Error **errp)
+{
+    VirtIONet *n = VIRTIO_NET(obj);
+    uint64_t updates = stat64_get(&n->flow_updates);
+    uint64_t hits, misses;
+    bool ok;
+
+    /* Packets steered by the eBPF program are counted in its map */
+    ebpf_rss_get_flow_stats(&n->ebpf_rss, &hits, &misses);
+    hits += stat64_get(&n->flow_hits);
+    misses += stat64_get(&n->flow_misses);
+
+    if (!visit_start_struct(v, name, NULL, 0, errp)) {
+        return;
+    }
+    ok = visit_type_uint64(v, "updates", &updates, errp) &&
+         visit_type_uint64(v, "hits", &hits, errp) &&
+         visit_type_uint64(v, "misses", &misses, errp);
+    if (ok) {
+        visit_check_struct(v, errp);
+    }
+    visit_end_struct(v, NULL);
+}
+
 static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
                                   size_t size,
                                   struct virtio_net_hdr_v1_hash *hdr)
@@ -1894,8 +2189,15 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
     }
 
     if (n->rss_data.redirect) {
-        new_index = hash & (n->rss_data.indirections_len - 1);
-        new_index = n->rss_data.indirections_table[new_index];
+        int flow_index = n->flow_table ?
+                         virtio_net_flow_lookup(n, buf, size) : -1;
+
+        if (flow_index >= 0) {
+            new_index = flow_index;
+        } else {
+            new_index = hash & (n->rss_data.indirections_len - 1);
+            new_index = n->rss_data.indirections_table[new_index];
+        }
     }
 
     return (index == new_index) ? -1 : new_index;
@@ -1908,7 +2210,7 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     VirtIONetQueue *q;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
     QEMU_UNINITIALIZED VirtQueueElement *elems[VIRTQUEUE_MAX_SIZE];
-    QEMU_UNINITIALIZED size_t lens[VIRTQUEUE_MAX_SIZE];
+    QEMU_UNINITIALIZED unsigned int lens[VIRTQUEUE_MAX_SIZE];
     QEMU_UNINITIALIZED struct iovec mhdr_sg[VIRTQUEUE_MAX_SIZE];
     struct virtio_net_hdr_v1_hash extra_hdr;
     unsigned mhdr_cnt = 0;
@@ -1920,7 +2222,13 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     if (n->rss_data.enabled && n->rss_data.enabled_software_rss) {
         int index = virtio_net_process_rss(nc, buf, size, &extra_hdr);
         if (index >= 0) {
-            nc = qemu_get_subqueue(n->nic, index % n->curr_queue_pairs);
+            index %= n->curr_queue_pairs;
+            /* Only steer to queues served by the current thread */
+            if (!n->vq_aio_context ||
+                n->vq_aio_context[index] ==
+                n->vq_aio_context[nc->queue_index]) {
+                nc = qemu_get_subqueue(n->nic, index);
+            }
         }
     }
 
@@ -2033,13 +2341,11 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
                      sizeof extra_hdr.hdr.num_buffers);
     }
 
+    /* signal other side */
+    virtqueue_push_batch(q->rx_vq, elems, lens, i);
     for (j = 0; j < i; j++) {
-        /* signal other side */
-        virtqueue_fill(q->rx_vq, elems[j], lens[j], j);
         g_free(elems[j]);
     }
-
-    virtqueue_flush(q->rx_vq, i);
     virtio_notify(vdev, q->rx_vq);
 
     return size;
@@ -2715,13 +3021,90 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 }
 
 /* TX */
+/* Number of packets popped from the TX virtqueue at a time */
+#define VIRTIO_NET_TX_BATCH 64
+
+/*
+ * Send the packet in @elem.  Returns 1 if the packet is done with (sent or
+ * dropped), 0 if the peer queued it and will complete it through
+ * virtio_net_tx_complete(), or -EINVAL if the device is now broken.
+ */
+static int virtio_net_tx_one(VirtIONetQueue *q, VirtQueueElement *elem)
+{
+    VirtIONet *n = q->n;
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
+    ssize_t ret;
+    unsigned int out_num;
+    struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
+    struct virtio_net_hdr *vhdr = &q->async_tx.vhdr;
+
+    out_num = elem->out_num;
+    out_sg = elem->out_sg;
+    if (out_num < 1) {
+        virtio_error(vdev, "virtio-net header not in first element");
+        return -EINVAL;
+    }
+
+    if (n->needs_vnet_hdr_swap) {
+        if (iov_to_buf(out_sg, out_num, 0, vhdr, sizeof(*vhdr)) <
+            sizeof(*vhdr)) {
+            virtio_error(vdev, "virtio-net header incorrect");
+            return -EINVAL;
+        }
+        virtio_net_hdr_swap(vdev, vhdr);
+        sg2[0].iov_base = vhdr;
+        sg2[0].iov_len = sizeof(*vhdr);
+        out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1, out_sg, out_num,
+                           sizeof(*vhdr), -1);
+        if (out_num == VIRTQUEUE_MAX_SIZE) {
+            return 1;
+        }
+        out_num += 1;
+        out_sg = sg2;
+    }
+    /*
+     * If host wants to see the guest header as is, we can
+     * pass it on unchanged. Otherwise, copy just the parts
+     * that host is interested in.
+     */
+    assert(n->host_hdr_len <= n->guest_hdr_len);
+    if (n->host_hdr_len != n->guest_hdr_len) {
+        if (iov_size(out_sg, out_num) < n->guest_hdr_len) {
+            virtio_error(vdev, "virtio-net header is invalid");
+            return -EINVAL;
+        }
+        unsigned sg_num = iov_copy(sg, ARRAY_SIZE(sg),
+                                   out_sg, out_num,
+                                   0, n->host_hdr_len);
+        sg_num += iov_copy(sg + sg_num, ARRAY_SIZE(sg) - sg_num,
+                         out_sg, out_num,
+                         n->guest_hdr_len, -1);
+        out_num = sg_num;
+        out_sg = sg;
+
+        if (out_num < 1) {
+            virtio_error(vdev, "virtio-net nothing to send");
+            return -EINVAL;
+        }
+    }
+
+    if (virtio_net_flow_affinity_active(n)) {
+        virtio_net_flow_record(n, elem->out_sg, elem->out_num, queue_index);
+    }
+
+    /* elem stays mapped until virtio_net_tx_complete(), no need to copy */
+    ret = qemu_sendv_packet_async_stable(qemu_get_subqueue(n->nic, queue_index),
+                                         out_sg, out_num,
+                                         virtio_net_tx_complete);
+    return ret != 0;
+}
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
-    VirtQueueElement *elem;
     int32_t num_packets = 0;
-    int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
         return num_packets;
     }
@@ -2731,90 +3114,57 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         return num_packets;
     }
 
-    for (;;) {
-        ssize_t ret;
-        unsigned int out_num;
-        struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
-        struct virtio_net_hdr vhdr;
+    while (num_packets < n->tx_burst) {
+        VirtQueueElement *elems[VIRTIO_NET_TX_BATCH];
+        unsigned int lens[VIRTIO_NET_TX_BATCH] = {};
+        unsigned int i, j, count;
+        int ret = 1;
 
-        elem = virtqueue_pop(q->tx_vq, sizeof(VirtQueueElement));
-        if (!elem) {
+        count = virtqueue_pop_batch(q->tx_vq, sizeof(VirtQueueElement),
+                                    (void **)elems,
+                                    MIN(n->tx_burst - num_packets,
+                                        VIRTIO_NET_TX_BATCH));
+        if (!count) {
             break;
         }
 
-        out_num = elem->out_num;
-        out_sg = elem->out_sg;
-        if (out_num < 1) {
-            virtio_error(vdev, "virtio-net header not in first element");
-            goto detach;
-        }
-
-        if (n->needs_vnet_hdr_swap) {
-            if (iov_to_buf(out_sg, out_num, 0, &vhdr, sizeof(vhdr)) <
-                sizeof(vhdr)) {
-                virtio_error(vdev, "virtio-net header incorrect");
-                goto detach;
-            }
-            virtio_net_hdr_swap(vdev, &vhdr);
-            sg2[0].iov_base = &vhdr;
-            sg2[0].iov_len = sizeof(vhdr);
-            out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1, out_sg, out_num,
-                               sizeof(vhdr), -1);
-            if (out_num == VIRTQUEUE_MAX_SIZE) {
-                goto drop;
+        for (i = 0; i < count; i++) {
+            ret = virtio_net_tx_one(q, elems[i]);
+            if (ret <= 0) {
+                break;
             }
-            out_num += 1;
-            out_sg = sg2;
         }
-        /*
-         * If host wants to see the guest header as is, we can
-         * pass it on unchanged. Otherwise, copy just the parts
-         * that host is interested in.
-         */
-        assert(n->host_hdr_len <= n->guest_hdr_len);
-        if (n->host_hdr_len != n->guest_hdr_len) {
-            if (iov_size(out_sg, out_num) < n->guest_hdr_len) {
-                virtio_error(vdev, "virtio-net header is invalid");
-                goto detach;
-            }
-            unsigned sg_num = iov_copy(sg, ARRAY_SIZE(sg),
-                                       out_sg, out_num,
-                                       0, n->host_hdr_len);
-            sg_num += iov_copy(sg + sg_num, ARRAY_SIZE(sg) - sg_num,
-                             out_sg, out_num,
-                             n->guest_hdr_len, -1);
-            out_num = sg_num;
-            out_sg = sg;
-
-            if (out_num < 1) {
-                virtio_error(vdev, "virtio-net nothing to send");
-                goto detach;
+
+        /* Complete everything that was sent or dropped at once */
+        if (i) {
+            virtqueue_push_batch(q->tx_vq, elems, lens, i);
+            virtio_notify(vdev, q->tx_vq);
+            for (j = 0; j < i; j++) {
+                g_free(elems[j]);
             }
+            num_packets += i;
         }
 
-        ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
-                                      out_sg, out_num, virtio_net_tx_complete);
         if (ret == 0) {
+            /* Give back the packets behind the one the peer queued */
+            for (j = count; j-- > i + 1;) {
+                virtqueue_unpop(q->tx_vq, elems[j], 0);
+                g_free(elems[j]);
+            }
             virtio_queue_set_notification(q->tx_vq, 0);
-            q->async_tx.elem = elem;
+            q->async_tx.elem = elems[i];
             return -EBUSY;
         }
 
-drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
-        g_free(elem);
-
-        if (++num_packets >= n->tx_burst) {
-            break;
+        if (ret < 0) {
+            for (j = i; j < count; j++) {
+                virtqueue_detach_element(q->tx_vq, elems[j], 0);
+                g_free(elems[j]);
+            }
+            return -EINVAL;
         }
     }
     return num_packets;
-
-detach:
-    virtqueue_detach_element(q->tx_vq, elem, 0);
-    g_free(elem);
-    return -EINVAL;
 }
 
 static void virtio_net_tx_timer(void *opaque);
@@ -2976,6 +3326,7 @@ static void virtio_net_tx_bh(void *opaque)
 static void virtio_net_add_queue(VirtIONet *n, int index)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    AioContext *ctx = n->vq_aio_context ? n->vq_aio_context[index] : NULL;
 
     n->vqs[index].rx_vq = virtio_add_queue(vdev, n->net_conf.rx_queue_size,
                                            virtio_net_handle_rx);
@@ -2991,10 +3342,16 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
         n->vqs[index].tx_vq =
             virtio_add_queue(vdev, n->net_conf.tx_queue_size,
                              virtio_net_handle_tx_bh);
-        n->vqs[index].tx_bh = qemu_bh_new_guarded(virtio_net_tx_bh, &n->vqs[index],
-                                                  &DEVICE(vdev)->mem_reentrancy_guard);
+        n->vqs[index].tx_bh = aio_bh_new_guarded(ctx ?: qemu_get_aio_context(),
+                                                 virtio_net_tx_bh,
+                                                 &n->vqs[index],
+                                                 &DEVICE(vdev)->mem_reentrancy_guard);
     }
 
+    /* tx=timer is rejected together with iothread-vq-mapping */
+    virtio_queue_set_host_notifier_ctx(n->vqs[index].rx_vq, ctx);
+    virtio_queue_set_host_notifier_ctx(n->vqs[index].tx_vq, ctx);
+
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
 }
@@ -3187,6 +3544,7 @@ static int virtio_net_post_load_device(void *opaque, int version_id)
     bool has_tunnel_hdr = virtio_has_tunnel_hdr(vdev->guest_features_ex);
 
     trace_virtio_net_post_load_device();
+    virtio_net_quiesce_begin(n);
     virtio_net_set_mrg_rx_bufs(n, n->mergeable_rx_bufs,
                                virtio_vdev_has_feature(vdev,
                                                        VIRTIO_F_VERSION_1),
@@ -3242,6 +3600,7 @@ static int virtio_net_post_load_device(void *opaque, int version_id)
     }
 
     virtio_net_commit_rss_config(n);
+    virtio_net_quiesce_end(n);
     return 0;
 }
 
@@ -3864,6 +4223,71 @@ static bool failover_hide_primary_device(DeviceListener *listener,
     return qatomic_read(&n->failover_primary_hidden);
 }
 
+/*
+ * Each queue pair, and the backend queue that feeds it, runs in the
+ * IOThread that iothread-vq-mapping assigns to it.  The vqs listed in the
+ * mapping are queue pair indices, the control virtqueue stays in the main
+ * loop.
+ */
+static bool virtio_net_vq_aio_context_init(VirtIONet *n, Error **errp)
+{
+    int i;
+
+    if (n->net_conf.tx && !strcmp(n->net_conf.tx, "timer")) {
+        error_setg(errp, "iothread-vq-mapping requires tx=bh");
+        return false;
+    }
+
+    /* Virtqueue handlers must not run in vCPU threads */
+    if (!virtio_device_ioeventfd_enabled(VIRTIO_DEVICE(n))) {
+        error_setg(errp, "ioeventfd is required for iothread-vq-mapping");
+        return false;
+    }
+
+    for (i = 0; i < n->nic_conf.peers.queues; i++) {
+        NetClientState *peer = n->nic_conf.peers.ncs[i];
+
+        if (peer->is_datapath && !peer->info->set_aio_context) {
+            error_setg(errp, "netdev '%s' does not support "
+                       "iothread-vq-mapping", peer->name);
+            return false;
+        }
+        if (get_vhost_net(peer)) {
+            error_setg(errp, "iothread-vq-mapping cannot be used with vhost "
+                       "(netdev '%s')", peer->name);
+            return false;
+        }
+    }
+
+    n->vq_aio_context = g_new(AioContext *, n->max_queue_pairs);
+    if (!iothread_vq_mapping_apply(n->net_conf.iothread_vq_mapping_list,
+                                   n->vq_aio_context, n->max_queue_pairs,
+                                   errp)) {
+        g_free(n->vq_aio_context);
+        n->vq_aio_context = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void virtio_net_vq_aio_context_cleanup(VirtIONet *n)
+{
+    int i;
+
+    if (!n->vq_aio_context) {
+        return;
+    }
+
+    /* Hand the backends back to the main loop */
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        qemu_set_net_aio_context(n->nic->ncs[i].peer, NULL);
+    }
+
+    iothread_vq_mapping_cleanup(n->net_conf.iothread_vq_mapping_list);
+    g_free(n->vq_aio_context);
+    n->vq_aio_context = NULL;
+}
+
 static void virtio_net_device_realize(DeviceState *dev, Error **errp)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(dev);
@@ -3897,6 +4321,25 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         n->host_features |= (1ULL << VIRTIO_NET_F_SPEED_DUPLEX);
     }
 
+    for (i = 0; n->flow_affinity && i < n->nic_conf.peers.queues; i++) {
+        NetClientState *peer = n->nic_conf.peers.ncs[i];
+        uint32_t peer_hash_types;
+
+        /* Flows are learnt from transmitted packets, which vhost hides */
+        if (get_vhost_net(peer)) {
+            error_setg(errp, "flow-affinity cannot be used with vhost "
+                       "(netdev '%s')", peer->name);
+            return;
+        }
+        /* Such a netdev steers received packets itself */
+        if (qemu_get_vnet_hash_supported_types(peer, &peer_hash_types)) {
+            error_setg(errp, "flow-affinity cannot be used with a netdev "
+                       "that computes the hash itself (netdev '%s')",
+                       peer->name);
+            return;
+        }
+    }
+
     if (n->failover) {
         n->primary_listener.hide_device = failover_hide_primary_device;
         qatomic_set(&n->failover_primary_hidden, true);
@@ -3958,6 +4401,17 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         virtio_cleanup(vdev);
         return;
     }
+
+    if (n->net_conf.iothread_vq_mapping_list &&
+        !virtio_net_vq_aio_context_init(n, errp)) {
+        virtio_cleanup(vdev);
+        return;
+    }
+
+    if (n->flow_affinity) {
+        n->flow_table = g_new0(uint64_t, VIRTIO_NET_FLOW_TABLE_SIZE);
+    }
+
     n->vqs = g_new0(VirtIONetQueue, n->max_queue_pairs);
     n->curr_queue_pairs = 1;
     n->tx_timeout = n->net_conf.txtimer;
@@ -3999,6 +4453,11 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
 
     for (i = 0; i < n->max_queue_pairs; i++) {
         n->nic->ncs[i].do_not_pad = true;
+        if (n->vq_aio_context) {
+            /* Checked in virtio_net_vq_aio_context_init() */
+            qemu_set_net_aio_context(n->nic->ncs[i].peer,
+                                     n->vq_aio_context[i]);
+        }
     }
 
     peer_test_vnet_hdr(n);
@@ -4060,6 +4519,8 @@ static void virtio_net_device_unrealize(DeviceState *dev)
 
     /* This will stop vhost backend if appropriate. */
     virtio_net_set_status(vdev, 0);
+    /* Keep the IOThreads away from the queues for good */
+    virtio_net_quiesce_begin(n);
 
     g_free(n->netclient_name);
     n->netclient_name = NULL;
@@ -4085,9 +4546,12 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     virtio_del_queue(vdev, max_queue_pairs * 2);
     qemu_announce_timer_del(&n->announce_timer, false);
     g_free(n->vqs);
+    virtio_net_vq_aio_context_cleanup(n);
     qemu_del_nic(n->nic);
     virtio_net_rsc_cleanup(n);
     g_free(n->rss_data.indirections_table);
+    g_free(n->flow_table);
+    n->flow_table = NULL;
     net_rx_pkt_uninit(n->rx_pkt);
     virtio_cleanup(vdev);
 }
@@ -4097,6 +4561,8 @@ static void virtio_net_reset(VirtIODevice *vdev)
     VirtIONet *n = VIRTIO_NET(vdev);
     int i;
 
+    virtio_net_quiesce_begin(n);
+
     /* Reset back to compatibility mode */
     n->promisc = 1;
     n->allmulti = 0;
@@ -4125,6 +4591,8 @@ static void virtio_net_reset(VirtIODevice *vdev)
     }
 
     virtio_net_disable_rss(n);
+    virtio_net_flow_clear(n);
+    virtio_net_quiesce_end(n);
 }
 
 static void virtio_net_instance_init(Object *obj)
@@ -4141,6 +4609,10 @@ static void virtio_net_instance_init(Object *obj)
                                   DEVICE(n));
 
     ebpf_rss_init(&n->ebpf_rss);
+
+    object_property_add(obj, "flow-affinity-stats", "VirtioNetFlowStats",
+                        virtio_net_get_flow_affinity_stats,
+                        NULL, NULL, NULL);
 }
 
 static int virtio_net_pre_save(void *opaque)
@@ -4244,6 +4716,9 @@ static const Property virtio_net_properties[] = {
                        TX_TIMER_INTERVAL),
     DEFINE_PROP_INT32("x-txburst", VirtIONet, net_conf.txburst, TX_BURST),
     DEFINE_PROP_STRING("tx", VirtIONet, net_conf.tx),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", VirtIONet,
+                                         net_conf.iothread_vq_mapping_list),
+    DEFINE_PROP_BOOL("flow-affinity", VirtIONet, flow_affinity, false),
     DEFINE_PROP_UINT16("rx_queue_size", VirtIONet, net_conf.rx_queue_size,
                        VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE),
     DEFINE_PROP_UINT16("tx_queue_size", VirtIONet, net_conf.tx_queue_size,
@@ -34,6 +34,9 @@ struct VhostIOVATree {
 
     /* GPA->IOVA address memory maps */
     IOVATree *gpa_iova_map;
+
+    /* Bumped on every removal, so users can cache translations */
+    uint64_t generation;
 };
 
 /**
@@ -52,6 +55,7 @@ VhostIOVATree *vhost_iova_tree_new(hwaddr iova_first, hwaddr iova_last)
     tree->iova_taddr_map = iova_tree_new();
     tree->iova_map = iova_tree_new();
     tree->gpa_iova_map = gpa_tree_new();
+    tree->generation = 0;
     return tree;
 }
 
@@ -66,6 +70,19 @@ void vhost_iova_tree_delete(VhostIOVATree *iova_tree)
     g_free(iova_tree);
 }
 
+/**
+ * Return the generation of the tree
+ *
+ * @tree: The VhostIOVATree
+ *
+ * A copy of a mapping returned by one of the find functions stays valid
+ * for as long as the generation does not change.
+ */
+uint64_t vhost_iova_tree_generation(const VhostIOVATree *tree)
+{
+    return tree->generation;
+}
+
 /**
  * Find the IOVA address stored from a memory address
  *
@@ -126,6 +143,7 @@ void vhost_iova_tree_remove(VhostIOVATree *iova_tree, DMAMap map)
 {
     iova_tree_remove(iova_tree->iova_taddr_map, map);
     iova_tree_remove(iova_tree->iova_map, map);
+    iova_tree->generation++;
 }
 
 /**
@@ -188,4 +206,5 @@ void vhost_iova_tree_remove_gpa(VhostIOVATree *iova_tree, DMAMap map)
 {
     iova_tree_remove(iova_tree->gpa_iova_map, map);
     iova_tree_remove(iova_tree->iova_map, map);
+    iova_tree->generation++;
 }
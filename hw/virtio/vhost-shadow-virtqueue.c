@@ -72,6 +72,58 @@ uint16_t vhost_svq_available_slots(const VhostShadowVirtqueue *svq)
     return svq->num_free;
 }
 
+/**
+ * Look up a translation in the SVQ IOVA cache
+ *
+ * @svq: Shadow VirtQueue
+ * @addr: GPA or HVA of the buffer
+ * @len: Length of the buffer
+ * @gpa: True if @addr is a GPA
+ *
+ * Guest memory is mapped as a handful of large regions for the whole time
+ * SVQ is enabled, so almost every descriptor falls in one of the few
+ * mappings used last.  Checking copies of them avoids a tree walk per
+ * descriptor.  The copies are dropped whenever the tree loses a mapping.
+ */
+static const DMAMap *vhost_svq_iova_cache_find(VhostShadowVirtqueue *svq,
+                                               hwaddr addr, size_t len,
+                                               bool gpa)
+{
+    uint64_t generation = vhost_iova_tree_generation(svq->iova_tree);
+
+    if (unlikely(svq->iova_cache_generation != generation)) {
+        memset(svq->iova_cache, 0, sizeof(svq->iova_cache));
+        svq->iova_cache_generation = generation;
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < SVQ_IOVA_CACHE_SIZE; i++) {
+        const SVQIOVACacheEntry *entry = &svq->iova_cache[i];
+        const DMAMap *map = &entry->map;
+
+        /* map->size is inclusive, and len - 1 wraps for empty buffers */
+        if (entry->valid && entry->gpa == gpa &&
+            addr >= map->translated_addr &&
+            addr - map->translated_addr <= map->size &&
+            len - 1 <= map->size - (addr - map->translated_addr)) {
+            return map;
+        }
+    }
+
+    return NULL;
+}
+
+static void vhost_svq_iova_cache_insert(VhostShadowVirtqueue *svq,
+                                        const DMAMap *map, bool gpa)
+{
+    SVQIOVACacheEntry *entry = &svq->iova_cache[svq->iova_cache_next];
+
+    entry->map = *map;
+    entry->gpa = gpa;
+    entry->valid = true;
+    svq->iova_cache_next = (svq->iova_cache_next + 1) % SVQ_IOVA_CACHE_SIZE;
+}
+
 /**
  * Translate addresses between the qemu's virtual address and the SVQ IOVA
  *
@@ -81,7 +133,7 @@ uint16_t vhost_svq_available_slots(const VhostShadowVirtqueue *svq)
  * @num: Length of iovec and minimum length of vaddr
  * @gpas: Descriptors' GPAs, if backed by guest memory
  */
-static bool vhost_svq_translate_addr(const VhostShadowVirtqueue *svq,
+static bool vhost_svq_translate_addr(VhostShadowVirtqueue *svq,
                                      hwaddr *addrs, const struct iovec *iovec,
                                      size_t num, const hwaddr *gpas)
 {
@@ -102,14 +154,28 @@ static bool vhost_svq_translate_addr(const VhostShadowVirtqueue *svq,
                 .translated_addr = gpas[i],
                 .size = iovec[i].iov_len,
             };
-            map = vhost_iova_tree_find_gpa(svq->iova_tree, &needle);
+            map = vhost_svq_iova_cache_find(svq, needle.translated_addr,
+                                            iovec[i].iov_len, true);
+            if (!map) {
+                map = vhost_iova_tree_find_gpa(svq->iova_tree, &needle);
+                if (map) {
+                    vhost_svq_iova_cache_insert(svq, map, true);
+                }
+            }
         } else {
             /* Search the IOVA->HVA tree */
             needle = (DMAMap) {
                 .translated_addr = (hwaddr)(uintptr_t)iovec[i].iov_base,
                 .size = iovec[i].iov_len,
             };
-            map = vhost_iova_tree_find_iova(svq->iova_tree, &needle);
+            map = vhost_svq_iova_cache_find(svq, needle.translated_addr,
+                                            iovec[i].iov_len, false);
+            if (!map) {
+                map = vhost_iova_tree_find_iova(svq->iova_tree, &needle);
+                if (map) {
+                    vhost_svq_iova_cache_insert(svq, map, false);
+                }
+            }
         }
 
         /*
@@ -199,7 +265,7 @@ static bool vhost_svq_add_split(VhostShadowVirtqueue *svq,
     unsigned avail_idx;
     vring_avail_t *avail = svq->vring.avail;
     bool ok;
-    g_autofree hwaddr *sgs = g_new(hwaddr, MAX(out_num, in_num));
+    hwaddr *sgs = svq->iova_scratch;
 
     *head = svq->free_head;
 
@@ -230,17 +296,28 @@ static bool vhost_svq_add_split(VhostShadowVirtqueue *svq,
     avail->ring[avail_idx] = cpu_to_le16(*head);
     svq->shadow_avail_idx++;
 
-    /* Update the avail index after write the descriptor */
-    smp_wmb();
-    avail->idx = cpu_to_le16(svq->shadow_avail_idx);
-
     return true;
 }
 
+/*
+ * Expose every avail entry added since the last call to the device, and
+ * notify it if it asked for it.  Callers adding several elements in a row
+ * pay the barriers and the notification once for all of them.
+ */
 static void vhost_svq_kick(VhostShadowVirtqueue *svq)
 {
+    vring_avail_t *avail = svq->vring.avail;
+    uint16_t old = le16_to_cpu(avail->idx);
     bool needs_kick;
 
+    if (old == svq->shadow_avail_idx) {
+        return;
+    }
+
+    /* Update the avail index after write the descriptor */
+    smp_wmb();
+    avail->idx = cpu_to_le16(svq->shadow_avail_idx);
+
     /*
      * We need to expose the available array entries before checking the used
      * flags
@@ -250,7 +327,7 @@ static void vhost_svq_kick(VhostShadowVirtqueue *svq)
     if (virtio_vdev_has_feature(svq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
         uint16_t avail_event = le16_to_cpu(
                 *(uint16_t *)(&svq->vring.used->ring[svq->vring.num]));
-        needs_kick = vring_need_event(avail_event, svq->shadow_avail_idx, svq->shadow_avail_idx - 1);
+        needs_kick = vring_need_event(avail_event, svq->shadow_avail_idx, old);
     } else {
         needs_kick =
                 !(svq->vring.used->flags & cpu_to_le16(VRING_USED_F_NO_NOTIFY));
@@ -263,15 +340,16 @@ static void vhost_svq_kick(VhostShadowVirtqueue *svq)
     event_notifier_set(&svq->hdev_kick);
 }
 
-/**
- * Add an element to a SVQ.
+/*
+ * Add an element to a SVQ without exposing it to the device yet.
  *
  * Return -EINVAL if element is invalid, -ENOSPC if dev queue is full
  */
-int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
-                  size_t out_num, const hwaddr *out_addr,
-                  const struct iovec *in_sg, size_t in_num,
-                  const hwaddr *in_addr, VirtQueueElement *elem)
+static int vhost_svq_add_nokick(VhostShadowVirtqueue *svq,
+                                const struct iovec *out_sg, size_t out_num,
+                                const hwaddr *out_addr,
+                                const struct iovec *in_sg, size_t in_num,
+                                const hwaddr *in_addr, VirtQueueElement *elem)
 {
     unsigned qemu_head;
     unsigned ndescs = in_num + out_num;
@@ -290,16 +368,38 @@ int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
     svq->num_free -= ndescs;
     svq->desc_state[qemu_head].elem = elem;
     svq->desc_state[qemu_head].ndescs = ndescs;
-    vhost_svq_kick(svq);
     return 0;
 }
 
-/* Convenience wrapper to add a guest's element to SVQ */
+/**
+ * Add an element to a SVQ.
+ *
+ * Return -EINVAL if element is invalid, -ENOSPC if dev queue is full
+ */
+int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
+                  size_t out_num, const hwaddr *out_addr,
+                  const struct iovec *in_sg, size_t in_num,
+                  const hwaddr *in_addr, VirtQueueElement *elem)
+{
+    int r = vhost_svq_add_nokick(svq, out_sg, out_num, out_addr,
+                                 in_sg, in_num, in_addr, elem);
+
+    if (r == 0) {
+        vhost_svq_kick(svq);
+    }
+    return r;
+}
+
+/*
+ * Convenience wrapper to add a guest's element to SVQ.  The caller kicks
+ * the device once it has added the whole batch.
+ */
 static int vhost_svq_add_element(VhostShadowVirtqueue *svq,
                                  VirtQueueElement *elem)
 {
-    return vhost_svq_add(svq, elem->out_sg, elem->out_num, elem->out_addr,
-                         elem->in_sg, elem->in_num, elem->in_addr, elem);
+    return vhost_svq_add_nokick(svq, elem->out_sg, elem->out_num,
+                                elem->out_addr, elem->in_sg, elem->in_num,
+                                elem->in_addr, elem);
 }
 
 /**
@@ -360,12 +460,15 @@ static void vhost_handle_guest_kick(VhostShadowVirtqueue *svq)
                 }
 
                 /* VQ is full or broken, just return and ignore kicks */
+                vhost_svq_kick(svq);
                 return;
             }
             /* elem belongs to SVQ or external caller now */
             elem = NULL;
         }
 
+        /* Expose everything popped so far with a single avail idx update */
+        vhost_svq_kick(svq);
         virtio_queue_set_notification(svq->vq, true);
     } while (!virtio_queue_empty(svq->vq));
 }
@@ -693,6 +796,9 @@ void vhost_svq_start(VhostShadowVirtqueue *svq, VirtIODevice *vdev,
     svq->vdev = vdev;
     svq->vq = vq;
     svq->iova_tree = iova_tree;
+    memset(svq->iova_cache, 0, sizeof(svq->iova_cache));
+    svq->iova_cache_generation = vhost_iova_tree_generation(iova_tree);
+    svq->iova_cache_next = 0;
 
     svq->vring.num = virtio_queue_get_num(vdev, virtio_get_queue_index(vq));
     svq->num_free = svq->vring.num;
@@ -706,6 +812,7 @@ void vhost_svq_start(VhostShadowVirtqueue *svq, VirtIODevice *vdev,
                            -1, 0);
     svq->desc_state = g_new0(SVQDescState, svq->vring.num);
     svq->desc_next = g_new0(uint16_t, svq->vring.num);
+    svq->iova_scratch = g_new(hwaddr, svq->vring.num);
     for (unsigned i = 0; i < svq->vring.num - 1; i++) {
         svq->desc_next[i] = i + 1;
     }
@@ -746,6 +853,7 @@ void vhost_svq_stop(VhostShadowVirtqueue *svq)
     svq->vq = NULL;
     g_free(svq->desc_next);
     g_free(svq->desc_state);
+    g_free(svq->iova_scratch);
     munmap(svq->vring.desc, vhost_svq_driver_area_size(svq));
     munmap(svq->vring.used, vhost_svq_device_area_size(svq));
     event_notifier_set_handler(&svq->hdev_call, NULL);
@@ -25,6 +25,18 @@ typedef struct SVQDescState {
     unsigned int ndescs;
 } SVQDescState;
 
+/* A copy of an IOVA tree node, see vhost_svq_translate_addr */
+typedef struct SVQIOVACacheEntry {
+    DMAMap map;
+
+    /* The map comes from the GPA->IOVA tree rather than the IOVA->HVA one */
+    bool gpa;
+
+    bool valid;
+} SVQIOVACacheEntry;
+
+#define SVQ_IOVA_CACHE_SIZE 4
+
 typedef struct VhostShadowVirtqueue VhostShadowVirtqueue;
 
 /**
@@ -78,6 +90,14 @@ typedef struct VhostShadowVirtqueue {
     /* IOVA mapping */
     VhostIOVATree *iova_tree;
 
+    /* Recently used translations, valid for iova_cache_generation */
+    SVQIOVACacheEntry iova_cache[SVQ_IOVA_CACHE_SIZE];
+    uint64_t iova_cache_generation;
+    unsigned int iova_cache_next;
+
+    /* IOVA of each descriptor of the element being added */
+    hwaddr *iova_scratch;
+
     /* SVQ vring descriptors state */
     SVQDescState *desc_state;
 
@@ -99,6 +99,7 @@ typedef enum VhostUserRequest {
     VHOST_USER_GET_SHARED_OBJECT = 41,
     VHOST_USER_SET_DEVICE_STATE_FD = 42,
     VHOST_USER_CHECK_DEVICE_STATE = 43,
+    VHOST_USER_SET_VRING_BUSY_POLL = 44,
     VHOST_USER_MAX
 } VhostUserRequest;
 
@@ -1365,7 +1366,25 @@ static int vhost_set_vring_file(struct vhost_dev *dev,
 static int vhost_user_set_vring_kick(struct vhost_dev *dev,
                                      struct vhost_vring_file *file)
 {
-    return vhost_set_vring_file(dev, VHOST_USER_SET_VRING_KICK, file);
+    struct vhost_user *u = dev->opaque;
+    struct vhost_vring_state state = {
+        .index = file->index,
+        .num = u->user->busy_poll_usecs,
+    };
+    int ret;
+
+    ret = vhost_set_vring_file(dev, VHOST_USER_SET_VRING_KICK, file);
+    if (ret < 0 || file->fd < 0 ||
+        !virtio_has_feature(dev->protocol_features,
+                            VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL)) {
+        return ret;
+    }
+
+    /*
+     * The backend now knows where kicks come from; let it suppress them
+     * and poll the ring instead while it is busy.
+     */
+    return vhost_set_vring(dev, VHOST_USER_SET_VRING_BUSY_POLL, &state, false);
 }
 
 static int vhost_user_set_vring_call(struct vhost_dev *dev,
@@ -2227,6 +2246,15 @@ static int vhost_user_backend_init(struct vhost_dev *dev, void *opaque,
                                VHOST_USER_PROTOCOL_F_GET_VRING_BASE_INFLIGHT);
         }
 
+        if (!u->user->busy_poll_usecs) {
+            protocol_features &= ~(1ULL <<
+                                   VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL);
+        } else if (!virtio_has_feature(protocol_features,
+                                       VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL)) {
+            warn_report_once("vhost-user backend does not support busy "
+                             "polling, using notifications");
+        }
+
         /* final set of protocol features */
         dev->protocol_features = protocol_features;
         err = vhost_user_set_protocol_features(dev, dev->protocol_features);
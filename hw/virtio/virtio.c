@@ -15,6 +15,7 @@
 #include "qapi/error.h"
 #include "qapi/qapi-commands-virtio.h"
 #include "trace.h"
+#include "qemu/aio-wait.h"
 #include "qemu/defer-call.h"
 #include "qemu/error-report.h"
 #include "qemu/log.h"
@@ -145,6 +146,9 @@ struct VirtQueue
     /* Notification enabled? */
     bool notification;
 
+    /* Return in-order packed completions with one used descriptor? */
+    bool used_batching;
+
     uint16_t queue_index;
 
     unsigned int inuse;
@@ -155,6 +159,8 @@ struct VirtQueue
     EventNotifier guest_notifier;
     EventNotifier host_notifier;
     bool host_notifier_enabled;
+    /* Where ioeventfd is processed, NULL for the main loop */
+    AioContext *host_notifier_ctx;
     QLIST_ENTRY(VirtQueue) node;
 };
 
@@ -610,6 +616,17 @@ bool virtio_queue_get_notification(VirtQueue *vq)
     return vq->notification;
 }
 
+/*
+ * Let a run of in-order completions on a packed ring be returned with a
+ * single used descriptor.  The driver then takes the length of every
+ * buffer but the last to be its full writable size, so this is only
+ * correct for devices that always report that.
+ */
+void virtio_queue_set_used_batching(VirtQueue *vq, bool enable)
+{
+    vq->used_batching = enable;
+}
+
 void virtio_queue_set_notification(VirtQueue *vq, int enable)
 {
     vq->notification = enable;
@@ -916,7 +933,7 @@ void virtqueue_unpop(VirtQueue *vq, const VirtQueueElement *elem,
 {
 
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
-        virtqueue_packed_rewind(vq, 1);
+        virtqueue_packed_rewind(vq, elem->ndescs);
     } else {
         virtqueue_split_rewind(vq, 1);
     }
@@ -1025,6 +1042,47 @@ static void virtqueue_ordered_fill(VirtQueue *vq, const VirtQueueElement *elem,
     }
 }
 
+/*
+ * Packed rings count descriptors in flight in vq->inuse, so unlike the
+ * split ring version this also finds the element when the ring is full.
+ * The common case is a completion for the oldest buffer, which is the
+ * first one looked at.
+ */
+static void virtqueue_packed_ordered_fill(VirtQueue *vq,
+                                          const VirtQueueElement *elem,
+                                          unsigned int len)
+{
+    unsigned int i = vq->used_idx;
+    unsigned int steps = 0;
+
+    while (steps < vq->inuse) {
+        VirtQueueElement *used = &vq->used_elems[i];
+
+        if (used->index == elem->index && !used->in_order_filled) {
+            used->len = len;
+            used->in_order_filled = true;
+            return;
+        }
+
+        /* Defensive sanity check */
+        if (unlikely(used->ndescs == 0 || used->ndescs > vq->vring.num)) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: %s invalid ndescs %u at position %u\n",
+                          __func__, vq->vdev->name, used->ndescs, i);
+            return;
+        }
+
+        steps += used->ndescs;
+        i += used->ndescs;
+        if (i >= vq->vring.num) {
+            i -= vq->vring.num;
+        }
+    }
+
+    qemu_log_mask(LOG_GUEST_ERROR, "%s: %s cannot fill buffer id %u\n",
+                  __func__, vq->vdev->name, elem->index);
+}
+
 static void virtqueue_packed_fill_desc(VirtQueue *vq,
                                        const VirtQueueElement *elem,
                                        unsigned int idx,
@@ -1076,7 +1134,11 @@ void virtqueue_fill(VirtQueue *vq, const VirtQueueElement *elem,
     }
 
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_IN_ORDER)) {
-        virtqueue_ordered_fill(vq, elem, len);
+        if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+            virtqueue_packed_ordered_fill(vq, elem, len);
+        } else {
+            virtqueue_ordered_fill(vq, elem, len);
+        }
     } else if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
         virtqueue_packed_fill(vq, elem, len, idx);
     } else {
@@ -1136,22 +1198,66 @@ static void virtqueue_packed_flush(VirtQueue *vq, unsigned int count)
     }
 }
 
+/*
+ * Publish the run of completed buffers at the head of an in-order packed
+ * ring.  Descriptors other than the first are written without barriers
+ * and the first one last, so that the whole run becomes visible at once.
+ *
+ * With used_batching, VIRTIO_F_IN_ORDER lets the device skip the others
+ * entirely: a single used descriptor carrying the id of the last buffer
+ * in the run completes all of them, so a run of N requests costs one
+ * descriptor write instead of N.
+ */
+static void virtqueue_packed_ordered_flush(VirtQueue *vq)
+{
+    unsigned int i = vq->used_idx;
+    unsigned int last = i;
+    unsigned int ndescs = 0;
+
+    if (unlikely(!vq->vring.desc)) {
+        return;
+    }
+
+    while (vq->used_elems[i].in_order_filled && ndescs < vq->inuse) {
+        if (!vq->used_batching && i != vq->used_idx) {
+            virtqueue_packed_fill_desc(vq, &vq->used_elems[i], ndescs, false);
+        }
+
+        vq->used_elems[i].in_order_filled = false;
+        last = i;
+        ndescs += vq->used_elems[i].ndescs;
+        i += vq->used_elems[i].ndescs;
+        if (i >= vq->vring.num) {
+            i -= vq->vring.num;
+        }
+    }
+
+    /* First expected in-order element isn't ready, nothing to do */
+    if (!ndescs) {
+        return;
+    }
+
+    virtqueue_packed_fill_desc(vq, &vq->used_elems[vq->used_batching ?
+                                                   last : vq->used_idx],
+                               0, true);
+    vq->inuse -= ndescs;
+    vq->used_idx += ndescs;
+    if (vq->used_idx >= vq->vring.num) {
+        vq->used_idx -= vq->vring.num;
+        vq->used_wrap_counter ^= 1;
+        vq->signalled_used_valid = false;
+    }
+}
+
 static void virtqueue_ordered_flush(VirtQueue *vq)
 {
     unsigned int i = vq->used_idx % vq->vring.num;
     unsigned int ndescs = 0;
     uint16_t old = vq->used_idx;
     uint16_t new;
-    bool packed;
     VRingUsedElem uelem;
 
-    packed = virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED);
-
-    if (packed) {
-        if (unlikely(!vq->vring.desc)) {
-            return;
-        }
-    } else if (unlikely(!vq->vring.used)) {
+    if (unlikely(!vq->vring.used)) {
         return;
     }
 
@@ -1162,17 +1268,9 @@ static void virtqueue_ordered_flush(VirtQueue *vq)
 
     /* Search for filled elements in-order */
     while (vq->used_elems[i].in_order_filled) {
-        /*
-         * First entry for packed VQs is written last so the guest
-         * doesn't see invalid descriptors.
-         */
-        if (packed && i != vq->used_idx) {
-            virtqueue_packed_fill_desc(vq, &vq->used_elems[i], ndescs, false);
-        } else if (!packed) {
-            uelem.id = vq->used_elems[i].index;
-            uelem.len = vq->used_elems[i].len;
-            vring_used_write(vq, &uelem, i);
-        }
+        uelem.id = vq->used_elems[i].index;
+        uelem.len = vq->used_elems[i].len;
+        vring_used_write(vq, &uelem, i);
 
         vq->used_elems[i].in_order_filled = false;
         ndescs += vq->used_elems[i].ndescs;
@@ -1182,23 +1280,13 @@ static void virtqueue_ordered_flush(VirtQueue *vq)
         }
     }
 
-    if (packed) {
-        virtqueue_packed_fill_desc(vq, &vq->used_elems[vq->used_idx], 0, true);
-        vq->used_idx += ndescs;
-        if (vq->used_idx >= vq->vring.num) {
-            vq->used_idx -= vq->vring.num;
-            vq->used_wrap_counter ^= 1;
-            vq->signalled_used_valid = false;
-        }
-    } else {
-        /* Make sure buffer is written before we update index. */
-        smp_wmb();
-        new = old + ndescs;
-        vring_used_idx_set(vq, new);
-        if (unlikely((int16_t)(new - vq->signalled_used) <
-                     (uint16_t)(new - old))) {
-            vq->signalled_used_valid = false;
-        }
+    /* Make sure buffer is written before we update index. */
+    smp_wmb();
+    new = old + ndescs;
+    vring_used_idx_set(vq, new);
+    if (unlikely((int16_t)(new - vq->signalled_used) <
+                 (uint16_t)(new - old))) {
+        vq->signalled_used_valid = false;
     }
     vq->inuse -= ndescs;
 }
@@ -1211,7 +1299,11 @@ void virtqueue_flush(VirtQueue *vq, unsigned int count)
     }
 
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_IN_ORDER)) {
-        virtqueue_ordered_flush(vq);
+        if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+            virtqueue_packed_ordered_flush(vq);
+        } else {
+            virtqueue_ordered_flush(vq);
+        }
     } else if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
         virtqueue_packed_flush(vq, count);
     } else {
@@ -1227,6 +1319,38 @@ void virtqueue_push(VirtQueue *vq, const VirtQueueElement *elem,
     virtqueue_flush(vq, 1);
 }
 
+/* virtqueue_push_batch:
+ * @vq: The #VirtQueue
+ * @elems: the elements to return to the guest, in pop order
+ * @lens: number of bytes written to each element
+ * @count: number of elements
+ *
+ * Equivalent to calling virtqueue_push() on each element, but the used
+ * ring index is published, and its write barrier paid, only once.
+ *
+ * Returns: true if the guest can see new used buffers.  With
+ * VIRTIO_F_IN_ORDER, completions that overtake an older request are held
+ * back and the caller need not notify the guest for them.
+ */
+bool virtqueue_push_batch(VirtQueue *vq, VirtQueueElement **elems,
+                          const unsigned int *lens, unsigned int count)
+{
+    uint16_t old_idx = vq->used_idx;
+    bool old_wrap = vq->used_wrap_counter;
+    unsigned int i;
+
+    if (!count) {
+        return false;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    for (i = 0; i < count; i++) {
+        virtqueue_fill(vq, elems[i], lens[i], i);
+    }
+    virtqueue_flush(vq, count);
+    return vq->used_idx != old_idx || vq->used_wrap_counter != old_wrap;
+}
+
 /* Called within rcu_read_lock().  */
 static int virtqueue_num_heads(VirtQueue *vq, unsigned int idx)
 {
@@ -1730,10 +1854,17 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+/*
+ * Pop the element at avail ring index @avail_idx, whose head descriptor
+ * is @head.  Called within rcu_read_lock(), with @caches known to cover
+ * the descriptor ring.
+ */
+static VirtQueueElement *virtqueue_split_pop_head(VirtQueue *vq, size_t sz,
+                                                  VRingMemoryRegionCaches *caches,
+                                                  unsigned int avail_idx,
+                                                  unsigned int head)
 {
-    unsigned int i, head, max, idx;
-    VRingMemoryRegionCaches *caches;
+    unsigned int i, max, idx;
     MemoryRegionCache indirect_desc_cache;
     MemoryRegionCache *desc_cache;
     int64_t len;
@@ -1747,45 +1878,12 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
 
     address_space_cache_init_empty(&indirect_desc_cache);
 
-    RCU_READ_LOCK_GUARD();
-    if (virtio_queue_empty_rcu(vq)) {
-        goto done;
-    }
-    /* Needed after virtio_queue_empty(), see comment in
-     * virtqueue_num_heads(). */
-    smp_rmb();
-
     /* When we start there are none of either input nor output. */
     out_num = in_num = elem_entries = 0;
 
     max = vq->vring.num;
-
-    if (vq->inuse >= vq->vring.num) {
-        virtio_error(vdev, "Virtqueue size exceeded");
-        goto done;
-    }
-
-    if (!virtqueue_get_head(vq, vq->last_avail_idx++, &head)) {
-        goto done;
-    }
-
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
-        vring_set_avail_event(vq, vq->last_avail_idx);
-    }
-
     i = head;
 
-    caches = vring_get_region_caches(vq);
-    if (!caches) {
-        virtio_error(vdev, "Region caches not initialized");
-        goto done;
-    }
-
-    if (caches->desc.len < max * sizeof(VRingDesc)) {
-        virtio_error(vdev, "Cannot map descriptor ring");
-        goto done;
-    }
-
     desc_cache = &caches->desc;
     vring_split_desc_read(vdev, &desc, desc_cache, i);
     if (desc.flags & VRING_DESC_F_INDIRECT) {
@@ -1858,7 +1956,7 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
     }
 
     if (virtio_vdev_has_feature(vdev, VIRTIO_F_IN_ORDER)) {
-        idx = (vq->last_avail_idx - 1) % vq->vring.num;
+        idx = avail_idx % vq->vring.num;
         vq->used_elems[idx].index = elem->index;
         vq->used_elems[idx].len = elem->len;
         vq->used_elems[idx].ndescs = elem->ndescs;
@@ -1877,10 +1975,75 @@ err_undo_map:
     goto done;
 }
 
-static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
+/* Called within rcu_read_lock().  */
+static unsigned int virtqueue_split_pop_batch(VirtQueue *vq, size_t sz,
+                                              void **elems, unsigned int max)
 {
-    unsigned int i, max;
+    VirtIODevice *vdev = vq->vdev;
     VRingMemoryRegionCaches *caches;
+    unsigned int QEMU_UNINITIALIZED heads[VIRTQUEUE_MAX_SIZE];
+    unsigned int first, i, n;
+    int num_heads;
+
+    if (virtio_queue_empty_rcu(vq)) {
+        return 0;
+    }
+    /* Provides the barrier needed after virtio_queue_empty_rcu(). */
+    num_heads = virtqueue_num_heads(vq, vq->last_avail_idx);
+    if (num_heads <= 0) {
+        return 0;
+    }
+
+    caches = vring_get_region_caches(vq);
+    if (!caches) {
+        virtio_error(vdev, "Region caches not initialized");
+        return 0;
+    }
+
+    if (caches->desc.len < vq->vring.num * sizeof(VRingDesc)) {
+        virtio_error(vdev, "Cannot map descriptor ring");
+        return 0;
+    }
+
+    /*
+     * Read all the heads in one pass over the avail ring, and publish
+     * the new avail event once for the whole batch.
+     */
+    n = MIN(max, num_heads);
+    first = vq->last_avail_idx;
+    for (i = 0; i < n; i++) {
+        if (!virtqueue_get_head(vq, vq->last_avail_idx++, &heads[i])) {
+            n = i;
+            break;
+        }
+    }
+
+    if (n && virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (vq->inuse >= vq->vring.num) {
+            virtio_error(vdev, "Virtqueue size exceeded");
+            break;
+        }
+        elems[i] = virtqueue_split_pop_head(vq, sz, caches, first + i,
+                                            heads[i]);
+        if (!elems[i]) {
+            break;
+        }
+    }
+    return i;
+}
+
+/*
+ * Pop the element at vq->last_avail_idx.  Called within rcu_read_lock(),
+ * with @caches known to cover the descriptor ring.
+ */
+static VirtQueueElement *virtqueue_packed_pop_rcu(VirtQueue *vq, size_t sz,
+                                                  VRingMemoryRegionCaches *caches)
+{
+    unsigned int i, max;
     MemoryRegionCache indirect_desc_cache;
     MemoryRegionCache *desc_cache;
     int64_t len;
@@ -1895,34 +2058,12 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
 
     address_space_cache_init_empty(&indirect_desc_cache);
 
-    RCU_READ_LOCK_GUARD();
-    if (virtio_queue_packed_empty_rcu(vq)) {
-        goto done;
-    }
-
     /* When we start there are none of either input nor output. */
     out_num = in_num = elem_entries = 0;
 
     max = vq->vring.num;
-
-    if (vq->inuse >= vq->vring.num) {
-        virtio_error(vdev, "Virtqueue size exceeded");
-        goto done;
-    }
-
     i = vq->last_avail_idx;
 
-    caches = vring_get_region_caches(vq);
-    if (!caches) {
-        virtio_error(vdev, "Region caches not initialized");
-        goto done;
-    }
-
-    if (caches->desc.len < max * sizeof(VRingDesc)) {
-        virtio_error(vdev, "Cannot map descriptor ring");
-        goto done;
-    }
-
     desc_cache = &caches->desc;
     vring_packed_desc_read(vdev, &desc, desc_cache, i, true);
     id = desc.id;
@@ -2027,19 +2168,70 @@ err_undo_map:
     goto done;
 }
 
-void *virtqueue_pop(VirtQueue *vq, size_t sz)
+/* Called within rcu_read_lock().  */
+static unsigned int virtqueue_packed_pop_batch(VirtQueue *vq, size_t sz,
+                                               void **elems, unsigned int max)
+{
+    VirtIODevice *vdev = vq->vdev;
+    VRingMemoryRegionCaches *caches;
+    unsigned int n;
+
+    if (virtio_queue_packed_empty_rcu(vq)) {
+        return 0;
+    }
+
+    caches = vring_get_region_caches(vq);
+    if (!caches) {
+        virtio_error(vdev, "Region caches not initialized");
+        return 0;
+    }
+
+    if (caches->desc.len < vq->vring.num * sizeof(VRingDesc)) {
+        virtio_error(vdev, "Cannot map descriptor ring");
+        return 0;
+    }
+
+    for (n = 0; n < max; n++) {
+        if (n && virtio_queue_packed_empty_rcu(vq)) {
+            break;
+        }
+        if (vq->inuse >= vq->vring.num) {
+            virtio_error(vdev, "Virtqueue size exceeded");
+            break;
+        }
+        elems[n] = virtqueue_packed_pop_rcu(vq, sz, caches);
+        if (!elems[n]) {
+            break;
+        }
+    }
+    return n;
+}
+
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
 {
     if (virtio_device_disabled(vq->vdev)) {
-        return NULL;
+        return 0;
     }
 
+    RCU_READ_LOCK_GUARD();
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
-        return virtqueue_packed_pop(vq, sz);
+        return virtqueue_packed_pop_batch(vq, sz, elems, max);
     } else {
-        return virtqueue_split_pop(vq, sz);
+        return virtqueue_split_pop_batch(vq, sz, elems, max);
     }
 }
 
+void *virtqueue_pop(VirtQueue *vq, size_t sz)
+{
+    void *elem;
+
+    if (!virtqueue_pop_batch(vq, sz, &elem, 1)) {
+        return NULL;
+    }
+    return elem;
+}
+
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
 {
     VRingMemoryRegionCaches *caches;
@@ -2582,6 +2774,7 @@ void virtio_delete_queue(VirtQueue *vq)
     vq->vring.num = 0;
     vq->vring.num_default = 0;
     vq->handle_output = NULL;
+    vq->host_notifier_ctx = NULL;
     g_free(vq->used_elems);
     vq->used_elems = NULL;
     virtio_virtqueue_reset_region_cache(vq);
@@ -2787,6 +2980,34 @@ static bool virtio_packed_virtqueue_needed(void *opaque)
     return virtio_host_has_feature(vdev, VIRTIO_F_RING_PACKED);
 }
 
+static bool virtio_in_order_filled_needed(void *opaque)
+{
+    VirtIODevice *vdev = opaque;
+    int i;
+
+    if (!virtio_vdev_has_feature(vdev, VIRTIO_F_IN_ORDER)) {
+        return false;
+    }
+
+    for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+        VirtQueue *vq = &vdev->vq[i];
+        unsigned int idx, steps;
+
+        if (!vq->vring.num || !vq->used_elems) {
+            continue;
+        }
+        idx = vq->used_idx % vq->vring.num;
+        for (steps = 0; steps < vq->inuse && vq->used_elems[idx].ndescs;
+             steps += vq->used_elems[idx].ndescs) {
+            if (vq->used_elems[idx].in_order_filled) {
+                return true;
+            }
+            idx = (idx + vq->used_elems[idx].ndescs) % vq->vring.num;
+        }
+    }
+    return false;
+}
+
 static bool virtio_ringsize_needed(void *opaque)
 {
     VirtIODevice *vdev = opaque;
@@ -2952,6 +3173,90 @@ static const VMStateDescription vmstate_virtio_extra_state = {
     }
 };
 
+/*
+ * Completions held back on a VIRTIO_F_IN_ORDER queue because an older
+ * buffer is still in flight.  The device has already forgotten about
+ * them, so they are saved as a list of (queue, position, len) that ends
+ * with VIRTIO_QUEUE_MAX.  Positions are ring indices, which are the same
+ * on both sides.
+ */
+static int get_in_order_filled(QEMUFile *f, void *pv, size_t size,
+                               const VMStateField *field)
+{
+    VirtIODevice *vdev = pv;
+    uint16_t i, idx;
+    uint32_t len;
+
+    while ((i = qemu_get_be16(f)) != VIRTIO_QUEUE_MAX) {
+        idx = qemu_get_be16(f);
+        len = qemu_get_be32(f);
+
+        if (i >= VIRTIO_QUEUE_MAX || !vdev->vq[i].used_elems ||
+            idx >= vdev->vq[i].vring.num) {
+            error_report("Invalid in-order completion for VQ %u at 0x%x",
+                         i, idx);
+            return -EINVAL;
+        }
+        /* virtio_load() fills in index and ndescs from the ring */
+        vdev->vq[i].used_elems[idx].len = len;
+        vdev->vq[i].used_elems[idx].in_order_filled = true;
+    }
+    return 0;
+}
+
+static int put_in_order_filled(QEMUFile *f, void *pv, size_t size,
+                               const VMStateField *field, JSONWriter *vmdesc)
+{
+    VirtIODevice *vdev = pv;
+    int i;
+
+    for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+        VirtQueue *vq = &vdev->vq[i];
+        unsigned int idx, steps;
+
+        if (!vq->vring.num || !vq->used_elems) {
+            continue;
+        }
+        idx = vq->used_idx % vq->vring.num;
+        for (steps = 0; steps < vq->inuse && vq->used_elems[idx].ndescs;
+             steps += vq->used_elems[idx].ndescs) {
+            if (vq->used_elems[idx].in_order_filled) {
+                qemu_put_be16(f, i);
+                qemu_put_be16(f, idx);
+                qemu_put_be32(f, vq->used_elems[idx].len);
+            }
+            idx = (idx + vq->used_elems[idx].ndescs) % vq->vring.num;
+        }
+    }
+    qemu_put_be16(f, VIRTIO_QUEUE_MAX);
+    return 0;
+}
+
+static const VMStateInfo vmstate_info_in_order_filled = {
+    .name = "virtqueue_in_order_filled",
+    .get = get_in_order_filled,
+    .put = put_in_order_filled,
+};
+
+static const VMStateDescription vmstate_virtio_in_order_filled = {
+    .name = "virtio/in_order_filled",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = &virtio_in_order_filled_needed,
+    .fields = (const VMStateField[]) {
+        {
+            .name         = "in_order_filled",
+            .version_id   = 0,
+            .field_exists = NULL,
+            .size         = 0,
+            .info         = &vmstate_info_in_order_filled,
+            .flags        = VMS_SINGLE,
+            .offset       = 0,
+        },
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_virtio_device_endian = {
     .name = "virtio/device_endian",
     .version_id = 1,
@@ -3049,6 +3354,7 @@ static const VMStateDescription vmstate_virtio = {
         &vmstate_virtio_started,
         &vmstate_virtio_packed_virtqueues,
         &vmstate_virtio_disabled,
+        &vmstate_virtio_in_order_filled,
         NULL
     }
 };
@@ -3316,6 +3622,63 @@ size_t virtio_get_config_size(const VirtIOConfigSizeParams *params,
     return config_size;
 }
 
+/*
+ * Called within rcu_read_lock().  VIRTIO_F_IN_ORDER queues keep the
+ * buffers in flight in vq->used_elems, in the order they were made
+ * available.  Only the elements themselves are migrated, by the device,
+ * so rebuild the id and descriptor count of each buffer from the ring.
+ * The driver may not touch these descriptors until they are used.
+ */
+static void virtqueue_in_order_load(VirtQueue *vq)
+{
+    VRingMemoryRegionCaches *caches = vring_get_region_caches(vq);
+    unsigned int idx, steps, ndescs, i;
+    VRingPackedDesc desc;
+
+    if (!caches) {
+        return;
+    }
+
+    if (!virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+        for (steps = 0; steps < vq->inuse; steps++) {
+            idx = (uint16_t)(vq->used_idx + steps) % vq->vring.num;
+            vq->used_elems[idx].index = vring_avail_ring(vq, idx);
+            vq->used_elems[idx].ndescs = 1;
+        }
+        return;
+    }
+
+    idx = vq->used_idx;
+    for (steps = 0; steps < vq->inuse; steps += ndescs) {
+        i = idx;
+        ndescs = 1;
+        vring_packed_desc_read(vq->vdev, &desc, &caches->desc, i, false);
+
+        /* An indirect table takes one slot, its id is in the head */
+        while (!(desc.flags & VRING_DESC_F_INDIRECT) &&
+               (desc.flags & VRING_DESC_F_NEXT) && ndescs < vq->vring.num) {
+            if (++i == vq->vring.num) {
+                i = 0;
+            }
+            vring_packed_desc_read(vq->vdev, &desc, &caches->desc, i, false);
+            ndescs++;
+        }
+
+        vq->used_elems[idx].index = desc.id;
+        vq->used_elems[idx].ndescs = ndescs;
+
+        /* Only the head of a buffer may be marked as filled */
+        for (i = 1; i < ndescs; i++) {
+            vq->used_elems[(idx + i) % vq->vring.num].in_order_filled = false;
+        }
+
+        idx += ndescs;
+        if (idx >= vq->vring.num) {
+            idx -= vq->vring.num;
+        }
+    }
+}
+
 int coroutine_mixed_fn
 virtio_load(VirtIODevice *vdev, QEMUFile *f, int version_id)
 {
@@ -3395,6 +3758,10 @@ virtio_load(VirtIODevice *vdev, QEMUFile *f, int version_id)
         qemu_get_be16s(f, &vdev->vq[i].last_avail_idx);
         vdev->vq[i].signalled_used_valid = false;
         vdev->vq[i].notification = true;
+        if (vdev->vq[i].used_elems) {
+            memset(vdev->vq[i].used_elems, 0,
+                   sizeof(VirtQueueElement) * vdev->vq[i].vring.num_default);
+        }
 
         if (!vdev->vq[i].vring.desc && vdev->vq[i].last_avail_idx) {
             error_report("VQ %d address 0x0 "
@@ -3476,6 +3843,17 @@ virtio_load(VirtIODevice *vdev, QEMUFile *f, int version_id)
                 vdev->vq[i].shadow_avail_idx = vdev->vq[i].last_avail_idx;
                 vdev->vq[i].shadow_avail_wrap_counter =
                                         vdev->vq[i].last_avail_wrap_counter;
+                if (vdev->vq[i].used_idx >= vdev->vq[i].vring.num ||
+                    vdev->vq[i].inuse > vdev->vq[i].vring.num) {
+                    error_report("VQ %d size 0x%x inconsistent with "
+                                 "used_idx 0x%x and inuse 0x%x",
+                                 i, vdev->vq[i].vring.num,
+                                 vdev->vq[i].used_idx, vdev->vq[i].inuse);
+                    return -1;
+                }
+                if (virtio_vdev_has_feature(vdev, VIRTIO_F_IN_ORDER)) {
+                    virtqueue_in_order_load(&vdev->vq[i]);
+                }
                 continue;
             }
 
@@ -3511,6 +3889,9 @@ virtio_load(VirtIODevice *vdev, QEMUFile *f, int version_id)
                              vdev->vq[i].used_idx);
                 return -1;
             }
+            if (virtio_vdev_has_feature(vdev, VIRTIO_F_IN_ORDER)) {
+                virtqueue_in_order_load(&vdev->vq[i]);
+            }
         }
     }
 
@@ -3987,6 +4368,11 @@ EventNotifier *virtio_queue_get_host_notifier(VirtQueue *vq)
     return &vq->host_notifier;
 }
 
+void virtio_queue_set_host_notifier_ctx(VirtQueue *vq, AioContext *ctx)
+{
+    vq->host_notifier_ctx = ctx;
+}
+
 EventNotifier *virtio_config_get_guest_notifier(VirtIODevice *vdev)
 {
     return &vdev->config_notifier;
@@ -4132,6 +4518,26 @@ static const Property virtio_properties[] = {
                      disable_legacy_check, false),
 };
 
+static void virtio_queue_detach_host_notifier(VirtQueue *vq)
+{
+    if (vq->host_notifier_ctx) {
+        virtio_queue_aio_detach_host_notifier(vq, vq->host_notifier_ctx);
+    } else {
+        event_notifier_set_handler(&vq->host_notifier, NULL);
+    }
+}
+
+/* Context: BH in the IOThread that processes @opaque */
+static void virtio_queue_host_notifier_stop_bh(void *opaque)
+{
+    VirtQueue *vq = opaque;
+
+    virtio_queue_aio_detach_host_notifier(vq, qemu_get_current_aio_context());
+
+    /* Process a kick that raced with the detach */
+    virtio_queue_host_notifier_read(&vq->host_notifier);
+}
+
 static int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
@@ -4152,8 +4558,12 @@ static int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
             err = r;
             goto assign_error;
         }
-        event_notifier_set_handler(&vq->host_notifier,
-                                   virtio_queue_host_notifier_read);
+        if (vq->host_notifier_ctx) {
+            virtio_queue_aio_attach_host_notifier(vq, vq->host_notifier_ctx);
+        } else {
+            event_notifier_set_handler(&vq->host_notifier,
+                                       virtio_queue_host_notifier_read);
+        }
     }
 
     for (n = 0; n < VIRTIO_QUEUE_MAX; n++) {
@@ -4175,7 +4585,7 @@ assign_error:
             continue;
         }
 
-        event_notifier_set_handler(&vq->host_notifier, NULL);
+        virtio_queue_detach_host_notifier(vq);
         r = virtio_bus_set_host_notifier(qbus, n, false);
         assert(r >= 0);
     }
@@ -4207,6 +4617,16 @@ static void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int n, r;
 
+    /* Quiesce the IOThreads before tearing down their host notifiers */
+    for (n = 0; n < VIRTIO_QUEUE_MAX; n++) {
+        VirtQueue *vq = &vdev->vq[n];
+
+        if (virtio_queue_get_num(vdev, n) && vq->host_notifier_ctx) {
+            aio_wait_bh_oneshot(vq->host_notifier_ctx,
+                                virtio_queue_host_notifier_stop_bh, vq);
+        }
+    }
+
     /*
      * Batch all the host notifiers in a single transaction to avoid
      * quadratic time complexity in address_space_update_ioeventfds().
@@ -4218,7 +4638,9 @@ static void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
         if (!virtio_queue_get_num(vdev, n)) {
             continue;
         }
-        event_notifier_set_handler(&vq->host_notifier, NULL);
+        if (!vq->host_notifier_ctx) {
+            event_notifier_set_handler(&vq->host_notifier, NULL);
+        }
         r = virtio_bus_set_host_notifier(qbus, n, false);
         assert(r >= 0);
     }
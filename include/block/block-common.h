@@ -537,6 +537,13 @@ typedef enum {
     BDRV_FIX_ERRORS   = 2,
 } BdrvCheckMode;
 
+/*
+ * The units of offset and total_work_size may be chosen arbitrarily by the
+ * block driver; total_work_size may change during the course of the check
+ */
+typedef void BlockDriverCheckStatusCB(BlockDriverState *bs, int64_t offset,
+                                      int64_t total_work_size, void *opaque);
+
 typedef struct BlockSizes {
     uint32_t phys;
     uint32_t log;
@@ -60,10 +60,16 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
  * must be > 0.
  *
  * @max_chunk means maximum length for one IO operation. Zero means unlimited.
+ *
+ * If @adaptive is true, the number of parallel coroutines and the length of
+ * IO operations are tuned at runtime based on the measured throughput, with
+ * @max_workers and @max_chunk as upper bounds.  The tuning state is kept in
+ * @s, so subsequent adaptive calls continue from the last configuration.
  */
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
                                      int max_workers, int64_t max_chunk,
+                                     bool adaptive,
                                      BlockCopyAsyncCallbackFunc cb,
                                      void *cb_opaque);
 
@@ -100,6 +106,13 @@ void block_copy_call_cancel(BlockCopyCallState *call_state);
 
 BdrvDirtyBitmap *block_copy_dirty_bitmap(BlockCopyState *s);
 int64_t block_copy_cluster_size(BlockCopyState *s);
+
+/*
+ * Get the current configuration of adaptive block-copy calls.  Returns false
+ * (and leaves @workers and @chunk untouched) if no adaptive call was made yet.
+ */
+bool block_copy_get_tuning(BlockCopyState *s, int *workers, int64_t *chunk);
+
 void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip);
 
 #endif /* BLOCK_COPY_H */
@@ -332,6 +332,28 @@ bdrv_co_copy_range(BdrvChild *src, int64_t src_offset,
                    int64_t bytes, BdrvRequestFlags read_flags,
                    BdrvRequestFlags write_flags);
 
+/**
+ * bdrv_co_get_data_fd:
+ *
+ * Look up a host file descriptor from which [*@offset, *@offset + @bytes)
+ * of @child can be read directly, e.g. with sendfile(2), bypassing the
+ * block layer.  This is only possible if every node down to the protocol
+ * layer is a plain mapping of the data.
+ *
+ * The descriptor is only valid while the graph is unchanged and @child's
+ * node is not reopened.  The caller must make sure that draining the node
+ * waits for it to finish using the descriptor.
+ *
+ * @child: Child to read from
+ * @offset: in: offset in @child; out: offset in the returned descriptor
+ * @bytes: number of bytes to read
+ *
+ * Returns: a file descriptor on success, -ENOTSUP if the data cannot be
+ * read directly, or another negative error code.
+ **/
+int coroutine_fn GRAPH_RDLOCK
+bdrv_co_get_data_fd(BdrvChild *child, int64_t *offset, int64_t bytes);
+
 /*
  * "I/O or GS" API functions. These functions can run without
  * the BQL, but only in one specific iothread/main loop.
@@ -365,7 +387,8 @@ bdrv_truncate(BdrvChild *child, int64_t offset, bool exact,
               PreallocMode prealloc, BdrvRequestFlags flags, Error **errp);
 
 int co_wrapper_mixed_bdrv_rdlock
-bdrv_check(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode fix);
+bdrv_check(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode fix,
+           BlockDriverCheckStatusCB *status_cb, void *cb_opaque);
 
 /* Invalidate any cached metadata used by image formats */
 int co_wrapper_mixed_bdrv_rdlock
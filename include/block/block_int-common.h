@@ -617,6 +617,17 @@ struct BlockDriver {
         BdrvChild *dst, int64_t dst_offset, int64_t bytes,
         BdrvRequestFlags read_flags, BdrvRequestFlags write_flags);
 
+    /*
+     * Map @offset onto a child of @bs and invoke bdrv_co_get_data_fd(child,
+     * ...), or return a host file descriptor from which the data can be
+     * read directly if @bs is the leaf.
+     *
+     * See the comment of bdrv_co_get_data_fd for the parameter and return
+     * value semantics.
+     */
+    int coroutine_fn GRAPH_RDLOCK_PTR (*bdrv_co_get_data_fd)(
+        BlockDriverState *bs, int64_t *offset, int64_t bytes);
+
     /*
      * Building block for bdrv_block_status[_above] and
      * bdrv_is_allocated[_above].  The driver should answer only
@@ -781,10 +792,12 @@ struct BlockDriver {
 
     /*
      * Returns 0 for completed check, -errno for internal errors.
-     * The check results are stored in result.
+     * The check results are stored in result.  Drivers may report their
+     * progress through status_cb, which can be NULL.
      */
     int coroutine_fn GRAPH_RDLOCK_PTR (*bdrv_co_check)(
-        BlockDriverState *bs, BdrvCheckResult *result, BdrvCheckMode fix);
+        BlockDriverState *bs, BdrvCheckResult *result, BdrvCheckMode fix,
+        BlockDriverCheckStatusCB *status_cb, void *cb_opaque);
 
     void coroutine_fn GRAPH_RDLOCK_PTR (*bdrv_co_debug_event)(
         BlockDriverState *bs, BlkdebugEvent event);
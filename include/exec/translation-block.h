@@ -146,6 +146,24 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /*
+     * Successor prediction for indirect branches out of this TB, see
+     * tcg_gen_lookup_and_goto_ptr_cached().  Written by any cpu with
+     * qatomic_set, read by generated code; a stale or mismatched entry
+     * is simply a miss, since the generated code re-checks the pc and
+     * the cpu state of the predicted TB before jumping to it.
+     */
+#define TB_IC_JUMP   0  /* last target of the indirect jump */
+#define TB_IC_RETURN 1  /* return address of the call ending this TB */
+    struct TranslationBlock *ic_dest[2];
+
+    /*
+     * Execution profile, allocated only with -accel tcg,profile=on.
+     * The counters live outside the code_gen buffer, which may not be
+     * writable while the generated code runs; see TBProfile.
+     */
+    struct TBProfile *profile;
 };
 
 /* The alignment given to TranslationBlock during allocation. */
@@ -212,6 +212,9 @@ typedef uint32_t MMUIdxMap;
 /* Use a fully associative victim tlb of 8 entries. */
 #define CPU_VTLB_SIZE 8
 
+/* Number of cross-cpu range flushes that may be queued before overflow. */
+#define CPU_TLB_PENDING_SIZE 16
+
 /*
  * The full TLB entry, which is not accessed by generated TCG code,
  * so the layout is not as critical as that of CPUTLBEntry. This is
@@ -302,6 +305,17 @@ typedef struct CPUTLBDesc {
     CPUTLBEntryFull *fulltlb;
 } CPUTLBDesc;
 
+/*
+ * A range flush requested by another cpu, not yet applied.
+ * See tlb_flush_range_by_mmuidx_all_cpus_synced.
+ */
+typedef struct CPUTLBPendingFlush {
+    vaddr addr;
+    vaddr len;
+    MMUIdxMap idxmap;
+    unsigned bits;
+} CPUTLBPendingFlush;
+
 /*
  * Data elements that are shared between all MMU modes.
  */
@@ -314,14 +328,28 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     MMUIdxMap dirty;
+    /*
+     * Flushes queued by other cpus, coalesced into ranges and applied
+     * by a single work item.  If pending[] overflows, the mmu_idx of
+     * the excess requests are accumulated in pending_full and flushed
+     * entirely.  pending_queued is true while a work item that will
+     * drain the buffer is outstanding.  Protected by tlb_c.lock.
+     */
+    CPUTLBPendingFlush pending[CPU_TLB_PENDING_SIZE];
+    unsigned n_pending;
+    MMUIdxMap pending_full;
+    bool pending_queued;
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
-     * of the stats without interfering with the cpu.
+     * of the stats without interfering with the cpu.  The batch and
+     * coalesce counts are only updated with tlb_c.lock held.
      */
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t batch_flush_count;
+    size_t coalesce_flush_count;
 } CPUTLBCommon;
 
 /*
@@ -358,15 +386,33 @@ typedef union IcountDecr {
     } u16;
 } IcountDecr;
 
+#define CPU_RAS_SIZE 16
+
+/*
+ * Return address stack, maintained by the code generated for
+ * tcg_gen_ras_push() and tcg_gen_lookup_and_goto_ptr_ret().  Each entry
+ * is the TranslationBlock that performed a call; its return prediction
+ * slot caches the TB at the return address.  Only used by the owning
+ * vCPU, and cleared together with the TB jump cache.
+ */
+typedef struct CPUReturnStack {
+#ifdef CONFIG_TCG
+    struct TranslationBlock *tb[CPU_RAS_SIZE];
+    uint32_t top;
+#endif
+} CPUReturnStack;
+
 /**
  * CPUNegativeOffsetState: Elements of CPUState most efficiently accessed
  *                         from CPUArchState, via small negative offsets.
+ * @ras: return address stack for generated code.
  * @can_do_io: True if memory-mapped IO is allowed.
  * @plugin_mem_cbs: active plugin memory callbacks
  * @plugin_mem_value_low: 64 lower bits of latest accessed mem value.
  * @plugin_mem_value_high: 64 higher bits of latest accessed mem value.
  */
 typedef struct CPUNegativeOffsetState {
+    CPUReturnStack ras;
     CPUTLB tlb;
 #ifdef CONFIG_PLUGIN
     /*
@@ -53,6 +53,7 @@ struct VHostUserBlk {
 
     bool skip_get_vring_base_on_force_shutdown;
     bool inflight_migration;
+    uint32_t busy_poll_usecs;
 };
 
 #endif
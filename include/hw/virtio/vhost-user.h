@@ -33,6 +33,7 @@ enum VhostUserProtocolFeature {
     VHOST_USER_PROTOCOL_F_SHARED_OBJECT = 18,
     VHOST_USER_PROTOCOL_F_DEVICE_STATE = 19,
     VHOST_USER_PROTOCOL_F_GET_VRING_BASE_INFLIGHT = 20,
+    VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL = 21,
     VHOST_USER_PROTOCOL_F_MAX
 };
 
@@ -63,6 +64,8 @@ typedef struct VhostUserHostNotifier {
  * @chr: the character backend for the socket
  * @notifiers: GPtrArray of @VhostUserHostnotifier
  * @memory_slots:
+ * @busy_poll_usecs: ask the backend to poll the rings for this long
+ *     before waiting for guest kicks again, 0 to disable
  */
 typedef struct VhostUserState {
     CharFrontend *chr;
@@ -70,6 +73,7 @@ typedef struct VhostUserState {
     int memory_slots;
     bool supports_config;
     bool supports_inflight_migration;
+    uint32_t busy_poll_usecs;
 } VhostUserState;
 
 /**
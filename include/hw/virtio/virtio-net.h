@@ -15,11 +15,13 @@
 #define QEMU_VIRTIO_NET_H
 
 #include "qemu/units.h"
+#include "qemu/stats64.h"
 #include "standard-headers/linux/virtio_net.h"
 #include "hw/virtio/virtio.h"
 #include "net/announce.h"
 #include "qemu/option_int.h"
 #include "qom/object.h"
+#include "qapi/qapi-types-virtio.h"
 
 #include "ebpf/ebpf_rss.h"
 
@@ -56,6 +58,7 @@ typedef struct virtio_net_conf
     char *duplex_str;
     uint8_t duplex;
     char *primary_id_str;
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
 } virtio_net_conf;
 
 /* Coalesced packets type & status */
@@ -138,6 +141,7 @@ typedef struct VirtioNetRscChain {
 
 #define VIRTIO_NET_RSS_MAX_KEY_SIZE     40
 #define VIRTIO_NET_RSS_MAX_TABLE_LEN    128
+#define VIRTIO_NET_FLOW_TABLE_SIZE      4096
 
 typedef struct VirtioNetRssData {
     bool    enabled;
@@ -163,6 +167,8 @@ typedef struct VirtIONetQueue {
     uint32_t tx_waiting;
     struct {
         VirtQueueElement *elem;
+        /* Byte-swapped header, must live as long as elem */
+        struct virtio_net_hdr vhdr;
     } async_tx;
     struct VirtIONet *n;
 } VirtIONetQueue;
@@ -230,6 +236,20 @@ struct VirtIONet {
     struct EBPFRSSContext ebpf_rss;
     uint32_t nr_ebpf_rss_fds;
     char **ebpf_rss_fds;
+    /* AioContext of each queue pair, NULL if all run in the main loop */
+    AioContext **vq_aio_context;
+    bool guest_notifiers_set;
+    /* Nesting depth of virtio_net_quiesce_begin() */
+    unsigned quiesce_depth;
+    /*
+     * Flow affinity: the RX queue of a flow follows the queue the guest
+     * last transmitted it on.  Entries are (flow hash << 32 | queue + 1).
+     */
+    bool flow_affinity;
+    uint64_t *flow_table;
+    Stat64 flow_updates;
+    Stat64 flow_hits;
+    Stat64 flow_misses;
 };
 
 size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
@@ -27,6 +27,7 @@ struct iovec;
 #define CSUM_ALL    (CSUM_IP | CSUM_TCP | CSUM_UDP)
 
 uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq);
+bool test_net_checksum_next_accel(void);
 uint16_t net_checksum_finish(uint32_t sum);
 uint16_t net_checksum_tcpudp(uint16_t length, uint16_t proto,
                              uint8_t *addrs, uint8_t *buf);
@@ -827,6 +827,24 @@ static inline bool aio_has_io_uring(void)
     return ctx->fdmon_ops->add_sqe;
 }
 
+/**
+ * aio_has_io_uring_sqe128: Return whether io_uring is available with
+ * 128-byte sqes (IORING_SETUP_SQE128), which IORING_OP_URING_CMD requests
+ * with an 80-byte command need.
+ *
+ * Like aio_has_io_uring(), the answer is the same in all AioContexts.
+ */
+static inline bool aio_has_io_uring_sqe128(void)
+{
+#ifdef IORING_SETUP_SQE128
+    AioContext *ctx = qemu_get_current_aio_context();
+    return ctx->fdmon_ops->add_sqe &&
+           (ctx->fdmon_io_uring.flags & IORING_SETUP_SQE128);
+#else
+    return false;
+#endif
+}
+
 /**
  * aio_add_sqe: Add an io_uring sqe for submission.
  * @prep_sqe: invoked with an sqe that should be prepared for submission
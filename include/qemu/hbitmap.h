@@ -61,6 +61,34 @@ struct HBitmapIter {
  */
 HBitmap *hbitmap_alloc(uint64_t size, int granularity);
 
+/**
+ * hbitmap_alloc_sparse:
+ * @size: Number of bits in the bitmap.
+ * @granularity: Granularity of the bitmap, as in hbitmap_alloc().
+ *
+ * Allocate a new HBitmap that only allocates memory for the parts that have
+ * bits set.  Sparse HBitmaps support all operations of dense ones, at the
+ * cost of an extra indirection on each access.  They are suited to large
+ * bitmaps that are mostly clean.
+ */
+HBitmap *hbitmap_alloc_sparse(uint64_t size, int granularity);
+
+/**
+ * hbitmap_is_sparse:
+ * @hb: HBitmap to operate on.
+ *
+ * Return whether @hb was allocated with hbitmap_alloc_sparse().
+ */
+bool hbitmap_is_sparse(const HBitmap *hb);
+
+/**
+ * hbitmap_memory_usage:
+ * @hb: HBitmap to operate on.
+ *
+ * Return the number of bytes of memory currently used by @hb.
+ */
+uint64_t hbitmap_memory_usage(const HBitmap *hb);
+
 /**
  * hbitmap_truncate:
  * @hb: The bitmap to change the size of.
@@ -15,6 +15,7 @@
 #include "io/channel-socket.h"
 #include "io/channel-file.h"
 #include "io/net-listener.h"
+#include "qemu/event_notifier.h"
 #include "qapi/error.h"
 #include "standard-headers/linux/virtio_blk.h"
 
@@ -22,6 +23,7 @@
 typedef struct VuFdWatch {
     VuDev *vu_dev;
     int fd; /*kick fd*/
+    EventNotifier notifier; /* wraps fd, which libvhost-user owns */
     void *pvt;
     vu_watch_cb cb;
     QTAILQ_ENTRY(VuFdWatch) next;
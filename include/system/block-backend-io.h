@@ -124,6 +124,13 @@ int coroutine_fn blk_co_copy_range(BlockBackend *blk_in, int64_t off_in,
                                    BlockBackend *blk_out, int64_t off_out,
                                    int64_t bytes, BdrvRequestFlags read_flags,
                                    BdrvRequestFlags write_flags);
+int coroutine_fn GRAPH_RDLOCK
+blk_co_copy_range_from(BdrvChild *src, int64_t off_in,
+                       BlockBackend *blk_out, int64_t off_out,
+                       int64_t bytes, BdrvRequestFlags read_flags,
+                       BdrvRequestFlags write_flags);
+int coroutine_fn blk_co_get_data_fd(BlockBackend *blk, int64_t *offset,
+                                    int64_t bytes);
 
 int coroutine_fn blk_co_block_status_above(BlockBackend *blk,
                                            BlockDriverState *base,
@@ -21,6 +21,7 @@ TCGv_vec tcg_constant_vec_matching(TCGv_vec match, unsigned vece, int64_t val);
 TCGv_i32 tcg_temp_new_i32(void);
 TCGv_i64 tcg_temp_new_i64(void);
 TCGv_ptr tcg_temp_new_ptr(void);
+TCGv_vaddr tcg_temp_new_vaddr(void);
 TCGv_i128 tcg_temp_new_i128(void);
 TCGv_vec tcg_temp_new_vec(TCGType type);
 TCGv_vec tcg_temp_new_vec_matching(TCGv_vec match);
@@ -83,6 +84,41 @@ void tcg_gen_goto_tb(unsigned idx);
  */
 void tcg_gen_lookup_and_goto_ptr(void);
 
+/**
+ * tcg_gen_lookup_and_goto_ptr_cached() - lookup_and_goto_ptr with an
+ *                                        inline prediction
+ * @dest: Guest address of the target TB, as it will be computed by
+ *        the cpu's get_tb_cpu_state hook
+ *
+ * Like tcg_gen_lookup_and_goto_ptr(), but first check whether @dest is
+ * the TB last reached from this exit and if so, jump to it directly
+ * without calling out of generated code.
+ *
+ * As for tcg_gen_goto_tb(), the caller must guarantee that the cpu state
+ * other than the pc, i.e. cs_base and flags, is the same at this exit as
+ * on entry to the TB.  The prediction is not used for CF_PCREL TBs.
+ */
+void tcg_gen_lookup_and_goto_ptr_cached(TCGv_vaddr dest);
+
+/**
+ * tcg_gen_ras_push() - push the current TB onto the return address stack
+ *
+ * For use with a call instruction ending the TB, whose return address
+ * is therefore the end of the TB.  The matching return should use
+ * tcg_gen_lookup_and_goto_ptr_ret().
+ */
+void tcg_gen_ras_push(void);
+
+/**
+ * tcg_gen_lookup_and_goto_ptr_ret() - lookup_and_goto_ptr for a return
+ * @dest: Guest address of the target TB
+ *
+ * As tcg_gen_lookup_and_goto_ptr_cached(), but predict the target using
+ * the return address stack filled by tcg_gen_ras_push().  The same
+ * restrictions apply.
+ */
+void tcg_gen_lookup_and_goto_ptr_ret(TCGv_vaddr dest);
+
 void tcg_gen_plugin_cb(unsigned from);
 void tcg_gen_plugin_mem_cb(TCGv_i64 addr, unsigned meminfo);
 
@@ -133,9 +133,10 @@ typedef enum TCGType {
     TCG_TYPE_V64,
     TCG_TYPE_V128,
     TCG_TYPE_V256,
+    TCG_TYPE_V512,
 
     /* Number of different types (integer not enum) */
-#define TCG_TYPE_COUNT  (TCG_TYPE_V256 + 1)
+#define TCG_TYPE_COUNT  (TCG_TYPE_V512 + 1)
 
     /* An alias for the size of the host register.  */
     TCG_TYPE_REG = TCG_TYPE_I64,
@@ -978,5 +979,9 @@ bool tcg_can_emit_vecop_list(const TCGOpcode *, TCGType, unsigned);
 void tcg_dump_ops(TCGContext *s, FILE *f, bool have_prefs);
 /* tcg_dump_stats: Append TCG statistics to @buf */
 void tcg_dump_stats(GString *buf);
+/* tcg_dump_profile: Append the @max most executed TBs to @buf */
+void tcg_dump_profile(GString *buf, size_t max);
+/* tcg_write_profile_pprof: Write the TB profile to @filename for pprof */
+bool tcg_write_profile_pprof(const char *filename, Error **errp);
 
 #endif /* TCG_H */
@@ -29,6 +29,10 @@
 #include "qemu/units.h"
 #include "qemu/memalign.h"
 
+#ifdef CONFIG_LINUX
+#include <sys/sendfile.h>
+#endif
+
 #define NBD_META_ID_BASE_ALLOCATION 0
 #define NBD_META_ID_ALLOCATION_DEPTH 1
 /* Dirty bitmaps use 'NBD_META_ID_DIRTY_BITMAP + i', so keep this id last. */
@@ -99,8 +103,18 @@ struct NBDExport {
     Notifier eject_notifier;
 
     bool allocation_depth;
+    bool zero_copy;
     BdrvDirtyBitmap **export_bitmaps;
     size_t nr_export_bitmaps;
+
+    /*
+     * For multi-threaded exports, the AioContexts that clients are spread
+     * over, round-robin as they attach.  NULL otherwise, in which case all
+     * clients run in common.ctx.
+     */
+    AioContext **ctxs;
+    size_t nr_ctxs;
+    size_t next_ctx;
 };
 
 static QTAILQ_HEAD(, NBDExport) exports = QTAILQ_HEAD_INITIALIZER(exports);
@@ -129,6 +143,7 @@ struct NBDClient {
     QemuMutex lock;
 
     NBDExport *exp;
+    AioContext *ctx; /* Fixed AioContext for requests, or NULL */
     QCryptoTLSCreds *tlscreds;
     char *tlsauthz;
     uint32_t handshake_max_secs;
@@ -159,6 +174,23 @@ struct NBDClient {
 
 static void nbd_client_receive_next_request(NBDClient *client);
 
+/* Runs in export AioContext and main loop thread */
+static AioContext *nbd_client_aio_context(NBDClient *client)
+{
+    return client->ctx ?: client->exp->common.ctx;
+}
+
+/* Runs in main loop thread, at the end of negotiation */
+static void nbd_client_attach_export(NBDClient *client, NBDExport *exp)
+{
+    client->exp = exp;
+    if (exp->nr_ctxs) {
+        client->ctx = exp->ctxs[exp->next_ctx++ % exp->nr_ctxs];
+    }
+    QTAILQ_INSERT_TAIL(&exp->clients, client, next);
+    blk_exp_ref(&exp->common);
+}
+
 /* Basic flow for negotiation
 
    Server         Client
@@ -536,8 +568,7 @@ nbd_negotiate_handle_export_name(NBDClient *client, bool no_zeroes,
         return ret;
     }
 
-    QTAILQ_INSERT_TAIL(&client->exp->clients, client, next);
-    blk_exp_ref(&client->exp->common);
+    nbd_client_attach_export(client, client->exp);
 
     return 0;
 }
@@ -750,10 +781,8 @@ nbd_negotiate_handle_info(NBDClient *client, Error **errp)
     }
 
     if (client->opt == NBD_OPT_GO) {
-        client->exp = exp;
         client->check_align = check_align;
-        QTAILQ_INSERT_TAIL(&client->exp->clients, client, next);
-        blk_exp_ref(&client->exp->common);
+        nbd_client_attach_export(client, exp);
         rc = 1;
     }
     return rc;
@@ -1755,7 +1784,7 @@ static bool nbd_drained_poll(void *opaque)
                  * qio_channel_yield().
                  */
                 if (client->recv_coroutine != NULL && client->read_yielding) {
-                    aio_bh_schedule_oneshot(nbd_export_aio_context(client->exp),
+                    aio_bh_schedule_oneshot(nbd_client_aio_context(client),
                                             nbd_wake_read_bh, client);
                 }
 
@@ -1832,11 +1861,6 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
         return -EEXIST;
     }
 
-    if (multithread) {
-        error_setg(errp, "NBD export does not support multi-threading");
-        return -EINVAL;
-    }
-
     size = blk_getlength(blk);
     if (size < 0) {
         error_setg_errno(errp, -size,
@@ -1939,6 +1963,15 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     }
 
     exp->allocation_depth = arg->allocation_depth;
+    exp->zero_copy = arg->zero_copy;
+
+    if (multithread) {
+        /* Guaranteed by common export code */
+        assert(mt_count >= 1);
+
+        exp->ctxs = g_memdup2(multithread, mt_count * sizeof(AioContext *));
+        exp->nr_ctxs = mt_count;
+    }
 
     /*
      * We need to inhibit request queuing in the block layer to ensure we can
@@ -2029,6 +2062,9 @@ static void nbd_export_delete(BlockExport *blk_exp)
     for (i = 0; i < exp->nr_export_bitmaps; i++) {
         bdrv_dirty_bitmap_set_busy(exp->export_bitmaps[i], false);
     }
+
+    g_free(exp->ctxs);
+    exp->ctxs = NULL;
 }
 
 const BlockExportDriver blk_exp_nbd = {
@@ -2057,6 +2093,88 @@ static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
     return ret;
 }
 
+/*
+ * Return a host file descriptor from which @size bytes at @offset can be
+ * sent to the client with sendfile(), and the matching file offset in
+ * @host_offset, or -1 if the data must be read into a buffer.
+ */
+static int coroutine_fn nbd_zero_copy_fd(NBDClient *client, uint64_t offset,
+                                         uint64_t size, int64_t *host_offset)
+{
+#ifdef CONFIG_LINUX
+    int fd;
+
+    /* TLS needs to see the plaintext */
+    if (!client->exp->zero_copy || client->ioc != QIO_CHANNEL(client->sioc)) {
+        return -1;
+    }
+
+    /*
+     * The request keeps the export from being drained until it completes,
+     * which in turn keeps the descriptor valid while we use it.
+     */
+    *host_offset = offset;
+    fd = blk_co_get_data_fd(client->exp->common.blk, host_offset, size);
+    return fd < 0 ? -1 : fd;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * Like nbd_co_send_iov(), then send @size bytes from @fd at @offset.
+ * Since the reply header is already out, a read error cannot be reported
+ * to the client and fails the connection.
+ */
+static int coroutine_fn nbd_co_send_iov_fd(NBDClient *client,
+                                           struct iovec *iov, unsigned niov,
+                                           int fd, int64_t offset,
+                                           uint64_t size, Error **errp)
+{
+#ifdef CONFIG_LINUX
+    static const uint8_t zeroes[4096];
+    off_t pos = offset;
+    int ret;
+
+    g_assert(qemu_in_coroutine());
+    trace_nbd_co_send_iov_fd(fd, offset, size);
+    qemu_co_mutex_lock(&client->send_lock);
+    client->send_coroutine = qemu_coroutine_self();
+
+    ret = qio_channel_writev_all(client->ioc, iov, niov, errp) < 0 ? -EIO : 0;
+
+    while (ret == 0 && size) {
+        ssize_t len = sendfile(client->sioc->fd, fd, &pos, size);
+
+        if (len < 0) {
+            if (errno == EAGAIN) {
+                qio_channel_yield(client->ioc, G_IO_OUT);
+            } else if (errno != EINTR) {
+                error_setg_errno(errp, errno, "sendfile failed");
+                ret = -EIO;
+            }
+        } else if (len == 0) {
+            /* The block layer reads the tail of an unaligned file as zeroes */
+            len = MIN(size, sizeof(zeroes));
+            if (qio_channel_write_all(client->ioc, (const char *)zeroes, len,
+                                      errp) < 0) {
+                ret = -EIO;
+            }
+            size -= len;
+        } else {
+            size -= len;
+        }
+    }
+
+    client->send_coroutine = NULL;
+    qemu_co_mutex_unlock(&client->send_lock);
+
+    return ret;
+#else
+    g_assert_not_reached();
+#endif
+}
+
 static inline void set_be_simple_reply(NBDSimpleReply *reply, uint64_t error,
                                        uint64_t cookie)
 {
@@ -2172,6 +2290,34 @@ static int coroutine_fn nbd_co_send_chunk_read(NBDClient *client,
     return nbd_co_send_iov(client, iov, 3, errp);
 }
 
+/* Like nbd_co_send_chunk_read(), but send the data from @fd */
+static int coroutine_fn nbd_co_send_chunk_read_fd(NBDClient *client,
+                                                  NBDRequest *request,
+                                                  uint64_t offset,
+                                                  int fd,
+                                                  int64_t host_offset,
+                                                  uint64_t size,
+                                                  bool final,
+                                                  Error **errp)
+{
+    NBDReply hdr;
+    NBDStructuredReadData chunk;
+    struct iovec iov[] = {
+        {.iov_base = &hdr},
+        {.iov_base = &chunk, .iov_len = sizeof(chunk)},
+        {.iov_len = size}
+    };
+
+    assert(size && size <= NBD_MAX_BUFFER_SIZE);
+    trace_nbd_co_send_chunk_read(request->cookie, offset, NULL, size);
+    /* The last element only feeds the length into the chunk header */
+    set_be_chunk(client, iov, 3, final ? NBD_REPLY_FLAG_DONE : 0,
+                 NBD_REPLY_TYPE_OFFSET_DATA, request);
+    stq_be_p(&chunk.offset, offset);
+
+    return nbd_co_send_iov_fd(client, iov, 2, fd, host_offset, size, errp);
+}
+
 static int coroutine_fn nbd_co_send_chunk_error(NBDClient *client,
                                                 NBDRequest *request,
                                                 uint32_t error,
@@ -2212,6 +2358,8 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
     int ret = 0;
     NBDExport *exp = client->exp;
     size_t progress = 0;
+    int64_t host_offset;
+    int fd;
 
     assert(size <= NBD_MAX_BUFFER_SIZE);
     while (progress < size) {
@@ -2248,6 +2396,11 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
             stq_be_p(&chunk.offset, offset + progress);
             stl_be_p(&chunk.length, pnum);
             ret = nbd_co_send_iov(client, iov, 2, errp);
+        } else if ((fd = nbd_zero_copy_fd(client, offset + progress, pnum,
+                                          &host_offset)) >= 0) {
+            ret = nbd_co_send_chunk_read_fd(client, request, offset + progress,
+                                            fd, host_offset, pnum, final,
+                                            errp);
         } else {
             ret = blk_co_pread(exp->common.blk, offset + progress, pnum,
                                data + progress, 0);
@@ -2855,6 +3008,8 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
 {
     int ret;
     NBDExport *exp = client->exp;
+    int64_t host_offset;
+    int fd;
 
     assert(request->type == NBD_CMD_READ);
     assert(request->len <= NBD_MAX_BUFFER_SIZE);
@@ -2875,6 +3030,25 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
                                        data, request->len, errp);
     }
 
+    fd = request->len ? nbd_zero_copy_fd(client, request->from, request->len,
+                                         &host_offset) : -1;
+    if (fd >= 0 && client->mode >= NBD_MODE_STRUCTURED) {
+        return nbd_co_send_chunk_read_fd(client, request, request->from, fd,
+                                         host_offset, request->len, true,
+                                         errp);
+    } else if (fd >= 0) {
+        NBDSimpleReply reply;
+        struct iovec iov[] = {
+            {.iov_base = &reply, .iov_len = sizeof(reply)},
+        };
+
+        trace_nbd_co_send_simple_reply(request->cookie, 0, nbd_err_lookup(0),
+                                       request->len);
+        set_be_simple_reply(&reply, 0, request->cookie);
+        return nbd_co_send_iov_fd(client, iov, 1, fd, host_offset,
+                                  request->len, errp);
+    }
+
     ret = blk_co_pread(exp->common.blk, request->from, request->len, data, 0);
     if (ret < 0) {
         return nbd_send_generic_reply(client, request, ret,
@@ -3215,7 +3389,8 @@ static void nbd_client_receive_next_request(NBDClient *client)
         nbd_client_get(client);
         req = nbd_request_get(client);
         client->recv_coroutine = qemu_coroutine_create(nbd_trip, req);
-        aio_co_schedule(client->exp->common.ctx, client->recv_coroutine);
+        aio_co_schedule(nbd_client_aio_context(client),
+                        client->recv_coroutine);
     }
 }
 
@@ -16,6 +16,7 @@
 #include <linux/if_link.h>
 #include <linux/if_xdp.h>
 #include <net/if.h>
+#include <sys/socket.h>
 #include <xdp/xsk.h>
 
 #include "clients.h"
@@ -55,20 +56,60 @@ typedef struct AFXDPState {
     char                 *map_path;
     int                  map_fd;
     uint32_t             map_start_index;
+
+    AioContext           *ctx;          /* NULL for the main loop */
+    bool                 busy_poll;
 } AFXDPState;
 
 #define AF_XDP_BATCH_SIZE 64
 
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
 static void af_xdp_send(void *opaque);
 static void af_xdp_writable(void *opaque);
 
+/*
+ * With SO_PREFER_BUSY_POLL the device queue is only serviced when we ask
+ * for it, so every empty poll of the rx ring must kick the kernel.
+ */
+static void af_xdp_busy_poll_kick(AFXDPState *s)
+{
+    recvfrom(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, NULL);
+}
+
+/* The AioContext io_poll() callback: are there received packets? */
+static bool af_xdp_rx_poll(void *opaque)
+{
+    AFXDPState *s = opaque;
+
+    if (xsk_cons_nb_avail(&s->rx, 1)) {
+        return true;
+    }
+    if (s->busy_poll) {
+        af_xdp_busy_poll_kick(s);
+        return xsk_cons_nb_avail(&s->rx, 1);
+    }
+    return false;
+}
+
 /* Set the event-loop handlers for the af-xdp backend. */
 static void af_xdp_update_fd_handler(AFXDPState *s)
 {
-    qemu_set_fd_handler(xsk_socket__fd(s->xsk),
-                        s->read_poll ? af_xdp_send : NULL,
-                        s->write_poll ? af_xdp_writable : NULL,
-                        s);
+    IOHandler *fd_read = s->read_poll ? af_xdp_send : NULL;
+    IOHandler *fd_write = s->write_poll ? af_xdp_writable : NULL;
+
+    if (s->ctx) {
+        /* Let the IOThread poll the rx ring instead of waiting for the fd */
+        aio_set_fd_handler(s->ctx, xsk_socket__fd(s->xsk), fd_read, fd_write,
+                           s->read_poll ? af_xdp_rx_poll : NULL, fd_read, s);
+    } else {
+        qemu_set_fd_handler(xsk_socket__fd(s->xsk), fd_read, fd_write, s);
+    }
 }
 
 /* Update the read handler. */
@@ -142,10 +183,16 @@ static void af_xdp_writable(void *opaque)
     qemu_flush_queued_packets(&s->nc);
 }
 
-static ssize_t af_xdp_receive(NetClientState *nc,
-                              const uint8_t *buf, size_t size)
+/*
+ * Gather the packet straight from the sender's iovec (i.e. guest memory
+ * for virtio-net) into a UMEM frame, rather than letting the net layer
+ * linearize it into a bounce buffer first.
+ */
+static ssize_t af_xdp_receive_iov(NetClientState *nc,
+                                  const struct iovec *iov, int iovcnt)
 {
     AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+    size_t size = iov_size(iov, iovcnt);
     struct xdp_desc *desc;
     uint32_t idx;
     void *data;
@@ -172,18 +219,34 @@ static ssize_t af_xdp_receive(NetClientState *nc,
     desc->len = size;
 
     data = xsk_umem__get_data(s->buffer, desc->addr);
-    memcpy(data, buf, size);
+    iov_to_buf(iov, iovcnt, 0, data, size);
 
     xsk_ring_prod__submit(&s->tx, 1);
     s->outstanding_tx++;
 
     if (xsk_ring_prod__needs_wakeup(&s->tx)) {
-        af_xdp_write_poll(s, true);
+        if (s->busy_poll) {
+            /* Kick Tx right away instead of a round trip through poll(). */
+            sendto(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
+        } else {
+            af_xdp_write_poll(s, true);
+        }
     }
 
     return size;
 }
 
+static ssize_t af_xdp_receive(NetClientState *nc,
+                              const uint8_t *buf, size_t size)
+{
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = size,
+    };
+
+    return af_xdp_receive_iov(nc, &iov, 1);
+}
+
 /*
  * Complete a previous send (backend --> guest) and enable the
  * fd_read callback.
@@ -226,6 +289,9 @@ static void af_xdp_send(void *opaque)
 
     n_rx = xsk_ring_cons__peek(&s->rx, AF_XDP_BATCH_SIZE, &idx);
     if (!n_rx) {
+        if (s->busy_poll) {
+            af_xdp_busy_poll_kick(s);
+        }
         return;
     }
 
@@ -403,6 +469,34 @@ static int af_xdp_socket_create(AFXDPState *s,
     return 0;
 }
 
+static int af_xdp_busy_poll_setup(AFXDPState *s,
+                                  const NetdevAFXDPOptions *opts, Error **errp)
+{
+    int fd = xsk_socket__fd(s->xsk);
+    int prefer = 1;
+    int usecs = opts->busy_poll_usecs;
+    int budget = opts->has_busy_poll_budget ? opts->busy_poll_budget
+                                            : AF_XDP_BATCH_SIZE;
+
+    if (!opts->has_busy_poll_usecs || !opts->busy_poll_usecs) {
+        return 0;
+    }
+
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                   &prefer, sizeof(prefer)) ||
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) ||
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET,
+                   &budget, sizeof(budget))) {
+        error_setg_errno(errp, errno,
+                         "failed to enable busy polling for %s queue_index: %d",
+                         s->ifname, s->nc.queue_index);
+        return -1;
+    }
+
+    s->busy_poll = true;
+    return 0;
+}
+
 static int af_xdp_update_xsk_map(AFXDPState *s, Error **errp)
 {
     int xsk_fd, idx, error = 0;
@@ -433,12 +527,33 @@ static int af_xdp_update_xsk_map(AFXDPState *s, Error **errp)
 }
 
 /* NetClientInfo methods. */
+/* Move the event-loop handlers to another AioContext. */
+static void af_xdp_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+    int fd = xsk_socket__fd(s->xsk);
+
+    if (s->ctx == ctx) {
+        return;
+    }
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, fd, NULL, NULL, NULL, NULL, NULL);
+    } else {
+        qemu_set_fd_handler(fd, NULL, NULL, NULL);
+    }
+    s->ctx = ctx;
+    af_xdp_update_fd_handler(s);
+}
+
 static NetClientInfo net_af_xdp_info = {
     .type = NET_CLIENT_DRIVER_AF_XDP,
     .size = sizeof(AFXDPState),
     .receive = af_xdp_receive,
+    .receive_iov = af_xdp_receive_iov,
     .poll = af_xdp_poll,
     .cleanup = af_xdp_cleanup,
+    .set_aio_context = af_xdp_set_aio_context,
 };
 
 static int *parse_socket_fds(const char *sock_fds_str,
@@ -520,6 +635,22 @@ int net_init_af_xdp(const Netdev *netdev,
         error_setg(errp, "'map-start-index' requires 'map-path'");
         return -1;
     }
+    if (opts->has_busy_poll_budget &&
+        (!opts->has_busy_poll_usecs || !opts->busy_poll_usecs)) {
+        error_setg(errp, "'busy-poll-budget' requires 'busy-poll-usecs'");
+        return -1;
+    }
+    if (opts->has_busy_poll_budget &&
+        (!opts->busy_poll_budget || opts->busy_poll_budget > INT_MAX)) {
+        error_setg(errp, "invalid 'busy-poll-budget' (%" PRIu32 ")",
+                   opts->busy_poll_budget);
+        return -1;
+    }
+    if (opts->has_busy_poll_usecs && opts->busy_poll_usecs > INT_MAX) {
+        error_setg(errp, "invalid 'busy-poll-usecs' (%" PRIu32 ")",
+                   opts->busy_poll_usecs);
+        return -1;
+    }
 
     map_start_index = opts->has_map_start_index ? opts->map_start_index : 0;
     if (map_start_index < 0) {
@@ -556,9 +687,12 @@ int net_init_af_xdp(const Netdev *netdev,
 
         if (af_xdp_umem_create(s, sock_fds ? sock_fds[i] : -1, &err) ||
             af_xdp_socket_create(s, opts, &err) ||
+            af_xdp_busy_poll_setup(s, opts, &err) ||
             af_xdp_update_xsk_map(s, &err)) {
             goto err;
         }
+
+        af_xdp_read_poll(s, true); /* Initially only poll for reads. */
     }
 
     if (nc0 && !inhibit) {
@@ -571,8 +705,6 @@ int net_init_af_xdp(const Netdev *netdev,
         }
     }
 
-    af_xdp_read_poll(s, true); /* Initially only poll for reads. */
-
     return 0;
 
 err:
@@ -7,6 +7,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/aio-wait.h"
 #include "qemu/cutils.h"
 #include "net/announce.h"
 #include "net/net.h"
@@ -133,6 +134,35 @@ static const char *qemu_ether_ntoa(const MACAddr *mac)
     return ret;
 }
 
+typedef struct AnnounceSelfPacket {
+    NetClientState *nc;
+    const uint8_t *buf;
+    int len;
+} AnnounceSelfPacket;
+
+static void qemu_announce_send_bh(void *opaque)
+{
+    AnnounceSelfPacket *pkt = opaque;
+
+    qemu_send_packet_raw(pkt->nc, pkt->buf, pkt->len);
+}
+
+/*
+ * The peer of a NIC may run in an IOThread, together with the NIC queue
+ * that it feeds; send the packet from there.
+ */
+static void qemu_announce_send(NetClientState *nc, const uint8_t *buf, int len)
+{
+    AioContext *ctx = nc->peer ? nc->peer->aio_context : NULL;
+    AnnounceSelfPacket pkt = { .nc = nc, .buf = buf, .len = len };
+
+    if (ctx) {
+        aio_wait_bh_oneshot(ctx, qemu_announce_send_bh, &pkt);
+    } else {
+        qemu_announce_send_bh(&pkt);
+    }
+}
+
 static void qemu_announce_self_iter(NICState *nic, void *opaque)
 {
     AnnounceTimer *timer = opaque;
@@ -164,7 +194,7 @@ static void qemu_announce_self_iter(NICState *nic, void *opaque)
     if (!skip) {
         len = announce_self_create(buf, nic->conf->macaddr.a);
 
-        qemu_send_packet_raw(qemu_get_queue(nic), buf, len);
+        qemu_announce_send(qemu_get_queue(nic), buf, len);
 
         /* if the NIC provides it's own announcement support, use it as well */
         if (nic->ncs->info->announce) {
@@ -18,25 +18,84 @@
 #include "qemu/osdep.h"
 #include "net/checksum.h"
 #include "net/eth.h"
+#include "host/cpuinfo.h"
 
-uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
+/*
+ * The accelerated helpers return the ones' complement sum of the buffer
+ * as host-endian 16-bit words, unfolded.  Since the ones' complement sum
+ * is independent of byte order (RFC 1071), net_checksum_add_cont only
+ * needs to fold it and swap it to the order the caller expects.
+ */
+typedef uint64_t (*csum_accel_fn)(const uint8_t *, size_t);
+
+/* Bytes summed into 32-bit vector lanes before widening them.  */
+#define NET_CHECKSUM_CHUNK  (64 * 1024)
+
+static uint64_t net_checksum_int(const uint8_t *buf, size_t len)
 {
-    uint32_t sum1 = 0, sum2 = 0;
-    int i;
+    uint64_t sum = 0;
 
-    for (i = 0; i < len - 1; i += 2) {
-        sum1 += (uint32_t)buf[i];
-        sum2 += (uint32_t)buf[i + 1];
+    /* A 32-bit word is congruent to the sum of its halves mod 0xffff.  */
+    for (; len >= 4; buf += 4, len -= 4) {
+        sum += ldl_he_p(buf);
+    }
+    if (len >= 2) {
+        sum += lduw_he_p(buf);
+        buf += 2;
+        len -= 2;
     }
-    if (i < len) {
-        sum1 += (uint32_t)buf[i];
+    if (len) {
+        uint8_t tail[2] = { buf[0], 0 };
+        sum += lduw_he_p(tail);
+    }
+    return sum;
+}
+
+#include "host/checksum.c.inc"
+
+static csum_accel_fn net_checksum_accel;
+static unsigned accel_index;
+
+static uint16_t net_checksum_fold(uint64_t sum)
+{
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
+{
+    uint16_t sum;
+
+    if (len <= 0) {
+        return 0;
     }
 
+    sum = net_checksum_fold(len >= 64 ? net_checksum_accel(buf, len)
+                                      : net_checksum_int(buf, len));
+    /* Big-endian words if the chunk starts at an even offset.  */
+    sum = be16_to_cpu(sum);
     if (seq & 1) {
-        return sum1 + (sum2 << 8);
-    } else {
-        return sum2 + (sum1 << 8);
+        sum = bswap16(sum);
+    }
+    return sum;
+}
+
+bool test_net_checksum_next_accel(void)
+{
+    if (accel_index != 0) {
+        net_checksum_accel = accel_table[--accel_index];
+        return true;
     }
+    return false;
+}
+
+static void __attribute__((constructor)) init_accel(void)
+{
+    accel_index = best_accel();
+    net_checksum_accel = accel_table[accel_index];
 }
 
 uint16_t net_checksum_finish(uint32_t sum)
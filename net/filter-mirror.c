@@ -45,19 +45,22 @@ struct MirrorState {
 
 typedef struct FilterSendCo {
     MirrorState *s;
-    char *buf;
+    const struct iovec *iov;
+    int iovcnt;
     ssize_t size;
     bool done;
     int ret;
 } FilterSendCo;
 
 static int _filter_send(MirrorState *s,
-                       char *buf,
+                       const struct iovec *iov,
+                       int iovcnt,
                        ssize_t size)
 {
     NetFilterState *nf = NETFILTER(s);
     int ret = 0;
     uint32_t len = 0;
+    int i;
 
     len = htonl(size);
     ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)&len, sizeof(len));
@@ -82,9 +85,19 @@ static int _filter_send(MirrorState *s,
         }
     }
 
-    ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)buf, size);
-    if (ret != size) {
-        goto err;
+    /*
+     * The caller waits for us, so the packet can be written straight
+     * from the sender's buffers.
+     */
+    for (i = 0; i < iovcnt; i++) {
+        if (!iov[i].iov_len) {
+            continue;
+        }
+        ret = qemu_chr_fe_write_all(&s->chr_out, iov[i].iov_base,
+                                    iov[i].iov_len);
+        if (ret != iov[i].iov_len) {
+            goto err;
+        }
     }
 
     return size;
@@ -97,9 +110,8 @@ static void coroutine_fn filter_send_co(void *opaque)
 {
     FilterSendCo *data = opaque;
 
-    data->ret = _filter_send(data->s, data->buf, data->size);
+    data->ret = _filter_send(data->s, data->iov, data->iovcnt, data->size);
     data->done = true;
-    g_free(data->buf);
     aio_wait_kick();
 }
 
@@ -108,19 +120,16 @@ static int filter_send(MirrorState *s,
                        int iovcnt)
 {
     ssize_t size = iov_size(iov, iovcnt);
-    char *buf = NULL;
 
     if (!size) {
         return 0;
     }
 
-    buf = g_malloc(size);
-    iov_to_buf(iov, iovcnt, 0, buf, size);
-
     FilterSendCo data = {
         .s = s,
+        .iov = iov,
+        .iovcnt = iovcnt,
         .size = size,
-        .buf = buf,
         .ret = 0,
     };
 
@@ -0,0 +1,213 @@
+/*
+ * Software segmentation and checksum offload for network backends
+ *
+ * Backends that move plain Ethernet frames (socket, stream, dgram, user,
+ * ...) cannot take the virtio-net header that a NIC produces when it is
+ * allowed to offload TSO/USO and checksumming.  With sw-offload=on, the
+ * net layer hands them the header anyway and this file performs the
+ * requested work right before the frames leave QEMU, so that the guest
+ * can build 64k packets and the per-packet cost is paid once per
+ * segment in a tight loop instead of once per segment in the guest.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "net/checksum.h"
+#include "net/eth.h"
+#include "standard-headers/linux/virtio_net.h"
+#include "gso.h"
+
+static void net_gso_l4_csum(uint8_t *buf, size_t len, bool is_ip6,
+                            size_t l3off, size_t l4off, uint8_t proto,
+                            size_t csum_off)
+{
+    size_t l4len = len - l4off;
+    uint8_t *csum = buf + l4off + csum_off;
+    uint32_t sum;
+
+    stw_he_p(csum, 0);
+    sum = net_checksum_add(l4len, buf + l4off);
+    if (is_ip6) {
+        sum += net_checksum_add(2 * sizeof(struct in6_address),
+                                buf + l3off +
+                                offsetof(struct ip6_header, ip6_src));
+    } else {
+        sum += net_checksum_add(2 * sizeof(uint32_t),
+                                buf + l3off +
+                                offsetof(struct ip_header, ip_src));
+    }
+    sum += proto + l4len;
+    stw_be_p(csum, net_checksum_finish_nozero(sum));
+}
+
+static ssize_t net_gso_deliver_buf(NetClientState *nc, uint8_t *buf,
+                                   size_t len, unsigned flags,
+                                   NetGSODeliver *deliver)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    return deliver(nc, &iov, 1, flags);
+}
+
+static ssize_t net_gso_segment(NetClientState *nc,
+                               const struct virtio_net_hdr *hdr,
+                               uint8_t *buf, size_t len, size_t size,
+                               unsigned flags, NetGSODeliver *deliver)
+{
+    struct iovec buf_iov = { .iov_base = buf, .iov_len = len };
+    uint8_t gso_type = hdr->gso_type & ~VIRTIO_NET_HDR_GSO_ECN;
+    size_t mss = hdr->gso_size;
+    bool hasip4, hasip6;
+    size_t l3off, l4off, l5off;
+    eth_ip6_hdr_info ip6info;
+    eth_ip4_hdr_info ip4info;
+    eth_l4_hdr_info l4info;
+    g_autofree uint8_t *seg = NULL;
+    size_t payload, off;
+    uint16_t ip_id;
+    uint32_t seq;
+    bool valid;
+    unsigned int i;
+
+    eth_get_protocols(&buf_iov, 1, 0, &hasip4, &hasip6,
+                      &l3off, &l4off, &l5off,
+                      &ip6info, &ip4info, &l4info);
+
+    switch (gso_type) {
+    case VIRTIO_NET_HDR_GSO_TCPV4:
+        valid = hasip4 && l4info.proto == ETH_L4_HDR_PROTO_TCP;
+        break;
+    case VIRTIO_NET_HDR_GSO_TCPV6:
+        valid = hasip6 && l4info.proto == ETH_L4_HDR_PROTO_TCP;
+        break;
+    case VIRTIO_NET_HDR_GSO_UDP_L4:
+        valid = (hasip4 || hasip6) && l4info.proto == ETH_L4_HDR_PROTO_UDP;
+        break;
+    default:
+        /* UFO needs IP fragmentation and is never offered to the guest */
+        valid = false;
+        break;
+    }
+
+    if (!valid || !mss || l5off > len) {
+        /* Drop malformed packets, as a NIC would */
+        return size;
+    }
+
+    /* IPv6 has no IP ID, and eth_get_protocols() leaves @ip4info unset */
+    ip_id = hasip4 ? be16_to_cpu(ip4info.ip4_hdr.ip_id) : 0;
+    seq = be32_to_cpu(l4info.hdr.tcp.th_seq);
+    payload = len - l5off;
+    seg = g_malloc(l5off + MIN(mss, payload));
+
+    off = 0;
+    i = 0;
+    do {
+        size_t seglen = MIN(mss, payload - off);
+        size_t seg_size = l5off + seglen;
+        bool last = off + seglen == payload;
+        ssize_t ret;
+
+        memcpy(seg, buf, l5off);
+        memcpy(seg + l5off, buf + l5off + off, seglen);
+
+        if (hasip4) {
+            struct ip_header *ip = (struct ip_header *)(seg + l3off);
+
+            stw_be_p(&ip->ip_len, seg_size - l3off);
+            stw_be_p(&ip->ip_id, ip_id + i);
+            eth_fix_ip4_checksum(ip, l4off - l3off);
+        } else {
+            struct ip6_header *ip6 = (struct ip6_header *)(seg + l3off);
+
+            stw_be_p(&ip6->ip6_plen, seg_size - l3off - sizeof(*ip6));
+        }
+
+        if (l4info.proto == ETH_L4_HDR_PROTO_TCP) {
+            tcp_header *tcp = (tcp_header *)(seg + l4off);
+            uint16_t th_flags = lduw_be_p(&tcp->th_offset_flags);
+
+            stl_be_p(&tcp->th_seq, seq + off);
+            if (i) {
+                th_flags &= ~TH_CWR;
+            }
+            if (!last) {
+                th_flags &= ~(TH_FIN | TH_PUSH);
+            }
+            stw_be_p(&tcp->th_offset_flags, th_flags);
+            net_gso_l4_csum(seg, seg_size, hasip6, l3off, l4off,
+                            IP_PROTO_TCP, offsetof(tcp_header, th_sum));
+        } else {
+            udp_header *udp = (udp_header *)(seg + l4off);
+
+            stw_be_p(&udp->uh_ulen, seg_size - l4off);
+            net_gso_l4_csum(seg, seg_size, hasip6, l3off, l4off,
+                            IP_PROTO_UDP, offsetof(udp_header, uh_sum));
+        }
+
+        ret = net_gso_deliver_buf(nc, seg, seg_size, flags, deliver);
+        if (ret <= 0) {
+            /*
+             * If the first segment could not be sent, let the caller
+             * queue the whole packet.  Otherwise the rest is lost, which
+             * TCP recovers from like any other drop.
+             */
+            return i ? size : ret;
+        }
+
+        off += seglen;
+        i++;
+    } while (off < payload);
+
+    return size;
+}
+
+ssize_t net_gso_deliver(NetClientState *nc, const struct iovec *iov,
+                        int iovcnt, unsigned flags, NetGSODeliver *deliver)
+{
+    struct virtio_net_hdr hdr;
+    size_t hdr_len = nc->vnet_hdr_len;
+    size_t size = iov_size(iov, iovcnt);
+    g_autofree struct iovec *frame_iov = NULL;
+    g_autofree uint8_t *buf = NULL;
+    size_t len;
+    int frame_cnt;
+    ssize_t ret;
+
+    if (size < hdr_len ||
+        iov_to_buf(iov, iovcnt, 0, &hdr, sizeof(hdr)) < sizeof(hdr)) {
+        return size;
+    }
+    len = size - hdr_len;
+
+    if (hdr.gso_type == VIRTIO_NET_HDR_GSO_NONE &&
+        !(hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)) {
+        /* Nothing to do, just skip the header without copying */
+        frame_iov = g_new(struct iovec, iovcnt);
+        frame_cnt = iov_copy(frame_iov, iovcnt, iov, iovcnt, hdr_len, len);
+        ret = deliver(nc, frame_iov, frame_cnt, flags);
+        return ret <= 0 ? ret : size;
+    }
+
+    buf = g_malloc(len);
+    iov_to_buf(iov, iovcnt, hdr_len, buf, len);
+
+    if (hdr.gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+        return net_gso_segment(nc, &hdr, buf, len, size, flags, deliver);
+    }
+
+    /* Partial checksum; the guest has seeded the field with the pseudo-header */
+    if (hdr.csum_start + hdr.csum_offset + sizeof(uint16_t) <= len) {
+        uint8_t *csum = buf + hdr.csum_start + hdr.csum_offset;
+
+        stw_be_p(csum, net_checksum_finish_nozero(
+                     net_checksum_add(len - hdr.csum_start,
+                                      buf + hdr.csum_start)));
+    }
+
+    ret = net_gso_deliver_buf(nc, buf, len, flags, deliver);
+    return ret <= 0 ? ret : size;
+}
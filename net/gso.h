@@ -0,0 +1,37 @@
+/*
+ * Software segmentation and checksum offload for network backends
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef NET_GSO_H
+#define NET_GSO_H
+
+#include "net/net.h"
+
+typedef ssize_t (NetGSODeliver)(NetClientState *nc, const struct iovec *iov,
+                                int iovcnt, unsigned flags);
+
+/**
+ * net_gso_deliver:
+ * @nc: the receiving backend, with a non-zero vnet_hdr_len
+ * @iov: packet prefixed by a virtio-net header of @nc->vnet_hdr_len bytes
+ * @iovcnt: number of elements in @iov
+ * @flags: packet flags, passed through to @deliver
+ * @deliver: callback that hands one plain Ethernet frame to @nc
+ *
+ * Strip the virtio-net header from @iov and carry out the offloads it
+ * requests on behalf of a backend that cannot: TCP and UDP segmentation
+ * according to gso_type and gso_size, and checksum completion for
+ * VIRTIO_NET_HDR_F_NEEDS_CSUM.  Each resulting frame is passed to
+ * @deliver.
+ *
+ * Returns: the return value of @deliver for the first frame if it is
+ * zero or negative, the size of @iov otherwise.  Frames following a
+ * frame that @deliver failed to send are dropped.
+ */
+ssize_t net_gso_deliver(NetClientState *nc, const struct iovec *iov,
+                        int iovcnt, unsigned flags, NetGSODeliver *deliver);
+
+#endif /* NET_GSO_H */
@@ -27,6 +27,7 @@
 #include "net/net.h"
 #include "clients.h"
 #include "hub.h"
+#include "gso.h"
 #include "hw/core/qdev-properties.h"
 #include "net/slirp.h"
 #include "net/eth.h"
@@ -516,6 +517,10 @@ bool qemu_has_ufo(NetClientState *nc)
 
 bool qemu_has_uso(NetClientState *nc)
 {
+    if (nc && nc->sw_offload) {
+        return true;
+    }
+
     if (!nc || !nc->info->has_uso) {
         return false;
     }
@@ -534,6 +539,10 @@ bool qemu_has_tunnel(NetClientState *nc)
 
 bool qemu_has_vnet_hdr(NetClientState *nc)
 {
+    if (nc && nc->sw_offload) {
+        return true;
+    }
+
     if (!nc || !nc->info->has_vnet_hdr) {
         return false;
     }
@@ -543,6 +552,12 @@ bool qemu_has_vnet_hdr(NetClientState *nc)
 
 bool qemu_has_vnet_hdr_len(NetClientState *nc, int len)
 {
+    if (nc && nc->sw_offload) {
+        return len == sizeof(struct virtio_net_hdr_mrg_rxbuf) ||
+               len == sizeof(struct virtio_net_hdr) ||
+               len == sizeof(struct virtio_net_hdr_v1_hash);
+    }
+
     if (!nc || !nc->info->has_vnet_hdr_len) {
         return false;
     }
@@ -570,7 +585,7 @@ int qemu_get_vnet_hdr_len(NetClientState *nc)
 
 void qemu_set_vnet_hdr_len(NetClientState *nc, int len)
 {
-    if (!nc || !nc->info->set_vnet_hdr_len) {
+    if (!nc || (!nc->info->set_vnet_hdr_len && !nc->sw_offload)) {
         return;
     }
 
@@ -580,7 +595,9 @@ void qemu_set_vnet_hdr_len(NetClientState *nc, int len)
            len == sizeof(struct virtio_net_hdr_v1_hash_tunnel));
 
     nc->vnet_hdr_len = len;
-    nc->info->set_vnet_hdr_len(nc, len);
+    if (nc->info->set_vnet_hdr_len) {
+        nc->info->set_vnet_hdr_len(nc, len);
+    }
 }
 
 bool qemu_get_vnet_hash_supported_types(NetClientState *nc, uint32_t *types)
@@ -592,6 +609,21 @@ bool qemu_get_vnet_hash_supported_types(NetClientState *nc, uint32_t *types)
     return nc->info->get_vnet_hash_supported_types(nc, types);
 }
 
+/*
+ * Move the I/O handlers of @nc to @ctx, or back to the main loop if @ctx
+ * is NULL.  Returns false if the backend can only run in the main loop.
+ */
+bool qemu_set_net_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    if (!nc || !nc->info->set_aio_context) {
+        return false;
+    }
+
+    nc->info->set_aio_context(nc, ctx);
+    nc->aio_context = ctx;
+    return true;
+}
+
 int qemu_set_vnet_le(NetClientState *nc, bool is_le)
 {
 #if HOST_BIG_ENDIAN
@@ -826,6 +858,17 @@ static ssize_t nc_sendv_compat(NetClientState *nc, const struct iovec *iov,
     return ret;
 }
 
+static ssize_t qemu_deliver_packet_one(NetClientState *nc,
+                                       const struct iovec *iov,
+                                       int iovcnt, unsigned flags)
+{
+    if (nc->info->receive_iov) {
+        return nc->info->receive_iov(nc, iov, iovcnt);
+    } else {
+        return nc_sendv_compat(nc, iov, iovcnt, flags);
+    }
+}
+
 static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
                                        unsigned flags,
                                        const struct iovec *iov,
@@ -862,12 +905,22 @@ static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
         memcpy(&iov_copy[1], iov, iovcnt * sizeof(*iov));
         iov = iov_copy;
         iovcnt++;
+    } else if (sender->sw_offload && sender->vnet_hdr_len &&
+               sender->peer == nc) {
+        /* The peer expects a header that the backend cannot provide */
+        iov_copy = g_new(struct iovec, iovcnt + 1);
+        iov_copy[0].iov_base = &vnet_hdr;
+        iov_copy[0].iov_len =  sender->vnet_hdr_len;
+        memcpy(&iov_copy[1], iov, iovcnt * sizeof(*iov));
+        iov = iov_copy;
+        iovcnt++;
     }
 
-    if (nc->info->receive_iov) {
-        ret = nc->info->receive_iov(nc, iov, iovcnt);
+    if (nc->sw_offload && nc->vnet_hdr_len) {
+        ret = net_gso_deliver(nc, iov, iovcnt, flags,
+                              qemu_deliver_packet_one);
     } else {
-        ret = nc_sendv_compat(nc, iov, iovcnt, flags);
+        ret = qemu_deliver_packet_one(nc, iov, iovcnt, flags);
     }
 
     if (owned_reentrancy_guard) {
@@ -881,9 +934,11 @@ static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
     return ret;
 }
 
-ssize_t qemu_sendv_packet_async(NetClientState *sender,
-                                const struct iovec *iov, int iovcnt,
-                                NetPacketSent *sent_cb)
+static ssize_t qemu_sendv_packet_async_with_flags(NetClientState *sender,
+                                                  unsigned flags,
+                                                  const struct iovec *iov,
+                                                  int iovcnt,
+                                                  NetPacketSent *sent_cb)
 {
     NetQueue *queue;
     size_t size = iov_size(iov, iovcnt);
@@ -899,24 +954,41 @@ ssize_t qemu_sendv_packet_async(NetClientState *sender,
 
     /* Let filters handle the packet first */
     ret = filter_receive_iov(sender, NET_FILTER_DIRECTION_TX, sender,
-                             QEMU_NET_PACKET_FLAG_NONE, iov, iovcnt, sent_cb);
+                             flags, iov, iovcnt, sent_cb);
     if (ret) {
         return ret;
     }
 
     ret = filter_receive_iov(sender->peer, NET_FILTER_DIRECTION_RX, sender,
-                             QEMU_NET_PACKET_FLAG_NONE, iov, iovcnt, sent_cb);
+                             flags, iov, iovcnt, sent_cb);
     if (ret) {
         return ret;
     }
 
     queue = sender->peer->incoming_queue;
 
-    return qemu_net_queue_send_iov(queue, sender,
-                                   QEMU_NET_PACKET_FLAG_NONE,
+    return qemu_net_queue_send_iov(queue, sender, flags,
                                    iov, iovcnt, sent_cb);
 }
 
+ssize_t qemu_sendv_packet_async(NetClientState *sender,
+                                const struct iovec *iov, int iovcnt,
+                                NetPacketSent *sent_cb)
+{
+    return qemu_sendv_packet_async_with_flags(sender,
+                                              QEMU_NET_PACKET_FLAG_NONE,
+                                              iov, iovcnt, sent_cb);
+}
+
+ssize_t qemu_sendv_packet_async_stable(NetClientState *sender,
+                                       const struct iovec *iov, int iovcnt,
+                                       NetPacketSent *sent_cb)
+{
+    return qemu_sendv_packet_async_with_flags(sender,
+                                              QEMU_NET_PACKET_FLAG_STABLE,
+                                              iov, iovcnt, sent_cb);
+}
+
 ssize_t
 qemu_sendv_packet(NetClientState *nc, const struct iovec *iov, int iovcnt)
 {
@@ -1317,11 +1389,47 @@ static int (* const net_client_init_fun[NET_CLIENT_DRIVER__MAX])(
 };
 
 
+static bool net_client_can_sw_offload(NetClientDriver type)
+{
+    switch (type) {
+    case NET_CLIENT_DRIVER_NIC:
+    case NET_CLIENT_DRIVER_HUBPORT:
+    case NET_CLIENT_DRIVER_VHOST_USER:
+    case NET_CLIENT_DRIVER_VHOST_VDPA:
+        /* Not a backend, or one that bypasses the net layer */
+        return false;
+    default:
+        return true;
+    }
+}
+
+static void net_client_set_sw_offload(const char *id)
+{
+    NetClientState *ncs[MAX_QUEUE_NUM];
+    int queues, i;
+
+    queues = qemu_find_net_clients_except(id, ncs, NET_CLIENT_DRIVER_NIC,
+                                          MAX_QUEUE_NUM);
+    for (i = 0; i < queues; i++) {
+        /* Backends with a native virtio-net header keep using it */
+        if (!ncs[i]->info->has_vnet_hdr) {
+            ncs[i]->sw_offload = true;
+        }
+    }
+}
+
 static int net_client_init1(const Netdev *netdev, bool is_netdev, Error **errp)
 {
     NetClientState *peer = NULL;
     NetClientState *nc;
 
+    if (netdev->has_sw_offload && netdev->sw_offload &&
+        !net_client_can_sw_offload(netdev->type)) {
+        error_setg(errp, "network backend '%s' does not support sw-offload",
+                   NetClientDriver_str(netdev->type));
+        return -1;
+    }
+
     if (is_netdev) {
         if (netdev->type == NET_CLIENT_DRIVER_NIC ||
             !net_client_init_fun[netdev->type]) {
@@ -1373,6 +1481,10 @@ static int net_client_init1(const Netdev *netdev, bool is_netdev, Error **errp)
         nc->is_netdev = true;
     }
 
+    if (netdev->has_sw_offload && netdev->sw_offload) {
+        net_client_set_sw_offload(netdev->id);
+    }
+
     return 0;
 }
 
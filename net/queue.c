@@ -23,6 +23,7 @@
 
 #include "qemu/osdep.h"
 #include "net/queue.h"
+#include "qemu/iov.h"
 #include "qemu/queue.h"
 #include "net/net.h"
 
@@ -46,9 +47,26 @@ struct NetPacket {
     unsigned flags;
     int size;
     NetPacketSent *sent_cb;
-    uint8_t data[];
+    /*
+     * Either a single element describing data[], or, for packets queued
+     * with QEMU_NET_PACKET_FLAG_STABLE, a copy of the sender's iovec
+     * array stored in data[].
+     */
+    struct iovec *iov;
+    int iovcnt;
+    struct iovec buf_iov;
+    bool pooled;
+    uint8_t data[] QEMU_ALIGNED(sizeof(void *));
 };
 
+/*
+ * Packets whose payload (or iovec array) fits in NET_PACKET_POOL_BUFSIZE
+ * bytes are recycled through a per-queue free list, so that a queue that
+ * is repeatedly filled and drained does not hit the allocator.
+ */
+#define NET_PACKET_POOL_BUFSIZE 2048
+#define NET_PACKET_POOL_MAX     64
+
 struct NetQueue {
     void *opaque;
     uint32_t nq_maxlen;
@@ -56,6 +74,8 @@ struct NetQueue {
     NetQueueDeliverFunc *deliver;
 
     QTAILQ_HEAD(, NetPacket) packets;
+    QTAILQ_HEAD(, NetPacket) pool;
+    uint32_t pool_count;
 
     unsigned delivering : 1;
 };
@@ -72,12 +92,44 @@ NetQueue *qemu_new_net_queue(NetQueueDeliverFunc *deliver, void *opaque)
     queue->deliver = deliver;
 
     QTAILQ_INIT(&queue->packets);
+    QTAILQ_INIT(&queue->pool);
 
     queue->delivering = 0;
 
     return queue;
 }
 
+static NetPacket *qemu_net_packet_alloc(NetQueue *queue, size_t len)
+{
+    NetPacket *packet;
+
+    if (len > NET_PACKET_POOL_BUFSIZE) {
+        packet = g_malloc(sizeof(NetPacket) + len);
+        packet->pooled = false;
+        return packet;
+    }
+
+    packet = QTAILQ_FIRST(&queue->pool);
+    if (packet) {
+        QTAILQ_REMOVE(&queue->pool, packet, entry);
+        queue->pool_count--;
+    } else {
+        packet = g_malloc(sizeof(NetPacket) + NET_PACKET_POOL_BUFSIZE);
+    }
+    packet->pooled = true;
+    return packet;
+}
+
+static void qemu_net_packet_free(NetQueue *queue, NetPacket *packet)
+{
+    if (packet->pooled && queue->pool_count < NET_PACKET_POOL_MAX) {
+        QTAILQ_INSERT_HEAD(&queue->pool, packet, entry);
+        queue->pool_count++;
+    } else {
+        g_free(packet);
+    }
+}
+
 void qemu_del_net_queue(NetQueue *queue)
 {
     NetPacket *packet, *next;
@@ -87,6 +139,11 @@ void qemu_del_net_queue(NetQueue *queue)
         g_free(packet);
     }
 
+    QTAILQ_FOREACH_SAFE(packet, &queue->pool, entry, next) {
+        QTAILQ_REMOVE(&queue->pool, packet, entry);
+        g_free(packet);
+    }
+
     g_free(queue);
 }
 
@@ -97,20 +154,12 @@ static void qemu_net_queue_append(NetQueue *queue,
                                   size_t size,
                                   NetPacketSent *sent_cb)
 {
-    NetPacket *packet;
-
-    if (queue->nq_count >= queue->nq_maxlen && !sent_cb) {
-        return; /* drop if queue full and no callback */
-    }
-    packet = g_malloc(sizeof(NetPacket) + size);
-    packet->sender = sender;
-    packet->flags = flags;
-    packet->size = size;
-    packet->sent_cb = sent_cb;
-    memcpy(packet->data, buf, size);
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = size
+    };
 
-    queue->nq_count++;
-    QTAILQ_INSERT_TAIL(&queue->packets, packet, entry);
+    qemu_net_queue_append_iov(queue, sender, flags, &iov, 1, sent_cb);
 }
 
 void qemu_net_queue_append_iov(NetQueue *queue,
@@ -131,18 +180,28 @@ void qemu_net_queue_append_iov(NetQueue *queue,
         max_len += iov[i].iov_len;
     }
 
-    packet = g_malloc(sizeof(NetPacket) + max_len);
+    /*
+     * The data only has to be copied if the sender may reuse it before
+     * the packet is delivered, i.e. unless it promised to keep it around
+     * until sent_cb is invoked.
+     */
+    if ((flags & QEMU_NET_PACKET_FLAG_STABLE) && sent_cb) {
+        packet = qemu_net_packet_alloc(queue, iovcnt * sizeof(*iov));
+        packet->iov = (struct iovec *)packet->data;
+        packet->iovcnt = iovcnt;
+        memcpy(packet->iov, iov, iovcnt * sizeof(*iov));
+        packet->size = max_len;
+    } else {
+        packet = qemu_net_packet_alloc(queue, max_len);
+        packet->size = iov_to_buf(iov, iovcnt, 0, packet->data, max_len);
+        packet->buf_iov.iov_base = packet->data;
+        packet->buf_iov.iov_len = packet->size;
+        packet->iov = &packet->buf_iov;
+        packet->iovcnt = 1;
+    }
     packet->sender = sender;
     packet->sent_cb = sent_cb;
     packet->flags = flags;
-    packet->size = 0;
-
-    for (i = 0; i < iovcnt; i++) {
-        size_t len = iov[i].iov_len;
-
-        memcpy(packet->data + packet->size, iov[i].iov_base, len);
-        packet->size += len;
-    }
 
     queue->nq_count++;
     QTAILQ_INSERT_TAIL(&queue->packets, packet, entry);
@@ -254,7 +313,7 @@ void qemu_net_queue_purge(NetQueue *queue, NetClientState *from)
             if (packet->sent_cb) {
                 packet->sent_cb(packet->sender, 0);
             }
-            g_free(packet);
+            qemu_net_packet_free(queue, packet);
         }
     }
 }
@@ -272,11 +331,11 @@ bool qemu_net_queue_flush(NetQueue *queue)
         QTAILQ_REMOVE(&queue->packets, packet, entry);
         queue->nq_count--;
 
-        ret = qemu_net_queue_deliver(queue,
-                                     packet->sender,
-                                     packet->flags,
-                                     packet->data,
-                                     packet->size);
+        ret = qemu_net_queue_deliver_iov(queue,
+                                         packet->sender,
+                                         packet->flags,
+                                         packet->iov,
+                                         packet->iovcnt);
         if (ret == 0) {
             queue->nq_count++;
             QTAILQ_INSERT_HEAD(&queue->packets, packet, entry);
@@ -287,7 +346,7 @@ bool qemu_net_queue_flush(NetQueue *queue)
             packet->sent_cb(packet->sender, ret);
         }
 
-        g_free(packet);
+        qemu_net_packet_free(queue, packet);
     }
     return true;
 }
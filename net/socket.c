@@ -43,17 +43,28 @@ typedef struct NetSocketState {
     IOHandler *send_fn;           /* differs between SOCK_STREAM/SOCK_DGRAM */
     bool read_poll;               /* waiting to receive data? */
     bool write_poll;              /* waiting to transmit data? */
+    AioContext *ctx;              /* NULL for the main loop */
 } NetSocketState;
 
 static void net_socket_accept(void *opaque);
 static void net_socket_writable(void *opaque);
+static void net_socket_connect(void *opaque);
+
+static void net_socket_set_fd_handler(NetSocketState *s, IOHandler *fd_read,
+                                      IOHandler *fd_write)
+{
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, fd_read, fd_write, NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
+}
 
 static void net_socket_update_fd_handler(NetSocketState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll ? s->send_fn : NULL,
-                        s->write_poll ? net_socket_writable : NULL,
-                        s);
+    net_socket_set_fd_handler(s,
+                              s->read_poll ? s->send_fn : NULL,
+                              s->write_poll ? net_socket_writable : NULL);
 }
 
 static void net_socket_read_poll(NetSocketState *s, bool enable)
@@ -322,11 +333,40 @@ static void net_socket_cleanup(NetClientState *nc)
     }
 }
 
+/*
+ * Move the handlers of the connected socket to @ctx.  The listening socket
+ * stays in the main loop.
+ */
+static void net_socket_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+
+    if (s->ctx == ctx) {
+        return;
+    }
+
+    if (s->fd != -1) {
+        net_socket_set_fd_handler(s, NULL, NULL);
+    }
+    s->ctx = ctx;
+    if (s->fd == -1) {
+        return;
+    }
+
+    if (s->send_fn) {
+        net_socket_update_fd_handler(s);
+    } else {
+        /* Stream socket that is still connecting */
+        net_socket_set_fd_handler(s, NULL, net_socket_connect);
+    }
+}
+
 static NetClientInfo net_dgram_socket_info = {
     .type = NET_CLIENT_DRIVER_SOCKET,
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive_dgram,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_dgram(NetClientState *peer,
@@ -418,6 +458,7 @@ static NetClientInfo net_socket_info = {
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_stream(NetClientState *peer,
@@ -444,7 +485,7 @@ static NetSocketState *net_socket_fd_init_stream(NetClientState *peer,
     if (is_connected) {
         net_socket_connect(s);
     } else {
-        qemu_set_fd_handler(s->fd, NULL, net_socket_connect, s);
+        net_socket_set_fd_handler(s, NULL, net_socket_connect);
     }
     return s;
 }
@@ -374,7 +374,7 @@ static void net_vhost_user_event(void *opaque, QEMUChrEvent event)
 
 static int net_vhost_user_init(NetClientState *peer, const char *device,
                                const char *name, Chardev *chr,
-                               int queues)
+                               int queues, uint32_t busy_poll_usecs)
 {
     Error *err = NULL;
     NetClientState *nc, *nc0 = NULL;
@@ -386,6 +386,7 @@ static int net_vhost_user_init(NetClientState *peer, const char *device,
     assert(queues > 0);
 
     user = g_new0(struct VhostUserState, 1);
+    user->busy_poll_usecs = busy_poll_usecs;
     for (i = 0; i < queues; i++) {
         nc = qemu_new_net_client(&net_vhost_user_info, peer, device, name);
         qemu_set_info_str(nc, "vhost-user%d to %s", i, chr->label);
@@ -480,5 +481,7 @@ int net_init_vhost_user(const Netdev *netdev, const char *name,
         return -1;
     }
 
-    return net_vhost_user_init(peer, "vhost_user", name, chr, queues);
+    return net_vhost_user_init(peer, "vhost_user", name, chr, queues,
+                               vhost_user_opts->has_busy_poll_usecs ?
+                               vhost_user_opts->busy_poll_usecs : 0);
 }
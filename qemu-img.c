@@ -607,16 +607,34 @@ static void dump_human_image_check(ImageCheck *check, bool quiet)
     }
 }
 
+/* Share of the progress bar that one bdrv_check() call reports on */
+typedef struct ImgCheckProgress {
+    float base;
+    float span;
+} ImgCheckProgress;
+
+static void check_status_cb(BlockDriverState *bs,
+                            int64_t offset, int64_t total_work_size,
+                            void *opaque)
+{
+    ImgCheckProgress *p = opaque;
+
+    qemu_progress_print(p->base + p->span * offset / total_work_size, 0);
+}
+
 static int collect_image_check(BlockDriverState *bs,
                    ImageCheck *check,
                    const char *filename,
                    const char *fmt,
-                   int fix)
+                   int fix,
+                   ImgCheckProgress *progress)
 {
     int ret;
     BdrvCheckResult result;
 
-    ret = bdrv_check(bs, &result, fix);
+    /* In case the driver does not call check_status_cb() */
+    qemu_progress_print(progress->base, 0);
+    ret = bdrv_check(bs, &result, fix, &check_status_cb, progress);
     if (ret < 0) {
         return ret;
     }
@@ -666,7 +684,8 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
     int flags = BDRV_O_CHECK;
     bool writethrough;
     ImageCheck *check;
-    bool quiet = false;
+    ImgCheckProgress check_progress;
+    bool quiet = false, progress = false;
     bool image_opts = false;
     bool force_share = false;
 
@@ -683,11 +702,12 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
             {"repair", required_argument, 0, 'r'},
             {"force-share", no_argument, 0, 'U'},
             {"output", required_argument, 0, OPTION_OUTPUT},
+            {"progress", no_argument, 0, 'p'},
             {"quiet", no_argument, 0, 'q'},
             {"object", required_argument, 0, OPTION_OBJECT},
             {0, 0, 0, 0}
         };
-        c = getopt_long(argc, argv, "hf:T:r:Uq",
+        c = getopt_long(argc, argv, "hf:T:r:Upq",
                         long_options, &option_index);
         if (c == -1) {
             break;
@@ -695,7 +715,7 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
         switch(c) {
         case 'h':
             cmd_help(ccmd, "[-f FMT | --image-opts] [-T CACHE_MODE] [-r leaks|all]\n"
-"        [-U] [--output human|json] [-q] [--object OBJDEF] FILE\n"
+"        [-U] [--output human|json] [-p] [-q] [--object OBJDEF] FILE\n"
 ,
 "  -f, --format FMT\n"
 "     specifies the format of the image explicitly (default: probing is used)\n"
@@ -711,6 +731,8 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
 "     open image in shared mode for concurrent access\n"
 "  --output human|json\n"
 "     output format (default: human)\n"
+"  -p, --progress\n"
+"     show check progress (not with --output json)\n"
 "  -q, --quiet\n"
 "     quiet mode (produce only error messages if any)\n"
 "  --object OBJDEF\n"
@@ -748,6 +770,9 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
         case OPTION_OUTPUT:
             output_format = parse_output_format(argv[0], optarg);
             break;
+        case 'p':
+            progress = true;
+            break;
         case 'q':
             quiet = true;
             break;
@@ -776,10 +801,21 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
     }
     bs = blk_bs(blk);
 
+    /* Progress output would end up in the middle of the JSON document */
+    if (quiet || output_format == OFORMAT_JSON) {
+        progress = false;
+    }
+    qemu_progress_init(progress, 1.0);
+
+    /* A repair is followed by a second check, each gets half of the bar */
+    check_progress.base = 0.f;
+    check_progress.span = fix ? 50.f : 100.f;
+
     check = g_new0(ImageCheck, 1);
-    ret = collect_image_check(bs, check, filename, fmt, fix);
+    ret = collect_image_check(bs, check, filename, fmt, fix, &check_progress);
 
     if (ret == -ENOTSUP) {
+        qemu_progress_end();
         error_report("This image format does not support checks");
         ret = 63;
         goto fail;
@@ -806,7 +842,10 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
 
         qapi_free_ImageCheck(check);
         check = g_new0(ImageCheck, 1);
-        ret = collect_image_check(bs, check, filename, fmt, 0);
+        check_progress.base = 50.f;
+        check_progress.span = 50.f;
+        ret = collect_image_check(bs, check, filename, fmt, 0,
+                                  &check_progress);
 
         check->leaks_fixed          = leaks_fixed;
         check->has_leaks_fixed      = has_leaks_fixed;
@@ -814,6 +853,9 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
         check->has_corruptions_fixed = has_corruptions_fixed;
     }
 
+    qemu_progress_print(100.f, 0);
+    qemu_progress_end();
+
     if (!ret) {
         switch (output_format) {
         case OFORMAT_HUMAN:
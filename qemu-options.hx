@@ -233,6 +233,7 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
+    "                profile=on|off (count executions and host cycles per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
@@ -269,6 +270,14 @@ SRST
         can be useful in some situations, such as when trying to analyse
         the logs produced by the ``-d`` option.
 
+    ``profile=on|off``
+        Makes the TCG accelerator count how often each translation block
+        is executed and how many host cycles are spent in it. The result
+        can be inspected with the ``info tcg-profile`` monitor command or
+        the ``x-query-tcg-profile`` QMP command, which can also write a
+        file for ``pprof``. This adds an atomic helper call to every block
+        and is meant for performance analysis only.
+
     ``split-wx=on|off``
         Controls the use of split w^x mapping for the TCG code generation
         buffer. Some operating systems require this to be enabled, and in
@@ -3032,6 +3041,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
     "         [,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]\n"
     "         [,map-path=/path/to/socket/map][,map-start-index=i]\n"
+    "         [,busy-poll-usecs=u][,busy-poll-budget=b]\n"
     "                attach to the existing network interface 'name' with AF_XDP socket\n"
     "                use 'mode=MODE' to specify an XDP program attach mode\n"
     "                use 'force-copy=on|off' to force XDP copy mode even if device supports zero-copy (default: off)\n"
@@ -3043,10 +3053,14 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                  and use 'map-start-index' to specify the starting index for the map (default: 0) (Since 10.1)\n"
     "                use 'queues=n' to specify how many queues of a multiqueue interface should be used\n"
     "                use 'start-queue=m' to specify the first queue that should be used\n"
+    "                use 'busy-poll-usecs=u' to busy poll the device queues for up to u microseconds\n"
+    "                use 'busy-poll-budget=b' to process up to b packets per busy poll (default: 64)\n"
 #endif
 #ifdef CONFIG_POSIX
-    "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
+    "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off][,busy-poll-usecs=n]\n"
     "                configure a vhost-user network, backed by a chardev 'dev'\n"
+    "                use 'busy-poll-usecs=n' to let the backend poll idle rings\n"
+    "                for n microseconds before waiting for notifications\n"
 #endif
 #ifdef __linux__
     "-netdev vhost-vdpa,id=str[,vhostdev=/path/to/dev][,vhostfd=h]\n"
@@ -3074,7 +3088,10 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                isolate this interface from others with 'isolated'\n"
 #endif
     "-netdev hubport,id=str,hubid=n[,netdev=nd]\n"
-    "                configure a hub port on the hub with ID 'n'\n", QEMU_ARCH_ALL)
+    "                configure a hub port on the hub with ID 'n'\n"
+    "-netdev <type>,...,sw-offload=on|off\n"
+    "                let the guest NIC offload TSO/USO and checksumming and do\n"
+    "                the work in QEMU for backends without vnet header support\n", QEMU_ARCH_ALL)
 DEF("nic", HAS_ARG, QEMU_OPTION_nic,
     "-nic [tap|bridge|"
 #ifdef CONFIG_PASST
@@ -3158,6 +3175,18 @@ SRST
     network backend) which is activated if no other networking options
     are provided.
 
+``-netdev type,...,sw-offload=on|off``
+    Backends that exchange plain Ethernet frames, such as ``socket``,
+    ``stream``, ``dgram`` or ``user``, cannot accept the virtio-net
+    header, so guest NICs normally disable TCP/UDP segmentation and
+    checksum offloads when connected to them. With ``sw-offload=on``
+    the offloads are offered to the guest anyway, and QEMU segments
+    large packets and completes partial checksums before handing the
+    frames to the backend. This saves guest CPU time and reduces the
+    number of guest notifications for bulk transfers. Backends with
+    native virtio-net header support (``tap``, ``passt``, ``netmap``)
+    ignore the option. The default is off.
+
 ``-netdev passt,id=str[,option][,...]``
     Configure a passt network backend which requires no administrator
     privilege to run. Valid options are:
@@ -3871,7 +3900,7 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
-``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z][,map-path=/path/to/socket/map][,map-start-index=i]``
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z][,map-path=/path/to/socket/map][,map-start-index=i][,busy-poll-usecs=u][,busy-poll-budget=b]``
     Configure AF_XDP backend to connect to a network interface 'name'
     using AF_XDP socket.  A specific program attach mode for a default
     XDP program can be forced with 'mode', defaults to best-effort,
@@ -3936,7 +3965,26 @@ SRST
     for insertion into the socket map.  The combination of 'map-path' and
     'sock-fds' together is not supported.
 
-``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
+    Queue i of the netdev serves queue pair i of the virtio-net device, so
+    with 'iothread-vq-mapping' on the device each AF_XDP socket is polled
+    by the IOThread of its queue pair.  'busy-poll-usecs' makes the sockets
+    use SO_PREFER_BUSY_POLL: the device queues are then processed by the
+    polling thread instead of by interrupts.  This works best together
+    with IOThreads, whose adaptive polling drives the busy poll, and with
+    the interface's ``napi_defer_hard_irqs`` and ``gro_flush_timeout``
+    configured.
+
+    .. parsed-literal::
+
+        echo 2 > /sys/class/net/eth0/napi_defer_hard_irqs
+        echo 200000 > /sys/class/net/eth0/gro_flush_timeout
+        |qemu_system| linux.img -object iothread,id=io0 -object iothread,id=io1 \\
+            -device '{"driver":"virtio-net-pci","netdev":"n1","mq":true,
+                      "iothread-vq-mapping":[{"iothread":"io0"},
+                                             {"iothread":"io1"}]}' \\
+            -netdev af-xdp,id=n1,ifname=eth0,queues=2,busy-poll-usecs=20
+
+``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n][,busy-poll-usecs=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
     specifically defined protocol to pass vhost ioctl replacement
@@ -3945,6 +3993,12 @@ SRST
     'queues=n' to specify the number of queues to be created for
     multiqueue vhost-user.
 
+    With 'busy-poll-usecs=n', backends that support it keep polling
+    the rings with guest kicks suppressed, and only go back to waiting
+    on the kick eventfds once the rings have been idle for n
+    microseconds. This trades backend CPU time for fewer syscalls and
+    wakeups at high packet rates.
+
     Example:
 
     ::
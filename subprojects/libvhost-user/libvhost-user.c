@@ -24,6 +24,7 @@
 #include <stdarg.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 #include <inttypes.h>
 #include <sys/types.h>
@@ -164,6 +165,7 @@ vu_request_to_string(unsigned int req)
         REQ(VHOST_USER_ADD_MEM_REG),
         REQ(VHOST_USER_REM_MEM_REG),
         REQ(VHOST_USER_GET_SHARED_OBJECT),
+        REQ(VHOST_USER_SET_VRING_BUSY_POLL),
         REQ(VHOST_USER_MAX),
     };
 #undef REQ
@@ -746,6 +748,96 @@ vu_log_write(VuDev *dev, uint64_t address, uint64_t length)
     vu_log_kick(dev);
 }
 
+static int64_t
+vu_clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool
+vu_queue_busy_pollable(VuVirtq *vq)
+{
+    return vq->busy_poll_usecs && vq->started && vq->handler &&
+           vq->kick_fd != -1;
+}
+
+void
+vu_queue_poll_begin(VuDev *dev, VuVirtq *vq)
+{
+    if (dev->broken || vq->busy_polling || !vu_queue_busy_pollable(vq)) {
+        return;
+    }
+
+    vu_queue_set_notification(dev, vq, 0);
+    vq->busy_polling = true;
+    vq->busy_poll_idle_since = vu_clock_ns();
+}
+
+void
+vu_queue_poll_end(VuDev *dev, VuVirtq *vq)
+{
+    if (!vq->busy_polling) {
+        return;
+    }
+
+    vq->busy_polling = false;
+    if (vq->started && !dev->broken) {
+        vu_queue_set_notification(dev, vq, 1);
+    }
+}
+
+bool
+vu_queue_poll(VuDev *dev, VuVirtq *vq)
+{
+    int64_t now;
+
+    if (!vq->busy_polling) {
+        /*
+         * The event loop checks once more after vu_queue_poll_end().  The
+         * guest did not kick for buffers it added while kicks were off,
+         * so they must be picked up here.
+         */
+        return !dev->broken && vu_queue_busy_pollable(vq) &&
+               !vu_queue_empty(dev, vq);
+    }
+    if (dev->broken || !vu_queue_busy_pollable(vq)) {
+        vu_queue_poll_end(dev, vq);
+        return false;
+    }
+    if (!vu_queue_empty(dev, vq)) {
+        return true;
+    }
+
+    /*
+     * Requests that are still in flight count as activity: the guest
+     * usually refills the ring as soon as they complete.
+     */
+    now = vu_clock_ns();
+    if (vq->inuse) {
+        vq->busy_poll_idle_since = now;
+        return false;
+    }
+
+    if (now - vq->busy_poll_idle_since >= vq->busy_poll_usecs * 1000LL) {
+        /* Idle for too long, go back to waiting for kicks */
+        vu_queue_poll_end(dev, vq);
+        return !vu_queue_empty(dev, vq);
+    }
+    return false;
+}
+
+void
+vu_queue_poll_ready(VuDev *dev, VuVirtq *vq)
+{
+    vq->busy_poll_idle_since = vu_clock_ns();
+    if (vq->handler) {
+        vq->handler(dev, vq - dev->vq);
+    }
+}
+
 static void
 vu_kick_cb(VuDev *dev, int condition, void *data)
 {
@@ -1270,7 +1362,9 @@ vu_get_vring_base_exec(VuDev *dev, VhostUserMsg *vmsg)
     vmsg->payload.state.num = dev->vq[index].last_avail_idx;
     vmsg->size = sizeof(vmsg->payload.state);
 
+    vu_queue_poll_end(dev, &dev->vq[index]);
     dev->vq[index].started = false;
+    dev->vq[index].busy_poll_usecs = 0;
     if (dev->iface->queue_set_started) {
         dev->iface->queue_set_started(dev, index, false);
     }
@@ -1653,6 +1747,10 @@ vu_get_protocol_features_exec(VuDev *dev, VhostUserMsg *vmsg)
      * (get_protocol_features) if it wants to use this for
      * simulation, but it is otherwise not desirable (if even
      * implemented by the frontend.)
+     *
+     * The same goes for VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL, which
+     * only has an effect if the device's event loop calls
+     * vu_queue_poll_begin() and friends.
      */
     uint64_t features = 1ULL << VHOST_USER_PROTOCOL_F_MQ |
                         1ULL << VHOST_USER_PROTOCOL_F_LOG_SHMFD |
@@ -1749,6 +1847,29 @@ vu_set_vring_enable_exec(VuDev *dev, VhostUserMsg *vmsg)
     return false;
 }
 
+static bool
+vu_set_vring_busy_poll_exec(VuDev *dev, VhostUserMsg *vmsg)
+{
+    unsigned int index = vmsg->payload.state.index;
+    unsigned int usecs = vmsg->payload.state.num;
+
+    DPRINT("State.index: %u\n", index);
+    DPRINT("State.busy_poll_usecs: %u\n", usecs);
+
+    if (!vu_has_protocol_feature(dev, VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL)) {
+        vu_panic(dev, "vring_busy_poll without the protocol feature");
+        return false;
+    }
+
+    if (index >= dev->max_queues) {
+        vu_panic(dev, "Invalid vring_busy_poll index: %u", index);
+        return false;
+    }
+
+    dev->vq[index].busy_poll_usecs = usecs;
+    return false;
+}
+
 static bool
 vu_set_backend_req_fd(VuDev *dev, VhostUserMsg *vmsg)
 {
@@ -2145,6 +2266,8 @@ vu_process_message(VuDev *dev, VhostUserMsg *vmsg)
         return vu_rem_mem_reg(dev, vmsg);
     case VHOST_USER_GET_SHARED_OBJECT:
         return vu_get_shared_object(dev, vmsg);
+    case VHOST_USER_SET_VRING_BUSY_POLL:
+        return vu_set_vring_busy_poll_exec(dev, vmsg);
     default:
         vmsg_close_fds(vmsg);
         vu_panic(dev, "Unhandled request: %d", vmsg->request);
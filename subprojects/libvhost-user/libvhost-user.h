@@ -69,6 +69,8 @@ enum VhostUserProtocolFeature {
     /* Feature 16 is reserved for VHOST_USER_PROTOCOL_F_STATUS. */
     /* Feature 17 reserved for VHOST_USER_PROTOCOL_F_XEN_MMAP. */
     VHOST_USER_PROTOCOL_F_SHARED_OBJECT = 18,
+    /* Features 19 and 20 are not supported by libvhost-user. */
+    VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL = 21,
     VHOST_USER_PROTOCOL_F_MAX
 };
 
@@ -114,6 +116,7 @@ typedef enum VhostUserRequest {
     VHOST_USER_ADD_MEM_REG = 37,
     VHOST_USER_REM_MEM_REG = 38,
     VHOST_USER_GET_SHARED_OBJECT = 41,
+    VHOST_USER_SET_VRING_BUSY_POLL = 44,
     VHOST_USER_MAX
 } VhostUserRequest;
 
@@ -369,6 +372,11 @@ typedef struct VuVirtq {
     unsigned int enable;
     bool started;
 
+    /* Idle time in us before going back from polling to kicks, 0 = off */
+    uint32_t busy_poll_usecs;
+    bool busy_polling;
+    int64_t busy_poll_idle_since;
+
     /* Guest addresses of our ring */
     struct vhost_vring_addr vra;
 } VuVirtq;
@@ -603,6 +611,54 @@ bool vu_rm_shared_object(VuDev *dev, unsigned char uuid[UUID_LEN]);
  */
 void vu_queue_set_notification(VuDev *dev, VuVirtq *vq, int enable);
 
+/**
+ * vu_queue_poll_begin:
+ * @dev: a VuDev context
+ * @vq: a VuVirtq queue
+ *
+ * Called by an event loop that busy polls its file descriptors when it
+ * starts polling.  If the front-end asked for @vq to be polled, guest
+ * kicks are suppressed until vu_queue_poll_end().
+ *
+ * Devices whose event loop uses this and the other vu_queue_poll*()
+ * functions should return VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL from
+ * their get_protocol_features callback; it is not offered otherwise.
+ */
+void vu_queue_poll_begin(VuDev *dev, VuVirtq *vq);
+
+/**
+ * vu_queue_poll_end:
+ * @dev: a VuDev context
+ * @vq: a VuVirtq queue
+ *
+ * Re-enable the guest kicks suppressed by vu_queue_poll_begin().  The
+ * caller must check vu_queue_poll() once more afterwards.
+ */
+void vu_queue_poll_end(VuDev *dev, VuVirtq *vq);
+
+/**
+ * vu_queue_poll:
+ * @dev: a VuDev context
+ * @vq: a VuVirtq queue
+ *
+ * Check a polled queue for new buffers without blocking.  Once the queue
+ * has been idle for the time requested by the front-end, guest kicks are
+ * re-enabled as by vu_queue_poll_end().  After that, buffers that are
+ * still pending are reported until the queue handler has consumed them.
+ *
+ * Returns: true if vu_queue_poll_ready() should be called.
+ */
+bool vu_queue_poll(VuDev *dev, VuVirtq *vq);
+
+/**
+ * vu_queue_poll_ready:
+ * @dev: a VuDev context
+ * @vq: a VuVirtq queue
+ *
+ * Run the queue handler for the buffers found by vu_queue_poll().
+ */
+void vu_queue_poll_ready(VuDev *dev, VuVirtq *vq);
+
 /**
  * vu_queue_enabled:
  * @dev: a VuDev context
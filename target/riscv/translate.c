@@ -288,6 +288,42 @@ static void lookup_and_goto_ptr(DisasContext *ctx)
     tcg_gen_lookup_and_goto_ptr();
 }
 
+/*
+ * Indirect jump to @dest, already written to cpu_pc, predicting the
+ * target TB.  Use the return address stack for calls and returns, as
+ * hinted by the choice of link registers (see "Unconditional Jumps" in
+ * the unprivileged spec).  Not usable if the jump sets env->elp, which
+ * is part of the TB flags.
+ */
+static void lookup_and_goto_ptr_predicted(DisasContext *ctx, TCGv dest,
+                                          int rd, int rs1)
+{
+    bool rd_link = rd == xRA || rd == xT0;
+    bool rs1_link = rs1 == xRA || rs1 == xT0;
+    TCGv_vaddr pc = tcg_temp_new_vaddr();
+
+#ifndef CONFIG_USER_ONLY
+    if (ctx->itrigger) {
+        gen_helper_itrigger_match(tcg_env);
+    }
+#endif
+
+    /* Match riscv_get_tb_cpu_state.  TCGv_vaddr is 64-bit on all hosts. */
+    tcg_gen_extu_tl_i64(pc, dest);
+    if (get_xl(ctx) == MXL_RV32) {
+        tcg_gen_ext32u_i64(pc, pc);
+    }
+
+    if (rd_link) {
+        tcg_gen_ras_push();
+        tcg_gen_lookup_and_goto_ptr_cached(pc);
+    } else if (rs1_link) {
+        tcg_gen_lookup_and_goto_ptr_ret(pc);
+    } else {
+        tcg_gen_lookup_and_goto_ptr_cached(pc);
+    }
+}
+
 static void exit_tb(DisasContext *ctx)
 {
 #ifndef CONFIG_USER_ONLY
@@ -639,6 +675,9 @@ static void gen_jal(DisasContext *ctx, int rd, target_ulong imm)
     gen_pc_plus_diff(succ_pc, ctx, ctx->cur_insn_len);
     gen_set_gpr(ctx, rd, succ_pc);
 
+    if (rd == xRA || rd == xT0) {
+        tcg_gen_ras_push();
+    }
     gen_goto_tb(ctx, 0, imm); /* must use this for safety */
     ctx->base.is_jmp = DISAS_NORETURN;
 }
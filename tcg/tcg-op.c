@@ -27,6 +27,7 @@
 #include "tcg/tcg-temp-internal.h"
 #include "tcg/tcg-op-common.h"
 #include "exec/translation-block.h"
+#include "hw/core/cpu.h"
 #include "exec/plugin-gen.h"
 #include "tcg-internal.h"
 #include "tcg-has.h"
@@ -2568,3 +2569,154 @@ void tcg_gen_lookup_and_goto_ptr(void)
     tcg_gen_op1i(INDEX_op_goto_ptr, TCG_TYPE_PTR, tcgv_ptr_arg(ptr));
     tcg_temp_free_ptr(ptr);
 }
+
+/*
+ * Predicted indirect branches.  The prediction is a TranslationBlock
+ * pointer, loaded from a slot in some TB; we jump straight to its code
+ * if it is for @dest and was translated for the same cpu state as the
+ * current TB.  The caller of the public functions below guarantees
+ * that the state other than the pc is unchanged at this exit, so this
+ * is the TB that helper_lookup_tb_ptr would find.  Note that an
+ * invalidated TB fails the cflags comparison because of CF_INVALID.
+ */
+static bool tcg_can_predict_goto_ptr(void)
+{
+    /*
+     * With CF_PCREL, tb->pc is not available to compare against.  With
+     * CF_BP_PAGE, every TB must go through helper_lookup_tb_ptr, which
+     * checks for breakpoints.
+     */
+    return !(tcg_ctx->gen_tb->cflags &
+             (CF_NO_GOTO_PTR | CF_PCREL | CF_BP_PAGE));
+}
+
+static void gen_goto_predicted_tb(TCGv_ptr tb, TCGv_vaddr dest,
+                                  TCGLabel *miss)
+{
+    const TranslationBlock *cur = tcg_ctx->gen_tb;
+    TCGv_i32 t32 = tcg_temp_ebb_new_i32();
+    TCGv_i64 t64 = tcg_temp_ebb_new_i64();
+    TCGv_ptr code = tcg_temp_ebb_new_ptr();
+
+    tcg_gen_brcondi_ptr(TCG_COND_EQ, tb, 0, miss);
+
+    /* Hosts are 64-bit, so tb->pc and @dest are both 64 bits wide */
+    QEMU_BUILD_BUG_ON(sizeof_field(TranslationBlock, pc) != 8);
+    tcg_gen_ld_i64(t64, tb, offsetof(TranslationBlock, pc));
+    tcg_gen_brcond_i64(TCG_COND_NE, t64, dest, miss);
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, cflags));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, cur->cflags, miss);
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, flags));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, cur->flags, miss);
+    tcg_gen_ld_i64(t64, tb, offsetof(TranslationBlock, cs_base));
+    tcg_gen_brcondi_i64(TCG_COND_NE, t64, cur->cs_base, miss);
+
+    tcg_gen_ld_ptr(code, tb, offsetof(TranslationBlock, tc.ptr));
+    tcg_gen_op1i(INDEX_op_goto_ptr, TCG_TYPE_PTR, tcgv_ptr_arg(code));
+
+    tcg_temp_free_i32(t32);
+    tcg_temp_free_i64(t64);
+    tcg_temp_free_ptr(code);
+}
+
+static void gen_goto_ptr_ic_miss(TCGv_ptr owner, unsigned idx)
+{
+    TCGv_ptr ptr = tcg_temp_ebb_new_ptr();
+
+    gen_helper_lookup_tb_ptr_ic(ptr, tcg_env, owner, tcg_constant_i32(idx));
+    tcg_gen_op1i(INDEX_op_goto_ptr, TCG_TYPE_PTR, tcgv_ptr_arg(ptr));
+    tcg_temp_free_ptr(ptr);
+}
+
+/* Return in @ptr the address of the current return address stack entry. */
+static void gen_ras_entry(TCGv_ptr ptr, TCGv_i32 top)
+{
+    TCGv_i32 t = tcg_temp_ebb_new_i32();
+
+    tcg_gen_shli_i32(t, top, ctz32(sizeof(void *)));
+    tcg_gen_ext_i32_ptr(ptr, t);
+    tcg_gen_add_ptr(ptr, ptr, tcg_env);
+    tcg_temp_free_i32(t);
+}
+
+#define RAS_OFS(F)  (offsetof(CPUState, neg.ras.F) - sizeof(CPUState))
+
+void tcg_gen_lookup_and_goto_ptr_cached(TCGv_vaddr dest)
+{
+    TranslationBlock *cur = tcg_ctx->gen_tb;
+    TCGLabel *miss;
+    TCGv_ptr tb;
+
+    if (!tcg_can_predict_goto_ptr()) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    plugin_gen_disable_mem_helpers();
+    miss = gen_new_label();
+    tb = tcg_temp_ebb_new_ptr();
+    tcg_gen_ld_ptr(tb, tcg_constant_ptr(&cur->ic_dest[TB_IC_JUMP]), 0);
+    gen_goto_predicted_tb(tb, dest, miss);
+    tcg_temp_free_ptr(tb);
+
+    gen_set_label(miss);
+    gen_goto_ptr_ic_miss(tcg_constant_ptr(cur), TB_IC_JUMP);
+}
+
+void tcg_gen_ras_push(void)
+{
+    TCGv_i32 top;
+    TCGv_ptr ptr;
+
+    if (!tcg_can_predict_goto_ptr()) {
+        return;
+    }
+
+    top = tcg_temp_ebb_new_i32();
+    ptr = tcg_temp_ebb_new_ptr();
+    tcg_gen_ld_i32(top, tcg_env, RAS_OFS(top));
+    gen_ras_entry(ptr, top);
+    tcg_gen_st_ptr(tcg_constant_ptr(tcg_ctx->gen_tb), ptr, RAS_OFS(tb));
+    tcg_gen_addi_i32(top, top, 1);
+    tcg_gen_andi_i32(top, top, CPU_RAS_SIZE - 1);
+    tcg_gen_st_i32(top, tcg_env, RAS_OFS(top));
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i32(top);
+}
+
+void tcg_gen_lookup_and_goto_ptr_ret(TCGv_vaddr dest)
+{
+    TCGLabel *miss;
+    TCGv_i32 top;
+    TCGv_ptr ptr, caller;
+
+    if (!tcg_can_predict_goto_ptr()) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    plugin_gen_disable_mem_helpers();
+    miss = gen_new_label();
+    top = tcg_temp_ebb_new_i32();
+    ptr = tcg_temp_ebb_new_ptr();
+    /* Live across the miss label, to be passed to the helper. */
+    caller = tcg_temp_new_ptr();
+
+    tcg_gen_ld_i32(top, tcg_env, RAS_OFS(top));
+    tcg_gen_subi_i32(top, top, 1);
+    tcg_gen_andi_i32(top, top, CPU_RAS_SIZE - 1);
+    tcg_gen_st_i32(top, tcg_env, RAS_OFS(top));
+    gen_ras_entry(ptr, top);
+    tcg_gen_ld_ptr(caller, ptr, RAS_OFS(tb));
+    tcg_temp_free_i32(top);
+
+    tcg_gen_brcondi_ptr(TCG_COND_EQ, caller, 0, miss);
+    tcg_gen_ld_ptr(ptr, caller,
+                   offsetof(TranslationBlock, ic_dest[TB_IC_RETURN]));
+    gen_goto_predicted_tb(ptr, dest, miss);
+    tcg_temp_free_ptr(ptr);
+
+    gen_set_label(miss);
+    gen_goto_ptr_ic_miss(caller, TB_IC_RETURN);
+    tcg_temp_free_ptr(caller);
+}
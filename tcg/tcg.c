@@ -2077,6 +2077,7 @@ TCGTemp *tcg_temp_new_internal(TCGType type, TCGTempKind kind)
     case TCG_TYPE_V64:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         n = 1;
         break;
     case TCG_TYPE_I128:
@@ -2140,6 +2141,11 @@ TCGv_ptr tcg_temp_ebb_new_ptr(void)
     return temp_tcgv_ptr(tcg_temp_new_internal(TCG_TYPE_PTR, TEMP_EBB));
 }
 
+TCGv_vaddr tcg_temp_new_vaddr(void)
+{
+    return temp_tcgv_vaddr(tcg_temp_new_internal(TCG_TYPE_PTR, TEMP_TB));
+}
+
 TCGv_i128 tcg_temp_new_i128(void)
 {
     return temp_tcgv_i128(tcg_temp_new_internal(TCG_TYPE_I128, TEMP_TB));
@@ -2165,6 +2171,9 @@ TCGv_vec tcg_temp_new_vec(TCGType type)
     case TCG_TYPE_V256:
         assert(TCG_TARGET_HAS_v256);
         break;
+    case TCG_TYPE_V512:
+        assert(TCG_TARGET_HAS_v512);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -2330,6 +2339,9 @@ bool tcg_op_supported(TCGOpcode op, TCGType type, unsigned flags)
     case TCG_TYPE_V256:
         has_type = TCG_TARGET_HAS_v256;
         break;
+    case TCG_TYPE_V512:
+        has_type = TCG_TARGET_HAS_v512;
+        break;
     default:
         has_type = false;
         break;
@@ -2705,6 +2717,7 @@ static char *tcg_get_arg_str_ptr(TCGContext *s, char *buf, int buf_size,
         case TCG_TYPE_V64:
         case TCG_TYPE_V128:
         case TCG_TYPE_V256:
+        case TCG_TYPE_V512:
             snprintf(buf, buf_size, "v%d$0x%" PRIx64,
                      64 << (ts->type - TCG_TYPE_V64), ts->val);
             break;
@@ -4466,8 +4479,9 @@ static void temp_allocate_frame(TCGContext *s, TCGTemp *ts)
     case TCG_TYPE_I128:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         /*
-         * Note that we do not require aligned storage for V256,
+         * Note that we do not require aligned storage for V256 or V512,
          * and that we provide alignment for I128 to match V128,
          * even if that's above what the host ABI requires.
          */
@@ -37,6 +37,11 @@
 #define TCG_TARGET_HAS_v64              have_avx1
 #define TCG_TARGET_HAS_v128             have_avx1
 #define TCG_TARGET_HAS_v256             have_avx2
+/*
+ * 512-bit operations are EVEX only.  Require BW and DQ so that every
+ * element size has the same set of operations as with 256-bit.
+ */
+#define TCG_TARGET_HAS_v512             (have_avx512bw && have_avx512dq)
 
 #define TCG_TARGET_HAS_andc_vec         1
 #define TCG_TARGET_HAS_orc_vec          have_avx512vl
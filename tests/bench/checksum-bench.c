@@ -0,0 +1,72 @@
+/*
+ * QEMU internet checksum speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "net/checksum.h"
+
+/* The byte-pair loop that net_checksum_add_cont used to be.  */
+static uint16_t checksum_ref(int len, const uint8_t *buf)
+{
+    uint32_t sum1 = 0, sum2 = 0;
+    int i;
+
+    for (i = 0; i < len - 1; i += 2) {
+        sum1 += buf[i];
+        sum2 += buf[i + 1];
+    }
+    if (i < len) {
+        sum1 += buf[i];
+    }
+    return net_checksum_finish(sum2 + (sum1 << 8));
+}
+
+static void test(const void *opaque)
+{
+    static const int sizes[] = { 64, 256, 1500, 9000, 64 * KiB - 1 };
+    int max = 64 * KiB;
+    uint8_t *buf = g_malloc(max + 1);
+    int accel_index = 0;
+
+    for (int i = 0; i <= max; i++) {
+        buf[i] = g_test_rand_int();
+    }
+
+    do {
+        if (accel_index != 0) {
+            g_test_message("%s", "");  /* gnu_printf Werror for simple "" */
+        }
+        for (int i = 0; i < ARRAY_SIZE(sizes); i++) {
+            int len = sizes[i];
+            double total = 0.0;
+
+            /* Odd start to exercise unaligned loads.  */
+            g_assert_cmpuint(net_raw_checksum(buf + 1, len), ==,
+                             checksum_ref(len, buf + 1));
+
+            g_test_timer_start();
+            do {
+                net_checksum_add(len, buf + 1);
+                total += len;
+            } while (g_test_timer_elapsed() < 0.5);
+
+            total /= MiB;
+            g_test_message("net_checksum #%d: %5dB %8.0f MB/sec",
+                           accel_index, len, total / g_test_timer_last());
+        }
+        accel_index++;
+    } while (test_net_checksum_next_accel());
+
+    g_free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_data_func("/net/checksum/speed", NULL, test);
+    return g_test_run();
+}
@@ -0,0 +1,120 @@
+/*
+ * QEMU HBitmap benchmark, dense vs. sparse
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/hbitmap.h"
+#include "qemu/units.h"
+
+/* 64 TiB at 64 KiB granularity */
+#define BENCH_ITEMS     (64 * TiB)
+#define BENCH_GRAN      16
+#define BENCH_BITS      (BENCH_ITEMS >> BENCH_GRAN)
+
+/* Dirty areas of 1 MiB, as written by a guest */
+#define BENCH_AREA      (1 * MiB)
+
+typedef struct BenchParams {
+    bool sparse;
+    /* Number of dirty areas out of BENCH_ITEMS / BENCH_AREA */
+    uint64_t nb_areas;
+} BenchParams;
+
+static HBitmap *bench_alloc(const BenchParams *p)
+{
+    return p->sparse ? hbitmap_alloc_sparse(BENCH_ITEMS, BENCH_GRAN) :
+                       hbitmap_alloc(BENCH_ITEMS, BENCH_GRAN);
+}
+
+static uint64_t bench_area(uint64_t i, uint64_t nb_areas)
+{
+    /* Spread the areas evenly over the whole bitmap */
+    return i * (BENCH_ITEMS / BENCH_AREA / nb_areas) * BENCH_AREA;
+}
+
+static void bench_fill(HBitmap *hb, uint64_t nb_areas)
+{
+    uint64_t i;
+
+    for (i = 0; i < nb_areas; i++) {
+        hbitmap_set(hb, bench_area(i, nb_areas), BENCH_AREA);
+    }
+}
+
+static void test(const void *opaque)
+{
+    const BenchParams *p = opaque;
+    HBitmap *hb, *other;
+    int64_t offset, bytes;
+    uint64_t i, found = 0;
+    double t_set, t_iter, t_merge, t_reset;
+
+    hb = bench_alloc(p);
+
+    g_test_timer_start();
+    bench_fill(hb, p->nb_areas);
+    t_set = g_test_timer_elapsed();
+
+    g_test_message("%s, %" PRIu64 " dirty areas: %" PRIu64 " KiB",
+                   p->sparse ? "sparse" : "dense", p->nb_areas,
+                   hbitmap_memory_usage(hb) / KiB);
+
+    g_test_timer_start();
+    for (offset = 0;
+         hbitmap_next_dirty_area(hb, offset, BENCH_ITEMS, INT64_MAX,
+                                 &offset, &bytes);
+         offset += bytes) {
+        found += bytes;
+    }
+    t_iter = g_test_timer_elapsed();
+    g_assert_cmpuint(found, ==, hbitmap_count(hb));
+
+    other = bench_alloc(p);
+    bench_fill(other, p->nb_areas);
+    g_test_timer_start();
+    hbitmap_merge(hb, other, hb);
+    t_merge = g_test_timer_elapsed();
+    hbitmap_free(other);
+
+    g_test_timer_start();
+    for (i = 0; i < p->nb_areas; i++) {
+        hbitmap_reset(hb, bench_area(i, p->nb_areas), BENCH_AREA);
+    }
+    t_reset = g_test_timer_elapsed();
+    g_assert(hbitmap_empty(hb));
+
+    g_test_message("  set %.3f ms, iterate %.3f ms, merge %.3f ms, "
+                   "reset %.3f ms, %" PRIu64 " KiB after reset",
+                   t_set * 1000, t_iter * 1000, t_merge * 1000,
+                   t_reset * 1000, hbitmap_memory_usage(hb) / KiB);
+
+    hbitmap_free(hb);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint64_t nb_areas[] = { 1, 1024, 64 * 1024, 1024 * 1024 };
+    int i, sparse;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (sparse = 0; sparse <= 1; sparse++) {
+        for (i = 0; i < ARRAY_SIZE(nb_areas); i++) {
+            BenchParams *p = g_new(BenchParams, 1);
+            g_autofree char *path = NULL;
+
+            *p = (BenchParams) {
+                .sparse = sparse,
+                .nb_areas = nb_areas[i],
+            };
+            path = g_strdup_printf("/hbitmap/%s/%" PRIu64,
+                                   sparse ? "sparse" : "dense", nb_areas[i]);
+            g_test_add_data_func_full(path, p, test, g_free);
+        }
+    }
+
+    return g_test_run();
+}
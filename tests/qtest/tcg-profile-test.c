@@ -0,0 +1,144 @@
+/*
+ * QTest testcase for the TCG translation block profile
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qobject/qdict.h"
+
+#define TIMEOUT_US              (30 * 1000 * 1000)
+
+/*
+ * Return the text of a successful x-query-tcg-profile.
+ * Takes ownership of @args.
+ */
+static char *query_profile(QTestState *qts, QDict *args)
+{
+    QDict *resp, *ret;
+    char *text;
+
+    resp = qtest_qmp(qts, "{ 'execute': 'x-query-tcg-profile',"
+                     "  'arguments': %p }", args);
+    ret = qdict_get_qdict(resp, "return");
+    g_assert(ret);
+    text = g_strdup(qdict_get_str(ret, "human-readable-text"));
+    qobject_unref(resp);
+    return text;
+}
+
+/*
+ * The firmware runs as soon as the machine starts; wait until the
+ * profile has seen a few blocks.
+ */
+static void wait_for_blocks(QTestState *qts, unsigned min_blocks)
+{
+    gint64 end = g_get_monotonic_time() + TIMEOUT_US;
+
+    for (;;) {
+        g_autofree char *text = query_profile(qts, qdict_new());
+        unsigned blocks;
+        uint64_t execs;
+
+        g_assert_cmpint(sscanf(text, "TB profile: %u blocks executed, "
+                               "%" SCNu64 " executions", &blocks, &execs),
+                        ==, 2);
+        if (blocks >= min_blocks) {
+            g_assert_cmpuint(execs, >=, blocks);
+            return;
+        }
+        g_assert_cmpint(g_get_monotonic_time(), <, end);
+        g_usleep(10 * 1000);
+    }
+}
+
+static void test_profile_disabled(void)
+{
+    QTestState *qts = qtest_init("-accel tcg");
+    QDict *resp, *error;
+
+    resp = qtest_qmp_assert_failure_ref(qts,
+                                        "{ 'execute': 'x-query-tcg-profile' }");
+    error = qdict_get_qdict(resp, "error");
+    g_assert_cmpstr(qdict_get_str(error, "class"), ==, "GenericError");
+    qobject_unref(resp);
+
+    qtest_quit(qts);
+}
+
+static void test_profile_max(void)
+{
+    QTestState *qts = qtest_init("-accel tcg,profile=on");
+    g_autofree char *text = NULL;
+    g_auto(GStrv) lines = NULL;
+    QDict *args = qdict_new();
+
+    wait_for_blocks(qts, 2);
+
+    /* Summary, column headers, one block and the "more" line */
+    qdict_put_int(args, "max", 1);
+    text = query_profile(qts, args);
+    lines = g_strsplit(g_strchomp(text), "\n", -1);
+    g_assert_cmpint(g_strv_length(lines), ==, 4);
+    g_assert(g_str_has_prefix(lines[0], "TB profile: "));
+    g_assert(g_str_has_prefix(lines[3], "("));
+    g_assert(g_str_has_suffix(lines[3], " more blocks not shown)"));
+
+    qtest_quit(qts);
+}
+
+static void test_profile_pprof(void)
+{
+    QTestState *qts = qtest_init("-accel tcg,profile=on");
+    g_autofree char *path = NULL;
+    g_autofree char *text = NULL;
+    QDict *args = qdict_new();
+    g_autofree uintptr_t *words = NULL;
+    size_t len, n;
+    int fd;
+
+    fd = g_file_open_tmp("qtest-tcg-profile-XXXXXX", &path, NULL);
+    g_assert(fd >= 0);
+    close(fd);
+
+    wait_for_blocks(qts, 1);
+
+    qdict_put_str(args, "pprof", path);
+    text = query_profile(qts, args);
+    g_assert(g_file_get_contents(path, (char **)&words, &len, NULL));
+    unlink(path);
+
+    /* Header, at least one single-frame sample and the trailer */
+    g_assert_cmpuint(len % sizeof(uintptr_t), ==, 0);
+    n = len / sizeof(uintptr_t);
+    g_assert_cmpuint(n, >=, 5 + 3 + 3);
+    g_assert_cmpuint((n - 5 - 3) % 3, ==, 0);
+    g_assert_cmpuint(words[0], ==, 0);
+    g_assert_cmpuint(words[1], ==, 3);
+    g_assert_cmpuint(words[2], ==, 0);
+    g_assert_cmpuint(words[4], ==, 0);
+    g_assert_cmpuint(words[5], >, 0);
+    g_assert_cmpuint(words[6], ==, 1);
+    g_assert_cmpuint(words[n - 3], ==, 0);
+    g_assert_cmpuint(words[n - 2], ==, 1);
+    g_assert_cmpuint(words[n - 1], ==, 0);
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (!qtest_has_accel("tcg")) {
+        g_test_skip("TCG not available");
+        return g_test_run();
+    }
+
+    qtest_add_func("/tcg-profile/disabled", test_profile_disabled);
+    qtest_add_func("/tcg-profile/max", test_profile_max);
+    qtest_add_func("/tcg-profile/pprof", test_profile_pprof);
+
+    return g_test_run();
+}
@@ -62,6 +62,7 @@
 #define VHOST_USER_PROTOCOL_F_LOG_SHMFD 1
 #define VHOST_USER_PROTOCOL_F_CROSS_ENDIAN   6
 #define VHOST_USER_PROTOCOL_F_CONFIG 9
+#define VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL 21
 
 #define VHOST_LOG_PAGE 0x1000
 
@@ -87,6 +88,7 @@ typedef enum VhostUserRequest {
     VHOST_USER_SET_VRING_ENABLE = 18,
     VHOST_USER_GET_CONFIG = 24,
     VHOST_USER_SET_CONFIG = 25,
+    VHOST_USER_SET_VRING_BUSY_POLL = 44,
     VHOST_USER_MAX
 } VhostUserRequest;
 
@@ -169,6 +171,8 @@ typedef struct TestServer {
     bool test_fail;
     int test_flags;
     int queues;
+    uint32_t busy_poll_usecs;
+    uint64_t busy_poll_rings;
     struct vhost_user_ops *vu_ops;
 } TestServer;
 
@@ -511,6 +515,15 @@ static void chr_read(void *opaque, const uint8_t *buf, int size)
                    msg.payload.state.num ? "enabled" : "disabled");
         break;
 
+    case VHOST_USER_SET_VRING_BUSY_POLL:
+        /* Only sent if we offered the feature */
+        g_assert(s->busy_poll_usecs);
+        g_assert_cmpint(msg.payload.state.num, ==, s->busy_poll_usecs);
+        assert(msg.payload.state.index < s->queues * 2);
+        s->busy_poll_rings |= 0x1ULL << msg.payload.state.index;
+        g_cond_broadcast(&s->data_cond);
+        break;
+
     default:
         g_test_message("vhost-user: un-handled message: %d", msg.request);
         break;
@@ -1055,6 +1068,36 @@ static void test_multiqueue(void *obj, void *arg, QGuestAllocator *alloc)
     wait_for_rings_started(s, s->queues * 2);
 }
 
+static void *vhost_user_test_setup_busy_poll(GString *cmd_line, void *arg)
+{
+    TestServer *s = vhost_user_test_setup(cmd_line, arg);
+
+    s->busy_poll_usecs = 50;
+    g_string_append_printf(cmd_line, " -set netdev.hs0.busy-poll-usecs=%u",
+                           s->busy_poll_usecs);
+
+    return s;
+}
+
+static void test_busy_poll(void *obj, void *arg, QGuestAllocator *alloc)
+{
+    TestServer *s = arg;
+    gint64 end_time;
+
+    wait_for_rings_started(s, 2);
+
+    /* SET_VRING_BUSY_POLL follows SET_VRING_KICK for every ring */
+    g_mutex_lock(&s->data_mutex);
+    end_time = g_get_monotonic_time() + 5 * G_TIME_SPAN_SECOND;
+    while (ctpop64(s->busy_poll_rings) != 2) {
+        if (!g_cond_wait_until(&s->data_cond, &s->data_mutex, end_time)) {
+            g_assert_cmpint(ctpop64(s->busy_poll_rings), ==, 2);
+            break;
+        }
+    }
+    g_mutex_unlock(&s->data_mutex);
+}
+
 
 static uint64_t vu_net_get_features(TestServer *s)
 {
@@ -1090,6 +1133,9 @@ static void vu_net_get_protocol_features(TestServer *s, CharFrontend *chr,
     if (s->queues > 1) {
         msg->payload.u64 |= 1 << VHOST_USER_PROTOCOL_F_MQ;
     }
+    if (s->busy_poll_usecs) {
+        msg->payload.u64 |= 1 << VHOST_USER_PROTOCOL_F_VRING_BUSY_POLL;
+    }
     qemu_chr_fe_write_all(chr, (uint8_t *)msg, VHOST_USER_HDR_SIZE + msg->size);
 }
 
@@ -1146,6 +1192,10 @@ static void register_vhost_user_test(void)
     qos_add_test("vhost-user/flags-mismatch", "virtio-net",
                  test_vhost_user_started, &opts);
 
+    opts.before = vhost_user_test_setup_busy_poll;
+    qos_add_test("vhost-user/busy-poll", "virtio-net",
+                 test_busy_poll, &opts);
+
     opts.before = vhost_user_test_setup_multiqueue;
     opts.edge.extra_device_opts = "mq=on";
     qos_add_test("vhost-user/multiqueue",
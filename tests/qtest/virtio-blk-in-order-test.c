@@ -0,0 +1,205 @@
+/*
+ * QTest testcase for migrating virtio-blk packed in-order virtqueues
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qobject/qdict.h"
+#include "libqos/libqos-pc.h"
+#include "libqos/virtio-pci.h"
+#include "standard-headers/linux/virtio_blk.h"
+#include "standard-headers/linux/virtio_config.h"
+#include "standard-headers/linux/virtio_ring.h"
+
+#define PCI_SLOT                0x04
+#define TIMEOUT_US              (30 * 1000 * 1000)
+
+/* One request: header, one sector of data and the status byte */
+#define REQ_DATA_OFFSET         sizeof(struct virtio_blk_outhdr)
+#define REQ_STATUS_OFFSET       (REQ_DATA_OFFSET + 512)
+#define REQ_SIZE                (REQ_STATUS_OFFSET + 1)
+#define REQ_NDESCS              3
+
+#define PACKED_DESC_SIZE        16
+#define PACKED_DESC_F_AVAIL     (1 << VRING_PACKED_DESC_F_AVAIL)
+#define PACKED_DESC_F_USED      (1 << VRING_PACKED_DESC_F_USED)
+
+static char *mig_socket;
+
+static void packed_desc_write(QTestState *qts, QVirtQueue *vq, uint16_t slot,
+                              uint64_t addr, uint32_t len, uint16_t id,
+                              uint16_t flags)
+{
+    uint64_t desc = vq->desc + slot * PACKED_DESC_SIZE;
+
+    qtest_writeq(qts, desc, addr);
+    qtest_writel(qts, desc + 8, len);
+    qtest_writew(qts, desc + 12, id);
+    qtest_writew(qts, desc + 14, flags);
+}
+
+/*
+ * Make a request available at @slot of a packed ring that has not
+ * wrapped yet.  The head is written last, as it publishes the buffer.
+ */
+static void add_request(QTestState *qts, QVirtQueue *vq, uint16_t slot,
+                        uint16_t id, uint32_t type, uint64_t sector,
+                        uint64_t req)
+{
+    uint16_t data_flags = type == VIRTIO_BLK_T_IN ? VRING_DESC_F_WRITE : 0;
+
+    qtest_writel(qts, req, type);
+    qtest_writel(qts, req + 4, 0);
+    qtest_writeq(qts, req + 8, sector);
+    qtest_writeb(qts, req + REQ_STATUS_OFFSET, 0xff);
+
+    packed_desc_write(qts, vq, slot + 1, req + REQ_DATA_OFFSET, 512, id,
+                      PACKED_DESC_F_AVAIL | VRING_DESC_F_NEXT | data_flags);
+    packed_desc_write(qts, vq, slot + 2, req + REQ_STATUS_OFFSET, 1, id,
+                      PACKED_DESC_F_AVAIL | VRING_DESC_F_WRITE);
+    packed_desc_write(qts, vq, slot, req, REQ_DATA_OFFSET, id,
+                      PACKED_DESC_F_AVAIL | VRING_DESC_F_NEXT);
+}
+
+static bool desc_is_used(QTestState *qts, QVirtQueue *vq, uint16_t slot)
+{
+    uint16_t flags = qtest_readw(qts, vq->desc + slot * PACKED_DESC_SIZE + 14);
+
+    return (flags & PACKED_DESC_F_USED) && (flags & PACKED_DESC_F_AVAIL);
+}
+
+/* Wait for a used descriptor at @slot and return its buffer id */
+static uint16_t wait_used(QTestState *qts, QVirtQueue *vq, uint16_t slot)
+{
+    gint64 start_time = g_get_monotonic_time();
+
+    while (!desc_is_used(qts, vq, slot)) {
+        qtest_clock_step(qts, 100);
+        g_assert(g_get_monotonic_time() - start_time <= TIMEOUT_US);
+    }
+    return qtest_readw(qts, vq->desc + slot * PACKED_DESC_SIZE + 12);
+}
+
+/* The source was stopped, so the destination stays stopped too */
+static void wait_incoming_done(QTestState *qts)
+{
+    gint64 start_time = g_get_monotonic_time();
+    QDict *rsp;
+    bool done;
+
+    do {
+        g_usleep(5000);
+        g_assert(g_get_monotonic_time() - start_time <= TIMEOUT_US);
+
+        rsp = qtest_qmp(qts, "{ 'execute': 'query-status' }");
+        done = strcmp(qdict_get_str(qdict_get_qdict(rsp, "return"),
+                                    "status"), "inmigrate");
+        qobject_unref(rsp);
+    } while (!done);
+}
+
+/*
+ * A failing write stops the VM with a read that was submitted after it
+ * already completed.  The read cannot be returned to the guest before the
+ * write, so both must survive migration and complete, in order, once the
+ * write is retried on the destination.
+ */
+static void test_migrate_in_flight(void)
+{
+    QPCIAddress addr = { .devfn = QPCI_DEVFN(PCI_SLOT, 0) };
+    g_autofree char *uri = g_strdup_printf("unix:%s", mig_socket);
+    const char *device = "-device virtio-blk-pci,addr=04.0,drive=drive0,"
+                         "packed=on,packed-in-order=on,"
+                         "werror=stop,rerror=stop ";
+    QOSState *src, *dst;
+    QVirtioPCIDevice *dev;
+    QVirtioDevice *vdev;
+    QVirtQueue *vq;
+    uint64_t features, write_req, read_req;
+    uint16_t id;
+
+    src = qtest_pc_boot("-blockdev driver=blkdebug,node-name=drive0,"
+                        "image.driver=null-co,image.read-zeroes=on,"
+                        "inject-error.0.event=pwritev,"
+                        "inject-error.0.iotype=write,"
+                        "inject-error.0.once=on "
+                        "%s", device);
+    dst = qtest_pc_boot("-blockdev driver=null-co,node-name=drive0,"
+                        "read-zeroes=on "
+                        "%s -incoming %s", device, uri);
+
+    dev = virtio_pci_new(src->pcibus, &addr);
+    g_assert_nonnull(dev);
+    vdev = &dev->vdev;
+
+    qvirtio_pci_device_enable(dev);
+    qvirtio_start_device(vdev);
+    features = qvirtio_get_features(vdev);
+    g_assert(features & (1ull << VIRTIO_F_RING_PACKED));
+    g_assert(features & (1ull << VIRTIO_F_IN_ORDER));
+    features &= ~(QVIRTIO_F_BAD_FEATURE |
+                  (1ull << VIRTIO_RING_F_INDIRECT_DESC) |
+                  (1ull << VIRTIO_RING_F_EVENT_IDX) |
+                  (1ull << VIRTIO_BLK_F_MQ));
+    qvirtio_set_features(vdev, features);
+
+    /* The split ring layout is larger, just clear the descriptors */
+    vq = qvirtqueue_setup(vdev, &src->alloc, 0);
+    qtest_memset(src->qts, vq->desc, 0, vq->size * PACKED_DESC_SIZE);
+    qvirtio_set_driver_ok(vdev);
+
+    write_req = guest_alloc(&src->alloc, REQ_SIZE);
+    read_req = guest_alloc(&src->alloc, REQ_SIZE);
+    add_request(src->qts, vq, 0, 1, VIRTIO_BLK_T_OUT, 0, write_req);
+    add_request(src->qts, vq, REQ_NDESCS, 2, VIRTIO_BLK_T_IN, 8, read_req);
+    vdev->bus->virtqueue_kick(vdev, vq);
+
+    qtest_qmp_eventwait(src->qts, "STOP");
+    g_assert(!desc_is_used(src->qts, vq, 0));
+
+    migrate(src, dst, uri);
+    wait_incoming_done(dst->qts);
+    qtest_qmp_assert_success(dst->qts, "{ 'execute': 'cont' }");
+
+    /* The two buffers may come back as one used descriptor */
+    id = wait_used(dst->qts, vq, 0);
+    if (id == 1) {
+        id = wait_used(dst->qts, vq, REQ_NDESCS);
+    }
+    g_assert_cmpint(id, ==, 2);
+    g_assert_cmpint(qtest_readb(dst->qts, write_req + REQ_STATUS_OFFSET), ==,
+                    VIRTIO_BLK_S_OK);
+    g_assert_cmpint(qtest_readb(dst->qts, read_req + REQ_STATUS_OFFSET), ==,
+                    VIRTIO_BLK_S_OK);
+
+    guest_free(&dst->alloc, read_req);
+    guest_free(&dst->alloc, write_req);
+    qvirtqueue_cleanup(vdev->bus, vq, &dst->alloc);
+    qos_object_destroy((QOSGraphObject *)dev);
+    qtest_pc_shutdown(src);
+    qtest_pc_shutdown(dst);
+}
+
+int main(int argc, char **argv)
+{
+    g_autofree char *tmp_dir = NULL;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    tmp_dir = g_dir_make_tmp("virtio-blk-in-order-test-XXXXXX", NULL);
+    g_assert_nonnull(tmp_dir);
+    mig_socket = g_strdup_printf("%s/migsocket", tmp_dir);
+
+    qtest_add_func("/virtio-blk/packed-in-order/migrate-in-flight",
+                   test_migrate_in_flight);
+
+    ret = g_test_run();
+
+    unlink(mig_socket);
+    rmdir(tmp_dir);
+    g_free(mig_socket);
+    return ret;
+}
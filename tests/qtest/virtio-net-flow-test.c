@@ -0,0 +1,340 @@
+/*
+ * QTest testcase for virtio-net flow-affinity receive steering
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qemu/bswap.h"
+#include "qemu/iov.h"
+#include "qobject/qdict.h"
+#include "libqos/libqos-malloc.h"
+#include "libqos/malloc-pc.h"
+#include "libqos/pci-pc.h"
+#include "libqos/virtio-pci.h"
+#include "hw/virtio/virtio-net.h"
+
+#define PCI_SLOT                0x04
+#define RSS_KEY_SIZE            40
+
+#define QVIRTIO_NET_TIMEOUT_US (30 * 1000 * 1000)
+#define VNET_HDR_SIZE sizeof(struct virtio_net_hdr_mrg_rxbuf)
+
+/* Ethernet, IPv4 and UDP headers followed by 4 bytes of payload */
+#define UDP_FRAME_SIZE          (14 + 20 + 8 + 4)
+
+#define GUEST_IP                0x0a000001
+#define PEER_IP                 0x0a000002
+
+typedef struct TestNIC {
+    QTestState *qts;
+    QGuestAllocator alloc;
+    QPCIBus *pcibus;
+    QVirtioPCIDevice *dev;
+    QVirtQueue *rx;
+    QVirtQueue *tx;
+    QVirtQueue *ctrl;
+    int sv[2];
+} TestNIC;
+
+typedef struct FlowStats {
+    uint64_t updates;
+    uint64_t hits;
+    uint64_t misses;
+} FlowStats;
+
+static void nic_start(TestNIC *nic)
+{
+    QPCIAddress addr = { .devfn = QPCI_DEVFN(PCI_SLOT, 0) };
+    QVirtioDevice *vdev;
+    uint64_t features;
+
+    g_assert_cmpint(socketpair(PF_UNIX, SOCK_STREAM, 0, nic->sv), !=, -1);
+    nic->qts = qtest_initf("-M pc -nodefaults -netdev socket,fd=%d,id=hs0 "
+                           "-device virtio-net-pci,id=net0,netdev=hs0,"
+                           "addr=%d,rss=on,flow-affinity=on",
+                           nic->sv[1], PCI_SLOT);
+    close(nic->sv[1]);
+
+    pc_alloc_init(&nic->alloc, nic->qts, 0);
+    nic->pcibus = qpci_new_pc(nic->qts, &nic->alloc);
+    nic->dev = virtio_pci_new(nic->pcibus, &addr);
+    g_assert_nonnull(nic->dev);
+    vdev = &nic->dev->vdev;
+
+    qvirtio_pci_device_enable(nic->dev);
+    qvirtio_start_device(vdev);
+    features = qvirtio_get_features(vdev);
+    g_assert(features & (1ull << VIRTIO_NET_F_RSS));
+    features &= ~(QVIRTIO_F_BAD_FEATURE |
+                  (1ull << VIRTIO_RING_F_INDIRECT_DESC) |
+                  (1ull << VIRTIO_RING_F_EVENT_IDX) |
+                  (1ull << VIRTIO_NET_F_HASH_REPORT));
+    qvirtio_set_features(vdev, features);
+
+    nic->rx = qvirtqueue_setup(vdev, &nic->alloc, 0);
+    nic->tx = qvirtqueue_setup(vdev, &nic->alloc, 1);
+    nic->ctrl = qvirtqueue_setup(vdev, &nic->alloc, 2);
+    qvirtio_set_driver_ok(vdev);
+}
+
+static void nic_stop(TestNIC *nic)
+{
+    QVirtioDevice *vdev = &nic->dev->vdev;
+
+    qvirtqueue_cleanup(vdev->bus, nic->ctrl, &nic->alloc);
+    qvirtqueue_cleanup(vdev->bus, nic->tx, &nic->alloc);
+    qvirtqueue_cleanup(vdev->bus, nic->rx, &nic->alloc);
+    qos_object_destroy((QOSGraphObject *)nic->dev);
+    qpci_free_pc(nic->pcibus);
+    alloc_destroy(&nic->alloc);
+    qtest_quit(nic->qts);
+    close(nic->sv[0]);
+}
+
+static void build_udp(uint8_t *buf, uint32_t saddr, uint16_t sport,
+                      uint32_t daddr, uint16_t dport)
+{
+    memset(buf, 0, UDP_FRAME_SIZE);
+
+    /* Ethernet: broadcast, so that the rx filter lets it through */
+    memset(buf, 0xff, 6);
+    buf[6] = 0x52;
+    buf[7] = 0x54;
+    stw_be_p(buf + 12, 0x0800);
+
+    /* IPv4 */
+    buf[14] = 0x45;
+    stw_be_p(buf + 16, UDP_FRAME_SIZE - 14);
+    buf[22] = 64;
+    buf[23] = 17;
+    stl_be_p(buf + 26, saddr);
+    stl_be_p(buf + 30, daddr);
+
+    /* UDP */
+    stw_be_p(buf + 34, sport);
+    stw_be_p(buf + 36, dport);
+    stw_be_p(buf + 38, UDP_FRAME_SIZE - 34);
+    memcpy(buf + 42, "TEST", 4);
+}
+
+/* Run a command on the control virtqueue */
+static uint8_t ctrl_cmd(TestNIC *nic, uint8_t class, uint8_t cmd,
+                        const void *data, size_t size)
+{
+    QVirtioDevice *vdev = &nic->dev->vdev;
+    struct virtio_net_ctrl_hdr hdr = { .class = class, .cmd = cmd };
+    uint64_t req_addr;
+    uint32_t free_head;
+    uint8_t status;
+
+    req_addr = guest_alloc(&nic->alloc, sizeof(hdr) + size + 1);
+    qtest_memwrite(nic->qts, req_addr, &hdr, sizeof(hdr));
+    qtest_memwrite(nic->qts, req_addr + sizeof(hdr), data, size);
+    qtest_writeb(nic->qts, req_addr + sizeof(hdr) + size, 0xff);
+
+    free_head = qvirtqueue_add(nic->qts, nic->ctrl, req_addr,
+                               sizeof(hdr) + size, false, true);
+    qvirtqueue_add(nic->qts, nic->ctrl, req_addr + sizeof(hdr) + size, 1,
+                   true, false);
+    qvirtqueue_kick(nic->qts, vdev, nic->ctrl, free_head);
+
+    qvirtio_wait_used_elem(nic->qts, vdev, nic->ctrl, free_head, NULL,
+                           QVIRTIO_NET_TIMEOUT_US);
+    status = qtest_readb(nic->qts, req_addr + sizeof(hdr) + size);
+    guest_free(&nic->alloc, req_addr);
+    return status;
+}
+
+/* Enable RSS over the single queue pair, hashing UDP over IPv4 */
+static void set_rss(TestNIC *nic)
+{
+    uint8_t cfg[4 + 2 + 2 + 2 + 2 + 1 + RSS_KEY_SIZE] = { 0 };
+    uint8_t *p = cfg;
+
+    stl_le_p(p, VIRTIO_NET_RSS_HASH_TYPE_IPv4 |
+                VIRTIO_NET_RSS_HASH_TYPE_UDPv4);
+    p += 4;
+    stw_le_p(p, 0);             /* indirection_table_mask */
+    p += 2;
+    stw_le_p(p, 0);             /* unclassified_queue */
+    p += 2;
+    stw_le_p(p, 0);             /* indirection_table[0] */
+    p += 2;
+    stw_le_p(p, 1);             /* max_tx_vq */
+    p += 2;
+    *p++ = RSS_KEY_SIZE;
+    memset(p, 0x6d, RSS_KEY_SIZE);
+
+    g_assert_cmpint(ctrl_cmd(nic, VIRTIO_NET_CTRL_MQ,
+                             VIRTIO_NET_CTRL_MQ_RSS_CONFIG, cfg, sizeof(cfg)),
+                    ==, VIRTIO_NET_OK);
+}
+
+/* Transmit a frame from the guest and drain it from the backend */
+static void guest_send(TestNIC *nic, const uint8_t *frame)
+{
+    QVirtioDevice *vdev = &nic->dev->vdev;
+    uint8_t buffer[UDP_FRAME_SIZE];
+    uint64_t req_addr;
+    uint32_t free_head, len;
+    int ret;
+
+    req_addr = guest_alloc(&nic->alloc, VNET_HDR_SIZE + UDP_FRAME_SIZE);
+    qtest_memset(nic->qts, req_addr, 0, VNET_HDR_SIZE);
+    qtest_memwrite(nic->qts, req_addr + VNET_HDR_SIZE, frame, UDP_FRAME_SIZE);
+
+    free_head = qvirtqueue_add(nic->qts, nic->tx, req_addr,
+                               VNET_HDR_SIZE + UDP_FRAME_SIZE, false, false);
+    qvirtqueue_kick(nic->qts, vdev, nic->tx, free_head);
+    qvirtio_wait_used_elem(nic->qts, vdev, nic->tx, free_head, NULL,
+                           QVIRTIO_NET_TIMEOUT_US);
+    guest_free(&nic->alloc, req_addr);
+
+    ret = recv(nic->sv[0], &len, sizeof(len), 0);
+    g_assert_cmpint(ret, ==, sizeof(len));
+    g_assert_cmpint(ntohl(len), ==, UDP_FRAME_SIZE);
+    ret = recv(nic->sv[0], buffer, UDP_FRAME_SIZE, MSG_WAITALL);
+    g_assert_cmpint(ret, ==, UDP_FRAME_SIZE);
+    g_assert(!memcmp(buffer, frame, UDP_FRAME_SIZE));
+}
+
+/* Feed a frame to the backend and wait for the guest to receive it */
+static void guest_receive(TestNIC *nic, uint8_t *frame)
+{
+    QVirtioDevice *vdev = &nic->dev->vdev;
+    uint8_t buffer[UDP_FRAME_SIZE];
+    uint32_t len = htonl(UDP_FRAME_SIZE);
+    struct iovec iov[] = {
+        {
+            .iov_base = &len,
+            .iov_len = sizeof(len),
+        }, {
+            .iov_base = frame,
+            .iov_len = UDP_FRAME_SIZE,
+        },
+    };
+    uint64_t req_addr;
+    uint32_t free_head;
+    int ret;
+
+    req_addr = guest_alloc(&nic->alloc, VNET_HDR_SIZE + UDP_FRAME_SIZE);
+    free_head = qvirtqueue_add(nic->qts, nic->rx, req_addr,
+                               VNET_HDR_SIZE + UDP_FRAME_SIZE, true, false);
+    qvirtqueue_kick(nic->qts, vdev, nic->rx, free_head);
+
+    ret = iov_send(nic->sv[0], iov, 2, 0, sizeof(len) + UDP_FRAME_SIZE);
+    g_assert_cmpint(ret, ==, sizeof(len) + UDP_FRAME_SIZE);
+
+    qvirtio_wait_used_elem(nic->qts, vdev, nic->rx, free_head, NULL,
+                           QVIRTIO_NET_TIMEOUT_US);
+    qtest_memread(nic->qts, req_addr + VNET_HDR_SIZE, buffer, UDP_FRAME_SIZE);
+    g_assert(!memcmp(buffer, frame, UDP_FRAME_SIZE));
+    guest_free(&nic->alloc, req_addr);
+}
+
+static FlowStats get_stats(TestNIC *nic)
+{
+    QDict *rsp, *ret;
+    FlowStats stats;
+
+    rsp = qtest_qmp(nic->qts, "{ 'execute': 'qom-get', 'arguments':"
+                    " { 'path': '/machine/peripheral/net0',"
+                    "   'property': 'flow-affinity-stats' } }");
+    ret = qdict_get_qdict(rsp, "return");
+    g_assert(ret);
+    stats.updates = qdict_get_uint(ret, "updates");
+    stats.hits = qdict_get_uint(ret, "hits");
+    stats.misses = qdict_get_uint(ret, "misses");
+    qobject_unref(rsp);
+    return stats;
+}
+
+static void check_stats(TestNIC *nic, uint64_t updates, uint64_t hits,
+                        uint64_t misses)
+{
+    FlowStats stats = get_stats(nic);
+
+    g_assert_cmpuint(stats.updates, ==, updates);
+    g_assert_cmpuint(stats.hits, ==, hits);
+    g_assert_cmpuint(stats.misses, ==, misses);
+}
+
+/*
+ * Transmitting on a flow records it, and receive steering then finds the
+ * reply in the table; a new RSS configuration forgets the flows.
+ */
+static void test_steering(void)
+{
+    TestNIC nic = { };
+    uint8_t out[UDP_FRAME_SIZE], reply[UDP_FRAME_SIZE];
+    uint8_t other[UDP_FRAME_SIZE];
+
+    build_udp(out, GUEST_IP, 1000, PEER_IP, 2000);
+    build_udp(reply, PEER_IP, 2000, GUEST_IP, 1000);
+    build_udp(other, PEER_IP, 3000, GUEST_IP, 1000);
+
+    nic_start(&nic);
+    check_stats(&nic, 0, 0, 0);
+
+    /* Nothing is recorded until the guest enables RSS */
+    guest_send(&nic, out);
+    check_stats(&nic, 0, 0, 0);
+
+    set_rss(&nic);
+    guest_send(&nic, out);
+    check_stats(&nic, 1, 0, 0);
+
+    /* The same flow again does not change the table */
+    guest_send(&nic, out);
+    check_stats(&nic, 1, 0, 0);
+
+    guest_receive(&nic, reply);
+    check_stats(&nic, 1, 1, 0);
+    guest_receive(&nic, other);
+    check_stats(&nic, 1, 1, 1);
+
+    /* The entries refer to the old configuration */
+    set_rss(&nic);
+    guest_receive(&nic, reply);
+    check_stats(&nic, 1, 1, 2);
+
+    guest_send(&nic, out);
+    guest_receive(&nic, reply);
+    check_stats(&nic, 2, 2, 2);
+
+    nic_stop(&nic);
+}
+
+/* The property is there, and all zero, with flow-affinity off */
+static void test_stats_disabled(void)
+{
+    QTestState *qts = qtest_init("-M pc -nodefaults "
+                                 "-netdev hubport,hubid=0,id=hs0 "
+                                 "-device virtio-net-pci,id=net0,netdev=hs0");
+    QDict *rsp, *ret;
+
+    rsp = qtest_qmp(qts, "{ 'execute': 'qom-get', 'arguments':"
+                    " { 'path': '/machine/peripheral/net0',"
+                    "   'property': 'flow-affinity-stats' } }");
+    ret = qdict_get_qdict(rsp, "return");
+    g_assert(ret);
+    g_assert_cmpuint(qdict_get_uint(ret, "updates"), ==, 0);
+    g_assert_cmpuint(qdict_get_uint(ret, "hits"), ==, 0);
+    g_assert_cmpuint(qdict_get_uint(ret, "misses"), ==, 0);
+    qobject_unref(rsp);
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/virtio-net/flow-affinity/steering", test_steering);
+    qtest_add_func("/virtio-net/flow-affinity/stats-disabled",
+                   test_stats_disabled);
+
+    return g_test_run();
+}
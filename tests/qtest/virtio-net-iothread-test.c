@@ -0,0 +1,318 @@
+/*
+ * QTest testcase for virtio-net with iothread-vq-mapping
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qemu/iov.h"
+#include "qobject/qdict.h"
+#include "libqos/libqos-malloc.h"
+#include "libqos/malloc-pc.h"
+#include "libqos/pci-pc.h"
+#include "libqos/virtio-pci.h"
+#include "hw/virtio/virtio-net.h"
+
+#ifndef ETH_P_RARP
+#define ETH_P_RARP 0x8035
+#endif
+
+#define NUM_NICS                2
+#define PCI_SLOT                0x04
+
+#define QVIRTIO_NET_TIMEOUT_US (30 * 1000 * 1000)
+#define VNET_HDR_SIZE sizeof(struct virtio_net_hdr_mrg_rxbuf)
+
+typedef struct TestNIC {
+    QVirtioPCIDevice *dev;
+    QVirtQueue *rx;
+    QVirtQueue *tx;
+    QVirtQueue *ctrl;
+    int sv[2];
+} TestNIC;
+
+static QGuestAllocator guest_malloc;
+static QPCIBus *pcibus;
+
+static void nic_start(QTestState *qts, TestNIC *nic, int index)
+{
+    QPCIAddress addr = { .devfn = QPCI_DEVFN(PCI_SLOT + index, 0) };
+    QVirtioDevice *vdev;
+    uint64_t features;
+
+    nic->dev = virtio_pci_new(pcibus, &addr);
+    g_assert_nonnull(nic->dev);
+    vdev = &nic->dev->vdev;
+
+    qvirtio_pci_device_enable(nic->dev);
+    qvirtio_start_device(vdev);
+    features = qvirtio_get_features(vdev);
+    features &= ~(QVIRTIO_F_BAD_FEATURE |
+                  (1ull << VIRTIO_RING_F_INDIRECT_DESC) |
+                  (1ull << VIRTIO_RING_F_EVENT_IDX) |
+                  (1ull << VIRTIO_NET_F_MQ) |
+                  (1ull << VIRTIO_NET_F_RSS));
+    g_assert(features & (1ull << VIRTIO_NET_F_CTRL_VQ));
+    g_assert(features & (1ull << VIRTIO_NET_F_CTRL_RX));
+    qvirtio_set_features(vdev, features);
+
+    nic->rx = qvirtqueue_setup(vdev, &guest_malloc, 0);
+    nic->tx = qvirtqueue_setup(vdev, &guest_malloc, 1);
+    nic->ctrl = qvirtqueue_setup(vdev, &guest_malloc, 2);
+    qvirtio_set_driver_ok(vdev);
+}
+
+static void nic_stop(TestNIC *nic)
+{
+    QVirtioDevice *vdev = &nic->dev->vdev;
+
+    qvirtqueue_cleanup(vdev->bus, nic->ctrl, &guest_malloc);
+    qvirtqueue_cleanup(vdev->bus, nic->tx, &guest_malloc);
+    qvirtqueue_cleanup(vdev->bus, nic->rx, &guest_malloc);
+    qos_object_destroy((QOSGraphObject *)nic->dev);
+    close(nic->sv[0]);
+}
+
+static QTestState *machine_start(TestNIC *nics)
+{
+    g_autoptr(GString) cmd_line = g_string_new("-M pc -nodefaults");
+    QTestState *qts;
+    int i;
+
+    for (i = 0; i < NUM_NICS; i++) {
+        g_assert_cmpint(socketpair(PF_UNIX, SOCK_STREAM, 0, nics[i].sv), !=,
+                        -1);
+        g_string_append_printf(cmd_line,
+                               " -object iothread,id=iot%d"
+                               " -netdev socket,fd=%d,id=hs%d",
+                               i, nics[i].sv[1], i);
+    }
+
+    qts = qtest_init(cmd_line->str);
+
+    for (i = 0; i < NUM_NICS; i++) {
+        g_autofree char *id = g_strdup_printf("net%d", i);
+
+        close(nics[i].sv[1]);
+        qtest_qmp_device_add(qts, "virtio-net-pci", id,
+                             "{'addr': %d, 'netdev': 'hs%d',"
+                             " 'iothread-vq-mapping': [{'iothread': 'iot%d'}]}",
+                             QPCI_DEVFN(PCI_SLOT + i, 0), i, i);
+    }
+
+    pc_alloc_init(&guest_malloc, qts, 0);
+    pcibus = qpci_new_pc(qts, &guest_malloc);
+
+    for (i = 0; i < NUM_NICS; i++) {
+        nic_start(qts, &nics[i], i);
+    }
+    return qts;
+}
+
+static void machine_stop(QTestState *qts, TestNIC *nics)
+{
+    int i;
+
+    for (i = 0; i < NUM_NICS; i++) {
+        nic_stop(&nics[i]);
+    }
+    qpci_free_pc(pcibus);
+    alloc_destroy(&guest_malloc);
+    qtest_quit(qts);
+}
+
+/* Queue an rx buffer, then feed a packet to the backend */
+static void rx_test(QTestState *qts, TestNIC *nic)
+{
+    QVirtioDevice *vdev = &nic->dev->vdev;
+    char test[] = "TEST";
+    char buffer[64];
+    int len = htonl(sizeof(test));
+    struct iovec iov[] = {
+        {
+            .iov_base = &len,
+            .iov_len = sizeof(len),
+        }, {
+            .iov_base = test,
+            .iov_len = sizeof(test),
+        },
+    };
+    uint64_t req_addr;
+    uint32_t free_head;
+    int ret;
+
+    req_addr = guest_alloc(&guest_malloc, 64);
+
+    free_head = qvirtqueue_add(qts, nic->rx, req_addr, 64, true, false);
+    qvirtqueue_kick(qts, vdev, nic->rx, free_head);
+
+    ret = iov_send(nic->sv[0], iov, 2, 0, sizeof(len) + sizeof(test));
+    g_assert_cmpint(ret, ==, sizeof(test) + sizeof(len));
+
+    qvirtio_wait_used_elem(qts, vdev, nic->rx, free_head, NULL,
+                           QVIRTIO_NET_TIMEOUT_US);
+    qtest_memread(qts, req_addr + VNET_HDR_SIZE, buffer, sizeof(test));
+    g_assert_cmpstr(buffer, ==, "TEST");
+
+    guest_free(&guest_malloc, req_addr);
+}
+
+static void recv_packet(TestNIC *nic, char *buffer, size_t size)
+{
+    uint32_t len;
+    int ret;
+
+    ret = recv(nic->sv[0], &len, sizeof(len), 0);
+    g_assert_cmpint(ret, ==, sizeof(len));
+    len = ntohl(len);
+    g_assert_cmpint(len, <=, size);
+
+    ret = recv(nic->sv[0], buffer, len, MSG_WAITALL);
+    g_assert_cmpint(ret, ==, len);
+}
+
+static void tx_test(QTestState *qts, TestNIC *nic)
+{
+    QVirtioDevice *vdev = &nic->dev->vdev;
+    char buffer[64];
+    uint64_t req_addr;
+    uint32_t free_head;
+
+    req_addr = guest_alloc(&guest_malloc, 64);
+    qtest_memwrite(qts, req_addr + VNET_HDR_SIZE, "TEST", 5);
+
+    free_head = qvirtqueue_add(qts, nic->tx, req_addr, 64, false, false);
+    qvirtqueue_kick(qts, vdev, nic->tx, free_head);
+
+    qvirtio_wait_used_elem(qts, vdev, nic->tx, free_head, NULL,
+                           QVIRTIO_NET_TIMEOUT_US);
+    guest_free(&guest_malloc, req_addr);
+
+    recv_packet(nic, buffer, sizeof(buffer));
+    g_assert_cmpstr(buffer, ==, "TEST");
+}
+
+/* Run a command on the control virtqueue, which stays in the main loop */
+static uint8_t ctrl_cmd(QTestState *qts, TestNIC *nic, uint8_t class,
+                        uint8_t cmd, const void *data, size_t size)
+{
+    QVirtioDevice *vdev = &nic->dev->vdev;
+    struct virtio_net_ctrl_hdr hdr = { .class = class, .cmd = cmd };
+    uint64_t req_addr;
+    uint32_t free_head;
+    uint8_t status;
+
+    req_addr = guest_alloc(&guest_malloc, sizeof(hdr) + size + 1);
+    qtest_memwrite(qts, req_addr, &hdr, sizeof(hdr));
+    qtest_memwrite(qts, req_addr + sizeof(hdr), data, size);
+    qtest_writeb(qts, req_addr + sizeof(hdr) + size, 0xff);
+
+    free_head = qvirtqueue_add(qts, nic->ctrl, req_addr, sizeof(hdr) + size,
+                               false, true);
+    qvirtqueue_add(qts, nic->ctrl, req_addr + sizeof(hdr) + size, 1,
+                   true, false);
+    qvirtqueue_kick(qts, vdev, nic->ctrl, free_head);
+
+    qvirtio_wait_used_elem(qts, vdev, nic->ctrl, free_head, NULL,
+                           QVIRTIO_NET_TIMEOUT_US);
+    status = qtest_readb(qts, req_addr + sizeof(hdr) + size);
+    guest_free(&guest_malloc, req_addr);
+    return status;
+}
+
+static void set_link(QTestState *qts, int index, bool up)
+{
+    QDict *rsp;
+
+    rsp = qtest_qmp(qts, "{ 'execute': 'set_link', 'arguments':"
+                    " { 'name': 'net%d', 'up': %i } }", index, up);
+    g_assert(!qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+}
+
+/*
+ * Change state that the IOThreads read, from the main loop, between
+ * packets that go through the IOThreads.
+ */
+static void test_ctrl(void)
+{
+    TestNIC nics[NUM_NICS] = { };
+    QTestState *qts;
+    uint8_t mac[ETH_ALEN] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+    uint8_t off = 0, on = 1;
+    int round, i;
+
+    qts = machine_start(nics);
+
+    for (round = 0; round < 8; round++) {
+        for (i = 0; i < NUM_NICS; i++) {
+            rx_test(qts, &nics[i]);
+            tx_test(qts, &nics[i]);
+
+            g_assert_cmpint(ctrl_cmd(qts, &nics[i], VIRTIO_NET_CTRL_RX,
+                                     VIRTIO_NET_CTRL_RX_PROMISC, &off, 1),
+                            ==, VIRTIO_NET_OK);
+            g_assert_cmpint(ctrl_cmd(qts, &nics[i], VIRTIO_NET_CTRL_RX,
+                                     VIRTIO_NET_CTRL_RX_ALLMULTI,
+                                     round & 1 ? &on : &off, 1),
+                            ==, VIRTIO_NET_OK);
+            mac[ETH_ALEN - 1] = round;
+            g_assert_cmpint(ctrl_cmd(qts, &nics[i], VIRTIO_NET_CTRL_MAC,
+                                     VIRTIO_NET_CTRL_MAC_ADDR_SET,
+                                     mac, sizeof(mac)),
+                            ==, VIRTIO_NET_OK);
+            /* The test packets are not addressed to us */
+            g_assert_cmpint(ctrl_cmd(qts, &nics[i], VIRTIO_NET_CTRL_RX,
+                                     VIRTIO_NET_CTRL_RX_PROMISC, &on, 1),
+                            ==, VIRTIO_NET_OK);
+
+            set_link(qts, i, false);
+            set_link(qts, i, true);
+        }
+    }
+
+    machine_stop(qts, nics);
+}
+
+/* RARP packets are sent from the IOThread that runs the backend */
+static void test_announce_self(void)
+{
+    TestNIC nics[NUM_NICS] = { };
+    QTestState *qts;
+    char buffer[64];
+    uint16_t *proto = (uint16_t *)&buffer[12];
+    QDict *rsp;
+    int i;
+
+    qts = machine_start(nics);
+
+    rsp = qtest_qmp(qts, "{ 'execute' : 'announce-self', "
+                    " 'arguments': {"
+                    " 'initial': 20, 'max': 100,"
+                    " 'rounds': 1, 'step': 10 } }");
+    g_assert(!qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+
+    for (i = 0; i < NUM_NICS; i++) {
+        recv_packet(&nics[i], buffer, sizeof(buffer));
+        g_assert_cmpint(*proto, ==, htons(ETH_P_RARP));
+
+        /* The datapath still works afterwards */
+        rx_test(qts, &nics[i]);
+        tx_test(qts, &nics[i]);
+    }
+
+    machine_stop(qts, nics);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/virtio-net/iothread-vq-mapping/ctrl", test_ctrl);
+    qtest_add_func("/virtio-net/iothread-vq-mapping/announce-self",
+                   test_announce_self);
+
+    return g_test_run();
+}
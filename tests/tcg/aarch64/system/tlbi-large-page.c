@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * TLB invalidation of a page inside a large page
+ *
+ * QEMU's softmmu TLB remembers large pages only as one region per
+ * mmu_idx and must flush the whole mmu_idx when an invalidation
+ * touches that region.  Invalidate the last 4k page of a 2mb block
+ * together with the abutting small page, which QEMU may handle as a
+ * single range, and check that the block mapping really went away.
+ */
+
+#include <stdint.h>
+#include <minilib.h>
+
+#define SZ_4K       0x1000UL
+#define SZ_2M       0x200000UL
+#define RAM_BASE    (1UL << 30)
+
+/* Attributes used by boot.S for .data: AF, NX, AttrIndx=0 */
+#define DESC_BLOCK  ((3UL << 53) | 0x401)
+#define DESC_PAGE   ((3UL << 53) | 0x403)
+#define DESC_TABLE  0x3UL
+
+/* Physical backing, above the 6mb used by the kernel image */
+#define PA_A        (RAM_BASE + 16 * 1024 * 1024)
+#define PA_B        (RAM_BASE + 18 * 1024 * 1024)
+#define PA_C        (RAM_BASE + 20 * 1024 * 1024)
+#define PA_SCRATCH  (RAM_BASE + 24 * 1024 * 1024)
+
+/* Level 2 slots (2mb each) inside the first GB of RAM */
+#define L2_ALIAS_A  8
+#define L2_ALIAS_B  9
+#define L2_BLOCK    10
+#define L2_SMALL    11
+#define L2_SCRATCH  12
+#define NR_SCRATCH  2
+
+#define VA(slot)    (RAM_BASE + (slot) * SZ_2M)
+
+static uint64_t l3_table[512] __attribute__((aligned(4096)));
+
+static void tlbi_all(void)
+{
+    asm volatile("dsb ishst\n\t"
+                 "tlbi vmalle1is\n\t"
+                 "dsb ish\n\t"
+                 "isb" : : : "memory");
+}
+
+static void tlbi_page(uint64_t va)
+{
+    asm volatile("tlbi vae1is, %0" : : "r" (va >> 12) : "memory");
+}
+
+/* TLBI RVAE1IS, two 4k pages starting at @va */
+static void tlbi_range2(uint64_t va)
+{
+    uint64_t op = (1UL << 46) | (va >> 12);     /* TG=4k, SCALE=NUM=0 */
+
+    asm volatile("sys #0, c8, c2, #1, %0" : : "r" (op) : "memory");
+}
+
+static uint64_t read_at(uint64_t va)
+{
+    return *(volatile uint64_t *)va;
+}
+
+static void write_at(uint64_t va, uint64_t val)
+{
+    *(volatile uint64_t *)va = val;
+}
+
+static volatile uint64_t *l2_table(void)
+{
+    uint64_t ttbr0, *l1;
+
+    asm("mrs %0, ttbr0_el1" : "=r" (ttbr0));
+    l1 = (uint64_t *)(ttbr0 & ~(SZ_4K - 1));
+
+    /* boot.S maps all of RAM through the table for IA[38:30] = 1 */
+    return (volatile uint64_t *)(l1[1] & 0xfffffffff000UL);
+}
+
+/*
+ * The softmmu TLB starts small, and a small TLB turns any multi-page
+ * range flush into a full flush.  Use a lot of entries and then flush
+ * everything a few times so that it is resized.
+ */
+static void grow_tlb(void)
+{
+    for (int round = 0; round < 4; round++) {
+        for (uint64_t off = 0; off < NR_SCRATCH * SZ_2M; off += SZ_4K) {
+            read_at(VA(L2_SCRATCH) + off);
+        }
+        tlbi_all();
+    }
+}
+
+static int check(const char *what, uint64_t va, uint64_t expected)
+{
+    uint64_t val = read_at(va);
+
+    if (val != expected) {
+        ml_printf("FAIL: %s: read %lx, expected %lx\n", what, val, expected);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Map the test block to @old, load it and the small page into the TLB,
+ * remap the block to @new and invalidate with @flush.
+ */
+static int run_one(volatile uint64_t *l2, const char *what,
+                   uint64_t old, uint64_t old_val,
+                   uint64_t new, uint64_t new_val,
+                   void (*flush)(uint64_t va))
+{
+    uint64_t last = VA(L2_BLOCK) + SZ_2M - SZ_4K;
+    int fail = 0;
+
+    l2[L2_BLOCK] = old | DESC_BLOCK;
+    tlbi_all();
+    grow_tlb();
+
+    fail |= check(what, VA(L2_BLOCK), old_val);
+    fail |= check(what, last, old_val);
+    fail |= check(what, VA(L2_SMALL), 0xcccc);
+
+    l2[L2_BLOCK] = new | DESC_BLOCK;
+    asm volatile("dsb ishst" : : : "memory");
+    flush(last);
+    asm volatile("dsb ish\n\tisb" : : : "memory");
+
+    /* Any address in the block must see the new mapping */
+    fail |= check(what, VA(L2_BLOCK), new_val);
+    fail |= check(what, last, new_val);
+    fail |= check(what, VA(L2_SMALL), 0xcccc);
+    return fail;
+}
+
+static void flush_pages(uint64_t va)
+{
+    tlbi_page(va);
+    tlbi_page(va + SZ_4K);
+}
+
+int main()
+{
+    volatile uint64_t *l2 = l2_table();
+    uint64_t isar0;
+    int fail = 0;
+
+    l2[L2_ALIAS_A] = PA_A | DESC_BLOCK;
+    l2[L2_ALIAS_B] = PA_B | DESC_BLOCK;
+    l2[L2_SMALL] = (uint64_t)l3_table | DESC_TABLE;
+    l3_table[0] = PA_C | DESC_PAGE;
+    for (int i = 0; i < NR_SCRATCH; i++) {
+        l2[L2_SCRATCH + i] = (PA_SCRATCH + i * SZ_2M) | DESC_BLOCK;
+    }
+    tlbi_all();
+
+    write_at(VA(L2_ALIAS_A), 0xaaaa);
+    write_at(VA(L2_ALIAS_A) + SZ_2M - SZ_4K, 0xaaaa);
+    write_at(VA(L2_ALIAS_B), 0xbbbb);
+    write_at(VA(L2_ALIAS_B) + SZ_2M - SZ_4K, 0xbbbb);
+    write_at(VA(L2_SMALL), 0xcccc);
+
+    fail |= run_one(l2, "vae1is", PA_A, 0xaaaa, PA_B, 0xbbbb, flush_pages);
+
+    /* FEAT_TLBIRANGE: ID_AA64ISAR0_EL1.TLB == 2 */
+    asm("mrs %0, id_aa64isar0_el1" : "=r" (isar0));
+    if (((isar0 >> 56) & 0xf) >= 2) {
+        fail |= run_one(l2, "rvae1is", PA_B, 0xbbbb, PA_A, 0xaaaa,
+                        tlbi_range2);
+    } else {
+        ml_printf("SKIP: FEAT_TLBIRANGE not present\n");
+    }
+
+    if (!fail) {
+        ml_printf("OK\n");
+    }
+    return fail;
+}
@@ -0,0 +1,32 @@
+#
+# Test that a breakpoint set on the target of a predicted indirect call
+# is hit.  test-indirect calls predicted() a few thousand times before
+# stopping in far_stop(), which returns into call_two() on another page;
+# call_two() then calls predicted() once more.
+#
+# This is launched via tests/guest-debug/run-test.py
+#
+
+import gdb
+from test_gdbstub import main, report
+
+
+def run_test():
+    "Run through the tests one by one"
+
+    bp = gdb.Breakpoint("far_stop")
+    gdb.execute("continue")
+    frame = gdb.selected_frame()
+    report(frame.name() == "far_stop", "break @ %s" % frame.name())
+    # Leave no breakpoint on the page that predicted() is returned from
+    bp.delete()
+
+    bp = gdb.Breakpoint("*predicted")
+    gdb.execute("continue")
+    pc = int(gdb.parse_and_eval("(long)$pc"))
+    target = int(gdb.parse_and_eval("(long)&predicted"))
+    report(pc == target and bp.hit_count == 1,
+           "break @ predicted (%d hits)" % bp.hit_count)
+
+
+main(run_test)
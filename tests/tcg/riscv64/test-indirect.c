@@ -0,0 +1,136 @@
+/*
+ * Indirect calls and returns, whose targets TCG predicts inline.
+ *
+ * call_all(), call_two() and the functions they call share a page of
+ * their own, so that their indirect calls and the returns are predicted.
+ * far_call() and far_stop() are on another page; see
+ * gdbstub/test-indirect.py for the breakpoint test.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+typedef long fn(long);
+
+long call_all(fn *const *fns, long n, long x);
+long call_two(fn *first, fn *second, long x);
+long add_one(long x);
+long add_two(long x);
+long predicted(long x);
+
+asm(".pushsection .text.ic, \"ax\"\n"
+    ".option push\n"
+    ".option norvc\n"
+    ".balign 4096\n"
+    /* x = fns[i](x) for i in [0, n), with jalr ra as the call */
+    ".globl call_all\n"
+    ".type call_all, @function\n"
+    "call_all:\n"
+    "   addi sp, sp, -32\n"
+    "   sd ra, 24(sp)\n"
+    "   sd s0, 16(sp)\n"
+    "   sd s1, 8(sp)\n"
+    "   mv s0, a0\n"
+    "   mv s1, a1\n"
+    "   mv a0, a2\n"
+    "1: beqz s1, 2f\n"
+    "   ld t1, 0(s0)\n"
+    "   jalr ra, 0(t1)\n"
+    "   addi s0, s0, 8\n"
+    "   addi s1, s1, -1\n"
+    "   j 1b\n"
+    "2: ld ra, 24(sp)\n"
+    "   ld s0, 16(sp)\n"
+    "   ld s1, 8(sp)\n"
+    "   addi sp, sp, 32\n"
+    "   ret\n"
+    /* second(first(x)), from two call sites */
+    ".globl call_two\n"
+    ".type call_two, @function\n"
+    "call_two:\n"
+    "   addi sp, sp, -16\n"
+    "   sd ra, 8(sp)\n"
+    "   sd s0, 0(sp)\n"
+    "   mv s0, a1\n"
+    "   mv t1, a0\n"
+    "   mv a0, a2\n"
+    "   jalr ra, 0(t1)\n"
+    "   jalr ra, 0(s0)\n"
+    "   ld ra, 8(sp)\n"
+    "   ld s0, 0(sp)\n"
+    "   addi sp, sp, 16\n"
+    "   ret\n"
+    ".globl add_one\n"
+    ".type add_one, @function\n"
+    "add_one:\n"
+    "   addi a0, a0, 1\n"
+    "   ret\n"
+    ".globl add_two\n"
+    ".type add_two, @function\n"
+    "add_two:\n"
+    "   addi a0, a0, 2\n"
+    "   ret\n"
+    ".globl predicted\n"
+    ".type predicted, @function\n"
+    "predicted:\n"
+    "   addi a0, a0, 3\n"
+    "   ret\n"
+    ".balign 4096\n"
+    ".option pop\n"
+    ".popsection");
+
+static long __attribute__((noinline)) far_call(long x)
+{
+    asm volatile("" : "+r"(x));
+    return x + 4;
+}
+
+/* gdbstub/test-indirect.py stops here */
+static long __attribute__((noinline)) far_stop(long x)
+{
+    asm volatile("" : "+r"(x));
+    return x + 5;
+}
+
+/* Reached through pointers, so that the calls from main() are indirect */
+static long (*volatile call_all_ptr)(fn *const *, long, long) = call_all;
+static long (*volatile call_two_ptr)(fn *, fn *, long) = call_two;
+
+int main(void)
+{
+    static fn *const same[] = { add_one, add_one, add_one, add_one };
+    static fn *const mixed[] = { add_one, add_two, far_call, predicted };
+    long x = 0;
+    int i;
+
+    /* Every call and return has the same target as the previous one */
+    for (i = 0; i < 1000; i++) {
+        x = call_all_ptr(same, 4, x);
+    }
+    assert(x == 4000);
+
+    /* The call targets change every time, the returns do not */
+    for (i = 0; i < 1000; i++) {
+        x = call_all_ptr(mixed, 4, x);
+    }
+    assert(x == 14000);
+
+    /* Returns from another page into call_two() */
+    for (i = 0; i < 1000; i++) {
+        x = call_two_ptr(far_call, predicted, x);
+    }
+    assert(x == 21000);
+
+    /*
+     * Stopped in far_stop(), the debugger sets a breakpoint on
+     * predicted(), which must be hit even though both the return into
+     * call_two() and its second call have been predicted so far.
+     */
+    x = call_two_ptr(far_stop, predicted, x);
+    assert(x == 21008);
+
+    printf("PASS\n");
+    return 0;
+}
@@ -27,6 +27,7 @@ typedef struct TestHBitmapData {
     size_t         size;
     size_t         old_size;
     int            granularity;
+    bool           sparse;
 } TestHBitmapData;
 
 
@@ -80,7 +81,8 @@ static void hbitmap_test_init(TestHBitmapData *data,
                               uint64_t size, int granularity)
 {
     size_t n;
-    data->hb = hbitmap_alloc(size, granularity);
+    data->hb = data->sparse ? hbitmap_alloc_sparse(size, granularity) :
+                              hbitmap_alloc(size, granularity);
 
     n = DIV_ROUND_UP(size, BITS_PER_LONG);
     if (n == 0) {
@@ -794,11 +796,23 @@ static void test_hbitmap_serialize_zeroes(TestHBitmapData *data,
     }
 }
 
+static void hbitmap_test_setup_sparse(TestHBitmapData *data,
+                                      const void *unused)
+{
+    data->sparse = true;
+}
+
+/* Run each test on both dense and sparse bitmaps */
 static void hbitmap_test_add(const char *testpath,
                                    void (*test_func)(TestHBitmapData *data, const void *user_data))
 {
+    g_autofree char *sparse_path =
+        g_strdup_printf("/hbitmap/sparse%s", testpath + strlen("/hbitmap"));
+
     g_test_add(testpath, TestHBitmapData, NULL, NULL, test_func,
                hbitmap_test_teardown);
+    g_test_add(sparse_path, TestHBitmapData, NULL, hbitmap_test_setup_sparse,
+               test_func, hbitmap_test_teardown);
 }
 
 static void test_hbitmap_iter_and_reset(TestHBitmapData *data,
@@ -1043,6 +1057,34 @@ static void test_hbitmap_next_dirty_area_after_truncate(TestHBitmapData *data,
     test_hbitmap_next_dirty_area_check(data, 0, INT64_MAX);
 }
 
+static void test_hbitmap_sparse_memory(TestHBitmapData *data,
+                                       const void *unused)
+{
+    uint64_t empty_usage, usage;
+
+    /*
+     * 2^30 bits take 128 MiB in a dense bitmap.  Too large for a shadow
+     * bitmap, so do not use hbitmap_test_init().
+     */
+    data->hb = hbitmap_alloc_sparse(UINT64_C(1) << 30, 0);
+    empty_usage = hbitmap_memory_usage(data->hb);
+    g_assert_cmpuint(empty_usage, <, 512 * 1024);
+
+    hbitmap_set(data->hb, L3 * 7 + 5, 1);
+    hbitmap_set(data->hb, (UINT64_C(1) << 30) - L2, L2);
+    usage = hbitmap_memory_usage(data->hb);
+    g_assert_cmpuint(usage, >, empty_usage);
+    g_assert_cmpuint(usage, <, empty_usage + 64 * 1024);
+    g_assert_cmpint(hbitmap_next_dirty(data->hb, 0, INT64_MAX), ==,
+                    L3 * 7 + 5);
+
+    /* Clearing the bits must give back the pages */
+    hbitmap_reset(data->hb, L3 * 7 + 5, 1);
+    hbitmap_reset(data->hb, (UINT64_C(1) << 30) - L2, L2);
+    g_assert(hbitmap_empty(data->hb));
+    g_assert_cmpuint(hbitmap_memory_usage(data->hb), ==, empty_usage);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -1114,6 +1156,10 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_after_truncate",
                      test_hbitmap_next_dirty_area_after_truncate);
 
+    g_test_add("/hbitmap/sparse/memory", TestHBitmapData, NULL,
+               hbitmap_test_setup_sparse, test_hbitmap_sparse_memory,
+               hbitmap_test_teardown);
+
     g_test_run();
 
     return 0;
@@ -0,0 +1,423 @@
+/*
+ * Software segmentation and checksum offload unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "net/checksum.h"
+#include "net/eth.h"
+#include "standard-headers/linux/virtio_net.h"
+#include "../net/gso.h"
+
+#define MSS         1000
+#define HDR_LEN     sizeof(struct virtio_net_hdr)
+#define IP4_LEN     sizeof(struct ip_header)
+#define IP6_LEN     sizeof(struct ip6_header)
+#define TCP_LEN     sizeof(tcp_header)
+#define UDP_LEN     sizeof(udp_header)
+
+#define IP_ID       0x1234
+#define TCP_SEQ     0xfffff000 /* wraps around */
+
+/* Frames passed to the deliver callback */
+static GPtrArray *frames;
+/* Index of the frame that the deliver callback fails to send, or -1 */
+static int fail_at = -1;
+
+static NetClientState test_nc = {
+    .vnet_hdr_len = HDR_LEN,
+};
+
+static ssize_t test_deliver(NetClientState *nc, const struct iovec *iov,
+                            int iovcnt, unsigned flags)
+{
+    size_t size = iov_size(iov, iovcnt);
+    GByteArray *frame;
+
+    g_assert(nc == &test_nc);
+    if ((int)frames->len == fail_at) {
+        return 0;
+    }
+
+    frame = g_byte_array_sized_new(size);
+    g_byte_array_set_size(frame, size);
+    iov_to_buf(iov, iovcnt, 0, frame->data, size);
+    g_ptr_array_add(frames, frame);
+    return size;
+}
+
+static void frames_reset(void)
+{
+    g_ptr_array_set_size(frames, 0);
+    fail_at = -1;
+}
+
+static uint8_t payload_byte(size_t i)
+{
+    return i * 7 + 3;
+}
+
+/*
+ * Build a virtio-net header followed by an Ethernet frame with @payload
+ * bytes of L4 payload.  Returns the total length.
+ */
+static size_t build_packet(uint8_t *buf, uint8_t gso_type, bool ip6,
+                           uint8_t proto, size_t payload, uint16_t tcp_flags)
+{
+    struct virtio_net_hdr *hdr = (struct virtio_net_hdr *)buf;
+    struct eth_header *eth = (struct eth_header *)(buf + HDR_LEN);
+    size_t l3off = HDR_LEN + ETH_HLEN;
+    size_t l4off = l3off + (ip6 ? IP6_LEN : IP4_LEN);
+    size_t l4len = proto == IP_PROTO_TCP ? TCP_LEN : UDP_LEN;
+    size_t i;
+
+    memset(buf, 0, l4off + l4len);
+    hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    hdr->gso_type = gso_type;
+    hdr->hdr_len = l4off + l4len - HDR_LEN;
+    hdr->gso_size = MSS;
+    hdr->csum_start = l4off - HDR_LEN;
+    hdr->csum_offset = proto == IP_PROTO_TCP ? offsetof(tcp_header, th_sum) :
+                                               offsetof(udp_header, uh_sum);
+
+    memset(eth->h_dest, 0x52, ETH_ALEN);
+    memset(eth->h_source, 0x54, ETH_ALEN);
+
+    if (ip6) {
+        struct ip6_header *ip = (struct ip6_header *)(buf + l3off);
+
+        stw_be_p(&eth->h_proto, ETH_P_IPV6);
+        stl_be_p(&ip->ip6_ctlun.ip6_un1.ip6_un1_flow, 0x60000000);
+        stw_be_p(&ip->ip6_plen, l4len + payload);
+        ip->ip6_nxt = proto;
+        ip->ip6_ctlun.ip6_un1.ip6_un1_hlim = 64;
+        ip->ip6_src.__in6_u.__u6_addr8[15] = 1;
+        ip->ip6_dst.__in6_u.__u6_addr8[15] = 2;
+    } else {
+        struct ip_header *ip = (struct ip_header *)(buf + l3off);
+
+        stw_be_p(&eth->h_proto, ETH_P_IP);
+        ip->ip_ver_len = (IP_HEADER_VERSION_4 << 4) | (IP4_LEN >> 2);
+        stw_be_p(&ip->ip_len, IP4_LEN + l4len + payload);
+        stw_be_p(&ip->ip_id, IP_ID);
+        ip->ip_ttl = 64;
+        ip->ip_p = proto;
+        stl_be_p(&ip->ip_src, 0x0a000001);
+        stl_be_p(&ip->ip_dst, 0x0a000002);
+    }
+
+    if (proto == IP_PROTO_TCP) {
+        tcp_header *tcp = (tcp_header *)(buf + l4off);
+
+        stw_be_p(&tcp->th_sport, 1234);
+        stw_be_p(&tcp->th_dport, 80);
+        stl_be_p(&tcp->th_seq, TCP_SEQ);
+        stw_be_p(&tcp->th_offset_flags, ((TCP_LEN >> 2) << 12) | tcp_flags);
+        stw_be_p(&tcp->th_win, 0xffff);
+    } else {
+        udp_header *udp = (udp_header *)(buf + l4off);
+
+        stw_be_p(&udp->uh_sport, 1234);
+        stw_be_p(&udp->uh_dport, 53);
+        stw_be_p(&udp->uh_ulen, UDP_LEN + payload);
+    }
+
+    for (i = 0; i < payload; i++) {
+        buf[l4off + l4len + i] = payload_byte(i);
+    }
+    return l4off + l4len + payload;
+}
+
+static ssize_t deliver_packet(uint8_t *buf, size_t len)
+{
+    struct iovec iov[] = {
+        /* Split the header off, as the NIC models do */
+        { .iov_base = buf, .iov_len = HDR_LEN },
+        { .iov_base = buf + HDR_LEN, .iov_len = len - HDR_LEN },
+    };
+
+    return net_gso_deliver(&test_nc, iov, ARRAY_SIZE(iov), 0, test_deliver);
+}
+
+/* The L4 checksum of @frame must verify against the pseudo header */
+static void check_l4_csum(uint8_t *frame, size_t len, bool ip6,
+                          uint8_t proto)
+{
+    size_t l4off = ETH_HLEN + (ip6 ? IP6_LEN : IP4_LEN);
+    uint32_t sum;
+
+    sum = net_checksum_add(len - l4off, frame + l4off);
+    if (ip6) {
+        sum += net_checksum_add(2 * sizeof(struct in6_address),
+                                frame + ETH_HLEN +
+                                offsetof(struct ip6_header, ip6_src));
+    } else {
+        sum += net_checksum_add(2 * sizeof(uint32_t),
+                                frame + ETH_HLEN +
+                                offsetof(struct ip_header, ip_src));
+    }
+    sum += proto + len - l4off;
+    g_assert_cmphex(net_checksum_finish(sum), ==, 0);
+}
+
+static void check_segments(uint8_t gso_type, bool ip6, uint8_t proto,
+                           size_t payload, unsigned nsegs)
+{
+    uint16_t tcp_flags = TCP_FLAG_ACK | TH_CWR | TH_PUSH | TH_FIN;
+    size_t l4off = ETH_HLEN + (ip6 ? IP6_LEN : IP4_LEN);
+    size_t l5off = l4off + (proto == IP_PROTO_TCP ? TCP_LEN : UDP_LEN);
+    g_autofree uint8_t *buf = g_malloc(HDR_LEN + l5off + payload);
+    size_t len, off;
+    unsigned i, j;
+
+    frames_reset();
+    len = build_packet(buf, gso_type, ip6, proto, payload, tcp_flags);
+    g_assert_cmpint(deliver_packet(buf, len), ==, len);
+    g_assert_cmpint(frames->len, ==, nsegs);
+
+    off = 0;
+    for (i = 0; i < nsegs; i++) {
+        GByteArray *frame = g_ptr_array_index(frames, i);
+        uint8_t *data = frame->data;
+        size_t seglen = MIN(MSS, payload - off);
+        bool last = i == nsegs - 1;
+
+        g_assert_cmpint(frame->len, ==, l5off + seglen);
+        g_assert(last || seglen == MSS);
+
+        /* Everything up to the IP header is copied unchanged */
+        g_assert(!memcmp(data, buf + HDR_LEN, ETH_HLEN));
+
+        if (ip6) {
+            struct ip6_header *ip = (struct ip6_header *)(data + ETH_HLEN);
+
+            g_assert_cmpint(lduw_be_p(&ip->ip6_plen), ==,
+                            frame->len - ETH_HLEN - IP6_LEN);
+        } else {
+            struct ip_header *ip = (struct ip_header *)(data + ETH_HLEN);
+
+            g_assert_cmpint(lduw_be_p(&ip->ip_len), ==,
+                            frame->len - ETH_HLEN);
+            g_assert_cmpint(lduw_be_p(&ip->ip_id), ==, IP_ID + i);
+            g_assert_cmphex(net_raw_checksum((uint8_t *)ip, IP4_LEN), ==, 0);
+        }
+
+        if (proto == IP_PROTO_TCP) {
+            tcp_header *tcp = (tcp_header *)(data + l4off);
+            uint16_t flags = TCP_HEADER_FLAGS(tcp);
+
+            g_assert_cmphex(ldl_be_p(&tcp->th_seq), ==,
+                            (uint32_t)(TCP_SEQ + off));
+            g_assert_cmpint(TCP_HEADER_DATA_OFFSET(tcp), ==, TCP_LEN);
+            g_assert(flags & TCP_FLAG_ACK);
+            g_assert_cmpint(!!(flags & TH_PUSH), ==, last);
+            g_assert_cmpint(!!(flags & TH_FIN), ==, last);
+            /* CWR is carried by the first segment of the burst only */
+            g_assert_cmphex(lduw_be_p(&tcp->th_offset_flags) & TH_CWR, ==,
+                            i ? 0 : TH_CWR);
+        } else {
+            udp_header *udp = (udp_header *)(data + l4off);
+
+            g_assert_cmpint(lduw_be_p(&udp->uh_ulen), ==,
+                            frame->len - l4off);
+        }
+        check_l4_csum(data, frame->len, ip6, proto);
+
+        for (j = 0; j < seglen; j++) {
+            g_assert_cmphex(data[l5off + j], ==, payload_byte(off + j));
+        }
+        off += seglen;
+    }
+    g_assert_cmpint(off, ==, payload);
+}
+
+static void test_tcp4(void)
+{
+    /* The last segment is shorter than gso_size */
+    check_segments(VIRTIO_NET_HDR_GSO_TCPV4, false, IP_PROTO_TCP,
+                   3 * MSS + 100, 4);
+}
+
+static void test_tcp4_ecn(void)
+{
+    /* The ECN bit does not change the segmentation */
+    check_segments(VIRTIO_NET_HDR_GSO_TCPV4 | VIRTIO_NET_HDR_GSO_ECN, false,
+                   IP_PROTO_TCP, 2 * MSS, 2);
+}
+
+static void test_tcp6(void)
+{
+    /* An odd-sized last segment exercises the checksum's trailing byte */
+    check_segments(VIRTIO_NET_HDR_GSO_TCPV6, true, IP_PROTO_TCP,
+                   2 * MSS + 1, 3);
+}
+
+static void test_udp4(void)
+{
+    check_segments(VIRTIO_NET_HDR_GSO_UDP_L4, false, IP_PROTO_UDP,
+                   2 * MSS + 10, 3);
+}
+
+static void test_udp6(void)
+{
+    check_segments(VIRTIO_NET_HDR_GSO_UDP_L4, true, IP_PROTO_UDP,
+                   MSS - 1, 1);
+}
+
+/* Malformed packets are dropped, and reported as sent */
+static void check_dropped(uint8_t *buf, size_t len)
+{
+    frames_reset();
+    g_assert_cmpint(deliver_packet(buf, len), ==, len);
+    g_assert_cmpint(frames->len, ==, 0);
+}
+
+static void test_bad_gso_type(void)
+{
+    uint8_t buf[2048];
+    size_t len;
+
+    /* TCPv4 segmentation of a TCPv6 packet */
+    len = build_packet(buf, VIRTIO_NET_HDR_GSO_TCPV4, true, IP_PROTO_TCP,
+                       MSS + 1, TCP_FLAG_ACK);
+    check_dropped(buf, len);
+
+    /* TCP segmentation of a UDP packet */
+    len = build_packet(buf, VIRTIO_NET_HDR_GSO_TCPV4, false, IP_PROTO_UDP,
+                       MSS + 1, 0);
+    check_dropped(buf, len);
+
+    /* UFO is never offered */
+    len = build_packet(buf, VIRTIO_NET_HDR_GSO_UDP, false, IP_PROTO_UDP,
+                       MSS + 1, 0);
+    check_dropped(buf, len);
+}
+
+static void test_zero_gso_size(void)
+{
+    uint8_t buf[2048];
+    size_t len;
+
+    len = build_packet(buf, VIRTIO_NET_HDR_GSO_TCPV4, false, IP_PROTO_TCP,
+                       MSS + 1, TCP_FLAG_ACK);
+    ((struct virtio_net_hdr *)buf)->gso_size = 0;
+    check_dropped(buf, len);
+}
+
+static void test_short_header(void)
+{
+    size_t l4off = HDR_LEN + ETH_HLEN + IP4_LEN;
+    uint8_t buf[2048];
+
+    /* The frame ends in the middle of the TCP header */
+    build_packet(buf, VIRTIO_NET_HDR_GSO_TCPV4, false, IP_PROTO_TCP,
+                 0, TCP_FLAG_ACK);
+    check_dropped(buf, l4off + TCP_LEN / 2);
+
+    /* ... or of the IP header */
+    check_dropped(buf, l4off - IP4_LEN / 2);
+}
+
+static void test_short_vnet_header(void)
+{
+    uint8_t buf[HDR_LEN] = { 0 };
+    struct iovec iov = { .iov_base = buf, .iov_len = HDR_LEN - 1 };
+
+    frames_reset();
+    g_assert_cmpint(net_gso_deliver(&test_nc, &iov, 1, 0, test_deliver), ==,
+                    HDR_LEN - 1);
+    g_assert_cmpint(frames->len, ==, 0);
+}
+
+static void test_needs_csum(void)
+{
+    size_t l4off = ETH_HLEN + IP4_LEN;
+    uint8_t buf[2048];
+    GByteArray *frame;
+    size_t len;
+
+    frames_reset();
+    len = build_packet(buf, VIRTIO_NET_HDR_GSO_NONE, false, IP_PROTO_UDP,
+                       MSS - 1, 0);
+    /* Seed the checksum field with the pseudo header, as guests do */
+    stw_be_p(buf + HDR_LEN + l4off + offsetof(udp_header, uh_sum),
+             ~net_checksum_finish(
+                 net_checksum_add(8, buf + HDR_LEN + ETH_HLEN +
+                                  offsetof(struct ip_header, ip_src)) +
+                 IP_PROTO_UDP + len - HDR_LEN - l4off));
+
+    g_assert_cmpint(deliver_packet(buf, len), ==, len);
+    g_assert_cmpint(frames->len, ==, 1);
+    frame = g_ptr_array_index(frames, 0);
+    g_assert_cmpint(frame->len, ==, len - HDR_LEN);
+    check_l4_csum(frame->data, frame->len, false, IP_PROTO_UDP);
+}
+
+static void test_no_offload(void)
+{
+    uint8_t buf[2048];
+    GByteArray *frame;
+    size_t len;
+
+    frames_reset();
+    len = build_packet(buf, VIRTIO_NET_HDR_GSO_NONE, true, IP_PROTO_TCP,
+                       100, TCP_FLAG_ACK);
+    ((struct virtio_net_hdr *)buf)->flags = 0;
+
+    g_assert_cmpint(deliver_packet(buf, len), ==, len);
+    g_assert_cmpint(frames->len, ==, 1);
+    frame = g_ptr_array_index(frames, 0);
+    g_assert_cmpint(frame->len, ==, len - HDR_LEN);
+    g_assert(!memcmp(frame->data, buf + HDR_LEN, frame->len));
+}
+
+static void test_deliver_fails(void)
+{
+    g_autofree uint8_t *buf = g_malloc(4 * MSS);
+    size_t len;
+
+    len = build_packet(buf, VIRTIO_NET_HDR_GSO_TCPV4, false, IP_PROTO_TCP,
+                       3 * MSS, TCP_FLAG_ACK);
+
+    /* The caller queues the whole packet if the first segment fails */
+    frames_reset();
+    fail_at = 0;
+    g_assert_cmpint(deliver_packet(buf, len), ==, 0);
+    g_assert_cmpint(frames->len, ==, 0);
+
+    /* Later failures drop the rest of the segments */
+    frames_reset();
+    fail_at = 1;
+    g_assert_cmpint(deliver_packet(buf, len), ==, len);
+    g_assert_cmpint(frames->len, ==, 1);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    frames = g_ptr_array_new_with_free_func((GDestroyNotify)g_byte_array_unref);
+
+    g_test_add_func("/net/gso/tcp4", test_tcp4);
+    g_test_add_func("/net/gso/tcp4-ecn", test_tcp4_ecn);
+    g_test_add_func("/net/gso/tcp6", test_tcp6);
+    g_test_add_func("/net/gso/udp4", test_udp4);
+    g_test_add_func("/net/gso/udp6", test_udp6);
+    g_test_add_func("/net/gso/bad-gso-type", test_bad_gso_type);
+    g_test_add_func("/net/gso/zero-gso-size", test_zero_gso_size);
+    g_test_add_func("/net/gso/short-header", test_short_header);
+    g_test_add_func("/net/gso/short-vnet-header", test_short_vnet_header);
+    g_test_add_func("/net/gso/needs-csum", test_needs_csum);
+    g_test_add_func("/net/gso/no-offload", test_no_offload);
+    g_test_add_func("/net/gso/deliver-fails", test_deliver_fails);
+
+    ret = g_test_run();
+
+    g_ptr_array_unref(frames);
+    return ret;
+}
@@ -0,0 +1,243 @@
+/*
+ * NetQueue unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "net/net.h"
+#include "net/queue.h"
+
+/* Larger than the buffers recycled by the queue */
+#define BIG_SIZE    4096
+
+static NetClientState test_sender;
+
+/* Whether qemu_net_queue_send_iov may deliver right away */
+static bool can_send;
+/* Value returned by test_deliver, or -1 to return the packet size */
+static ssize_t deliver_ret = -1;
+
+/* What test_deliver saw last */
+static struct {
+    int calls;
+    unsigned flags;
+    int iovcnt;
+    void *base0;
+    uint8_t data[BIG_SIZE];
+    size_t size;
+} delivered;
+
+/* What test_sent saw */
+static int sent_calls;
+static ssize_t sent_ret;
+
+int qemu_can_send_packet(NetClientState *nc)
+{
+    g_assert(nc == &test_sender);
+    return can_send;
+}
+
+static ssize_t test_deliver(NetClientState *sender, unsigned flags,
+                            const struct iovec *iov, int iovcnt,
+                            void *opaque)
+{
+    g_assert(sender == &test_sender);
+
+    delivered.calls++;
+    delivered.flags = flags;
+    delivered.iovcnt = iovcnt;
+    delivered.base0 = iov[0].iov_base;
+    delivered.size = iov_to_buf(iov, iovcnt, 0, delivered.data,
+                                sizeof(delivered.data));
+    return deliver_ret < 0 ? iov_size(iov, iovcnt) : deliver_ret;
+}
+
+static void test_sent(NetClientState *sender, ssize_t ret)
+{
+    g_assert(sender == &test_sender);
+    sent_calls++;
+    sent_ret = ret;
+}
+
+static NetQueue *queue_new(void)
+{
+    memset(&delivered, 0, sizeof(delivered));
+    sent_calls = 0;
+    sent_ret = -1;
+    can_send = false;
+    deliver_ret = -1;
+    return qemu_new_net_queue(test_deliver, NULL);
+}
+
+/* A stable packet is queued by reference and delivered with its iovec */
+static void test_stable(void)
+{
+    NetQueue *queue = queue_new();
+    uint8_t a[16], b[32];
+    struct iovec iov[2] = {
+        { .iov_base = a, .iov_len = sizeof(a) },
+        { .iov_base = b, .iov_len = sizeof(b) },
+    };
+
+    memset(a, 0x11, sizeof(a));
+    memset(b, 0x22, sizeof(b));
+    g_assert_cmpint(qemu_net_queue_send_iov(queue, &test_sender,
+                                            QEMU_NET_PACKET_FLAG_STABLE,
+                                            iov, 2, test_sent), ==, 0);
+    g_assert_cmpint(delivered.calls, ==, 0);
+
+    /* The payload was not copied, so the queue sees later changes. */
+    memset(b, 0x33, sizeof(b));
+    g_assert_true(qemu_net_queue_flush(queue));
+
+    g_assert_cmpint(delivered.calls, ==, 1);
+    g_assert_cmpint(delivered.iovcnt, ==, 2);
+    g_assert_true(delivered.base0 == a);
+    g_assert_true(delivered.flags & QEMU_NET_PACKET_FLAG_STABLE);
+    g_assert_cmpuint(delivered.size, ==, sizeof(a) + sizeof(b));
+    g_assert_cmpint(delivered.data[sizeof(a)], ==, 0x33);
+    g_assert_cmpint(sent_calls, ==, 1);
+    g_assert_cmpint(sent_ret, ==, sizeof(a) + sizeof(b));
+
+    qemu_del_net_queue(queue);
+}
+
+/* Without a sent callback nothing tells the sender when to reuse the data */
+static void test_stable_no_cb(void)
+{
+    NetQueue *queue = queue_new();
+    uint8_t a[16];
+    struct iovec iov = { .iov_base = a, .iov_len = sizeof(a) };
+
+    memset(a, 0x11, sizeof(a));
+    qemu_net_queue_send_iov(queue, &test_sender, QEMU_NET_PACKET_FLAG_STABLE,
+                            &iov, 1, NULL);
+    memset(a, 0x22, sizeof(a));
+    g_assert_true(qemu_net_queue_flush(queue));
+
+    g_assert_cmpint(delivered.calls, ==, 1);
+    g_assert_true(delivered.base0 != a);
+    g_assert_cmpint(delivered.data[0], ==, 0x11);
+
+    qemu_del_net_queue(queue);
+}
+
+/* Other packets are copied into a single buffer when queued */
+static void test_copied(void)
+{
+    NetQueue *queue = queue_new();
+    uint8_t a[16], b[32];
+    struct iovec iov[2] = {
+        { .iov_base = a, .iov_len = sizeof(a) },
+        { .iov_base = b, .iov_len = sizeof(b) },
+    };
+
+    memset(a, 0x11, sizeof(a));
+    memset(b, 0x22, sizeof(b));
+    qemu_net_queue_send_iov(queue, &test_sender, QEMU_NET_PACKET_FLAG_NONE,
+                            iov, 2, test_sent);
+    memset(b, 0x33, sizeof(b));
+    g_assert_true(qemu_net_queue_flush(queue));
+
+    g_assert_cmpint(delivered.calls, ==, 1);
+    g_assert_cmpint(delivered.iovcnt, ==, 1);
+    g_assert_cmpuint(delivered.size, ==, sizeof(a) + sizeof(b));
+    g_assert_cmpint(delivered.data[0], ==, 0x11);
+    g_assert_cmpint(delivered.data[sizeof(a)], ==, 0x22);
+    g_assert_cmpint(sent_calls, ==, 1);
+
+    qemu_del_net_queue(queue);
+}
+
+/* Copied packets reuse the buffer of the previous one; big ones do not */
+static void test_pool(void)
+{
+    NetQueue *queue = queue_new();
+    g_autofree uint8_t *big = g_malloc0(BIG_SIZE);
+    uint8_t small[64] = { 0 };
+    void *first;
+
+    qemu_net_queue_send(queue, &test_sender, QEMU_NET_PACKET_FLAG_NONE,
+                        small, sizeof(small), NULL);
+    qemu_net_queue_flush(queue);
+    first = delivered.base0;
+
+    small[0] = 0x44;
+    qemu_net_queue_send(queue, &test_sender, QEMU_NET_PACKET_FLAG_NONE,
+                        small, sizeof(small), NULL);
+    qemu_net_queue_flush(queue);
+    g_assert_true(delivered.base0 == first);
+    g_assert_cmpint(delivered.data[0], ==, 0x44);
+
+    big[BIG_SIZE - 1] = 0x55;
+    qemu_net_queue_send(queue, &test_sender, QEMU_NET_PACKET_FLAG_NONE,
+                        big, BIG_SIZE, NULL);
+    qemu_net_queue_flush(queue);
+    g_assert_true(delivered.base0 != first);
+    g_assert_cmpuint(delivered.size, ==, BIG_SIZE);
+    g_assert_cmpint(delivered.data[BIG_SIZE - 1], ==, 0x55);
+
+    qemu_del_net_queue(queue);
+}
+
+/* A stable packet that the peer cannot take yet stays queued as is */
+static void test_stable_redeliver(void)
+{
+    NetQueue *queue = queue_new();
+    uint8_t a[16];
+    struct iovec iov = { .iov_base = a, .iov_len = sizeof(a) };
+
+    can_send = true;
+    deliver_ret = 0;
+    g_assert_cmpint(qemu_net_queue_send_iov(queue, &test_sender,
+                                            QEMU_NET_PACKET_FLAG_STABLE,
+                                            &iov, 1, test_sent), ==, 0);
+    g_assert_cmpint(delivered.calls, ==, 1);
+    g_assert_false(qemu_net_queue_flush(queue));
+    g_assert_cmpint(delivered.calls, ==, 2);
+    g_assert_cmpint(sent_calls, ==, 0);
+
+    deliver_ret = -1;
+    g_assert_true(qemu_net_queue_flush(queue));
+    g_assert_cmpint(delivered.calls, ==, 3);
+    g_assert_true(delivered.base0 == a);
+    g_assert_cmpint(sent_calls, ==, 1);
+
+    qemu_del_net_queue(queue);
+}
+
+/* Purging hands stable packets back to the sender */
+static void test_stable_purge(void)
+{
+    NetQueue *queue = queue_new();
+    uint8_t a[16];
+    struct iovec iov = { .iov_base = a, .iov_len = sizeof(a) };
+
+    qemu_net_queue_send_iov(queue, &test_sender, QEMU_NET_PACKET_FLAG_STABLE,
+                            &iov, 1, test_sent);
+    qemu_net_queue_purge(queue, &test_sender);
+
+    g_assert_cmpint(sent_calls, ==, 1);
+    g_assert_cmpint(sent_ret, ==, 0);
+    g_assert_true(qemu_net_queue_flush(queue));
+    g_assert_cmpint(delivered.calls, ==, 0);
+
+    qemu_del_net_queue(queue);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/net/queue/stable", test_stable);
+    g_test_add_func("/net/queue/stable-no-cb", test_stable_no_cb);
+    g_test_add_func("/net/queue/copied", test_copied);
+    g_test_add_func("/net/queue/pool", test_pool);
+    g_test_add_func("/net/queue/stable-redeliver", test_stable_redeliver);
+    g_test_add_func("/net/queue/stable-purge", test_stable_purge);
+
+    return g_test_run();
+}
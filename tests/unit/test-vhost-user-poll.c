@@ -0,0 +1,129 @@
+/*
+ * libvhost-user ring busy polling unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libvhost-user.h"
+
+#define RING_SIZE 8
+
+/* The ring lives in our own memory, as if mapped from the guest */
+static uint64_t ring_mem[512];
+#define RING_DESC   ((struct vring_desc *)ring_mem)
+#define RING_AVAIL  ((struct vring_avail *)((char *)ring_mem + 1024))
+#define RING_USED   ((struct vring_used *)((char *)ring_mem + 2048))
+
+static VuDev dev;
+static VuVirtq vq;
+static int handler_calls;
+
+static void test_handler(VuDev *d, int qidx)
+{
+    g_assert(d == &dev);
+    handler_calls++;
+
+    /* Consume everything, like a real device would */
+    vq.last_avail_idx = le16toh(RING_AVAIL->idx);
+    vq.shadow_avail_idx = vq.last_avail_idx;
+}
+
+static void queue_init(void)
+{
+    memset(ring_mem, 0, sizeof(ring_mem));
+    memset(&dev, 0, sizeof(dev));
+    memset(&vq, 0, sizeof(vq));
+    handler_calls = 0;
+
+    dev.vq = &vq;
+    dev.max_queues = 1;
+    vq.vring.num = RING_SIZE;
+    vq.vring.desc = RING_DESC;
+    vq.vring.avail = RING_AVAIL;
+    vq.vring.used = RING_USED;
+    vq.handler = test_handler;
+    vq.started = true;
+    vq.notification = true;
+    vq.kick_fd = 0;
+    vq.call_fd = -1;
+    vq.err_fd = -1;
+    vq.busy_poll_usecs = 1000000;
+}
+
+/* What the guest does to make a buffer available */
+static void guest_add_buffer(void)
+{
+    RING_AVAIL->idx = htole16(le16toh(RING_AVAIL->idx) + 1);
+}
+
+static bool guest_kicks(void)
+{
+    return !(le16toh(RING_USED->flags) & VRING_USED_F_NO_NOTIFY);
+}
+
+/* Buffers found while polling are handed to the queue handler */
+static void test_poll(void)
+{
+    queue_init();
+
+    vu_queue_poll_begin(&dev, &vq);
+    g_assert_true(vq.busy_polling);
+    g_assert_false(guest_kicks());
+    g_assert_false(vu_queue_poll(&dev, &vq));
+
+    guest_add_buffer();
+    g_assert_true(vu_queue_poll(&dev, &vq));
+    vu_queue_poll_ready(&dev, &vq);
+    g_assert_cmpint(handler_calls, ==, 1);
+    g_assert_false(vu_queue_poll(&dev, &vq));
+
+    vu_queue_poll_end(&dev, &vq);
+    g_assert_false(vq.busy_polling);
+    g_assert_true(guest_kicks());
+}
+
+/*
+ * A buffer added while kicks were off is still found by the check that
+ * follows vu_queue_poll_end(), because the guest never kicks for it.
+ */
+static void test_poll_end_pending(void)
+{
+    queue_init();
+
+    vu_queue_poll_begin(&dev, &vq);
+    guest_add_buffer();
+    vu_queue_poll_end(&dev, &vq);
+    g_assert_true(guest_kicks());
+
+    g_assert_true(vu_queue_poll(&dev, &vq));
+    vu_queue_poll_ready(&dev, &vq);
+    g_assert_cmpint(handler_calls, ==, 1);
+    g_assert_false(vu_queue_poll(&dev, &vq));
+}
+
+/* Queues that the front-end did not ask to poll are left to kicks */
+static void test_poll_off(void)
+{
+    queue_init();
+    vq.busy_poll_usecs = 0;
+
+    vu_queue_poll_begin(&dev, &vq);
+    g_assert_false(vq.busy_polling);
+    g_assert_true(guest_kicks());
+
+    guest_add_buffer();
+    g_assert_false(vu_queue_poll(&dev, &vq));
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/vhost-user/poll/basic", test_poll);
+    g_test_add_func("/vhost-user/poll/end-pending", test_poll_end_pending);
+    g_test_add_func("/vhost-user/poll/off", test_poll_off);
+
+    return g_test_run();
+}
@@ -35,6 +35,7 @@
 
 #define INDIRECTION_TABLE_SIZE 128
 #define HASH_CALCULATION_BUFFER_SIZE 36
+#define FLOW_TABLE_SIZE 4096
 
 struct rss_config_t {
     __u8 redirect;
@@ -42,6 +43,7 @@ struct rss_config_t {
     __u32 hash_types;
     __u16 indirections_len;
     __u16 default_queue;
+    __u8 flow_affinity;
 } __attribute__((packed));
 
 struct toeplitz_key_data_t {
@@ -100,6 +102,29 @@ struct {
     __uint(map_flags, BPF_F_MMAPABLE);
 } tap_rss_map_indirection_table SEC(".maps");
 
+/*
+ * Flow affinity: QEMU records the queue on which the guest last transmitted
+ * each TCP/UDP flow, as (flow hash << 32 | queue + 1) at the index given by
+ * the low bits of the hash.
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(__u64));
+    __uint(max_entries, FLOW_TABLE_SIZE);
+    __uint(map_flags, BPF_F_MMAPABLE);
+} tap_rss_map_flow_table SEC(".maps");
+
+#define FLOW_STAT_HITS 0
+#define FLOW_STAT_MISSES 1
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(__u64));
+    __uint(max_entries, 2);
+} tap_rss_map_flow_stats SEC(".maps");
+
 static inline void net_rx_rss_add_chunk(__u8 *rss_input, size_t *bytes_written,
                                         const void *ptr, size_t size) {
     __builtin_memcpy(&rss_input[*bytes_written], ptr, size);
@@ -383,144 +408,144 @@ error:
 static inline bool calculate_rss_hash(struct __sk_buff *skb,
                                       struct rss_config_t *config,
                                       struct toeplitz_key_data_t *toe,
+                                      struct packet_hash_info_t *info,
                                       __u32 *result)
 {
     __u8 rss_input[HASH_CALCULATION_BUFFER_SIZE] = {};
     size_t bytes_written = 0;
     int err = 0;
-    struct packet_hash_info_t packet_info = {};
 
-    err = parse_packet(skb, &packet_info);
+    err = parse_packet(skb, info);
     if (err) {
         return false;
     }
 
-    if (packet_info.is_ipv4) {
-        if (packet_info.is_tcp &&
+    if (info->is_ipv4) {
+        if (info->is_tcp &&
             config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_TCPv4) {
 
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_src,
-                                 sizeof(packet_info.in_src));
+                                 &info->in_src,
+                                 sizeof(info->in_src));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_dst,
-                                 sizeof(packet_info.in_dst));
+                                 &info->in_dst,
+                                 sizeof(info->in_dst));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.src_port,
-                                 sizeof(packet_info.src_port));
+                                 &info->src_port,
+                                 sizeof(info->src_port));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.dst_port,
-                                 sizeof(packet_info.dst_port));
-        } else if (packet_info.is_udp &&
+                                 &info->dst_port,
+                                 sizeof(info->dst_port));
+        } else if (info->is_udp &&
                    config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_UDPv4) {
 
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_src,
-                                 sizeof(packet_info.in_src));
+                                 &info->in_src,
+                                 sizeof(info->in_src));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_dst,
-                                 sizeof(packet_info.in_dst));
+                                 &info->in_dst,
+                                 sizeof(info->in_dst));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.src_port,
-                                 sizeof(packet_info.src_port));
+                                 &info->src_port,
+                                 sizeof(info->src_port));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.dst_port,
-                                 sizeof(packet_info.dst_port));
+                                 &info->dst_port,
+                                 sizeof(info->dst_port));
         } else if (config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_IPv4) {
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_src,
-                                 sizeof(packet_info.in_src));
+                                 &info->in_src,
+                                 sizeof(info->in_src));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_dst,
-                                 sizeof(packet_info.in_dst));
+                                 &info->in_dst,
+                                 sizeof(info->in_dst));
         }
-    } else if (packet_info.is_ipv6) {
-        if (packet_info.is_tcp &&
+    } else if (info->is_ipv6) {
+        if (info->is_tcp &&
             config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_TCPv6) {
 
-            if (packet_info.is_ipv6_ext_src &&
+            if (info->is_ipv6_ext_src &&
                 config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_TCP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_src,
-                                     sizeof(packet_info.in6_ext_src));
+                                     &info->in6_ext_src,
+                                     sizeof(info->in6_ext_src));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_src,
-                                     sizeof(packet_info.in6_src));
+                                     &info->in6_src,
+                                     sizeof(info->in6_src));
             }
-            if (packet_info.is_ipv6_ext_dst &&
+            if (info->is_ipv6_ext_dst &&
                 config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_TCP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_dst,
-                                     sizeof(packet_info.in6_ext_dst));
+                                     &info->in6_ext_dst,
+                                     sizeof(info->in6_ext_dst));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_dst,
-                                     sizeof(packet_info.in6_dst));
+                                     &info->in6_dst,
+                                     sizeof(info->in6_dst));
             }
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.src_port,
-                                 sizeof(packet_info.src_port));
+                                 &info->src_port,
+                                 sizeof(info->src_port));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.dst_port,
-                                 sizeof(packet_info.dst_port));
-        } else if (packet_info.is_udp &&
+                                 &info->dst_port,
+                                 sizeof(info->dst_port));
+        } else if (info->is_udp &&
                    config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_UDPv6) {
 
-            if (packet_info.is_ipv6_ext_src &&
+            if (info->is_ipv6_ext_src &&
                config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_UDP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_src,
-                                     sizeof(packet_info.in6_ext_src));
+                                     &info->in6_ext_src,
+                                     sizeof(info->in6_ext_src));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_src,
-                                     sizeof(packet_info.in6_src));
+                                     &info->in6_src,
+                                     sizeof(info->in6_src));
             }
-            if (packet_info.is_ipv6_ext_dst &&
+            if (info->is_ipv6_ext_dst &&
                config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_UDP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_dst,
-                                     sizeof(packet_info.in6_ext_dst));
+                                     &info->in6_ext_dst,
+                                     sizeof(info->in6_ext_dst));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_dst,
-                                     sizeof(packet_info.in6_dst));
+                                     &info->in6_dst,
+                                     sizeof(info->in6_dst));
             }
 
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.src_port,
-                                 sizeof(packet_info.src_port));
+                                 &info->src_port,
+                                 sizeof(info->src_port));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.dst_port,
-                                 sizeof(packet_info.dst_port));
+                                 &info->dst_port,
+                                 sizeof(info->dst_port));
 
         } else if (config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_IPv6) {
-            if (packet_info.is_ipv6_ext_src &&
+            if (info->is_ipv6_ext_src &&
                config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_IP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_src,
-                                     sizeof(packet_info.in6_ext_src));
+                                     &info->in6_ext_src,
+                                     sizeof(info->in6_ext_src));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_src,
-                                     sizeof(packet_info.in6_src));
+                                     &info->in6_src,
+                                     sizeof(info->in6_src));
             }
-            if (packet_info.is_ipv6_ext_dst &&
+            if (info->is_ipv6_ext_dst &&
                 config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_IP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_dst,
-                                     sizeof(packet_info.in6_ext_dst));
+                                     &info->in6_ext_dst,
+                                     sizeof(info->in6_ext_dst));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_dst,
-                                     sizeof(packet_info.in6_dst));
+                                     &info->in6_dst,
+                                     sizeof(info->in6_dst));
             }
         }
     }
@@ -534,12 +559,138 @@ static inline bool calculate_rss_hash(struct __sk_buff *skb,
     return true;
 }
 
+static inline __u32 rol32(__u32 word, unsigned int shift)
+{
+    return (word << shift) | (word >> (32 - shift));
+}
+
+/* Same as qemu_xxhash8() in include/qemu/xxhash.h */
+static inline __u32 flow_xxhash8(__u64 ab, __u64 cd, __u64 ef,
+                                 __u32 g, __u32 h)
+{
+    __u32 v1 = 1 + 2654435761U + 2246822519U;
+    __u32 v2 = 1 + 2246822519U;
+    __u32 v3 = 1 + 0;
+    __u32 v4 = 1 - 2654435761U;
+    __u32 h32;
+
+    v1 = rol32(v1 + (__u32)ab * 2246822519U, 13) * 2654435761U;
+    v2 = rol32(v2 + (__u32)(ab >> 32) * 2246822519U, 13) * 2654435761U;
+    v3 = rol32(v3 + (__u32)cd * 2246822519U, 13) * 2654435761U;
+    v4 = rol32(v4 + (__u32)(cd >> 32) * 2246822519U, 13) * 2654435761U;
+
+    h32 = rol32(v1, 1) + rol32(v2, 7) + rol32(v3, 12) + rol32(v4, 18);
+    h32 += 28;
+
+    h32 = rol32(h32 + (__u32)ef * 3266489917U, 17) * 668265263U;
+    h32 = rol32(h32 + (__u32)(ef >> 32) * 3266489917U, 17) * 668265263U;
+    h32 = rol32(h32 + g * 3266489917U, 17) * 668265263U;
+    h32 = rol32(h32 + h * 3266489917U, 17) * 668265263U;
+
+    h32 ^= h32 >> 15;
+    h32 *= 2246822519U;
+    h32 ^= h32 >> 13;
+    h32 *= 3266489917U;
+    h32 ^= h32 >> 16;
+
+    return h32;
+}
+
+/*
+ * Hash the TCP/UDP 5-tuple so that both directions of a flow get the same
+ * value, like virtio_net_flow_hash() in hw/net/virtio-net.c.  Returns 0 for
+ * packets that are not part of a flow.
+ */
+static inline __u32 flow_hash(struct packet_hash_info_t *info)
+{
+    __u64 src, dst, tmp;
+    __u64 src_hi, dst_hi;
+    __u32 sport = info->src_port;
+    __u32 dport = info->dst_port;
+    __u8 proto;
+    __u32 hash;
+
+    if (info->is_tcp) {
+        proto = IPPROTO_TCP;
+    } else if (info->is_udp) {
+        proto = IPPROTO_UDP;
+    } else {
+        return 0;
+    }
+
+    if (info->is_ipv4) {
+        src = info->in_src;
+        dst = info->in_dst;
+    } else if (info->is_ipv6) {
+        __builtin_memcpy(&src, &info->in6_src, sizeof(src));
+        __builtin_memcpy(&src_hi, (__u8 *)&info->in6_src + 8, sizeof(src_hi));
+        __builtin_memcpy(&dst, &info->in6_dst, sizeof(dst));
+        __builtin_memcpy(&dst_hi, (__u8 *)&info->in6_dst + 8, sizeof(dst_hi));
+        src ^= src_hi;
+        dst ^= dst_hi;
+    } else {
+        return 0;
+    }
+
+    if (src > dst || (src == dst && sport > dport)) {
+        tmp = src;
+        src = dst;
+        dst = tmp;
+        tmp = sport;
+        sport = dport;
+        dport = tmp;
+    }
+
+    hash = flow_xxhash8(src, dst, proto, sport, dport);
+    return hash ? hash : 1;
+}
+
+static inline void flow_stat_inc(__u32 stat)
+{
+    __u64 *counter = bpf_map_lookup_elem(&tap_rss_map_flow_stats, &stat);
+
+    if (counter) {
+        *counter += 1;
+    }
+}
+
+/*
+ * Return the queue on which the guest last transmitted the flow of the
+ * packet, or -1 if it is not known.
+ */
+static inline int flow_lookup(struct packet_hash_info_t *info)
+{
+    __u32 hash = flow_hash(info);
+    __u32 idx = hash & (FLOW_TABLE_SIZE - 1);
+    __u64 *entry;
+    __u64 value;
+
+    if (!hash) {
+        return -1;
+    }
+
+    entry = bpf_map_lookup_elem(&tap_rss_map_flow_table, &idx);
+    if (!entry) {
+        return -1;
+    }
+
+    value = *entry;
+    if (value >> 32 != hash || !(__u32)value) {
+        flow_stat_inc(FLOW_STAT_MISSES);
+        return -1;
+    }
+
+    flow_stat_inc(FLOW_STAT_HITS);
+    return (__u32)value - 1;
+}
+
 SEC("socket")
 int tun_rss_steering_prog(struct __sk_buff *skb)
 {
 
     struct rss_config_t *config;
     struct toeplitz_key_data_t *toe;
+    struct packet_hash_info_t packet_info = {};
 
     __u32 key = 0;
     __u32 hash = 0;
@@ -551,9 +702,18 @@ int tun_rss_steering_prog(struct __sk_buff *skb)
         return 0;
     }
 
-    if (config->redirect && calculate_rss_hash(skb, config, toe, &hash)) {
+    if (config->redirect &&
+        calculate_rss_hash(skb, config, toe, &packet_info, &hash)) {
         __u32 table_idx = hash % config->indirections_len;
         __u16 *queue = 0;
+        int flow_queue;
+
+        if (config->flow_affinity) {
+            flow_queue = flow_lookup(&packet_info);
+            if (flow_queue >= 0) {
+                return flow_queue;
+            }
+        }
 
         queue = bpf_map_lookup_elem(&tap_rss_map_indirection_table,
                                     &table_idx);
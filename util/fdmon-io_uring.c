@@ -470,7 +470,21 @@ bool fdmon_io_uring_setup(AioContext *ctx, Error **errp)
 
     ctx->io_uring_fd_tag = NULL;
 
+#ifdef IORING_SETUP_SQE128
+    /*
+     * Large sqes let users submit IORING_OP_URING_CMD requests with a full
+     * 80-byte command (e.g. FUSE-over-io_uring).  Fall back to normal sqes
+     * on kernels that do not support them.
+     */
+    ret = io_uring_queue_init(FDMON_IO_URING_ENTRIES, &ctx->fdmon_io_uring,
+                              IORING_SETUP_SQE128);
+    if (ret == -EINVAL) {
+        ret = io_uring_queue_init(FDMON_IO_URING_ENTRIES,
+                                  &ctx->fdmon_io_uring, 0);
+    }
+#else
     ret = io_uring_queue_init(FDMON_IO_URING_ENTRIES, &ctx->fdmon_io_uring, 0);
+#endif
     if (ret != 0) {
         error_setg_errno(errp, -ret, "Failed to initialize io_uring");
         return false;
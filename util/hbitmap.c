@@ -50,8 +50,19 @@
  * extremely sparse, this is also O(m + m/W + m/W^2 + ...), so the amortized
  * cost of advancing from one bit to the next is usually constant (worst case
  * O(logB n) as in the non-amortized complexity).
+ *
+ * Sparse HBitmaps (see hbitmap_alloc_sparse) split all levels except level 0
+ * into pages of HB_PAGE_WORDS words.  A page is only allocated while it has
+ * bits set; reading from a missing page returns zeroes.  A level N+1 page is
+ * all zero iff the HB_PAGE_WORDS bits covering it in level N are clear, so
+ * the upper levels tell cheaply when a page can be freed.  A mostly clean
+ * bitmap then costs little more than its page tables, which take 1/512th
+ * of the memory of the dense bottom level.
  */
 
+#define HB_PAGE_SHIFT 9
+#define HB_PAGE_WORDS (1 << HB_PAGE_SHIFT)
+
 struct HBitmap {
     /*
      * Size of the bitmap, as requested in hbitmap_alloc or in hbitmap_truncate.
@@ -94,13 +105,126 @@ struct HBitmap {
      *
      * Note that all bitmaps have the same number of levels.  Even a 1-bit
      * bitmap will still allocate HBITMAP_LEVELS arrays.
+     *
+     * In sparse bitmaps, levels[] is NULL for levels other than 0 and
+     * pages[] holds the page tables instead.  Use hb_word() and
+     * hb_word_ptr() to access words independent of the representation.
      */
     unsigned long *levels[HBITMAP_LEVELS];
+    unsigned long **pages[HBITMAP_LEVELS];
 
-    /* The length of each levels[] array. */
+    /* The length of each level, in words. */
     uint64_t sizes[HBITMAP_LEVELS];
+
+    bool sparse;
+    /* Number of allocated pages in a sparse bitmap.  */
+    uint64_t nb_pages;
 };
 
+static inline uint64_t hb_nb_pages(uint64_t size)
+{
+    return DIV_ROUND_UP(size, HB_PAGE_WORDS);
+}
+
+/* Read word @pos of @level.  */
+static inline unsigned long hb_word(const HBitmap *hb, unsigned level,
+                                    uint64_t pos)
+{
+    const unsigned long *page;
+
+    if (likely(hb->levels[level])) {
+        return hb->levels[level][pos];
+    }
+
+    page = hb->pages[level][pos >> HB_PAGE_SHIFT];
+    return page ? page[pos & (HB_PAGE_WORDS - 1)] : 0;
+}
+
+/*
+ * Return a pointer to word @pos of @level, or NULL if the word is zero
+ * because its page is not allocated.
+ */
+static inline unsigned long *hb_word_lookup(HBitmap *hb, unsigned level,
+                                            uint64_t pos)
+{
+    unsigned long *page;
+
+    if (likely(hb->levels[level])) {
+        return &hb->levels[level][pos];
+    }
+
+    page = hb->pages[level][pos >> HB_PAGE_SHIFT];
+    return page ? &page[pos & (HB_PAGE_WORDS - 1)] : NULL;
+}
+
+/* Return a pointer to word @pos of @level, allocating its page if needed.  */
+static inline unsigned long *hb_word_ptr(HBitmap *hb, unsigned level,
+                                         uint64_t pos)
+{
+    unsigned long **page;
+
+    if (likely(hb->levels[level])) {
+        return &hb->levels[level][pos];
+    }
+
+    page = &hb->pages[level][pos >> HB_PAGE_SHIFT];
+    if (!*page) {
+        *page = g_new0(unsigned long, HB_PAGE_WORDS);
+        hb->nb_pages++;
+    }
+    return &(*page)[pos & (HB_PAGE_WORDS - 1)];
+}
+
+static void hb_free_page(HBitmap *hb, unsigned level, uint64_t page)
+{
+    if (hb->pages[level][page]) {
+        g_free(hb->pages[level][page]);
+        hb->pages[level][page] = NULL;
+        hb->nb_pages--;
+    }
+}
+
+/*
+ * Free the pages that became empty after resetting items @first to @last
+ * (in bottom level bits).  The upper levels must be up to date.
+ */
+static void hb_release_pages(HBitmap *hb, uint64_t first, uint64_t last)
+{
+    unsigned level;
+
+    if (!hb->sparse) {
+        return;
+    }
+
+    for (level = HBITMAP_LEVELS - 1; level > 0; level--) {
+        /* Level 0 always has the sentinel set */
+        unsigned long ignore = level == 1 ? 1UL << (BITS_PER_LONG - 1) : 0;
+        uint64_t page;
+
+        /* Bits of level + 1 (or items) become words of this level */
+        first >>= BITS_PER_LEVEL;
+        last >>= BITS_PER_LEVEL;
+
+        for (page = first >> HB_PAGE_SHIFT; page <= last >> HB_PAGE_SHIFT;
+             page++) {
+            /* Bits of level - 1 covering this page */
+            uint64_t pos = (page << HB_PAGE_SHIFT) >> BITS_PER_LEVEL;
+            uint64_t end = ((page + 1) << HB_PAGE_SHIFT) >> BITS_PER_LEVEL;
+
+            if (!hb->pages[level][page]) {
+                continue;
+            }
+            end = MIN(end, hb->sizes[level - 1]);
+            while (pos < end && !(hb_word(hb, level - 1, pos) & ~ignore)) {
+                pos++;
+            }
+            if (pos == end) {
+                hb_free_page(hb, level, page);
+            }
+        }
+    }
+}
+
 /* Advance hbi to the next nonzero word and return it.  hbi->pos
  * is updated.  Returns zero if we reach the end of the bitmap.
  */
@@ -114,7 +238,7 @@ static unsigned long hbitmap_iter_skip_words(HBitmapIter *hbi)
     do {
         i--;
         pos >>= BITS_PER_LEVEL;
-        cur = hbi->cur[i] & hb->levels[i][pos];
+        cur = hbi->cur[i] & hb_word(hb, i, pos);
     } while (cur == 0);
 
     /* Check for end of iteration.  We always use fewer than BITS_PER_LONG
@@ -136,7 +260,7 @@ static unsigned long hbitmap_iter_skip_words(HBitmapIter *hbi)
         hbi->cur[i] = cur & (cur - 1);
 
         /* Set up next level for iteration.  */
-        cur = hb->levels[i + 1][pos];
+        cur = hb_word(hb, i + 1, pos);
     }
 
     hbi->pos = pos;
@@ -149,7 +273,7 @@ static unsigned long hbitmap_iter_skip_words(HBitmapIter *hbi)
 int64_t hbitmap_iter_next(HBitmapIter *hbi)
 {
     unsigned long cur = hbi->cur[HBITMAP_LEVELS - 1] &
-            hbi->hb->levels[HBITMAP_LEVELS - 1][hbi->pos];
+            hb_word(hbi->hb, HBITMAP_LEVELS - 1, hbi->pos);
     int64_t item;
 
     if (cur == 0) {
@@ -182,7 +306,7 @@ void hbitmap_iter_init(HBitmapIter *hbi, const HBitmap *hb, uint64_t first)
         pos >>= BITS_PER_LEVEL;
 
         /* Drop bits representing items before first.  */
-        hbi->cur[i] = hb->levels[i][pos] & ~((1UL << bit) - 1);
+        hbi->cur[i] = hb_word(hb, i, pos) & ~((1UL << bit) - 1);
 
         /* We have already added level i+1, so the lowest set bit has
          * been processed.  Clear it.
@@ -220,8 +344,7 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
 int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
 {
     size_t pos = (start >> hb->granularity) >> BITS_PER_LEVEL;
-    unsigned long *last_lev = hb->levels[HBITMAP_LEVELS - 1];
-    unsigned long cur = last_lev[pos];
+    unsigned long cur;
     unsigned start_bit_offset;
     uint64_t end_bit, sz;
     int64_t res;
@@ -232,6 +355,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
         return -1;
     }
 
+    cur = hb_word(hb, HBITMAP_LEVELS - 1, pos);
     end_bit = count > hb->orig_size - start ?
                 hb->size :
                 ((start + count - 1) >> hb->granularity) + 1;
@@ -247,13 +371,14 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
     if (cur == (unsigned long)-1) {
         do {
             pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
+        } while (pos < sz &&
+                 hb_word(hb, HBITMAP_LEVELS - 1, pos) == (unsigned long)-1);
 
         if (pos >= sz) {
             return -1;
         }
 
-        cur = last_lev[pos];
+        cur = hb_word(hb, HBITMAP_LEVELS - 1, pos);
     }
 
     res = (pos << BITS_PER_LEVEL) + ctol(cur);
@@ -439,18 +564,21 @@ static bool hb_set_between(HBitmap *hb, int level, uint64_t start,
     i = pos;
     if (i < lastpos) {
         uint64_t next = (start | (BITS_PER_LONG - 1)) + 1;
-        changed |= hb_set_elem(&hb->levels[level][i], start, next - 1);
+        changed |= hb_set_elem(hb_word_ptr(hb, level, i), start, next - 1);
         for (;;) {
+            unsigned long *elem;
+
             start = next;
             next += BITS_PER_LONG;
             if (++i == lastpos) {
                 break;
             }
-            changed |= (hb->levels[level][i] == 0);
-            hb->levels[level][i] = ~0UL;
+            elem = hb_word_ptr(hb, level, i);
+            changed |= (*elem == 0);
+            *elem = ~0UL;
         }
     }
-    changed |= hb_set_elem(&hb->levels[level][i], start, last);
+    changed |= hb_set_elem(hb_word_ptr(hb, level, i), start, last);
 
     /* If there was any change in this layer, we may have to update
      * the one above.
@@ -497,6 +625,11 @@ static inline bool hb_reset_elem(unsigned long *elem, uint64_t start, uint64_t l
     assert((last >> BITS_PER_LEVEL) == (start >> BITS_PER_LEVEL));
     assert(start <= last);
 
+    /* Missing page of a sparse bitmap, already zero */
+    if (!elem) {
+        return false;
+    }
+
     mask = 2UL << (last & (BITS_PER_LONG - 1));
     mask -= 1UL << (start & (BITS_PER_LONG - 1));
     blanked = *elem != 0 && ((*elem & ~mask) == 0);
@@ -523,25 +656,30 @@ static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
          * unless the lower-level word became entirely zero.  So, remove pos
          * from the upper-level range if bits remain set.
          */
-        if (hb_reset_elem(&hb->levels[level][i], start, next - 1)) {
+        if (hb_reset_elem(hb_word_lookup(hb, level, i), start, next - 1)) {
             changed = true;
         } else {
             pos++;
         }
 
         for (;;) {
+            unsigned long *elem;
+
             start = next;
             next += BITS_PER_LONG;
             if (++i == lastpos) {
                 break;
             }
-            changed |= (hb->levels[level][i] != 0);
-            hb->levels[level][i] = 0UL;
+            elem = hb_word_lookup(hb, level, i);
+            if (elem) {
+                changed |= (*elem != 0);
+                *elem = 0UL;
+            }
         }
     }
 
     /* Same as above, this time for lastpos.  */
-    if (hb_reset_elem(&hb->levels[level][i], start, last)) {
+    if (hb_reset_elem(hb_word_lookup(hb, level, i), start, last)) {
         changed = true;
     } else {
         lastpos--;
@@ -577,9 +715,25 @@ void hbitmap_reset(HBitmap *hb, uint64_t start, uint64_t count)
     assert(last < hb->size);
 
     hb->count -= hb_count_between(hb, first, last);
-    if (hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last) &&
-        hb->meta) {
-        hbitmap_set(hb->meta, start, count);
+    if (hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last)) {
+        hb_release_pages(hb, first, last);
+        if (hb->meta) {
+            hbitmap_set(hb->meta, start, count);
+        }
+    }
+}
+
+static void hb_clear_level(HBitmap *hb, unsigned level)
+{
+    uint64_t page;
+
+    if (hb->levels[level]) {
+        memset(hb->levels[level], 0, hb->sizes[level] * sizeof(unsigned long));
+        return;
+    }
+
+    for (page = 0; page < hb_nb_pages(hb->sizes[level]); page++) {
+        hb_free_page(hb, level, page);
     }
 }
 
@@ -589,7 +743,7 @@ void hbitmap_reset_all(HBitmap *hb)
 
     /* Same as hbitmap_alloc() except for memset() instead of malloc() */
     for (i = HBITMAP_LEVELS; --i >= 1; ) {
-        memset(hb->levels[i], 0, hb->sizes[i] * sizeof(unsigned long));
+        hb_clear_level(hb, i);
     }
 
     hb->levels[0][0] = 1UL << (BITS_PER_LONG - 1);
@@ -621,7 +775,7 @@ bool hbitmap_get(const HBitmap *hb, uint64_t item)
     unsigned long bit = 1UL << (pos & (BITS_PER_LONG - 1));
     assert(pos < hb->size);
 
-    return (hb->levels[HBITMAP_LEVELS - 1][pos >> BITS_PER_LEVEL] & bit) != 0;
+    return (hb_word(hb, HBITMAP_LEVELS - 1, pos >> BITS_PER_LEVEL) & bit) != 0;
 }
 
 uint64_t hbitmap_serialization_align(const HBitmap *hb)
@@ -638,7 +792,7 @@ uint64_t hbitmap_serialization_align(const HBitmap *hb)
  */
 static void serialization_chunk(const HBitmap *hb,
                                 uint64_t start, uint64_t count,
-                                unsigned long **first_el, uint64_t *el_count)
+                                uint64_t *first_el, uint64_t *el_count)
 {
     uint64_t last = start + count - 1;
     uint64_t gran = hbitmap_serialization_align(hb);
@@ -652,15 +806,26 @@ static void serialization_chunk(const HBitmap *hb,
     start = (start >> hb->granularity) >> BITS_PER_LEVEL;
     last = (last >> hb->granularity) >> BITS_PER_LEVEL;
 
-    *first_el = &hb->levels[HBITMAP_LEVELS - 1][start];
+    *first_el = start;
     *el_count = last - start + 1;
 }
 
+/* Store @val into word @pos of the bottom level, for deserialization.  */
+static void hb_store_word(HBitmap *hb, uint64_t pos, unsigned long val)
+{
+    unsigned long *elem = val ? hb_word_ptr(hb, HBITMAP_LEVELS - 1, pos) :
+                                hb_word_lookup(hb, HBITMAP_LEVELS - 1, pos);
+
+    if (elem) {
+        *elem = val;
+    }
+}
+
 uint64_t hbitmap_serialization_size(const HBitmap *hb,
                                     uint64_t start, uint64_t count)
 {
     uint64_t el_count;
-    unsigned long *cur;
+    uint64_t cur;
 
     if (!count) {
         return 0;
@@ -674,7 +839,7 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
                             uint64_t start, uint64_t count)
 {
     uint64_t el_count;
-    unsigned long *cur, *end;
+    uint64_t cur, end;
 
     if (!count) {
         return;
@@ -683,8 +848,9 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
     end = cur + el_count;
 
     while (cur != end) {
-        unsigned long el =
-            (BITS_PER_LONG == 32 ? cpu_to_le32(*cur) : cpu_to_le64(*cur));
+        unsigned long el = hb_word(hb, HBITMAP_LEVELS - 1, cur);
+
+        el = (BITS_PER_LONG == 32 ? cpu_to_le32(el) : cpu_to_le64(el));
 
         memcpy(buf, &el, sizeof(el));
         buf += sizeof(el);
@@ -697,7 +863,7 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
                               bool finish)
 {
     uint64_t el_count;
-    unsigned long *cur, *end;
+    uint64_t cur, end;
 
     if (!count) {
         return;
@@ -706,13 +872,16 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
     end = cur + el_count;
 
     while (cur != end) {
-        memcpy(cur, buf, sizeof(*cur));
+        unsigned long el;
+
+        memcpy(&el, buf, sizeof(el));
 
         if (BITS_PER_LONG == 32) {
-            le32_to_cpus((uint32_t *)cur);
+            le32_to_cpus((uint32_t *)&el);
         } else {
-            le64_to_cpus((uint64_t *)cur);
+            le64_to_cpus((uint64_t *)&el);
         }
+        hb_store_word(hb, cur, el);
 
         buf += sizeof(unsigned long);
         cur++;
@@ -722,18 +891,35 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
     }
 }
 
+/* Set @count words of the bottom level, starting at @first, to @val.  */
+static void hb_fill_words(HBitmap *hb, uint64_t first, uint64_t count,
+                          unsigned long val)
+{
+    uint64_t i;
+
+    if (!hb->sparse) {
+        memset(&hb->levels[HBITMAP_LEVELS - 1][first], val ? 0xff : 0,
+               count * sizeof(unsigned long));
+        return;
+    }
+
+    for (i = first; i < first + count; i++) {
+        hb_store_word(hb, i, val);
+    }
+}
+
 void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
                                 bool finish)
 {
     uint64_t el_count;
-    unsigned long *first;
+    uint64_t first;
 
     if (!count) {
         return;
     }
     serialization_chunk(hb, start, count, &first, &el_count);
 
-    memset(first, 0, el_count * sizeof(unsigned long));
+    hb_fill_words(hb, first, el_count, 0);
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -743,14 +929,14 @@ void hbitmap_deserialize_ones(HBitmap *hb, uint64_t start, uint64_t count,
                               bool finish)
 {
     uint64_t el_count;
-    unsigned long *first;
+    uint64_t first;
 
     if (!count) {
         return;
     }
     serialization_chunk(hb, start, count, &first, &el_count);
 
-    memset(first, 0xff, el_count * sizeof(unsigned long));
+    hb_fill_words(hb, first, el_count, ~0UL);
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -767,11 +953,17 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
     for (lev = HBITMAP_LEVELS - 1; lev-- > 0; ) {
         prev_size = size;
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
-        memset(bitmap->levels[lev], 0, size * sizeof(unsigned long));
+        hb_clear_level(bitmap, lev);
 
         for (i = 0; i < prev_size; ++i) {
-            if (bitmap->levels[lev + 1][i]) {
-                bitmap->levels[lev][i >> BITS_PER_LEVEL] |=
+            if (!bitmap->levels[lev + 1] &&
+                !bitmap->pages[lev + 1][i >> HB_PAGE_SHIFT]) {
+                /* Skip to the end of the missing page */
+                i |= HB_PAGE_WORDS - 1;
+                continue;
+            }
+            if (hb_word(bitmap, lev + 1, i)) {
+                *hb_word_ptr(bitmap, lev, i >> BITS_PER_LEVEL) |=
                     1UL << (i & (BITS_PER_LONG - 1));
             }
         }
@@ -779,6 +971,9 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
 
     bitmap->levels[0][0] |= 1UL << (BITS_PER_LONG - 1);
     bitmap->count = hb_count_between(bitmap, 0, bitmap->size - 1);
+
+    /* Deserialized zeroes may have left empty pages behind */
+    hb_release_pages(bitmap, 0, bitmap->size - 1);
 }
 
 void hbitmap_free(HBitmap *hb)
@@ -786,12 +981,17 @@ void hbitmap_free(HBitmap *hb)
     unsigned i;
     assert(!hb->meta);
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
+        if (hb->pages[i]) {
+            hb_clear_level(hb, i);
+            g_free(hb->pages[i]);
+        }
         g_free(hb->levels[i]);
     }
     g_free(hb);
 }
 
-HBitmap *hbitmap_alloc(uint64_t size, int granularity)
+static HBitmap *hbitmap_alloc_common(uint64_t size, int granularity,
+                                     bool sparse)
 {
     HBitmap *hb = g_new0(struct HBitmap, 1);
     unsigned i;
@@ -805,10 +1005,15 @@ HBitmap *hbitmap_alloc(uint64_t size, int granularity)
 
     hb->size = size;
     hb->granularity = granularity;
+    hb->sparse = sparse;
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
         hb->sizes[i] = size;
-        hb->levels[i] = g_new0(unsigned long, size);
+        if (sparse && i > 0) {
+            hb->pages[i] = g_new0(unsigned long *, hb_nb_pages(size));
+        } else {
+            hb->levels[i] = g_new0(unsigned long, size);
+        }
     }
 
     /* We necessarily have free bits in level 0 due to the definition
@@ -820,6 +1025,37 @@ HBitmap *hbitmap_alloc(uint64_t size, int granularity)
     return hb;
 }
 
+HBitmap *hbitmap_alloc(uint64_t size, int granularity)
+{
+    return hbitmap_alloc_common(size, granularity, false);
+}
+
+HBitmap *hbitmap_alloc_sparse(uint64_t size, int granularity)
+{
+    return hbitmap_alloc_common(size, granularity, true);
+}
+
+bool hbitmap_is_sparse(const HBitmap *hb)
+{
+    return hb->sparse;
+}
+
+uint64_t hbitmap_memory_usage(const HBitmap *hb)
+{
+    uint64_t usage = sizeof(*hb);
+    unsigned i;
+
+    for (i = 0; i < HBITMAP_LEVELS; i++) {
+        if (hb->pages[i]) {
+            usage += hb_nb_pages(hb->sizes[i]) * sizeof(unsigned long *);
+        } else {
+            usage += hb->sizes[i] * sizeof(unsigned long);
+        }
+    }
+
+    return usage + hb->nb_pages * HB_PAGE_WORDS * sizeof(unsigned long);
+}
+
 void hbitmap_truncate(HBitmap *hb, uint64_t size)
 {
     bool shrink;
@@ -862,6 +1098,22 @@ void hbitmap_truncate(HBitmap *hb, uint64_t size)
         }
         old = hb->sizes[i];
         hb->sizes[i] = size;
+        if (hb->pages[i]) {
+            uint64_t old_pages = hb_nb_pages(old);
+            uint64_t new_pages = hb_nb_pages(size);
+            uint64_t page;
+
+            /* The reset above cleared the bits, but not all pages */
+            for (page = new_pages; page < old_pages; page++) {
+                hb_free_page(hb, i, page);
+            }
+            hb->pages[i] = g_renew(unsigned long *, hb->pages[i], new_pages);
+            if (new_pages > old_pages) {
+                memset(&hb->pages[i][old_pages], 0,
+                       (new_pages - old_pages) * sizeof(*hb->pages[i]));
+            }
+            continue;
+        }
         hb->levels[i] = g_renew(unsigned long, hb->levels[i], size);
         if (!shrink) {
             memset(&hb->levels[i][old], 0x00,
@@ -916,7 +1168,12 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
         return;
     }
 
-    if (a->granularity != b->granularity) {
+    /*
+     * Going through the dirty areas also avoids touching the missing pages
+     * of sparse bitmaps.
+     */
+    if (a->granularity != b->granularity ||
+        a->sparse || b->sparse || result->sparse) {
         if ((a != result) && (b != result)) {
             hbitmap_reset_all(result);
         }
@@ -944,11 +1201,46 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
     result->count = hb_count_between(result, 0, result->size - 1);
 }
 
+static char *hbitmap_sparse_sha256(const HBitmap *bitmap, Error **errp)
+{
+    static const unsigned long zero_page[HB_PAGE_WORDS];
+    unsigned level = HBITMAP_LEVELS - 1;
+    uint64_t size = bitmap->sizes[level];
+    g_autoptr(QCryptoHash) hash = NULL;
+    char *digest = NULL;
+    uint64_t page;
+
+    hash = qcrypto_hash_new(QCRYPTO_HASH_ALGO_SHA256, errp);
+    if (!hash) {
+        return NULL;
+    }
+
+    for (page = 0; page < hb_nb_pages(size); page++) {
+        const unsigned long *data = bitmap->pages[level][page] ?: zero_page;
+        uint64_t words = MIN(size - (page << HB_PAGE_SHIFT), HB_PAGE_WORDS);
+
+        if (qcrypto_hash_update(hash, data, words * sizeof(unsigned long),
+                                errp) < 0) {
+            return NULL;
+        }
+    }
+
+    if (qcrypto_hash_finalize_digest(hash, &digest, errp) < 0) {
+        return NULL;
+    }
+    return digest;
+}
+
 char *hbitmap_sha256(const HBitmap *bitmap, Error **errp)
 {
     size_t size = bitmap->sizes[HBITMAP_LEVELS - 1] * sizeof(unsigned long);
     char *data = (char *)bitmap->levels[HBITMAP_LEVELS - 1];
     char *hash = NULL;
+
+    if (bitmap->sparse) {
+        return hbitmap_sparse_sha256(bitmap, errp);
+    }
+
     qcrypto_hash_digest(QCRYPTO_HASH_ALGO_SHA256, data, size, &hash, errp);
 
     return hash;
@@ -256,6 +256,16 @@ static coroutine_fn void vu_client_trip(void *opaque)
     aio_wait_kick();
 }
 
+/* Stop vu_client_trip() if an error occurred in a queue handler */
+static void check_vu_dev_broken(VuDev *vu_dev)
+{
+    if (vu_dev->broken) {
+        VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+
+        qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    }
+}
+
 /*
  * a wrapper for vu_kick_cb
  *
@@ -263,19 +273,70 @@ static coroutine_fn void vu_client_trip(void *opaque)
  * callback function, pack VuDev and pvt into a struct. Then unpack it
  * and pass them to vu_kick_cb
  */
-static void kick_handler(void *opaque)
+static void kick_handler(EventNotifier *e)
 {
-    VuFdWatch *vu_fd_watch = opaque;
+    VuFdWatch *vu_fd_watch = container_of(e, VuFdWatch, notifier);
     VuDev *vu_dev = vu_fd_watch->vu_dev;
 
     vu_fd_watch->cb(vu_dev, 0, vu_fd_watch->pvt);
+    check_vu_dev_broken(vu_dev);
+}
 
-    /* Stop vu_client_trip() if an error occurred in vu_fd_watch->cb() */
-    if (vu_dev->broken) {
-        VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+/* libvhost-user only watches kick fds, pvt is the queue index */
+static VuVirtq *kick_vq(VuFdWatch *vu_fd_watch)
+{
+    return &vu_fd_watch->vu_dev->vq[(intptr_t)vu_fd_watch->pvt];
+}
 
-        qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
-    }
+/*
+ * Rings that the front-end asked us to busy poll are polled by the
+ * AioContext, so that other handlers keep running between polls.
+ */
+static void kick_poll_begin(EventNotifier *e)
+{
+    VuFdWatch *vu_fd_watch = container_of(e, VuFdWatch, notifier);
+
+    vu_queue_poll_begin(vu_fd_watch->vu_dev, kick_vq(vu_fd_watch));
+}
+
+static void kick_poll_end(EventNotifier *e)
+{
+    VuFdWatch *vu_fd_watch = container_of(e, VuFdWatch, notifier);
+
+    vu_queue_poll_end(vu_fd_watch->vu_dev, kick_vq(vu_fd_watch));
+}
+
+static bool kick_poll(void *opaque)
+{
+    EventNotifier *e = opaque;
+    VuFdWatch *vu_fd_watch = container_of(e, VuFdWatch, notifier);
+
+    return vu_queue_poll(vu_fd_watch->vu_dev, kick_vq(vu_fd_watch));
+}
+
+static void kick_poll_ready(EventNotifier *e)
+{
+    VuFdWatch *vu_fd_watch = container_of(e, VuFdWatch, notifier);
+    VuDev *vu_dev = vu_fd_watch->vu_dev;
+
+    vu_queue_poll_ready(vu_dev, kick_vq(vu_fd_watch));
+    check_vu_dev_broken(vu_dev);
+}
+
+static void attach_vu_fd_watch(AioContext *ctx, VuFdWatch *vu_fd_watch)
+{
+    aio_set_event_notifier(ctx, &vu_fd_watch->notifier, kick_handler,
+                           kick_poll, kick_poll_ready);
+    aio_set_event_notifier_poll(ctx, &vu_fd_watch->notifier,
+                                kick_poll_begin, kick_poll_end);
+}
+
+static void detach_vu_fd_watch(AioContext *ctx, VuFdWatch *vu_fd_watch)
+{
+    aio_set_event_notifier(ctx, &vu_fd_watch->notifier, NULL, NULL, NULL);
+
+    /* io_poll_end() is not called if the handler is removed while polling */
+    kick_poll_end(&vu_fd_watch->notifier);
 }
 
 static VuFdWatch *find_vu_fd_watch(VuServer *server, int fd)
@@ -309,12 +370,12 @@ set_watch(VuDev *vu_dev, int fd, int vu_evt,
 
         vu_fd_watch->fd = fd;
         vu_fd_watch->cb = cb;
-        /* TODO: handle error more gracefully than aborting */
-        qemu_set_blocking(fd, false, &error_abort);
-        aio_set_fd_handler(server->ctx, fd, kick_handler,
-                           NULL, NULL, NULL, vu_fd_watch);
         vu_fd_watch->vu_dev = vu_dev;
         vu_fd_watch->pvt = pvt;
+        event_notifier_init_fd(&vu_fd_watch->notifier, fd);
+        /* TODO: handle error more gracefully than aborting */
+        qemu_set_blocking(fd, false, &error_abort);
+        attach_vu_fd_watch(server->ctx, vu_fd_watch);
     }
 }
 
@@ -332,7 +393,7 @@ static void remove_watch(VuDev *vu_dev, int fd)
     if (!vu_fd_watch) {
         return;
     }
-    aio_set_fd_handler(server->ctx, fd, NULL, NULL, NULL, NULL, NULL);
+    detach_vu_fd_watch(server->ctx, vu_fd_watch);
 
     QTAILQ_REMOVE(&server->vu_fd_watches, vu_fd_watch, next);
     g_free(vu_fd_watch);
@@ -397,8 +458,7 @@ void vhost_user_server_stop(VuServer *server)
         VuFdWatch *vu_fd_watch;
 
         QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-            aio_set_fd_handler(server->ctx, vu_fd_watch->fd,
-                               NULL, NULL, NULL, NULL, vu_fd_watch);
+            detach_vu_fd_watch(server->ctx, vu_fd_watch);
         }
 
         qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
@@ -436,8 +496,7 @@ void vhost_user_server_attach_aio_context(VuServer *server, AioContext *ctx)
     }
 
     QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-        aio_set_fd_handler(ctx, vu_fd_watch->fd, kick_handler, NULL,
-                           NULL, NULL, vu_fd_watch);
+        attach_vu_fd_watch(ctx, vu_fd_watch);
     }
 
     if (server->co_trip) {
@@ -468,8 +527,7 @@ void vhost_user_server_detach_aio_context(VuServer *server)
         VuFdWatch *vu_fd_watch;
 
         QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-            aio_set_fd_handler(server->ctx, vu_fd_watch->fd,
-                               NULL, NULL, NULL, NULL, vu_fd_watch);
+            detach_vu_fd_watch(server->ctx, vu_fd_watch);
         }
     }
 